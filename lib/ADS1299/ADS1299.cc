@@ -4,12 +4,90 @@
 extern SPIClass *hspi;
 
 volatile bool ADS1299::channelDataAvailable = false;
+TaskHandle_t volatile ADS1299::acqTaskHandle = NULL;
+volatile int64_t ADS1299::drdyMicros = 0;
+volatile uint32_t ADS1299::drdySequence = 0;
 
 /// @brief ADS1299 回调函数
 /// @return
 void IRAM_ATTR ADS1299::ADS_DRDY_Service()
 {
+    // stamp first: the edge time is the sample time, however late the read is
+    int64_t now = esp_timer_get_time();
+    drdySequence++;
+    drdyMicros = now;
+    drdySequence++;
     channelDataAvailable = true;
+    if (acqTaskHandle != NULL)
+    {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(acqTaskHandle, &woken);
+        if (woken)
+        {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+/// @brief Reader task: sleeps until DRDY, clocks the frame(s) out and queues
+///        them for `loop()`, so a slow HTTP request can no longer cost samples.
+/// @param arg {ADS1299 *} - The driver instance
+void ADS1299::acquisitionTask(void *arg)
+{
+    ADS1299 *ads = (ADS1299 *)arg;
+    Frame frame;
+    while (ads->acqTaskRunning)
+    {
+        // DRDY edges that arrive before we get here collapse into one read,
+        // the ADS has already overwritten the older data anyway
+        uint32_t edges = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ADS_ACQ_TASK_WAKE_MS));
+        if (edges == 0)
+        {
+            continue;
+        }
+        // streamStop() takes acqMutex before it sends SDATAC, so the RDATAC
+        // ending a reconfiguration can never follow it
+        xSemaphoreTake(ads->acqMutex, portMAX_DELAY);
+        if (!ads->acqTaskRunning || !ads->streaming)
+        {
+            xSemaphoreGive(ads->acqMutex);
+            continue;
+        }
+        ads->readChannelData(frame);
+        channelDataAvailable = false;
+        boolean late = esp_timer_get_time() - frame.timestamp > (int64_t)ads->getSamplePeriodMicros();
+        boolean queued = ads->frameQueue.push(frame);
+        if (!queued)
+        {
+            ads->framesDropped++;
+        }
+        // the gap until the next DRDY is where queued register changes go,
+        // conversions keep running so the stream never stops for them
+        uint8_t pending = ads->pendingConfig.exchange(0);
+        if (pending != 0)
+        {
+            ads->applyPendingConfig(pending, true);
+            ads->appliedConfig++;
+        }
+        xSemaphoreGive(ads->acqMutex);
+        if (ads->stats != NULL)
+        {
+            if (edges > 1)
+            {
+                ads->stats->add(StreamStats::COUNTER_DRDY_MISSED, edges - 1);
+            }
+            if (late)
+            {
+                ads->stats->add(StreamStats::COUNTER_SPI_LATE);
+            }
+            if (!queued)
+            {
+                ads->stats->add(StreamStats::COUNTER_OVERRUN);
+            }
+        }
+    }
+    acqTaskHandle = NULL;
+    vTaskDelete(NULL);
 }
 
 /// @brief Configure the test signals that can be inernally generated by the ADS1299
@@ -34,9 +112,9 @@ void ADS1299::configureInternalTestSignal(byte amplitudeCode, byte freqCode)
             targetSS = DAISY_ADS;
         }
         if (amplitudeCode == ADSTESTSIG_NOCHANGE)
-            amplitudeCode = (RREG(CONFIG2, targetSS) & (0b00000100));
+            amplitudeCode = (getRegister(CONFIG2, targetSS) & (0b00000100));
         if (freqCode == ADSTESTSIG_NOCHANGE)
-            freqCode = (RREG(CONFIG2, targetSS) & (0b00000011));
+            freqCode = (getRegister(CONFIG2, targetSS) & (0b00000011));
         freqCode &= 0b00000011;                               // only the last two bits are used
         amplitudeCode &= 0b00000100;                          // only this bit is used
         byte setting = 0b11010000 | freqCode | amplitudeCode; // compose the code
@@ -75,6 +153,10 @@ void ADS1299::csLow(ChipSelect targetSS)
 {
     // hspi->beginTransaction(SPISettings(ADS_SPI_SPEED, MSBFIRST, SPI_MODE1));
     // hspi->setFrequency(ADS_SPI_SPEED);
+    if (spiMutex != NULL)
+    {
+        xSemaphoreTake(spiMutex, portMAX_DELAY);
+    }
     switch (targetSS)
     {
     case BOARD_ADS:
@@ -98,10 +180,10 @@ void ADS1299::csLow(ChipSelect targetSS)
 /// @param
 void ADS1299::streamSafeSetAllChannelsToDefault(void)
 {
-    boolean wasStreaming = streaming;
-
-    // Stop streaming if you are currently streaming
-    if (streaming)
+    // With the acquisition task running the change lands between two samples,
+    // otherwise stop streaming if you are currently streaming
+    boolean wasStreaming = streaming && acqTaskHandle == NULL;
+    if (wasStreaming)
     {
         streamStop();
     }
@@ -133,6 +215,10 @@ void ADS1299::csHigh(ChipSelect targetSS)
         // 处理未知的枚举值
         break;
     }
+    if (spiMutex != NULL)
+    {
+        xSemaphoreGive(spiMutex);
+    }
     // hspi->endTransaction();
 }
 
@@ -144,25 +230,14 @@ void ADS1299::setChannelsToDefault(void)
         {
             channelSettings[i][j] = defaultChannelSettings[j];
         }
-        useInBias[i] = true; // keeping track of Bias Generation
-        useSRB2[i] = true;   // keeping track of SRB2 inclusion
-    }
-    boardUseSRB1 = daisyUseSRB1 = false;
-
-    writeChannelSettings(); // write settings to on-board ADS
-
-    for (int i = 0; i < numChannels; i++)
-    { // turn off the impedance measure signal
-        leadOffSettings[i][PCHAN] = OFF;
+        useInBias[i] = true;             // keeping track of Bias Generation
+        useSRB2[i] = true;               // keeping track of SRB2 inclusion
+        leadOffSettings[i][PCHAN] = OFF; // turn off the impedance measure signal
         leadOffSettings[i][NCHAN] = OFF;
     }
-    changeChannelLeadOffDetect(); // write settings to all ADS
+    boardUseSRB1 = daisyUseSRB1 = false;
 
-    WREG(MISC1, 0x00, BOARD_ADS); // open SRB1 switch on-board
-    if (daisyPresent)
-    {
-        WREG(MISC1, 0x00, DAISY_ADS);
-    } // open SRB1 switch on-daisy
+    writeChannelSettings(); // channels, lead off and the SRB1 switch of all ADS in one burst each
 }
 
 /// @brief reset all the registers to default settings
@@ -174,6 +249,7 @@ void ADS1299::RESET(ChipSelect targetSS)
     xfer(_RESET);
     delayMicroseconds(12); // must wait 18 tCLK cycles to execute this command (Datasheet, pg. 35)
     csHigh(targetSS);
+    resetRegisterShadow(targetSS);
 }
 
 void ADS1299::removeDaisy(void)
@@ -219,10 +295,10 @@ void ADS1299::SDATAC(ChipSelect targetSS)
 /// @param srb1
 void ADS1299::streamSafeChannelSettingsForChannel(byte channelNumber, byte powerDown, byte gain, byte inputType, byte bias, byte srb2, byte srb1)
 {
-    boolean wasStreaming = streaming;
-
-    // Stop streaming if you are currently streaming
-    if (streaming)
+    // With the acquisition task running the change lands between two samples,
+    // otherwise stop streaming if you are currently streaming
+    boolean wasStreaming = streaming && acqTaskHandle == NULL;
+    if (wasStreaming)
     {
         streamStop();
     }
@@ -240,10 +316,10 @@ void ADS1299::streamSafeChannelSettingsForChannel(byte channelNumber, byte power
 
 void ADS1299::streamSafeChannelSettingsForChannel(byte channelNumber)
 {
-    boolean wasStreaming = streaming;
-
-    // Stop streaming if you are currently streaming
-    if (streaming)
+    // With the acquisition task running the change lands between two samples,
+    // otherwise stop streaming if you are currently streaming
+    boolean wasStreaming = streaming && acqTaskHandle == NULL;
+    if (wasStreaming)
     {
         streamStop();
     }
@@ -261,7 +337,7 @@ void ADS1299::streamSafeChannelSettingsForChannel(byte channelNumber)
 /// @param N
 void ADS1299::deactivateChannel(byte N)
 {
-    byte setting, startChan, endChan;
+    byte startChan, endChan;
     ADS1299::ChipSelect targetSS;
 
     if (N < 9)
@@ -280,32 +356,14 @@ void ADS1299::deactivateChannel(byte N)
         startChan = 8;
         endChan = 16;
     }
-    SDATAC(targetSS);
-    delay(1);                                     // exit Read Data Continuous mode to communicate with ADS
     N = constrain(N - 1, startChan, endChan - 1); // subtracts 1 so that we're counting from 0, not 1
 
-    setting = RREG(CH1SET + (N - startChan), targetSS);
-    delay(1);             // get the current channel settings
-    bitSet(setting, 7);   // set bit7 to shut down channel
-    bitClear(setting, 3); // clear bit3 to disclude from SRB2 if used
-    WREG(CH1SET + (N - startChan), setting, targetSS);
-    delay(1); // write the new value to disable the channel
-
-    // remove the channel from the bias generation...
-    setting = RREG(BIAS_SENSP, targetSS);
-    delay(1);                         // get the current bias settings
-    bitClear(setting, N - startChan); // clear this channel's bit to remove from bias generation
-    WREG(BIAS_SENSP, setting, targetSS);
-    delay(1); // send the modified byte back to the ADS
-
-    setting = RREG(BIAS_SENSN, targetSS);
-    delay(1);                         // get the current bias settings
-    bitClear(setting, N - startChan); // clear this channel's bit to remove from bias generation
-    WREG(BIAS_SENSN, setting, targetSS);
-    delay(1); // send the modified byte back to the ADS
+    // a powered down channel also leaves SRB2 and the bias generation, useSRB2
+    // and useInBias keep what activateChannel() should restore
+    channelSettings[N][POWER_DOWN] = YES;
+    leadOffSettings[N][PCHAN] = leadOffSettings[N][NCHAN] = OFF;
 
-    leadOffSettings[N][0] = leadOffSettings[N][1] = NO;
-    changeChannelLeadOffDetect(N + 1);
+    updateRegisters(targetSS);
 }
 
 /// @brief Used to set lead off for a channel, if running must stop and start after...
@@ -314,10 +372,10 @@ void ADS1299::deactivateChannel(byte N)
 /// @param nInput [byte] - Apply signal to N input, either ON (1) or OFF (0)
 void ADS1299::streamSafeLeadOffSetForChannel(byte channelNumber, byte pInput, byte nInput)
 {
-    boolean wasStreaming = streaming;
-
-    // Stop streaming if you are currently streaming
-    if (streaming)
+    // With the acquisition task running the change lands between two samples,
+    // otherwise stop streaming if you are currently streaming
+    boolean wasStreaming = streaming && acqTaskHandle == NULL;
+    if (wasStreaming)
     {
         streamStop();
     }
@@ -335,10 +393,10 @@ void ADS1299::streamSafeLeadOffSetForChannel(byte channelNumber, byte pInput, by
 
 void ADS1299::streamSafeLeadOffSetForChannel(byte channelNumber)
 {
-    boolean wasStreaming = streaming;
-
-    // Stop streaming if you are currently streaming
-    if (streaming)
+    // With the acquisition task running the change lands between two samples,
+    // otherwise stop streaming if you are currently streaming
+    boolean wasStreaming = streaming && acqTaskHandle == NULL;
+    if (wasStreaming)
     {
         streamStop();
     }
@@ -358,13 +416,14 @@ void ADS1299::streamSafeLeadOffSetForChannel(byte channelNumber)
 /// @return
 byte ADS1299::RREG(byte _address, ChipSelect targetSS)
 {                                   //  reads ONE register at _address
+    byte *shadow = regData[targetSS == DAISY_ADS ? DAISY_ADS : BOARD_ADS];
     byte opcode1 = _address + 0x20; //  RREG expects 001rrrrr where rrrrr = _address
     csLow(targetSS);                //  open SPI
     xfer(opcode1);                  //  opcode1
     xfer(0x00);                     //  opcode2
-    regData[_address] = xfer(0x00); //  update mirror location with returned byte
+    shadow[_address] = xfer(0x00);  //  update mirror location with returned byte
     csHigh(targetSS);               //  close SPI
-    return regData[_address];       // return requested register value
+    return shadow[_address];        // return requested register value
 }
 
 /// @brief Used to set the sample rate
@@ -393,14 +452,63 @@ void ADS1299::streamSafeSetSampleRate(SAMPLE_RATE sr)
 /// @param
 /// @param
 void ADS1299::WREG(byte _address, byte _value, ChipSelect target_SS)
-{                                   //  Write ONE register at _address
+{
+    WREGS(_address, &_value, 1, target_SS);
+}
+
+/// @brief write consecutive ADS registers with one multi-register WREG
+/// @param _address {byte} - First register
+/// @param _values  {const byte *} - One value per register
+/// @param _count   {byte} - Number of registers, 1..ADS_NUM_REGISTERS
+/// @param target_SS {ChipSelect} - BOTH_ADS writes the same values to both chips
+void ADS1299::WREGS(byte _address, const byte *_values, byte _count, ChipSelect target_SS)
+{
     byte opcode1 = _address + 0x40; //  WREG expects 010rrrrr where rrrrr = _address
     csLow(target_SS);               //  open SPI
     xfer(opcode1);                  //  Send WREG command & address
-    xfer(0x00);                     //  Send number of registers to read -1
-    xfer(_value);                   //  Write the value to the register
-    csHigh(target_SS);              //  close SPI
-    regData[_address] = _value;     //  update the mirror array
+    xfer(_count - 1);               //  Send number of registers to write -1
+    for (byte i = 0; i < _count; i++)
+    {
+        xfer(_values[i]); //  the address auto increments after each value
+    }
+    csHigh(target_SS); //  close SPI
+    if (target_SS != DAISY_ADS)
+    {
+        memcpy(&regData[BOARD_ADS][_address], _values, _count); //  update the mirror array
+    }
+    if (target_SS != BOARD_ADS)
+    {
+        memcpy(&regData[DAISY_ADS][_address], _values, _count);
+    }
+}
+
+/// @brief Load the register values the ADS1299 has after power up or RESET
+///        (datasheet, register map) into the mirror
+/// @param targetSS {ChipSelect} - The chip that was reset
+void ADS1299::resetRegisterShadow(ChipSelect targetSS)
+{
+    static const byte defaults[ADS_NUM_REGISTERS] = {
+        ADS_ID, 0x96, 0xC0, 0x60, 0x00,                 // ID_REG, CONFIG1..3, LOFF
+        0x61, 0x61, 0x61, 0x61, 0x61, 0x61, 0x61, 0x61, // CH1SET..CH8SET
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,       // BIAS_SENSP..LOFF_STATN
+        0x0F, 0x00, 0x00, 0x00};                        // GPIO, MISC1, MISC2, CONFIG4
+    if (targetSS != DAISY_ADS)
+    {
+        memcpy(regData[BOARD_ADS], defaults, ADS_NUM_REGISTERS);
+    }
+    if (targetSS != BOARD_ADS)
+    {
+        memcpy(regData[DAISY_ADS], defaults, ADS_NUM_REGISTERS);
+    }
+}
+
+/// @brief Last value written to or read from a register, no SPI traffic
+/// @param address  {byte} - Register address
+/// @param targetSS {ChipSelect} - BOARD_ADS or DAISY_ADS
+/// @return {byte} - Mirrored register value
+byte ADS1299::getRegister(byte address, ChipSelect targetSS)
+{
+    return regData[targetSS == DAISY_ADS ? DAISY_ADS : BOARD_ADS][address];
 }
 
 /// @brief Used to set the channelSettings array to default settings
@@ -507,9 +615,17 @@ void ADS1299::STANDBY(ChipSelect targetSS)
 }
 
 ADS1299::ADS1299()
-    : lastSampleTime(0), curSampleRate(SAMPLE_RATE_250),
-      isRunning(false)
+    : lastSampleTime(0), lastSampleMicros(0), framesDropped(0), stats(NULL), impedanceReady(false), configSequence(0),
+      configChanged(false), curSampleRate(SAMPLE_RATE_250), isRunning(false), acqTaskRunning(false), pendingConfig(0), appliedConfig(0),
+      configPending(false)
 {
+    spiMutex = xSemaphoreCreateMutex();
+    acqMutex = xSemaphoreCreateMutex();
+    memset(channelSettings, 0, sizeof(channelSettings));
+    memset(leadOffSettings, 0, sizeof(leadOffSettings));
+    boardUseSRB1 = daisyUseSRB1 = false;
+    daisyPresent = false;
+    resetRegisterShadow(BOTH_ADS); // power-on register values
     // ();
     // softReset();
 }
@@ -641,11 +757,30 @@ void ADS1299::resetADS(ChipSelect targetSS)
     RESET(targetSS);  // send RESET command to default all registers
     SDATAC(targetSS); // exit Read Data Continuous mode to communicate with ADS
     delay(100);
-    // turn off all channels
-    for (int chan = startChan; chan <= stopChan; chan++)
+    // settings now match the reset registers, turn off all channels in one burst
+    for (int chan = startChan - 1; chan < stopChan; chan++)
     {
-        deactivateChannel(chan);
+        channelSettings[chan][POWER_DOWN] = YES;
+        channelSettings[chan][GAIN_SET] = ADS_GAIN24;
+        channelSettings[chan][INPUT_TYPE_SET] = ADSINPUT_SHORTED;
+        channelSettings[chan][BIAS_SET] = NO;
+        channelSettings[chan][SRB2_SET] = NO;
+        channelSettings[chan][SRB1_SET] = NO;
+        leadOffSettings[chan][PCHAN] = leadOffSettings[chan][NCHAN] = OFF;
     }
+    if (targetSS == BOARD_ADS)
+    {
+        boardUseSRB1 = false;
+    }
+    if (targetSS == DAISY_ADS)
+    {
+        daisyUseSRB1 = false;
+        if (!daisyPresent)
+        {
+            return;
+        }
+    }
+    applyChannelRegisters(targetSS);
 }
 
 /// @brief check if daisy present
@@ -664,8 +799,7 @@ boolean ADS1299::smellDaisy(void)
 
 void ADS1299::writeChannelSettings(void)
 {
-    boolean use_SRB1 = false;
-    byte setting, startChan, endChan;
+    byte startChan, endChan;
     ChipSelect targetSS;
 
     for (int b = 0; b < 2; b++)
@@ -687,99 +821,25 @@ void ADS1299::writeChannelSettings(void)
             endChan = 16;
         }
 
-        SDATAC(targetSS);
-        delay(1); // exit Read Data Continuous mode to communicate with ADS
-
+        boolean use_SRB1 = false;
         for (byte i = startChan; i < endChan; i++)
-        { // write 8 channel settings
-            setting = 0x00;
-            if (channelSettings[i][POWER_DOWN] == YES)
-            {
-                setting |= 0x80;
-            }
-            setting |= channelSettings[i][GAIN_SET];       // gain
-            setting |= channelSettings[i][INPUT_TYPE_SET]; // input code
-            if (channelSettings[i][SRB2_SET] == YES)
-            {
-                setting |= 0x08;   // close this SRB2 switch
-                useSRB2[i] = true; // remember SRB2 state for this channel
-            }
-            else
-            {
-                useSRB2[i] = false; // rememver SRB2 state for this channel
-            }
-            WREG(CH1SET + (i - startChan), setting, targetSS); // write this channel's register settings
-
-            // add or remove this channel from inclusion in BIAS generation
-            setting = RREG(BIAS_SENSP, targetSS); // get the current P bias settings
-            if (channelSettings[i][BIAS_SET] == YES)
-            {
-                bitSet(setting, i - startChan);
-                useInBias[i] = true; // add this channel to the bias generation
-            }
-            else
-            {
-                bitClear(setting, i - startChan);
-                useInBias[i] = false; // remove this channel from bias generation
-            }
-            WREG(BIAS_SENSP, setting, targetSS);
-            delay(1); // send the modified byte back to the ADS
-
-            setting = RREG(BIAS_SENSN, targetSS); // get the current N bias settings
-            if (channelSettings[i][BIAS_SET] == YES)
-            {
-                bitSet(setting, i - startChan); // set this channel's bit to add it to the bias generation
-            }
-            else
-            {
-                bitClear(setting, i - startChan); // clear this channel's bit to remove from bias generation
-            }
-            WREG(BIAS_SENSN, setting, targetSS);
-            delay(1); // send the modified byte back to the ADS
-
+        {
+            useSRB2[i] = channelSettings[i][SRB2_SET] == YES;   // remember SRB2 state for this channel
+            useInBias[i] = channelSettings[i][BIAS_SET] == YES; // remember bias state for this channel
             if (channelSettings[i][SRB1_SET] == YES)
             {
                 use_SRB1 = true; // if any of the channel setting closes SRB1, it is closed for all
             }
-        } // end of CHnSET and BIAS settings
-    }     // end of board select loop
-    if (use_SRB1)
-    {
-        for (int i = startChan; i < endChan; i++)
-        {
-            channelSettings[i][SRB1_SET] = YES;
-        }
-        WREG(MISC1, 0x20, targetSS); // close SRB1 swtich
-        if (targetSS == BOARD_ADS)
-        {
-            boardUseSRB1 = true;
         }
-        if (targetSS == DAISY_ADS)
-        {
-            daisyUseSRB1 = true;
-        }
-    }
-    else
-    {
-        for (int i = startChan; i < endChan; i++)
-        {
-            channelSettings[i][SRB1_SET] = NO;
-        }
-        WREG(MISC1, 0x00, targetSS); // open SRB1 switch
-        if (targetSS == BOARD_ADS)
-        {
-            boardUseSRB1 = false;
-        }
-        if (targetSS == DAISY_ADS)
-        {
-            daisyUseSRB1 = false;
-        }
-    }
+        setSRB1(targetSS, use_SRB1);
+
+        updateRegisters(targetSS);
+    } // end of board select loop
 }
 
 void ADS1299::writeChannelSettings(byte N)
 {
-    byte setting, startChan, endChan;
+    byte startChan, endChan;
     ChipSelect targetSS;
 
     if (N < 9)
@@ -800,94 +860,195 @@ void ADS1299::writeChannelSettings(byte N)
     }
     // function accepts channel 1-16, must be 0 indexed to work with array
     N = constrain(N - 1, startChan, endChan - 1); // subtracts 1 so that we're counting from 0, not 1
-    // first, disable any data collection
-    SDATAC(targetSS);
-    delay(1); // exit Read Data Continuous mode to communicate with ADS
 
-    setting = 0x00;
-    if (channelSettings[N][POWER_DOWN] == YES)
-        setting |= 0x80;
-    setting |= channelSettings[N][GAIN_SET];       // gain
-    setting |= channelSettings[N][INPUT_TYPE_SET]; // input code
-    if (channelSettings[N][SRB2_SET] == YES)
+    useSRB2[N] = channelSettings[N][SRB2_SET] == YES; // keep track of SRB2 usage
+    useInBias[N] = channelSettings[N][BIAS_SET] == YES;
+    // if SRB1 is closed or open for one channel, it will be the same for all channels
+    setSRB1(targetSS, channelSettings[N][SRB1_SET] == YES);
+
+    updateRegisters(targetSS);
+}
+
+/// @brief Open or close the SRB1 switch of one ADS, it is shared by all 8 channels
+/// @param targetSS {ChipSelect} - BOARD_ADS or DAISY_ADS
+/// @param closed   {boolean} - SRB1 connected to the N inputs
+void ADS1299::setSRB1(ChipSelect targetSS, boolean closed)
+{
+    byte startChan = targetSS == DAISY_ADS ? 8 : 0;
+    for (byte i = startChan; i < startChan + 8; i++)
     {
-        setting |= 0x08;   // close this SRB2 switch
-        useSRB2[N] = true; // keep track of SRB2 usage
+        channelSettings[i][SRB1_SET] = closed ? YES : NO;
+    }
+    if (targetSS == DAISY_ADS)
+    {
+        daisyUseSRB1 = closed;
     }
     else
     {
-        useSRB2[N] = false;
+        boardUseSRB1 = closed;
+    }
+}
+
+/// @brief Compute the channel registers channelSettings, leadOffSettings and
+///        the SRB1 flag ask for. Every other register keeps its mirrored value,
+///        so the image can be diffed against what the chip holds.
+/// @param targetSS {ChipSelect} - BOARD_ADS (channels 1-8) or DAISY_ADS (9-16)
+/// @param image    {byte *} - Receives ADS_NUM_REGISTERS bytes
+void ADS1299::buildChannelRegisters(ChipSelect targetSS, byte *image)
+{
+    byte chip = targetSS == DAISY_ADS ? DAISY_ADS : BOARD_ADS;
+    byte startChan = chip * OPENBCI_ADS_CHANS_PER_BOARD;
+    memcpy(image, regData[chip], ADS_NUM_REGISTERS);
+    image[BIAS_SENSP] = image[BIAS_SENSN] = 0x00;
+    image[LOFF_SENSP] = image[LOFF_SENSN] = 0x00;
+
+    for (byte i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
+    {
+        const byte *settings = channelSettings[startChan + i];
+        byte setting = settings[GAIN_SET] | settings[INPUT_TYPE_SET];
+        if (settings[POWER_DOWN] == YES)
+        {
+            setting |= 0x80; // a powered down channel is kept out of SRB2 and the bias
+        }
+        else
+        {
+            if (settings[SRB2_SET] == YES)
+            {
+                setting |= 0x08; // close this SRB2 switch
+            }
+            if (settings[BIAS_SET] == YES)
+            {
+                bitSet(image[BIAS_SENSP], i); // add this channel to the bias generation
+                bitSet(image[BIAS_SENSN], i);
+            }
+        }
+        image[CH1SET + i] = setting;
+
+        if (leadOffSettings[startChan + i][PCHAN] == ON)
+        {
+            bitSet(image[LOFF_SENSP], i);
+        }
+        if (leadOffSettings[startChan + i][NCHAN] == ON)
+        {
+            bitSet(image[LOFF_SENSN], i);
+        }
     }
-    WREG(CH1SET + (N - startChan), setting, targetSS); // write this channel's register settings
 
-    // add or remove from inclusion in BIAS generation
-    setting = RREG(BIAS_SENSP, targetSS); // get the current P bias settings
-    if (channelSettings[N][BIAS_SET] == YES)
+    boolean useSRB1 = chip == DAISY_ADS ? daisyUseSRB1 : boardUseSRB1;
+    image[MISC1] = useSRB1 ? 0x20 : 0x00; // close or open the SRB1 switch
+}
+
+/// @brief Write the registers in [first, last] that differ from the mirror.
+///        The span from the first to the last changed register goes out as
+///        one WREG burst, unchanged registers inside it are rewritten as is.
+/// @param image    {const byte *} - Full register image, see buildChannelRegisters()
+/// @param first    {byte} - First register address to consider
+/// @param last     {byte} - Last register address to consider
+/// @param targetSS {ChipSelect} - BOARD_ADS or DAISY_ADS
+void ADS1299::applyRegisters(const byte *image, byte first, byte last, ChipSelect targetSS)
+{
+    const byte *shadow = regData[targetSS == DAISY_ADS ? DAISY_ADS : BOARD_ADS];
+    while (first <= last && image[first] == shadow[first])
     {
-        useInBias[N] = true;
-        bitSet(setting, N - startChan); // set this channel's bit to add it to the bias generation
+        first++;
     }
-    else
+    if (first > last)
     {
-        useInBias[N] = false;
-        bitClear(setting, N - startChan); // clear this channel's bit to remove from bias generation
+        return; // the chip already holds this image
     }
-    WREG(BIAS_SENSP, setting, targetSS);
-    delay(1);                             // send the modified byte back to the ADS
-    setting = RREG(BIAS_SENSN, targetSS); // get the current N bias settings
-    if (channelSettings[N][BIAS_SET] == YES)
+    while (image[last] == shadow[last])
     {
-        bitSet(setting, N - startChan); // set this channel's bit to add it to the bias generation
+        last--;
     }
-    else
+    WREGS(first, image + first, last - first + 1, targetSS);
+}
+
+/// @brief Bring one ADS in line with channelSettings/leadOffSettings: at most
+///        one burst for CH1SET..LOFF_SENSN and one for MISC1. Must be called
+///        out of Read Data Continuous mode.
+/// @param targetSS {ChipSelect} - BOARD_ADS or DAISY_ADS
+void ADS1299::applyChannelRegisters(ChipSelect targetSS)
+{
+    byte image[ADS_NUM_REGISTERS];
+    buildChannelRegisters(targetSS, image);
+    applyRegisters(image, CH1SET, LOFF_SENSN, targetSS);
+    applyRegisters(image, MISC1, MISC1, targetSS); // LOFF_FLIP..GPIO in between are left alone
+}
+
+
+/// @brief Get channelSettings/leadOffSettings of one ADS into its registers.
+///        While the acquisition task streams, the change is queued for it and
+///        lands between two samples, see applyPendingConfig().
+/// @param targetSS {ChipSelect} - BOARD_ADS or DAISY_ADS
+void ADS1299::updateRegisters(ChipSelect targetSS)
+{
+    if (streaming && acqTaskHandle != NULL)
     {
-        bitClear(setting, N - startChan); // clear this channel's bit to remove from bias generation
+        pendingConfig.fetch_or((uint8_t)(1 << targetSS));
+        return;
     }
-    WREG(BIAS_SENSN, setting, targetSS);
-    delay(1); // send the modified byte back to the ADS
+    updateChannelScale();
+    SDATAC(targetSS); // exit Read Data Continuous mode to communicate with ADS
+    applyChannelRegisters(targetSS);
+}
 
-    // if SRB1 is closed or open for one channel, it will be the same for all channels
-    if (channelSettings[N][SRB1_SET] == YES)
+/// @brief Write the queued register changes. The acquisition task calls this
+///        right after reading a frame: SDATAC, the diff bursts, RDATAC, all
+///        before the next DRDY. START stays high, so no sample is skipped; the
+///        first frame after it carries the next `config` number.
+/// @param pending {uint8_t} - 1 << BOARD_ADS and/or 1 << DAISY_ADS
+/// @param resume  {boolean} - Go back to Read Data Continuous mode afterwards
+void ADS1299::applyPendingConfig(uint8_t pending, boolean resume)
+{
+    if (!daisyPresent)
     {
-        for (int i = startChan; i < endChan; i++)
-        {
-            channelSettings[i][SRB1_SET] = YES;
-        }
-        if (targetSS == BOARD_ADS)
-            boardUseSRB1 = true;
-        if (targetSS == DAISY_ADS)
-            daisyUseSRB1 = true;
-        setting = 0x20; // close SRB1 swtich
+        pending &= ~(1 << DAISY_ADS);
     }
-    if (channelSettings[N][SRB1_SET] == NO)
+    if (pending == 0)
     {
-        for (int i = startChan; i < endChan; i++)
-        {
-            channelSettings[i][SRB1_SET] = NO;
-        }
-        if (targetSS == BOARD_ADS)
-            boardUseSRB1 = false;
-        if (targetSS == DAISY_ADS)
-            daisyUseSRB1 = false;
-        setting = 0x00; // open SRB1 switch
+        return;
+    }
+    ChipSelect targetSS = BOTH_ADS; // one SDATAC/RDATAC reaches both chips
+    if (pending == (1 << BOARD_ADS))
+    {
+        targetSS = BOARD_ADS;
+    }
+    if (pending == (1 << DAISY_ADS))
+    {
+        targetSS = DAISY_ADS;
+    }
+    SDATAC(targetSS);
+    if (pending & (1 << BOARD_ADS))
+    {
+        applyChannelRegisters(BOARD_ADS);
+    }
+    if (pending & (1 << DAISY_ADS))
+    {
+        applyChannelRegisters(DAISY_ADS);
+    }
+    if (resume)
+    {
+        RDATAC(targetSS);
+    }
+}
+
+/// @brief Rebuild the nanovolt scale table from the GAIN_SET of every channel.
+///         Called wherever channelSettings are written to the ADS.
+void ADS1299::updateChannelScale(void)
+{
+    static const uint8_t gains[8] = {1, 2, 4, 6, 8, 12, 24, 24}; // ADS_GAIN01..ADS_GAIN24 >> 4
+    for (uint8_t i = 0; i < OPENBCI_NUMBER_OF_CHANNELS_DAISY; i++)
+    {
+        channelScale.setGain(i, gains[(channelSettings[i][GAIN_SET] >> 4) & 0x07]);
     }
-    WREG(MISC1, setting, targetSS);
 }
 
 /// @brief change the lead off detect settings for all channels
 void ADS1299::changeChannelLeadOffDetect()
 {
-    byte setting, startChan, endChan;
-    ChipSelect targetSS;
-
     for (int b = 0; b < 2; b++)
     {
-        if (b == 0)
-        {
-            targetSS = BOARD_ADS;
-            startChan = 0;
-            endChan = 8;
-        }
+        ChipSelect targetSS = BOARD_ADS;
         if (b == 1)
         {
             if (!daisyPresent)
@@ -895,36 +1056,9 @@ void ADS1299::changeChannelLeadOffDetect()
                 return;
             }
             targetSS = DAISY_ADS;
-            startChan = 8;
-            endChan = 16;
         }
 
-        SDATAC(targetSS);
-        delay(1); // exit Read Data Continuous mode to communicate with ADS
-        byte P_setting = RREG(LOFF_SENSP, targetSS);
-        byte N_setting = RREG(LOFF_SENSN, targetSS);
-
-        for (int i = startChan; i < endChan; i++)
-        {
-            if (leadOffSettings[i][PCHAN] == ON)
-            {
-                bitSet(P_setting, i - startChan);
-            }
-            else
-            {
-                bitClear(P_setting, i - startChan);
-            }
-            if (leadOffSettings[i][NCHAN] == ON)
-            {
-                bitSet(N_setting, i - startChan);
-            }
-            else
-            {
-                bitClear(N_setting, i - startChan);
-            }
-            WREG(LOFF_SENSP, P_setting, targetSS);
-            WREG(LOFF_SENSN, N_setting, targetSS);
-        }
+        updateRegisters(targetSS);
     }
 }
 
@@ -932,14 +1066,11 @@ void ADS1299::changeChannelLeadOffDetect()
 /// @param N
 void ADS1299::changeChannelLeadOffDetect(byte N)
 {
-    byte setting, startChan, endChan;
     ChipSelect targetSS;
 
     if (N < 9)
     {
         targetSS = BOARD_ADS;
-        startChan = 0;
-        endChan = 8;
     }
     else
     {
@@ -948,34 +1079,9 @@ void ADS1299::changeChannelLeadOffDetect(byte N)
             return;
         }
         targetSS = DAISY_ADS;
-        startChan = 8;
-        endChan = 16;
     }
 
-    N = constrain(N - 1, startChan, endChan - 1);
-    SDATAC(targetSS);
-    delay(1); // exit Read Data Continuous mode to communicate with ADS
-    byte P_setting = RREG(LOFF_SENSP, targetSS);
-    byte N_setting = RREG(LOFF_SENSN, targetSS);
-
-    if (leadOffSettings[N][PCHAN] == ON)
-    {
-        bitSet(P_setting, N - startChan);
-    }
-    else
-    {
-        bitClear(P_setting, N - startChan);
-    }
-    if (leadOffSettings[N][NCHAN] == ON)
-    {
-        bitSet(N_setting, N - startChan);
-    }
-    else
-    {
-        bitClear(N_setting, N - startChan);
-    }
-    WREG(LOFF_SENSP, P_setting, targetSS);
-    WREG(LOFF_SENSN, N_setting, targetSS);
+    updateRegisters(targetSS);
 }
 
 /// @brief This is a function that can be called multiple times, this is
@@ -1017,7 +1123,7 @@ void ADS1299::configureLeadOffDetection(byte amplitudeCode, byte freqCode)
             }
             targetSS = DAISY_ADS;
         }
-        setting = RREG(LOFF, targetSS); // get the current bias settings
+        setting = getRegister(LOFF, targetSS); // get the current lead off settings from the mirror
         // reconfigure the byte to get what we want
         setting &= 0b11110000;    // clear out the last four bits
         setting |= amplitudeCode; // set the amplitude
@@ -1049,14 +1155,13 @@ void ADS1299::updateChannelData(void)
     // this needs to be reset, or else it will constantly flag us
     channelDataAvailable = false;
 
-    lastSampleTime = millis();
+    lastSampleMicros = getDrdyMicros();
+    lastSampleTime = (unsigned long)(lastSampleMicros / 1000);
 
-    boolean downsample = false;
-
-    updateBoardData(downsample);
+    updateBoardData();
     if (daisyPresent)
     {
-        updateDaisyData(downsample);
+        updateDaisyData();
     }
 
     // switch (curBoardMode)
@@ -1088,162 +1193,337 @@ void ADS1299::updateChannelData(void)
     // }
 }
 
+/// @brief Read from the board's ADS1299 chip and fill the core arrays with
+///         new data.
+/// @param
 void ADS1299::updateBoardData(void)
 {
-    updateBoardData(true);
+    uint8_t frame[OPENBCI_ADS_BYTES_PER_FRAME];
+    readFrame(BOARD_ADS, frame); // status register (1100 + LOFF_STATP + LOFF_STATN + GPIO[7:4]) + 8 channels
+    boardStat = parseFrame(frame, boardChannelDataRaw, boardChannelDataInt);
+
+    if (firstDataPacket == true)
+    {
+        firstDataPacket = false;
+    }
 }
 
-void ADS1299::updateBoardData(boolean downsample)
+/// @brief Read from the Daisy's ADS1299 chip and fill the core arrays with
+//         new data. Rate reduction is the decimator's job, see popFrame().
+/// @param
+void ADS1299::updateDaisyData(void)
 {
-    byte inByte;
-    int byteCounter = 0;
+    // Read status register (1100 + LOFF_STATP + LOFF_STATN + GPIO[7:4]) and
+    // 24 bits of channel data in 8 3 byte chunks, converted to 32bit ints
+    uint8_t frame[OPENBCI_ADS_BYTES_PER_FRAME];
+    readFrame(DAISY_ADS, frame);
+    daisyStat = parseFrame(frame, daisyChannelDataRaw, daisyChannelDataInt);
 
-    // if ((daisyPresent) && !firstDataPacket && downsample)
-    // {
-    //     for (int i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
-    //     {                                                        // shift and average the byte arrays
-    //         lastBoardChannelDataInt[i] = boardChannelDataInt[i]; // remember the last samples
-    //     }
-    // }
+    if (firstDataPacket == true)
+    {
+        firstDataPacket = false;
+    }
+}
 
-    csLow(BOARD_ADS); //  open SPI
-    for (int i = 0; i < 3; i++)
+/// @brief Clock one complete RDATAC frame (status word + 8 channels) out of
+///        an ADS in a single bulk SPI transaction instead of 27 `xfer()` calls.
+/// @param targetSS {ChipSelect} - The ADS to read, BOARD_ADS or DAISY_ADS
+/// @param frame    {uint8_t *} - Caller buffer of OPENBCI_ADS_BYTES_PER_FRAME bytes
+void ADS1299::readFrame(ChipSelect targetSS, uint8_t *frame)
+{
+    static const uint8_t zeros[OPENBCI_ADS_BYTES_PER_FRAME] = {0}; // keep DIN low while clocking data out
+    csLow(targetSS);
+    hspi->transferBytes(zeros, frame, OPENBCI_ADS_BYTES_PER_FRAME);
+    csHigh(targetSS);
+}
+
+/// @brief Read the board (and daisy) frames for one sample and timestamp them.
+///        Called from the acquisition task, does not touch the public channel arrays.
+/// @param frame {Frame &} - Receives the raw frames
+void ADS1299::readChannelData(Frame &frame)
+{
+    readFrame(BOARD_ADS, frame.board);
+    if (daisyPresent)
     {
-        inByte = xfer(0x00); //  read status register (1100 + LOFF_STATP + LOFF_STATN + GPIO[7:4])
-        boardStat = (boardStat << 8) | inByte;
+        readFrame(DAISY_ADS, frame.daisy);
     }
-    for (int i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
+    frame.timestamp = getDrdyMicros();
+    frame.config = appliedConfig;
+}
+
+/// @brief Time between two DRDY edges at the current sample rate
+/// @return {unsigned long} - The period in microseconds
+unsigned long ADS1299::getSamplePeriodMicros(void)
+{
+    // SAMPLE_RATE_16000 is 0, every step down halves the rate
+    return (1000000UL << curSampleRate) / 16000;
+}
+
+/// @brief Time of the last DRDY edge as stamped by the ISR. 64 bit loads are
+///        not atomic on the ESP32, retry if the ISR ran in between.
+/// @return {int64_t} - esp_timer microseconds
+int64_t ADS1299::getDrdyMicros(void)
+{
+    uint32_t sequence;
+    int64_t stamp;
+    do
+    {
+        sequence = drdySequence;
+        stamp = drdyMicros;
+    } while ((sequence & 1) || sequence != drdySequence);
+    return stamp;
+}
+
+/// @brief Take the oldest frames queued by the acquisition task and load the
+///        next sample into the channel data arrays the senders read from.
+///        With decimation that takes getFactor() frames; their timestamp is
+///        moved back by the decimator's delay.
+/// @return {boolean} - `false` if the queue ran empty first
+boolean ADS1299::popFrame(void)
+{
+    Frame frame;
+    while (frameQueue.pop(frame))
     {
-        for (int j = 0; j < OPENBCI_ADS_BYTES_PER_CHAN; j++)
-        { //  read 24 bits of channel data in 8 3 byte chunks
-            inByte = xfer(0x00);
-            boardChannelDataRaw[byteCounter] = inByte; // raw data goes here
-            byteCounter++;
-            // boardChannelDataInt[i] = (boardChannelDataInt[i] << 8) | inByte; // int data goes here
+        if (frame.config != configSequence)
+        {
+            configPending = true;
+            configSequence = frame.config;
+            updateChannelScale(); // the new gains apply from this frame on
+            impedance.setChannels(getLeadOffChannels()); // and so does the lead-off current
+        }
+        boardStat = parseFrame(frame.board, boardChannelDataRaw, boardChannelDataInt);
+        if (daisyPresent)
+        {
+            daisyStat = parseFrame(frame.daisy, daisyChannelDataRaw, daisyChannelDataInt);
         }
+        if (impedance.isEnabled())
+        {
+            feedImpedanceMonitor(); // at the ADS rate, ahead of the decimator and the filters
+        }
+        if (decimator.getFactor() > 1 && !decimateChannelData())
+        {
+            continue;
+        }
+        configChanged = configPending;
+        configPending = false;
+        lastSampleMicros = frame.timestamp - (int64_t)decimator.getDelay() * getSamplePeriodMicros();
+        lastSampleTime = (unsigned long)(lastSampleMicros / 1000);
+        if (filterBank.isEnabled())
+        {
+            // the raw bytes follow, so every packet type carries the filtered data
+            filterBank.process(boardChannelDataInt, 0, OPENBCI_ADS_CHANS_PER_BOARD);
+            if (daisyPresent)
+            {
+                filterBank.process(daisyChannelDataInt, OPENBCI_ADS_CHANS_PER_BOARD, OPENBCI_ADS_CHANS_PER_BOARD);
+            }
+        }
+        if (decimator.getFactor() > 1 || filterBank.isEnabled())
+        {
+            packFrame(boardChannelDataInt, boardChannelDataRaw);
+            if (daisyPresent)
+            {
+                packFrame(daisyChannelDataInt, daisyChannelDataRaw);
+            }
+        }
+        return true;
     }
-    csHigh(BOARD_ADS); // close SPI
-
-    // // need to convert 24bit to 32bit if using the filter
-    // for (int i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
-    // { // convert 3 byte 2's compliment to 4 byte 2's compliment
-    //     if (bitRead(boardChannelDataInt[i], 23) == 1)
-    //     {
-    //         boardChannelDataInt[i] |= 0xFF000000;
-    //     }
-    //     else
-    //     {
-    //         boardChannelDataInt[i] &= 0x00FFFFFF;
-    //     }
-    // }
-    // if ((daisyPresent) && !firstDataPacket && downsample)
-    // {
-    //     byteCounter = 0;
-    //     for (int i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
-    //     { // take the average of this and the last sample
-    //         meanBoardChannelDataInt[i] = (lastBoardChannelDataInt[i] + boardChannelDataInt[i]) / 2;
-    //     }
-    //     for (int i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
-    //     { // place the average values in the meanRaw array
-    //         for (int b = 2; b >= 0; b--)
-    //         {
-    //             meanBoardDataRaw[byteCounter] = (meanBoardChannelDataInt[i] >> (b * 8)) & 0xFF;
-    //             byteCounter++;
-    //         }
-    //     }
-    // }
+    return false;
+}
 
-    if (firstDataPacket == true)
+/// @brief Feed the parsed frame and its lead-off status to the impedance
+///        monitor, board then daisy channels
+void ADS1299::feedImpedanceMonitor(void)
+{
+    int32_t channels[IMPEDANCE_CHANNELS];
+    uint8_t count = OPENBCI_ADS_CHANS_PER_BOARD;
+    // status word: 1100, LOFF_STATP, LOFF_STATN, GPIO[7:4]
+    uint16_t leadOffP = (boardStat >> 12) & 0xFF;
+    uint16_t leadOffN = (boardStat >> 4) & 0xFF;
+    for (uint8_t i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
     {
-        firstDataPacket = false;
+        channels[i] = boardChannelDataInt[i];
+    }
+    if (daisyPresent)
+    {
+        for (uint8_t i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
+        {
+            channels[OPENBCI_ADS_CHANS_PER_BOARD + i] = daisyChannelDataInt[i];
+        }
+        leadOffP |= ((daisyStat >> 12) & 0xFF) << OPENBCI_ADS_CHANS_PER_BOARD;
+        leadOffN |= ((daisyStat >> 4) & 0xFF) << OPENBCI_ADS_CHANS_PER_BOARD;
+        count += OPENBCI_ADS_CHANS_PER_BOARD;
+    }
+    if (impedance.add(channels, count, leadOffP, leadOffN))
+    {
+        impedanceReady = true;
     }
 }
 
-/// @brief Read from the Daisy's ADS1299 chip and fill the core arrays with
-//         new data. Defaults to downsampling if the daisy is present.
-/// @param
-void ADS1299::updateDaisyData(void)
+/// @brief Feed the parsed frame to the decimator, board then daisy channels
+/// @return {boolean} - `true` if the channel data arrays now hold an output sample
+boolean ADS1299::decimateChannelData(void)
 {
-    updateDaisyData(true);
+    int32_t channels[DECIMATOR_CHANNELS];
+    const uint8_t count = daisyPresent ? 2 * OPENBCI_ADS_CHANS_PER_BOARD : OPENBCI_ADS_CHANS_PER_BOARD;
+    for (uint8_t i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
+    {
+        channels[i] = boardChannelDataInt[i];
+        channels[OPENBCI_ADS_CHANS_PER_BOARD + i] = daisyChannelDataInt[i];
+    }
+    if (!decimator.process(channels, count))
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
+    {
+        boardChannelDataInt[i] = channels[i];
+        daisyChannelDataInt[i] = channels[OPENBCI_ADS_CHANS_PER_BOARD + i];
+    }
+    return true;
 }
 
-/// @brief Read from the Daisy's ADS1299 chip and fill the core arrays with
-//         new data.
-/// @param  downsample {boolean} - Averages the last sample with the current to cut the sample rate in half.
-void ADS1299::updateDaisyData(boolean downsample)
+/// @brief Rate the samples leave popFrame() at
+/// @return {uint32_t} - Hz, the ADS data rate over the decimation factor
+uint32_t ADS1299::getStreamRate(void)
 {
-    byte inByte;
-    int byteCounter = 0;
+    return (16000 >> curSampleRate) / decimator.getFactor();
+}
 
-    if (daisyPresent && !firstDataPacket && downsample)
+/// @brief Stream one sample per `factor` ADS samples, so the ADS can run at
+///        a higher rate for its lower noise. Call from the same task as popFrame().
+/// @param factor {uint8_t} - 1 (off) or a power of two up to DECIMATOR_MAX_FACTOR
+/// @return {boolean} - `false` if the factor is not supported
+boolean ADS1299::setDecimation(uint8_t factor)
+{
+    if (!decimator.setFactor(factor))
     {
-        for (int i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
-        {                                                        // shift and average the byte arrays
-            lastDaisyChannelDataInt[i] = daisyChannelDataInt[i]; // remember the last samples
-        }
+        return false;
     }
+    filterBank.setSampleRate(getStreamRate()); // the filter runs at the decimated rate
+    return true;
+}
 
-    // Open SPI
-    csLow(DAISY_ADS);
-    // Read status register (1100 + LOFF_STATP + LOFF_STATN + GPIO[7:4])
-    // TODO: Do we really need to read this status register ever time?
-    for (int i = 0; i < 3; i++)
+/// @brief Choose the filter popFrame() applies, NOTCH_NONE and BANDPASS_NONE
+///        for raw data. Call from the same task as popFrame().
+/// @param notch    {BiquadBank::NOTCH} - Mains notch
+/// @param bandpass {BiquadBank::BANDPASS} - Pass band
+void ADS1299::setFilter(BiquadBank::NOTCH notch, BiquadBank::BANDPASS bandpass)
+{
+    filterBank.configure(notch, bandpass, getStreamRate());
+}
+
+/// @brief Drive the AC lead-off current into the P input of every powered
+///        channel, or stop it on all of them. While it is on popFrame() keeps
+///        measuring the impedance; the data carries the tone (31.25 Hz after
+///        a soft reset), so notch it if it matters. Safe while streaming.
+/// @param on {boolean} - `true` to start monitoring
+void ADS1299::setImpedanceMonitor(boolean on)
+{
+    const int channels = daisyPresent ? OPENBCI_NUMBER_OF_CHANNELS_DAISY : OPENBCI_ADS_CHANS_PER_BOARD;
+    for (int i = 0; i < channels; i++)
+    {
+        leadOffSettings[i][PCHAN] = on && channelSettings[i][POWER_DOWN] == NO ? ON : OFF;
+        leadOffSettings[i][NCHAN] = OFF;
+    }
+    changeChannelLeadOffDetect();
+    if (!(streaming && acqTaskHandle != NULL))
     {
-        inByte = xfer(0x00);
-        daisyStat = (daisyStat << 8) | inByte;
+        impedance.setChannels(getLeadOffChannels()); // otherwise popFrame() does when the registers are in
     }
+}
 
-    // Read 24 bits of channel data in 8 3 byte chunks
-    for (int i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
+/// @brief Point the impedance monitor at the LOFF register's current and
+///        frequency and at the ADS data rate
+void ADS1299::configureImpedanceMonitor(void)
+{
+    static const float drive[4] = {6e-9f, 24e-9f, 6e-6f, 24e-6f}; // LOFF_MAG_6NA..LOFF_MAG_24UA
+    static const float tone[4] = {0, 7.8125f, 31.25f, 0};         // DC, 7.8 Hz, 31.2 Hz, fDR / 4 (not measured)
+    const byte loff = regData[BOARD_ADS][LOFF];
+    impedance.configure(tone[loff & 0x03], 16000 >> curSampleRate, drive[(loff >> 2) & 0x03]);
+    impedance.setChannels(getLeadOffChannels());
+}
+
+/// @brief Channels with a lead-off current on either input
+/// @return {uint16_t} - Bit n for channel n, board then daisy
+uint16_t ADS1299::getLeadOffChannels(void)
+{
+    uint16_t mask = 0;
+    const int channels = daisyPresent ? OPENBCI_NUMBER_OF_CHANNELS_DAISY : OPENBCI_ADS_CHANS_PER_BOARD;
+    for (int i = 0; i < channels; i++)
     {
-        for (int j = 0; j < OPENBCI_ADS_BYTES_PER_CHAN; j++)
+        if (leadOffSettings[i][PCHAN] == ON || leadOffSettings[i][NCHAN] == ON)
         {
-            inByte = xfer(0x00);
-            daisyChannelDataRaw[byteCounter] = inByte; // raw data goes here
-            byteCounter++;
-            daisyChannelDataInt[i] = (daisyChannelDataInt[i] << 8) | inByte; // int data goes here
+            mask |= 1 << i;
         }
     }
+    return mask;
+}
 
-    // Close SPI
-    csHigh(DAISY_ADS);
+/// @brief Start the DRDY driven reader task on its own core
+/// @return {boolean} - `true` if the task is running
+boolean ADS1299::beginAcquisitionTask(void)
+{
+    if (acqTaskHandle != NULL)
+    {
+        return true;
+    }
+    acqTaskRunning = true;
+    TaskHandle_t handle = NULL;
+    if (xTaskCreatePinnedToCore(acquisitionTask, "ads_acq", ADS_ACQ_TASK_STACK_SIZE, this,
+                                ADS_ACQ_TASK_PRIORITY, &handle, ADS_ACQ_TASK_CORE) != pdPASS)
+    {
+        acqTaskRunning = false;
+        return false;
+    }
+    acqTaskHandle = handle;
+    return true;
+}
 
-    // Convert 24bit to 32bit
-    for (int i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
+/// @brief Stop the reader task and wait for it to exit
+void ADS1299::endAcquisitionTask(void)
+{
+    TaskHandle_t handle = acqTaskHandle;
+    if (handle == NULL)
     {
-        // Convert 3 byte 2's compliment to 4 byte 2's compliment
-        if (bitRead(daisyChannelDataInt[i], 23) == 1)
-        {
-            daisyChannelDataInt[i] |= 0xFF000000;
-        }
-        else
-        {
-            daisyChannelDataInt[i] &= 0x00FFFFFF;
-        }
+        return;
+    }
+    acqTaskRunning = false;
+    xTaskNotifyGive(handle);
+    while (acqTaskHandle != NULL)
+    {
+        vTaskDelay(1);
     }
+}
 
-    if (daisyPresent && !firstDataPacket && downsample)
+/// @brief Split a frame read by `readFrame` into its status word and channel data.
+/// @param frame {const uint8_t *} - OPENBCI_ADS_BYTES_PER_FRAME bytes from the ADS
+/// @param raw   {byte *} - Receives the 24 raw channel bytes, may be NULL
+/// @param data  {int *} - Receives 8 sign extended channel values, may be NULL
+/// @return      {int} - The 24 bit status word (1100 + LOFF_STATP + LOFF_STATN + GPIO[7:4])
+int ADS1299::parseFrame(const uint8_t *frame, byte *raw, int *data)
+{
+    const uint8_t *channels = frame + OPENBCI_ADS_BYTES_PER_STATUS;
+    if (raw != NULL)
     {
-        byteCounter = 0;
-        // Average this sample with the last sample
-        for (int i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
-        {
-            meanDaisyChannelDataInt[i] = (lastDaisyChannelDataInt[i] + daisyChannelDataInt[i]) / 2;
-        }
-        // Place the average values in the meanRaw array
-        for (int i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
-        {
-            for (int b = 2; b >= 0; b--)
-            {
-                meanDaisyDataRaw[byteCounter] = (meanDaisyChannelDataInt[i] >> (b * 8)) & 0xFF;
-                byteCounter++;
-            }
-        }
+        memcpy(raw, channels, OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE);
+    }
+    if (data != NULL)
+    {
+        SignExtend24::frame(channels, data); // 3 byte 2's complement to 4 byte 2's complement
     }
+    return (frame[0] << 16) | (frame[1] << 8) | frame[2];
+}
 
-    if (firstDataPacket == true)
+/// @brief The inverse of `parseFrame` for the channel data
+/// @param data {const int *} - 8 channel values, 24 bit range
+/// @param raw  {byte *} - Receives the 24 raw channel bytes
+void ADS1299::packFrame(const int *data, byte *raw)
+{
+    for (int i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
     {
-        firstDataPacket = false;
+        raw[i * OPENBCI_ADS_BYTES_PER_CHAN] = (data[i] >> 16) & 0xFF;
+        raw[i * OPENBCI_ADS_BYTES_PER_CHAN + 1] = (data[i] >> 8) & 0xFF;
+        raw[i * OPENBCI_ADS_BYTES_PER_CHAN + 2] = data[i] & 0xFF;
     }
 }
 
@@ -1277,16 +1557,25 @@ void ADS1299::startHSPI(void)
 
 ADS1299::~ADS1299()
 {
+    endAcquisitionTask();
+    if (spiMutex != NULL)
+    {
+        vSemaphoreDelete(spiMutex);
+    }
+    if (acqMutex != NULL)
+    {
+        vSemaphoreDelete(acqMutex);
+    }
 }
 
 /// @brief Used to activate a channel, if running must stop and start after...
 /// @param channelNumber int the channel you want to change
 void ADS1299::streamSafeChannelActivate(byte channelNumber)
 {
-    boolean wasStreaming = streaming;
-
-    // Stop streaming if you are currently streaming
-    if (streaming)
+    // With the acquisition task running the change lands between two samples,
+    // otherwise stop streaming if you are currently streaming
+    boolean wasStreaming = streaming && acqTaskHandle == NULL;
+    if (wasStreaming)
     {
         streamStop();
     }
@@ -1303,7 +1592,7 @@ void ADS1299::streamSafeChannelActivate(byte channelNumber)
 
 void ADS1299::activateChannel(byte N)
 {
-    byte setting, startChan, endChan;
+    byte startChan, endChan;
     ChipSelect targetSS;
     if (N < 9)
     {
@@ -1324,64 +1613,12 @@ void ADS1299::activateChannel(byte N)
 
     N = constrain(N - 1, startChan, endChan - 1); // 0-7 or 8-15
 
-    SDATAC(targetSS); // exit Read Data Continuous mode to communicate with ADS
-    setting = 0x00;
-    //  channelSettings[N][POWER_DOWN] = NO; // keep track of channel on/off in this array  REMOVE?
-    setting |= channelSettings[N][GAIN_SET];       // gain
-    setting |= channelSettings[N][INPUT_TYPE_SET]; // input code
-    if (useSRB2[N] == true)
-    {
-        channelSettings[N][SRB2_SET] = YES;
-    }
-    else
-    {
-        channelSettings[N][SRB2_SET] = NO;
-    }
-    if (channelSettings[N][SRB2_SET] == YES)
-    {
-        bitSet(setting, 3);
-    } // close this SRB2 switch
-    WREG(CH1SET + (N - startChan), setting, targetSS);
-    // add or remove from inclusion in BIAS generation
-    if (useInBias[N])
-    {
-        channelSettings[N][BIAS_SET] = YES;
-    }
-    else
-    {
-        channelSettings[N][BIAS_SET] = NO;
-    }
-    setting = RREG(BIAS_SENSP, targetSS); // get the current P bias settings
-    if (channelSettings[N][BIAS_SET] == YES)
-    {
-        bitSet(setting, N - startChan); // set this channel's bit to add it to the bias generation
-        useInBias[N] = true;
-    }
-    else
-    {
-        bitClear(setting, N - startChan); // clear this channel's bit to remove from bias generation
-        useInBias[N] = false;
-    }
-    WREG(BIAS_SENSP, setting, targetSS);
-    delay(1);                             // send the modified byte back to the ADS
-    setting = RREG(BIAS_SENSN, targetSS); // get the current N bias settings
-    if (channelSettings[N][BIAS_SET] == YES)
-    {
-        bitSet(setting, N - startChan); // set this channel's bit to add it to the bias generation
-    }
-    else
-    {
-        bitClear(setting, N - startChan); // clear this channel's bit to remove from bias generation
-    }
-    WREG(BIAS_SENSN, setting, targetSS);
-    delay(1); // send the modified byte back to the ADS
+    // power up and restore the SRB2 and bias membership from before deactivateChannel()
+    channelSettings[N][POWER_DOWN] = NO;
+    channelSettings[N][SRB2_SET] = useSRB2[N] ? YES : NO;
+    channelSettings[N][BIAS_SET] = useInBias[N] ? YES : NO;
 
-    setting = 0x00;
-    if (targetSS == BOARD_ADS && boardUseSRB1 == true)
-        setting = 0x20;
-    if (targetSS == DAISY_ADS && daisyUseSRB1 == true)
-        setting = 0x20;
-    WREG(MISC1, setting, targetSS); // close all SRB1 swtiches
+    updateRegisters(targetSS);
 }
 
 void ADS1299::activateAllChannelsToTestCondition(byte testInputCode, byte amplitudeCode, byte freqCode)
@@ -1414,10 +1651,10 @@ void ADS1299::activateAllChannelsToTestCondition(byte testInputCode, byte amplit
 /// @param channelNumber {int} - the channel you want to change
 void ADS1299::streamSafeChannelDeactivate(byte channelNumber)
 {
-    boolean wasStreaming = streaming;
-
-    // Stop streaming if you are currently streaming
-    if (streaming)
+    // With the acquisition task running the change lands between two samples,
+    // otherwise stop streaming if you are currently streaming
+    boolean wasStreaming = streaming && acqTaskHandle == NULL;
+    if (wasStreaming)
     {
         streamStop();
     }
@@ -1435,8 +1672,18 @@ void ADS1299::streamSafeChannelDeactivate(byte channelNumber)
 /// @brief Call this to stop streaming from the ADS1299
 void ADS1299::streamStop()
 {
+    // wait for a read or reconfiguration in progress, the next one sees streaming cleared
+    xSemaphoreTake(acqMutex, portMAX_DELAY);
     streaming = false;
+    xSemaphoreGive(acqMutex);
     stopADS();
+    // changes queued after the last sample the acquisition task read
+    uint8_t pending = pendingConfig.exchange(0);
+    if (pending != 0)
+    {
+        applyPendingConfig(pending, false);
+        updateChannelScale();
+    }
 }
 
 /// @brief Stop the continuous data acquisition
@@ -1462,6 +1709,9 @@ void ADS1299::startADS()
     // sampleCounter = 0;
     // sampleCounterBLE = 0;
     firstDataPacket = true;
+    decimator.reset();
+    filterBank.setSampleRate(getStreamRate()); // the rate may have changed, and the history is stale
+    configureImpedanceMonitor();
     RDATAC(BOTH_ADS); // enter Read Data Continuous mode
     delay(1);
     START(BOTH_ADS); // start the data acquisition
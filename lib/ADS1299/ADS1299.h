@@ -2,6 +2,17 @@
 #include "Config.h"
 #include <Arduino.h>
 #include "ADS1299_Definitions.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "SpscRing.h"
+#include "StreamStats.h"
+#include "ChannelScale.h"
+#include "BiquadBank.h"
+#include "Decimator.h"
+#include "ImpedanceMonitor.h"
+#include "SignExtend24.h"
 
 class ADS1299
 {
@@ -24,6 +35,15 @@ public:
         SAMPLE_RATE_250
     };
 
+    // STRUCTS
+    typedef struct
+    {
+        int64_t timestamp;       // esp_timer microseconds at the DRDY edge that announced the sample
+        uint8_t config;          // register changes applied before this frame was sampled, see configSequence
+        uint8_t board[OPENBCI_ADS_BYTES_PER_FRAME];
+        uint8_t daisy[OPENBCI_ADS_BYTES_PER_FRAME];
+    } Frame;
+
     // Variables
     boolean boardUseSRB1; // used to keep track of if we are using SRB1
     boolean daisyPresent;
@@ -37,29 +57,33 @@ public:
     byte channelSettings[OPENBCI_NUMBER_OF_CHANNELS_DAISY][OPENBCI_NUMBER_OF_CHANNEL_SETTINGS]; // array to hold current channel settings
     byte daisyChannelDataRaw[OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE];
     byte defaultChannelSettings[OPENBCI_NUMBER_OF_CHANNEL_SETTINGS]; // default channel settings
-    byte lastBoardDataRaw[OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE];
-    byte lastDaisyDataRaw[OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE];
     byte leadOffSettings[OPENBCI_NUMBER_OF_CHANNELS_DAISY][OPENBCI_NUMBER_OF_LEAD_OFF_SETTINGS]; // used to control on/off of impedance measure for P and N side of each channel
-    byte meanBoardDataRaw[OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE];
-    byte meanDaisyDataRaw[OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE];
     // byte sampleCounter;
     // byte sampleCounterBLE;
 
     int boardChannelDataInt[OPENBCI_NUMBER_CHANNELS_PER_ADS_SAMPLE]; // array used when reading channel data as ints
     int daisyChannelDataInt[OPENBCI_NUMBER_CHANNELS_PER_ADS_SAMPLE]; // array used when reading channel data as ints
-    int lastBoardChannelDataInt[OPENBCI_NUMBER_CHANNELS_PER_ADS_SAMPLE];
-    int lastDaisyChannelDataInt[OPENBCI_NUMBER_CHANNELS_PER_ADS_SAMPLE];
-    int meanBoardChannelDataInt[OPENBCI_NUMBER_CHANNELS_PER_ADS_SAMPLE];
-    int meanDaisyChannelDataInt[OPENBCI_NUMBER_CHANNELS_PER_ADS_SAMPLE];
     int numChannels;
 
     short auxData[3]; // This is user faceing
     short axisData[3];
 
-    unsigned long lastSampleTime;
+    unsigned long lastSampleTime; // ms, DRDY time of the sample in the channel data arrays
+    int64_t lastSampleMicros;     // the same in esp_timer microseconds
 
     static volatile bool channelDataAvailable;
 
+    SpscRing<Frame, ADS_FRAME_QUEUE_SIZE> frameQueue; // acquisition task -> loop()
+    volatile uint32_t framesDropped;                  // frames lost because frameQueue was full
+    StreamStats *stats;                               // optional, receives overrun/DRDY/SPI counters
+    ChannelScale channelScale;                        // count -> nV per channel, follows channelSettings gains
+    Decimator decimator;                              // popFrame() hands out one sample per getFactor() frames
+    BiquadBank filterBank;                            // notch/bandpass popFrame() runs the channel data through, after the decimator
+    ImpedanceMonitor impedance;                       // popFrame() feeds it every ADS frame while a lead-off current is on
+    boolean impedanceReady;                           // impedance finished a block since the flag was last cleared
+    uint8_t configSequence;                           // live reconfigurations seen by popFrame(), wraps
+    boolean configChanged;                            // the frame popFrame() loaded is the first one after a live reconfiguration
+
     // ENUMS
     // ACCEL_MODE curAccelMode;
     // BOARD_MODE curBoardMode;
@@ -77,6 +101,9 @@ public:
     boolean smellDaisy(void);
     void writeChannelSettings(void);
     void writeChannelSettings(byte);
+    void updateChannelScale(void);
+    void buildChannelRegisters(ChipSelect targetSS, byte *image);
+    byte getRegister(byte address, ChipSelect targetSS);
     void changeChannelLeadOffDetect();
     void changeChannelLeadOffDetect(byte N);
     void softReset(void);
@@ -85,9 +112,23 @@ public:
     void boardBeginADSInterrupt(void);
     void updateChannelData(void);
     void updateBoardData(void);
-    void updateBoardData(boolean);
     void updateDaisyData(void);
-    void updateDaisyData(boolean);
+    void readFrame(ChipSelect targetSS, uint8_t *frame);
+    void readChannelData(Frame &frame);
+    boolean popFrame(void);
+    boolean decimateChannelData(void);
+    unsigned long getSamplePeriodMicros(void);
+    uint32_t getStreamRate(void);
+    boolean setDecimation(uint8_t factor);
+    static int64_t getDrdyMicros(void);
+    boolean beginAcquisitionTask(void);
+    void endAcquisitionTask(void);
+    static int parseFrame(const uint8_t *frame, byte *raw, int *data);
+    static void packFrame(const int *data, byte *raw);
+    void setFilter(BiquadBank::NOTCH notch, BiquadBank::BANDPASS bandpass);
+    void setImpedanceMonitor(boolean on);
+    void configureImpedanceMonitor(void);
+    uint16_t getLeadOffChannels(void);
     void sendChannelData(void);
     // void sendChannelData(PACKET_TYPE);
     void sendChannelDataSerial();
@@ -121,6 +162,7 @@ public:
 
 private:
     static void IRAM_ATTR ADS_DRDY_Service();
+    static void acquisitionTask(void *arg);
     byte xfer(byte _data);
     void csLow(ChipSelect targetSS);
     void csHigh(ChipSelect targetSS);
@@ -129,6 +171,14 @@ private:
     void deactivateChannel(byte N);
     byte RREG(byte, ChipSelect targetSS);
     void WREG(byte, byte, ChipSelect); // write one ADS register
+    void WREGS(byte, const byte *, byte, ChipSelect); // write consecutive ADS registers in one burst
+    void applyRegisters(const byte *image, byte first, byte last, ChipSelect targetSS);
+    void applyChannelRegisters(ChipSelect targetSS);
+    void setSRB1(ChipSelect targetSS, boolean closed);
+    void updateRegisters(ChipSelect targetSS);
+    void feedImpedanceMonitor(void);
+    void applyPendingConfig(uint8_t pending, boolean resume);
+    void resetRegisterShadow(ChipSelect targetSS);
     void STOP(ChipSelect targetSS);
     void RDATAC(ChipSelect targetSS);
     void START(ChipSelect targetSS);
@@ -136,10 +186,20 @@ private:
 
     // Variables
     boolean firstDataPacket;
-    byte regData[24]; // array is used to mirror register data
+    byte regData[2][ADS_NUM_REGISTERS]; // mirror of the BOARD_ADS and DAISY_ADS registers, kept by RESET/RREG/WREG
     int boardStat;    // used to hold the status register
     int daisyStat;
     boolean isRunning;
+    volatile boolean acqTaskRunning;
+    std::atomic<uint8_t> pendingConfig; // 1 << ChipSelect of each ADS whose registers the acquisition task must update
+    uint8_t appliedConfig;              // acquisition task side of configSequence
+    boolean configPending;              // popFrame() saw a reconfiguration the decimator has not output yet
+    SemaphoreHandle_t spiMutex; // serialises the acquisition task and loop() on the SPI bus
+    SemaphoreHandle_t acqMutex; // held by the acquisition task from its streaming check until the frame and queued changes are done
+
+    static TaskHandle_t volatile acqTaskHandle;
+    static volatile int64_t drdyMicros;      // esp_timer_get_time() at the last DRDY edge
+    static volatile uint32_t drdySequence;   // odd while the ISR is writing drdyMicros
 
 
     // void printRegisterName(byte);
@@ -45,6 +45,7 @@
 #define MISC1 0x15
 #define MISC2 0x16
 #define CONFIG4 0x17
+#define ADS_NUM_REGISTERS 24 // ID_REG..CONFIG4
 
 #define OUTPUT_NOTHING (0) // quiet
 #define OUTPUT_8_CHAN (1)  // not using Daisy module
@@ -128,4 +129,15 @@
 #define OPENBCI_NUMBER_OF_LEAD_OFF_SETTINGS 2
 
 #define OPENBCI_ADS_BYTES_PER_CHAN 3
-#define OPENBCI_ADS_CHANS_PER_BOARD 8
\ No newline at end of file
+#define OPENBCI_ADS_CHANS_PER_BOARD 8
+
+/** One RDATAC frame: 24 bit status word followed by 8 x 24 bit channels */
+#define OPENBCI_ADS_BYTES_PER_STATUS 3
+#define OPENBCI_ADS_BYTES_PER_FRAME (OPENBCI_ADS_BYTES_PER_STATUS + OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE)
+
+/** Acquisition task: woken by DRDY, reads the ADS(s) and queues frames for loop() */
+#define ADS_ACQ_TASK_STACK_SIZE (4096)
+#define ADS_ACQ_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+#define ADS_ACQ_TASK_CORE (0) // loop() and the web server run on core 1
+#define ADS_ACQ_TASK_WAKE_MS (100) // re-check the run flag at least this often
+#define ADS_FRAME_QUEUE_SIZE (256) // power of two, ~1 s at 250 SPS
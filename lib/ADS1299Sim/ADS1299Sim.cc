@@ -0,0 +1,431 @@
+#include <math.h>
+#include "ADS1299Sim.h"
+
+// Register values after power up or RESET, and the bits a WREG may change
+// (ADS1299 datasheet, register map). Reserved bits keep their fixed value.
+static const uint8_t resetValues[ADS_NUM_REGISTERS] = {
+    ADS_ID, 0x96, 0xC0, 0x60, 0x00,                 // ID_REG, CONFIG1..3, LOFF
+    0x61, 0x61, 0x61, 0x61, 0x61, 0x61, 0x61, 0x61, // CH1SET..CH8SET
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,       // BIAS_SENSP..LOFF_STATN
+    0x0F, 0x00, 0x00, 0x00};                        // GPIO, MISC1, MISC2, CONFIG4
+static const uint8_t writableBits[ADS_NUM_REGISTERS] = {
+    0x00, 0x67, 0x17, 0x9E, 0xEF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00,
+    0xFF, 0x20, 0x00, 0x0A};
+static const uint8_t gains[8] = {1, 2, 4, 6, 8, 12, 24, 24}; // CHnSET bits 6:4, 111 is reserved
+
+#define DRDY_NANOS(dr) ((1000000000ULL << (dr)) / 16000) // DR bits of CONFIG1, 000 is 16 kSPS
+
+/// @brief Deterministic noise in [-1, 1) with a roughly normal shape, a pure
+///        function of the sample and channel so expectedCode() can reproduce it
+static double noise(uint64_t sample, uint8_t channel)
+{
+    uint64_t z = sample * 16 + channel + 0x9E3779B97F4A7C15ULL;
+    double sum = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        z += 0x9E3779B97F4A7C15ULL;
+        uint64_t x = z;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        x ^= x >> 31;
+        sum += (double)(x >> 11) / (double)(1ULL << 53);
+    }
+    return sum / 2 - 1;
+}
+
+ADS1299Sim::ADS1299Sim()
+    : ignoredCommands(0), _daisyPresent(true), _converting(false), _resetLow(false), _samples(0),
+      _nextDrdy(0), _busHz(0), _busNanos(0)
+{
+    for (int c = 0; c < OPENBCI_NUMBER_OF_CHANNELS_DAISY; c++)
+    {
+        _sineMicrovolts[c] = 0;
+        _sineHertz[c] = 0;
+    }
+    for (int i = 0; i < ADS_SIM_CHIPS; i++)
+    {
+        _chips[i].selected = false;
+        reset(_chips[i]);
+    }
+}
+
+/// @brief Plug or unplug the daisy module. Without it CS2 talks to nobody.
+void ADS1299Sim::setDaisyPresent(bool present)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    _daisyPresent = present;
+}
+
+/// @brief Feed a pure sine instead of the synthetic EEG to a NORMAL input
+/// @param channel    {uint8_t} - 0-7 board, 8-15 daisy
+/// @param microvolts {double} - Amplitude at the electrode, 0 restores the EEG
+/// @param hertz      {double} - Frequency
+void ADS1299Sim::setSine(uint8_t channel, double microvolts, double hertz)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if (channel >= OPENBCI_NUMBER_OF_CHANNELS_DAISY)
+        return;
+    _sineMicrovolts[channel] = microvolts;
+    _sineHertz[channel] = hertz;
+}
+
+/// @brief Let every SPI byte cost 8 clocks of virtual time, 0 to disable
+void ADS1299Sim::setBusClock(uint32_t hz)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    _busHz = hz;
+    _busNanos = 0;
+}
+
+/// @brief Power cycle both chips: default registers, RDATAC, not converting
+void ADS1299Sim::powerOn(void)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    for (int i = 0; i < ADS_SIM_CHIPS; i++)
+        reset(_chips[i]);
+    _converting = false;
+}
+
+/// @brief One conversion on every running chip, then a falling DRDY edge
+void ADS1299Sim::convert(void)
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (!_converting)
+            return;
+        uint64_t sample = _samples++;
+        latch(0, sample);
+        latch(1, sample);
+    }
+    nativeSetPinLevel(PIN_ADS_DRDY, LOW);
+    nativeTriggerInterrupt(PIN_ADS_DRDY);
+}
+
+/// @brief Move the virtual clock forward, converting whenever a sample is due
+///        at the data rate the board chip is set to
+/// @param micros {uint64_t} - How far to run
+/// @return {uint32_t} - Conversions done
+uint32_t ADS1299Sim::advance(uint64_t micros)
+{
+    uint64_t target = (nativeMicros() + micros) * 1000;
+    uint32_t converted = 0;
+    for (;;)
+    {
+        uint64_t due;
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            if (!_converting || _nextDrdy > target)
+                break;
+            due = _nextDrdy;
+            _nextDrdy += DRDY_NANOS(_chips[0].regs[CONFIG1] & 0x07);
+        }
+        uint64_t now = nativeMicros();
+        if (due / 1000 > now)
+            nativeAdvanceMicros(due / 1000 - now);
+        convert();
+        converted++;
+    }
+    uint64_t now = nativeMicros();
+    if (target / 1000 > now)
+        nativeAdvanceMicros(target / 1000 - now);
+    return converted;
+}
+
+/// @brief DRDY period at the board chip's current data rate, rounded down
+uint32_t ADS1299Sim::getSamplePeriodMicros(void)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return periodMicros();
+}
+
+uint64_t ADS1299Sim::getSamples(void)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return _samples;
+}
+
+bool ADS1299Sim::isConverting(void)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return _converting;
+}
+
+bool ADS1299Sim::isReadContinuous(uint8_t chip)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return chip < ADS_SIM_CHIPS && _chips[chip].readContinuous;
+}
+
+uint8_t ADS1299Sim::getRegister(uint8_t chip, uint8_t address)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if (chip >= ADS_SIM_CHIPS || address >= ADS_NUM_REGISTERS)
+        return 0x00;
+    return _chips[chip].regs[address];
+}
+
+/// @brief The code a channel carries for `sample` under the current settings
+/// @param chip    {uint8_t} - 0 board, 1 daisy
+/// @param channel {uint8_t} - 0-7 on that chip
+/// @param sample  {uint64_t} - Conversion number since START
+/// @return {int32_t} - Sign extended 24 bit code
+int32_t ADS1299Sim::expectedCode(uint8_t chip, uint8_t channel, uint64_t sample)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    uint8_t chSet = _chips[chip].regs[CH1SET + channel];
+    if (chSet & 0x80)
+        return 0;
+    return toCode(inputVolts(chip, channel, sample), chSet);
+}
+
+uint8_t ADS1299Sim::transfer(uint8_t data)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    busTime(1);
+    uint8_t out = 0x00;
+    bool driven = false;
+    for (int i = 0; i < ADS_SIM_CHIPS; i++)
+    {
+        if (!_chips[i].selected || (i == 1 && !_daisyPresent))
+            continue;
+        uint8_t b = clock(_chips[i], data);
+        out = driven ? (out & b) : b; // both on the bus: open drain-ish contention
+        driven = true;
+    }
+    return out;
+}
+
+void ADS1299Sim::pinChanged(uint8_t pin, uint8_t level)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if (pin == PIN_ADS_CS1 || pin == PIN_ADS_CS2)
+    {
+        Chip &chip = _chips[pin == PIN_ADS_CS1 ? 0 : 1];
+        chip.selected = level == LOW;
+        if (chip.selected)
+        {
+            chip.phase = PHASE_OPCODE;
+            if (chip.readContinuous)
+                chip.framePosition = 0; // output register holds the last conversion
+        }
+    }
+    else if (pin == PIN_ADS_RESET)
+    {
+        if (level == LOW)
+        {
+            _resetLow = true;
+        }
+        else if (_resetLow)
+        {
+            _resetLow = false;
+            for (int i = 0; i < ADS_SIM_CHIPS; i++)
+                reset(_chips[i]);
+            _converting = false;
+        }
+    }
+}
+
+void ADS1299Sim::reset(Chip &chip)
+{
+    memcpy(chip.regs, resetValues, ADS_NUM_REGISTERS);
+    memset(chip.frame, 0, sizeof(chip.frame));
+    chip.frame[0] = 0xC0;
+    chip.readContinuous = true; // the ADS1299 starts up in RDATAC mode
+    chip.standby = false;
+    chip.phase = PHASE_OPCODE;
+    chip.framePosition = OPENBCI_ADS_BYTES_PER_FRAME;
+}
+
+/// @brief One byte on the bus for one selected chip: shift frame data out while
+///        decoding what comes in
+uint8_t ADS1299Sim::clock(Chip &chip, uint8_t data)
+{
+    uint8_t out = 0x00;
+    if (chip.framePosition < OPENBCI_ADS_BYTES_PER_FRAME)
+    {
+        if (chip.framePosition == 0 && &chip == &_chips[0])
+            nativeSetPinLevel(PIN_ADS_DRDY, HIGH); // DRDY returns high once data is clocked out
+        out = chip.frame[chip.framePosition++];
+    }
+    switch (chip.phase)
+    {
+    case PHASE_OPCODE:
+        command(chip, data);
+        break;
+    case PHASE_COUNT:
+        chip.remaining = (data & 0x1F) + 1;
+        chip.phase = PHASE_REGISTERS;
+        break;
+    case PHASE_REGISTERS:
+        if (chip.address < ADS_NUM_REGISTERS)
+        {
+            if (chip.writing)
+                writeRegister(chip, chip.address, data);
+            else
+                out = chip.regs[chip.address];
+        }
+        chip.address++;
+        if (--chip.remaining == 0)
+            chip.phase = PHASE_OPCODE;
+        break;
+    }
+    return out;
+}
+
+void ADS1299Sim::command(Chip &chip, uint8_t opcode)
+{
+    if ((opcode & 0xE0) == 0x20 || (opcode & 0xE0) == 0x40)
+    {
+        if (chip.readContinuous)
+        {
+            ignoredCommands++; // SDATAC first, the datasheet says RREG/WREG are ignored in RDATAC
+            return;
+        }
+        chip.writing = (opcode & 0xE0) == 0x40;
+        chip.address = opcode & 0x1F;
+        chip.phase = PHASE_COUNT;
+        return;
+    }
+    switch (opcode)
+    {
+    case _WAKEUP:
+        chip.standby = false;
+        break;
+    case _STANDBY:
+        chip.standby = true;
+        break;
+    case _RESET:
+        reset(chip);
+        break;
+    case _START:
+        if (!_converting)
+        {
+            _converting = true;
+            _samples = 0;
+            _nextDrdy = nativeMicros() * 1000 + DRDY_NANOS(_chips[0].regs[CONFIG1] & 0x07);
+        }
+        break;
+    case _STOP:
+        _converting = false;
+        break;
+    case _RDATAC:
+        chip.readContinuous = true;
+        break;
+    case _SDATAC:
+        chip.readContinuous = false;
+        break;
+    case _RDATA:
+        chip.framePosition = 0;
+        break;
+    default:
+        break; // 0x00 while clocking data out, or not a command
+    }
+}
+
+void ADS1299Sim::writeRegister(Chip &chip, uint8_t address, uint8_t value)
+{
+    uint8_t mask = writableBits[address];
+    chip.regs[address] = (chip.regs[address] & ~mask) | (value & mask);
+}
+
+/// @brief Put the conversion of `sample` in a chip's output register. The daisy
+///        runs off the board's clock output, without CLK_EN it converts nothing.
+void ADS1299Sim::latch(uint8_t index, uint64_t sample)
+{
+    Chip &chip = _chips[index];
+    if (chip.standby)
+        return;
+    if (index == 1 && (!_daisyPresent || !(_chips[0].regs[CONFIG1] & 0x20)))
+        return;
+    // status: 1100, LOFF_STATP, LOFF_STATN, GPIO[7:4]
+    uint8_t statp = chip.regs[LOFF_STATP];
+    uint8_t statn = chip.regs[LOFF_STATN];
+    chip.frame[0] = 0xC0 | (statp >> 4);
+    chip.frame[1] = (uint8_t)(statp << 4) | (statn >> 4);
+    chip.frame[2] = (uint8_t)(statn << 4) | (chip.regs[GPIO] >> 4);
+    for (uint8_t c = 0; c < OPENBCI_ADS_CHANS_PER_BOARD; c++)
+    {
+        uint8_t chSet = chip.regs[CH1SET + c];
+        int32_t code = (chSet & 0x80) ? 0 : toCode(inputVolts(index, c, sample), chSet);
+        uint8_t *p = chip.frame + OPENBCI_ADS_BYTES_PER_STATUS + c * OPENBCI_ADS_BYTES_PER_CHAN;
+        p[0] = (uint8_t)(code >> 16);
+        p[1] = (uint8_t)(code >> 8);
+        p[2] = (uint8_t)code;
+    }
+    chip.framePosition = chip.readContinuous ? 0 : OPENBCI_ADS_BYTES_PER_FRAME;
+}
+
+/// @brief Differential input voltage the channel mux selects
+double ADS1299Sim::inputVolts(uint8_t index, uint8_t channel, uint64_t sample)
+{
+    const Chip &chip = _chips[index];
+    uint8_t global = index * OPENBCI_ADS_CHANS_PER_BOARD + channel;
+    double t = (double)sample * DRDY_NANOS(chip.regs[CONFIG1] & 0x07) / 1e9;
+    switch (chip.regs[CH1SET + channel] & 0x07)
+    {
+    case ADSINPUT_NORMAL:
+        if (_sineMicrovolts[global] != 0)
+            return _sineMicrovolts[global] * 1e-6 * sin(2 * M_PI * _sineHertz[global] * t);
+        // alpha and theta rhythm, mains pickup and electrode noise
+        return 20e-6 * sin(2 * M_PI * 10 * t + global * 0.7) +
+               8e-6 * sin(2 * M_PI * 6 * t + global * 1.3) +
+               10e-6 * sin(2 * M_PI * 50 * t) +
+               3e-6 * noise(sample, global);
+    case ADSINPUT_SHORTED:
+        return 1e-6 * noise(sample, global);
+    case ADSINPUT_MVDD:
+        return 2.5; // (AVDD - AVSS) / 2 on a 5 V analog supply
+    case ADSINPUT_TEMP:
+        return 145.3e-3; // 25 degrees C
+    case ADSINPUT_TESTSIG:
+    {
+        uint8_t config2 = chip.regs[CONFIG2];
+        if (!(config2 & 0x10))
+            return 0; // INT_CAL clear: test signal driven externally, nothing there
+        double amplitude = ADS_SIM_TEST_SIGNAL * ((config2 & 0x04) ? 2 : 1);
+        switch (config2 & 0x03)
+        {
+        case 0x00:
+            return fmod(t * ADS_SIM_CLOCK_HZ / (1 << 21), 1.0) < 0.5 ? amplitude : -amplitude;
+        case 0x01:
+            return fmod(t * ADS_SIM_CLOCK_HZ / (1 << 20), 1.0) < 0.5 ? amplitude : -amplitude;
+        case 0x03:
+            return amplitude; // DC
+        default:
+            return 0;
+        }
+    }
+    default:
+        return 0; // BIAS_MEAS, BIAS_DRP, BIAS_DRN: nothing connected
+    }
+}
+
+int32_t ADS1299Sim::toCode(double volts, uint8_t chSet)
+{
+    double code = round(volts * gains[(chSet >> 4) & 0x07] * 8388607.0 / ADS_SIM_VREF);
+    if (code > 8388607)
+        return 8388607;
+    if (code < -8388608)
+        return -8388608;
+    return (int32_t)code;
+}
+
+uint32_t ADS1299Sim::periodMicros(void)
+{
+    return (uint32_t)(DRDY_NANOS(_chips[0].regs[CONFIG1] & 0x07) / 1000);
+}
+
+/// @brief Charge SPI bytes to the virtual clock at the bus rate
+void ADS1299Sim::busTime(uint32_t bytes)
+{
+    if (_busHz == 0)
+        return;
+    _busNanos += bytes * 8000000000ULL / _busHz;
+    if (_busNanos >= 1000)
+    {
+        nativeAdvanceMicros(_busNanos / 1000);
+        _busNanos %= 1000;
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+// Simulated ADS1299 (board and daisy) for host builds. It sits behind `hspi`
+// as a NativeSPIDevice and follows the chip selects, RESET and DRDY pins from
+// ADS1299_Definitions.h, so the unmodified driver, acquisition task and
+// packetizers run against it.
+#include <mutex>
+#include <SPI.h>
+#include "ADS1299_Definitions.h"
+
+#define ADS_SIM_CHIPS 2
+#define ADS_SIM_VREF 4.5            // volts, VREFP - VREFN
+#define ADS_SIM_TEST_SIGNAL 1.875e-3 // volts, 1x internal test signal, VREF / 2.4 mV
+#define ADS_SIM_CLOCK_HZ 2048000.0   // fCLK, sets the test signal frequency
+
+class ADS1299Sim : public NativeSPIDevice
+{
+public:
+    ADS1299Sim();
+
+    void setDaisyPresent(bool present);
+    void setSine(uint8_t channel, double microvolts, double hertz);
+    void setBusClock(uint32_t hz);
+    void powerOn(void);
+
+    void convert(void);
+    uint32_t advance(uint64_t micros);
+    uint32_t getSamplePeriodMicros(void);
+    uint64_t getSamples(void);
+    bool isConverting(void);
+    bool isReadContinuous(uint8_t chip);
+    uint8_t getRegister(uint8_t chip, uint8_t address);
+    int32_t expectedCode(uint8_t chip, uint8_t channel, uint64_t sample);
+
+    uint8_t transfer(uint8_t data);
+    void pinChanged(uint8_t pin, uint8_t level);
+
+    uint32_t ignoredCommands; // RREG/WREG sent while in RDATAC mode, the chip drops them
+
+private:
+    enum Phase
+    {
+        PHASE_OPCODE,
+        PHASE_COUNT,
+        PHASE_REGISTERS
+    };
+    struct Chip
+    {
+        uint8_t regs[ADS_NUM_REGISTERS];
+        bool selected;
+        bool readContinuous;
+        bool standby;
+        Phase phase;
+        bool writing;
+        uint8_t address;
+        uint8_t remaining;
+        uint8_t frame[OPENBCI_ADS_BYTES_PER_FRAME];
+        uint8_t framePosition; // next frame byte clocked out, past the end when idle
+    };
+
+    void reset(Chip &chip);
+    uint8_t clock(Chip &chip, uint8_t data);
+    void command(Chip &chip, uint8_t opcode);
+    void writeRegister(Chip &chip, uint8_t address, uint8_t value);
+    void latch(uint8_t index, uint64_t sample);
+    double inputVolts(uint8_t index, uint8_t channel, uint64_t sample);
+    int32_t toCode(double volts, uint8_t chSet);
+    uint32_t periodMicros(void);
+    void busTime(uint32_t bytes);
+
+    std::mutex _lock;
+    Chip _chips[ADS_SIM_CHIPS];
+    bool _daisyPresent;
+    bool _converting;
+    bool _resetLow;
+    uint64_t _samples;     // conversions since START
+    uint64_t _nextDrdy;    // virtual nanoseconds of the next conversion
+    uint32_t _busHz;       // 0: SPI transfers take no virtual time
+    uint64_t _busNanos;    // SPI time not yet added to the clock
+    double _sineMicrovolts[OPENBCI_NUMBER_OF_CHANNELS_DAISY];
+    double _sineHertz[OPENBCI_NUMBER_OF_CHANNELS_DAISY];
+};
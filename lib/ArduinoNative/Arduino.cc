@@ -0,0 +1,208 @@
+#include <stdarg.h>
+#include <atomic>
+#include "Arduino.h"
+#include "esp_timer.h"
+
+HardwareSerial Serial0;
+
+static std::atomic<uint64_t> _micros(0);
+static uint8_t _pinLevel[NATIVE_NUM_PINS];
+static void (*_isr[NATIVE_NUM_PINS])(void);
+static void (*_pinWriteHook)(uint8_t, uint8_t) = nullptr;
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin >= NATIVE_NUM_PINS)
+        return;
+    _pinLevel[pin] = val ? HIGH : LOW;
+    if (_pinWriteHook)
+        _pinWriteHook(pin, _pinLevel[pin]);
+}
+
+int digitalRead(uint8_t pin)
+{
+    if (pin >= NATIVE_NUM_PINS)
+        return LOW;
+    return _pinLevel[pin];
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode)
+{
+    (void)mode;
+    if (pin < NATIVE_NUM_PINS)
+        _isr[pin] = isr;
+}
+
+void detachInterrupt(uint8_t pin)
+{
+    if (pin < NATIVE_NUM_PINS)
+        _isr[pin] = nullptr;
+}
+
+unsigned long millis(void)
+{
+    return (unsigned long)(_micros.load() / 1000);
+}
+
+unsigned long micros(void)
+{
+    return (unsigned long)_micros.load();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)_micros.load();
+}
+
+void delay(uint32_t ms)
+{
+    _micros += (uint64_t)ms * 1000;
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    _micros += us;
+}
+
+void yield(void)
+{
+}
+
+uint64_t nativeMicros(void)
+{
+    return _micros.load();
+}
+
+void nativeSetMicros(uint64_t us)
+{
+    _micros = us;
+}
+
+void nativeAdvanceMicros(uint64_t us)
+{
+    _micros += us;
+}
+
+/// @brief Drive an input pin from the outside world, e.g. a simulated DRDY line
+void nativeSetPinLevel(uint8_t pin, uint8_t val)
+{
+    if (pin < NATIVE_NUM_PINS)
+        _pinLevel[pin] = val ? HIGH : LOW;
+}
+
+/// @brief Run the handler registered with attachInterrupt() for `pin`
+void nativeTriggerInterrupt(uint8_t pin)
+{
+    if (pin < NATIVE_NUM_PINS && _isr[pin])
+        _isr[pin]();
+}
+
+/// @brief Observe every digitalWrite(), used by simulated SPI devices to track chip select
+void nativeSetPinWriteHook(void (*hook)(uint8_t pin, uint8_t val))
+{
+    _pinWriteHook = hook;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    (void)baud;
+}
+
+size_t HardwareSerial::print(const char *s)
+{
+    if (echo)
+        fputs(s, stdout);
+    return strlen(s);
+}
+
+size_t HardwareSerial::print(char c)
+{
+    char s[2] = {c, 0};
+    return print(s);
+}
+
+size_t HardwareSerial::print(int n, int base)
+{
+    return print((long)n, base);
+}
+
+size_t HardwareSerial::print(unsigned int n, int base)
+{
+    return print((unsigned long)n, base);
+}
+
+size_t HardwareSerial::print(long n, int base)
+{
+    if (n < 0 && base == DEC)
+        return print('-') + print((unsigned long)-n, base);
+    return print((unsigned long)n, base);
+}
+
+size_t HardwareSerial::print(unsigned long n, int base)
+{
+    char buf[8 * sizeof(long) + 1];
+    char *str = &buf[sizeof(buf) - 1];
+    *str = '\0';
+    if (base < 2)
+        base = 10;
+    do
+    {
+        unsigned long m = n;
+        n /= base;
+        char c = m - base * n;
+        *--str = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+    return print(str);
+}
+
+size_t HardwareSerial::println(void)
+{
+    return print("\r\n");
+}
+
+size_t HardwareSerial::println(const char *s)
+{
+    return print(s) + println();
+}
+
+size_t HardwareSerial::println(char c)
+{
+    return print(c) + println();
+}
+
+size_t HardwareSerial::println(int n, int base)
+{
+    return print(n, base) + println();
+}
+
+size_t HardwareSerial::println(unsigned int n, int base)
+{
+    return print(n, base) + println();
+}
+
+size_t HardwareSerial::println(long n, int base)
+{
+    return print(n, base) + println();
+}
+
+size_t HardwareSerial::println(unsigned long n, int base)
+{
+    return print(n, base) + println();
+}
+
+size_t HardwareSerial::printf(const char *format, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    print(buf);
+    return len < 0 ? 0 : (size_t)len;
+}
@@ -0,0 +1,85 @@
+#pragma once
+// Host (native) stand-in for the parts of the Arduino core used by the
+// ADS1299 driver. Time is virtual: delay() and delayMicroseconds() advance
+// the clock instantly so driver start-up sequences run in microseconds.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define IRAM_ATTR
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+#define digitalPinToInterrupt(p) (p)
+
+#define NATIVE_NUM_PINS 64
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t pin);
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield(void);
+
+// Host-only hooks used by tests and simulated peripherals
+uint64_t nativeMicros(void);
+void nativeSetMicros(uint64_t us);
+void nativeAdvanceMicros(uint64_t us);
+void nativeSetPinLevel(uint8_t pin, uint8_t val);
+void nativeTriggerInterrupt(uint8_t pin);
+void nativeSetPinWriteHook(void (*hook)(uint8_t pin, uint8_t val));
+
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud);
+    size_t print(const char *s);
+    size_t print(char c);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t println(void);
+    size_t println(const char *s);
+    size_t println(char c);
+    size_t println(int n, int base = DEC);
+    size_t println(unsigned int n, int base = DEC);
+    size_t println(long n, int base = DEC);
+    size_t println(unsigned long n, int base = DEC);
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+    boolean echo = false; // mirror output to stdout
+};
+
+extern HardwareSerial Serial0;
@@ -0,0 +1,130 @@
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+struct NativeTask
+{
+    std::mutex lock;
+    std::condition_variable cond;
+    uint32_t notifications;
+    NativeTask() : notifications(0) {}
+};
+
+struct NativeSemaphore
+{
+    std::timed_mutex lock;
+};
+
+static thread_local NativeTask *_currentTask = nullptr;
+
+/// @brief Runs `pvTaskCode` on its own thread. Handles stay valid for the life of
+///        the process so a late notification to a finished task is harmless.
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char *pcName, uint32_t usStackDepth,
+                                   void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pvCreatedTask,
+                                   BaseType_t xCoreID)
+{
+    (void)pcName;
+    (void)usStackDepth;
+    (void)uxPriority;
+    (void)xCoreID;
+    NativeTask *task = new NativeTask();
+    if (pvCreatedTask)
+        *pvCreatedTask = task;
+    std::thread([task, pvTaskCode, pvParameters]()
+                {
+                    _currentTask = task;
+                    pvTaskCode(pvParameters);
+                })
+        .detach();
+    return pdPASS;
+}
+
+/// @brief Only self deletion is supported: the thread ends when the task function returns
+void vTaskDelete(TaskHandle_t xTask)
+{
+    (void)xTask;
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(xTicksToDelay * portTICK_PERIOD_MS));
+}
+
+void taskYIELD(void)
+{
+    std::this_thread::yield();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return _currentTask;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    NativeTask *task = _currentTask;
+    if (task == nullptr)
+        return 0;
+    std::unique_lock<std::mutex> guard(task->lock);
+    if (xTicksToWait == portMAX_DELAY)
+    {
+        task->cond.wait(guard, [task]()
+                        { return task->notifications > 0; });
+    }
+    else
+    {
+        task->cond.wait_for(guard, std::chrono::milliseconds(xTicksToWait * portTICK_PERIOD_MS), [task]()
+                            { return task->notifications > 0; });
+    }
+    uint32_t value = task->notifications;
+    if (value > 0)
+        task->notifications = xClearCountOnExit ? 0 : value - 1;
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    {
+        std::lock_guard<std::mutex> guard(xTaskToNotify->lock);
+        xTaskToNotify->notifications++;
+    }
+    xTaskToNotify->cond.notify_one();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    xTaskNotifyGive(xTaskToNotify);
+    if (pxHigherPriorityTaskWoken)
+        *pxHigherPriorityTaskWoken = pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return new NativeSemaphore();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime)
+{
+    if (xBlockTime == portMAX_DELAY)
+    {
+        xSemaphore->lock.lock();
+        return pdTRUE;
+    }
+    return xSemaphore->lock.try_lock_for(std::chrono::milliseconds(xBlockTime * portTICK_PERIOD_MS)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore)
+{
+    xSemaphore->lock.unlock();
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore)
+{
+    delete xSemaphore;
+}
@@ -0,0 +1,87 @@
+#include "SPI.h"
+
+static NativeSPIDevice *_device = nullptr;
+
+static void forwardPinWrite(uint8_t pin, uint8_t level)
+{
+    if (_device)
+        _device->pinChanged(pin, level);
+}
+
+void NativeSPIDevice::transferBytes(const uint8_t *data, uint8_t *out, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        uint8_t in = transfer(data ? data[i] : 0xFF);
+        if (out)
+            out[i] = in;
+    }
+}
+
+/// @brief Put `device` on the bus, replacing any previous one
+void nativeAttachSPIDevice(NativeSPIDevice *device)
+{
+    _device = device;
+    nativeSetPinWriteHook(device ? forwardPinWrite : nullptr);
+}
+
+SPIClass::SPIClass(uint8_t spi_bus)
+    : byteTransfers(0), bulkTransfers(0), _spi_num(spi_bus), _freq(1000000), _dataMode(SPI_MODE0)
+{
+}
+
+void SPIClass::begin(int8_t sck, int8_t miso, int8_t mosi, int8_t ss)
+{
+    (void)sck;
+    (void)miso;
+    (void)mosi;
+    (void)ss;
+}
+
+void SPIClass::end()
+{
+}
+
+void SPIClass::setFrequency(uint32_t freq)
+{
+    _freq = freq;
+}
+
+void SPIClass::setDataMode(uint8_t dataMode)
+{
+    _dataMode = dataMode;
+}
+
+void SPIClass::setBitOrder(uint8_t bitOrder)
+{
+    (void)bitOrder;
+}
+
+void SPIClass::beginTransaction(SPISettings settings)
+{
+    _freq = settings._clock;
+    _dataMode = settings._dataMode;
+}
+
+void SPIClass::endTransaction(void)
+{
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+    byteTransfers++;
+    return _device ? _device->transfer(data) : 0x00;
+}
+
+void SPIClass::transferBytes(const uint8_t *data, uint8_t *out, uint32_t size)
+{
+    bulkTransfers++;
+    if (_device)
+    {
+        _device->transferBytes(data, out, size);
+    }
+    else if (out)
+    {
+        memset(out, 0, size);
+    }
+}
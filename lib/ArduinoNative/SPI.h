@@ -0,0 +1,65 @@
+#pragma once
+// Host (native) SPI bus. Transfers are routed to whatever NativeSPIDevice is
+// attached, so tests can put a fake or simulated ADS1299 behind `hspi`.
+#include "Arduino.h"
+
+#define FSPI 0
+#define HSPI 1
+
+#define SPI_MODE0 0
+#define SPI_MODE1 1
+#define SPI_MODE2 2
+#define SPI_MODE3 3
+
+#define SPI_LSBFIRST 0
+#define SPI_MSBFIRST 1
+#define LSBFIRST SPI_LSBFIRST
+#define MSBFIRST SPI_MSBFIRST
+
+class SPISettings
+{
+public:
+    SPISettings() : _clock(1000000), _bitOrder(SPI_MSBFIRST), _dataMode(SPI_MODE0) {}
+    SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode)
+        : _clock(clock), _bitOrder(bitOrder), _dataMode(dataMode) {}
+    uint32_t _clock;
+    uint8_t _bitOrder;
+    uint8_t _dataMode;
+};
+
+/// @brief A peripheral sitting on the native SPI bus. `pinChanged` sees every
+///        digitalWrite() so the device can follow its chip select line.
+class NativeSPIDevice
+{
+public:
+    virtual ~NativeSPIDevice() {}
+    virtual uint8_t transfer(uint8_t data) = 0;
+    virtual void transferBytes(const uint8_t *data, uint8_t *out, uint32_t size);
+    virtual void pinChanged(uint8_t pin, uint8_t level) {}
+};
+
+void nativeAttachSPIDevice(NativeSPIDevice *device);
+
+class SPIClass
+{
+public:
+    SPIClass(uint8_t spi_bus = HSPI);
+    void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1);
+    void end();
+    void setFrequency(uint32_t freq);
+    void setDataMode(uint8_t dataMode);
+    void setBitOrder(uint8_t bitOrder);
+    void beginTransaction(SPISettings settings);
+    void endTransaction(void);
+    uint8_t transfer(uint8_t data);
+    void transferBytes(const uint8_t *data, uint8_t *out, uint32_t size);
+
+    // Host-only statistics so tests can assert on bus usage
+    uint32_t byteTransfers;
+    uint32_t bulkTransfers;
+
+private:
+    uint8_t _spi_num;
+    uint32_t _freq;
+    uint8_t _dataMode;
+};
@@ -0,0 +1,6 @@
+#pragma once
+// Host stand-in for the ESP-IDF high resolution timer, runs on the same
+// virtual clock as micros() but does not wrap.
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,103 @@
+#include "ControlTask.h"
+
+ControlTask::ControlTask() : _poll(NULL), _context(NULL), _handle(NULL), _running(false), _polls(0), _waiting(0)
+{
+    _lock = xSemaphoreCreateMutex();
+}
+
+ControlTask::~ControlTask()
+{
+    end();
+    vSemaphoreDelete(_lock);
+}
+
+/// @brief Start calling `poll` on its own task, CONTROL_TASK_IDLE_MS apart
+/// @param poll    {PollFunction} - One pass of the control plane
+/// @param context {void *} - Handed to `poll`
+/// @return {bool} - `false` if the task could not be created
+bool ControlTask::begin(PollFunction poll, void *context)
+{
+    if (_handle != NULL)
+    {
+        return true;
+    }
+    _poll = poll;
+    _context = context;
+    _polls = 0;
+    _running = true;
+    TaskHandle_t handle = NULL;
+    if (xTaskCreatePinnedToCore(task, "control", CONTROL_TASK_STACK_SIZE, this,
+                                CONTROL_TASK_PRIORITY, &handle, CONTROL_TASK_CORE) != pdPASS)
+    {
+        _running = false;
+        return false;
+    }
+    _handle = handle;
+    return true;
+}
+
+/// @brief Stop the task after its current poll and wait for it to exit
+void ControlTask::end(void)
+{
+    if (_handle == NULL)
+    {
+        return;
+    }
+    _running = false;
+    while (_handle != NULL)
+    {
+        vTaskDelay(1);
+    }
+}
+
+void ControlTask::lock(void)
+{
+    _waiting++;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _waiting--;
+}
+
+void ControlTask::unlock(void)
+{
+    xSemaphoreGive(_lock);
+}
+
+/// @brief Called without the lock: if a handler waits for it, wait until it
+///        took it, so the next lock() queues behind that handler
+void ControlTask::handOver(void)
+{
+    while (_waiting > 0)
+    {
+        taskYIELD();
+    }
+}
+
+/// @brief Called with the lock: between two steps of a long change, let a
+///        waiting `loop()` have its pass first
+void ControlTask::yield(void)
+{
+    unlock();
+    handOver();
+    lock();
+}
+
+/// @brief Called with the lock: wait `ms` without it
+/// @param ms {uint32_t} - Milliseconds
+void ControlTask::sleep(uint32_t ms)
+{
+    Unlocked unlocked(*this);
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+void ControlTask::task(void *arg)
+{
+    ControlTask *control = (ControlTask *)arg;
+    while (control->_running)
+    {
+        control->_poll(control->_context);
+        control->_polls++;
+        vTaskDelay(pdMS_TO_TICKS(CONTROL_TASK_IDLE_MS));
+    }
+    control->_handle = NULL;
+    vTaskDelete(NULL);
+}
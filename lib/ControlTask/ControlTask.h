@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#define CONTROL_TASK_STACK_SIZE (8192)
+#define CONTROL_TASK_PRIORITY (1) // below the acquisition task and the Wi-Fi stack on core 0
+#define CONTROL_TASK_CORE (0)     // loop() keeps core 1 to itself
+#define CONTROL_TASK_IDLE_MS (2)  // between two polls, an idle server must not spin
+
+/// @brief Runs the control plane, e.g. `server.handleClient()`, on a task of
+///        its own so parsing a request and building and sending its response
+///        never hold up `loop()`. What both sides change is guarded by one
+///        lock: `loop()` holds it for a stream pass, a handler only while it
+///        reads or changes that state, never while it talks to its client.
+///        A handler that has to wait, for a peer or a settling board, lets
+///        go of it for that long with `Unlocked`, `sleep()` or `yield()`.
+///        `loop()` never sleeps, so it calls `handOver()` between two passes
+///        or a waiting handler would hardly ever get the lock.
+class ControlTask
+{
+public:
+    typedef void (*PollFunction)(void *context);
+
+    /// @brief Holds the lock for a scope
+    class Guard
+    {
+    public:
+        explicit Guard(ControlTask &task) : _task(task) { _task.lock(); }
+        ~Guard() { _task.unlock(); }
+
+    private:
+        ControlTask &_task;
+    };
+
+    /// @brief Lets go of a held lock for a scope and takes it back after,
+    ///        what it guards may have changed in between
+    class Unlocked
+    {
+    public:
+        explicit Unlocked(ControlTask &task) : _task(task) { _task.unlock(); }
+        ~Unlocked() { _task.lock(); }
+
+    private:
+        ControlTask &_task;
+    };
+
+    ControlTask();
+    ~ControlTask();
+
+    bool begin(PollFunction poll, void *context);
+    void end(void);
+    bool isRunning(void) const { return _handle != NULL; }
+    void lock(void);
+    void unlock(void);
+    void handOver(void);
+    void yield(void);
+    void sleep(uint32_t ms);
+    /// @brief Times the task called its poll function since begin()
+    uint32_t getPolls(void) const { return _polls; }
+
+private:
+    static void task(void *arg);
+
+    SemaphoreHandle_t _lock;
+    PollFunction _poll;
+    void *_context;
+    TaskHandle_t volatile _handle;
+    volatile bool _running;
+    volatile uint32_t _polls;
+    std::atomic<uint32_t> _waiting; // lock() calls blocked on the lock right now, from either side
+};
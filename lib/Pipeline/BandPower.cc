@@ -0,0 +1,247 @@
+#include <math.h>
+#include <string.h>
+#include "BandPower.h"
+
+#if defined(ESP_PLATFORM) && defined(__has_include)
+#if __has_include(<dsps_fft2r.h>)
+#include <dsps_fft2r.h>
+#define BAND_POWER_ESP_DSP
+#endif
+#endif
+
+#define BAND_POWER_PI 3.14159265358979323846
+
+// as the OpenBCI GUI splits them
+static const float bandEdges[BandPower::BAND_END][2] = {
+    {1, 4}, {4, 8}, {8, 13}, {13, 30}, {30, 55}};
+
+#ifndef BAND_POWER_ESP_DSP
+// e^(-2 pi i k / BAND_POWER_MAX_WINDOW), smaller transforms take every n-th
+static float twiddle[BAND_POWER_MAX_WINDOW / 2][2];
+#endif
+static bool tablesReady = false;
+
+BandPower::BandPower()
+    : _window(0), _hop(0), _sampleRate(0)
+{
+    configure(BAND_POWER_DEFAULT_WINDOW, BAND_POWER_DEFAULT_HOP, 250);
+}
+
+/// @brief Choose the window and hop and lay out the bands over the bins
+/// @param window       {uint16_t} - Samples per transform, a power of two from
+///                                  BAND_POWER_MIN_WINDOW to BAND_POWER_MAX_WINDOW
+/// @param hop          {uint16_t} - Samples between windows, 1 to `window`
+/// @param sampleRateHz {uint32_t} - Rate the samples arrive at, after any decimation
+/// @return {bool} - `false` if the window or hop is not supported, nothing changed
+bool BandPower::configure(uint16_t window, uint16_t hop, uint32_t sampleRateHz)
+{
+    if (window < BAND_POWER_MIN_WINDOW || window > BAND_POWER_MAX_WINDOW || (window & (window - 1)) != 0 ||
+        hop == 0 || hop > window || sampleRateHz == 0)
+    {
+        return false;
+    }
+    if (!tablesReady)
+    {
+#ifdef BAND_POWER_ESP_DSP
+        dsps_fft2r_init_fc32(NULL, BAND_POWER_MAX_WINDOW);
+#else
+        for (int k = 0; k < BAND_POWER_MAX_WINDOW / 2; k++)
+        {
+            twiddle[k][0] = (float)cos(2 * BAND_POWER_PI * k / BAND_POWER_MAX_WINDOW);
+            twiddle[k][1] = (float)-sin(2 * BAND_POWER_PI * k / BAND_POWER_MAX_WINDOW);
+        }
+#endif
+        tablesReady = true;
+    }
+    _window = window;
+    _hop = hop;
+    _sampleRate = sampleRateHz;
+
+    // periodic Hann; Parseval puts N sum(w^2) / 2 of a unit mean square into
+    // the positive bins
+    double energy = 0;
+    for (uint16_t n = 0; n < _window; n++)
+    {
+        const double w = 0.5 - 0.5 * cos(2 * BAND_POWER_PI * n / _window);
+        _taper[n] = (float)w;
+        energy += w * w;
+    }
+    _scale = (float)(2 / (_window * energy));
+
+    // a bin belongs to the band its centre falls in, DC and Nyquist to none
+    for (uint8_t b = 0; b < BAND_END; b++)
+    {
+        double start = ceil(bandEdges[b][0] * (double)_window / _sampleRate);
+        double end = ceil(bandEdges[b][1] * (double)_window / _sampleRate);
+        start = start < 1 ? 1 : (start > _window / 2 ? _window / 2 : start);
+        end = end < start ? start : (end > _window / 2 ? _window / 2 : end);
+        _binStart[b] = (uint16_t)start;
+        _binEnd[b] = (uint16_t)end;
+    }
+    reset();
+    return true;
+}
+
+/// @brief Forget the signal history, e.g. when the stream restarts or a
+///        gain changes; the next powers come a whole window later
+void BandPower::reset(void)
+{
+    _channels = 0;
+    _next = _filled = _sinceOutput = 0;
+    memset(_power, 0, sizeof(_power));
+}
+
+const char *BandPower::getName(BAND band)
+{
+    switch (band)
+    {
+    case BAND_DELTA:
+        return "delta";
+    case BAND_THETA:
+        return "theta";
+    case BAND_ALPHA:
+        return "alpha";
+    case BAND_BETA:
+        return "beta";
+    case BAND_GAMMA:
+        return "gamma";
+    default:
+        return "none";
+    }
+}
+
+float BandPower::getLow(BAND band)
+{
+    return band < BAND_END ? bandEdges[band][0] : 0;
+}
+
+float BandPower::getHigh(BAND band)
+{
+    return band < BAND_END ? bandEdges[band][1] : 0;
+}
+
+/// @brief Take one sample of every channel
+/// @param data  {const int32_t *} - Sign extended 24 bit values
+/// @param count {uint8_t} - Channels, a change starts the window over
+/// @return {bool} - `true` if a window completed, `getPower()` has new values
+bool BandPower::add(const int32_t *data, uint8_t count)
+{
+    if (count > BAND_POWER_CHANNELS)
+    {
+        count = BAND_POWER_CHANNELS;
+    }
+    if (count != _channels)
+    {
+        reset();
+        _channels = count;
+    }
+    memcpy(_samples[_next], data, count * sizeof(int32_t));
+    _next = _next + 1 == _window ? 0 : _next + 1;
+    if (_filled < _window)
+    {
+        _filled++;
+    }
+    if (++_sinceOutput < _hop || _filled < _window)
+    {
+        return false;
+    }
+    _sinceOutput = 0;
+    compute();
+    return true;
+}
+
+/// @brief Two channels per transform, a in the real part and b in the
+///        imaginary part: X_a(k) = (Z(k) + Z*(N - k)) / 2 and
+///        X_b(k) = (Z(k) - Z*(N - k)) / 2i
+void BandPower::compute(void)
+{
+    const uint16_t n = _window;
+    for (uint8_t a = 0; a < _channels; a += 2)
+    {
+        const uint8_t b = a + 1 < _channels ? a + 1 : a;
+        // take the whole counts of the mean out in integers, an electrode
+        // offset can be millions of counts and would leave float rounding all
+        // over the spectrum; the fraction left would leak into bin 1
+        int64_t sumA = 0, sumB = 0;
+        for (uint16_t i = 0; i < n; i++)
+        {
+            sumA += _samples[i][a];
+            sumB += _samples[i][b];
+        }
+        const int32_t meanA = (int32_t)(sumA / n), meanB = (int32_t)(sumB / n);
+        const float fractionA = (float)(sumA - (int64_t)meanA * n) / n;
+        const float fractionB = (float)(sumB - (int64_t)meanB * n) / n;
+        uint16_t at = _next;
+        for (uint16_t i = 0; i < n; i++)
+        {
+            _fft[2 * i] = _taper[i] * ((float)(_samples[at][a] - meanA) - fractionA);
+            _fft[2 * i + 1] = b != a ? _taper[i] * ((float)(_samples[at][b] - meanB) - fractionB) : 0;
+            at = at + 1 == n ? 0 : at + 1;
+        }
+        transform(_fft);
+        for (uint8_t band = 0; band < BAND_END; band++)
+        {
+            float powerA = 0, powerB = 0;
+            for (uint16_t k = _binStart[band]; k < _binEnd[band]; k++)
+            {
+                const float zr = _fft[2 * k], zi = _fft[2 * k + 1];
+                const float mr = _fft[2 * (n - k)], mi = _fft[2 * (n - k) + 1];
+                powerA += (zr + mr) * (zr + mr) + (zi - mi) * (zi - mi);
+                powerB += (zi + mi) * (zi + mi) + (zr - mr) * (zr - mr);
+            }
+            _power[a][band] = powerA * _scale / 4;
+            if (b != a)
+            {
+                _power[b][band] = powerB * _scale / 4;
+            }
+        }
+    }
+}
+
+/// @brief In place forward complex FFT of `_window` points
+void BandPower::transform(float *data) const
+{
+#ifdef BAND_POWER_ESP_DSP
+    dsps_fft2r_fc32(data, _window);
+    dsps_bit_rev_fc32(data, _window);
+#else
+    const uint16_t n = _window;
+    for (uint16_t i = 1, j = 0; i < n; i++)
+    {
+        uint16_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            float t = data[2 * i];
+            data[2 * i] = data[2 * j];
+            data[2 * j] = t;
+            t = data[2 * i + 1];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j + 1] = t;
+        }
+    }
+    for (uint16_t half = 1; half < n; half <<= 1)
+    {
+        const uint16_t stride = BAND_POWER_MAX_WINDOW / (2 * half);
+        for (uint16_t start = 0; start < n; start += 2 * half)
+        {
+            for (uint16_t k = 0; k < half; k++)
+            {
+                const float wr = twiddle[k * stride][0], wi = twiddle[k * stride][1];
+                float *p = data + 2 * (start + k);
+                float *q = p + 2 * half;
+                const float tr = wr * q[0] - wi * q[1];
+                const float ti = wr * q[1] + wi * q[0];
+                q[0] = p[0] - tr;
+                q[1] = p[1] - ti;
+                p[0] += tr;
+                p[1] += ti;
+            }
+        }
+    }
+#endif
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+
+#define BAND_POWER_CHANNELS 16
+#define BAND_POWER_MIN_WINDOW 32
+#define BAND_POWER_MAX_WINDOW 512 // 2 s at 250 Hz, 0.5 Hz bins
+#define BAND_POWER_DEFAULT_WINDOW 256
+#define BAND_POWER_DEFAULT_HOP 64
+
+/// @brief Per channel EEG band powers over a sliding window: every `hop`
+///        samples the last `window` samples of each channel lose their mean,
+///        get a Hann taper and go through a float FFT, and the periodogram
+///        bins are summed per band. Real channels are paired into one complex
+///        transform, so 16 channels cost 8 FFTs. On the ESP32 the transform is
+///        esp-dsp's (SIMD on the S3), elsewhere a plain radix-2.
+class BandPower
+{
+public:
+    enum BAND
+    {
+        BAND_DELTA,
+        BAND_THETA,
+        BAND_ALPHA,
+        BAND_BETA,
+        BAND_GAMMA,
+        BAND_END
+    };
+
+    BandPower();
+
+    bool configure(uint16_t window, uint16_t hop, uint32_t sampleRateHz);
+    void setSampleRate(uint32_t sampleRateHz) { configure(_window, _hop, sampleRateHz); }
+    void reset(void);
+    bool add(const int32_t *data, uint8_t count);
+    uint16_t getWindow(void) const { return _window; }
+    uint16_t getHop(void) const { return _hop; }
+    uint32_t getSampleRate(void) const { return _sampleRate; }
+    uint8_t getChannels(void) const { return _channels; }
+    /// @brief Mean square of the band, in counts^2, as of the last window
+    float getPower(uint8_t channel, BAND band) const { return _power[channel][band]; }
+    static const char *getName(BAND band);
+    static float getLow(BAND band);
+    static float getHigh(BAND band);
+
+private:
+    void compute(void);
+    void transform(float *data) const;
+
+    uint16_t _window;
+    uint16_t _hop;
+    uint32_t _sampleRate;
+    uint8_t _channels;
+    uint16_t _next;        // ring position of the next sample, and so of the oldest
+    uint16_t _filled;      // samples in the ring, up to the window
+    uint16_t _sinceOutput; // samples since the last window was computed
+    uint16_t _binStart[BAND_END];
+    uint16_t _binEnd[BAND_END];
+    float _scale; // one sided periodogram bin -> mean square, undoes the taper
+    float _taper[BAND_POWER_MAX_WINDOW];
+    float _fft[2 * BAND_POWER_MAX_WINDOW]; // interleaved re, im
+    float _power[BAND_POWER_CHANNELS][BAND_END];
+    int32_t _samples[BAND_POWER_MAX_WINDOW][BAND_POWER_CHANNELS];
+};
@@ -0,0 +1,210 @@
+#include <math.h>
+#include <string.h>
+#include "BiquadBank.h"
+
+#define BIQUAD_PI 3.14159265358979323846
+
+static const double bandpassEdges[BiquadBank::BANDPASS_END][2] = {
+    {0, 0}, {1, 50}, {5, 50}, {3, 45}, {7, 13}, {15, 50}};
+
+BiquadBank::BiquadBank()
+    : _notch(NOTCH_NONE), _bandpass(BANDPASS_NONE), _sections(0)
+{
+    reset();
+}
+
+/// @brief Design the cascade for a filter choice and clear the history
+/// @param notch        {NOTCH} - Mains notch, NOTCH_NONE for none
+/// @param bandpass     {BANDPASS} - 4th order Butterworth band, BANDPASS_NONE for none
+/// @param sampleRateHz {uint32_t} - ADS data rate the samples arrive at
+void BiquadBank::configure(NOTCH notch, BANDPASS bandpass, uint32_t sampleRateHz)
+{
+    _notch = notch < NOTCH_END ? notch : NOTCH_NONE;
+    _bandpass = bandpass < BANDPASS_END ? bandpass : BANDPASS_NONE;
+    _sections = 0;
+    const double fs = sampleRateHz;
+    if (_notch != NOTCH_NONE)
+    {
+        addNotch(_notch == NOTCH_50 ? 50 : 60, fs);
+    }
+    if (_bandpass != BANDPASS_NONE)
+    {
+        addButterworth(bandpassEdges[_bandpass][0], fs, true);
+        addButterworth(bandpassEdges[_bandpass][1], fs, false);
+    }
+    reset();
+}
+
+/// @brief Forget the signal history, e.g. when the stream restarts
+void BiquadBank::reset(void)
+{
+    memset(_state, 0, sizeof(_state));
+}
+
+const char *BiquadBank::getName(NOTCH notch)
+{
+    switch (notch)
+    {
+    case NOTCH_50:
+        return "50Hz";
+    case NOTCH_60:
+        return "60Hz";
+    default:
+        return "none";
+    }
+}
+
+const char *BiquadBank::getName(BANDPASS bandpass)
+{
+    switch (bandpass)
+    {
+    case BANDPASS_1_50:
+        return "1-50Hz";
+    case BANDPASS_5_50:
+        return "5-50Hz";
+    case BANDPASS_3_45:
+        return "3-45Hz";
+    case BANDPASS_7_13:
+        return "7-13Hz";
+    case BANDPASS_15_50:
+        return "15-50Hz";
+    default:
+        return "none";
+    }
+}
+
+/// @brief One section over all channels:
+///        y = b0 x + b1 x1 + b2 x2 - a1 y1 - a2 y2, in Q2.30 * Q31. Samples stay
+///        under 2^30 and coefficients under 2, so the five products sum to
+///        less than 7 * 2^60 and the accumulator cannot wrap. The form is
+///        picked once per section, the channel loops have no branches but
+///        the saturation.
+/// @param x {int32_t *} - Section input, replaced by its output
+void BiquadBank::runSection(const Coefficients &c, State &state, int32_t *x, uint8_t first, uint8_t count)
+{
+    const int64_t b0 = c.b0, b1 = c.b1, b2 = c.b2, a1 = c.a1, a2 = c.a2;
+    const uint8_t bShift = c.bShift, aShift = c.aShift;
+    int32_t *x1 = state.x1 + first, *x2 = state.x2 + first;
+    int32_t *y1 = state.y1 + first, *y2 = state.y2 + first;
+    int32_t *error = state.error + first, *error2 = state.error2 + first;
+    int64_t acc[BIQUAD_CHANNELS];
+    if (aShift == 0)
+    {
+        for (uint8_t i = 0; i < count; i++)
+        {
+            acc[i] = ((b0 * x[i] + b1 * x1[i] + b2 * x2[i]) >> bShift) - a1 * y1[i] - a2 * y2[i] + error[i];
+        }
+    }
+    else
+    {
+        for (uint8_t i = 0; i < count; i++)
+        {
+            acc[i] = ((b0 * x[i] + b1 * x1[i] + b2 * x2[i]) >> bShift) + ((a1 * y1[i] + a2 * y2[i]) >> aShift) +
+                     ((2 * (int64_t)y1[i] - y2[i]) << BIQUAD_COEFF_SHIFT) + 2 * (int64_t)error[i] - error2[i];
+        }
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        int64_t y = acc[i] >> BIQUAD_COEFF_SHIFT;
+        error2[i] = error[i];
+        error[i] = (int32_t)(acc[i] - (y << BIQUAD_COEFF_SHIFT));
+        if (y >= BIQUAD_LIMIT || y < -BIQUAD_LIMIT)
+        {
+            y = y > 0 ? BIQUAD_LIMIT - 1 : -BIQUAD_LIMIT;
+            error[i] = error2[i] = 0;
+        }
+        x2[i] = x1[i];
+        x1[i] = x[i];
+        y2[i] = y1[i];
+        y1[i] = (int32_t)y;
+        x[i] = (int32_t)y;
+    }
+}
+
+static int32_t toFixed(double value, uint8_t shift)
+{
+    double scaled = floor(ldexp(value, BIQUAD_COEFF_SHIFT + shift) + 0.5);
+    if (scaled > 2147483647.0)
+    {
+        return 2147483647;
+    }
+    if (scaled < -2147483648.0)
+    {
+        return -2147483647 - 1;
+    }
+    return (int32_t)scaled;
+}
+
+static double largest(double a, double b, double c)
+{
+    double m = fabs(a) > fabs(b) ? fabs(a) : fabs(b);
+    return fabs(c) > m ? fabs(c) : m;
+}
+
+/// @brief Bits a set of coefficients no larger than `magnitude` can gain over Q2.30
+static uint8_t extraShift(double magnitude)
+{
+    uint8_t shift = 0;
+    while (shift < BIQUAD_MAX_EXTRA_SHIFT && ldexp(magnitude, shift + 1) < 1)
+    {
+        shift++;
+    }
+    return shift;
+}
+
+void BiquadBank::addSection(double b0, double b1, double b2, double a0, double a1, double a2)
+{
+    if (_sections >= BIQUAD_MAX_SECTIONS)
+    {
+        return;
+    }
+    Coefficients &c = _coeff[_sections++];
+    c.bShift = extraShift(largest(b0 / a0, b1 / a0, b2 / a0));
+    c.b0 = toFixed(b0 / a0, c.bShift);
+    c.b2 = toFixed(b2 / a0, c.bShift);
+    // round the DC gain, not b1: a high pass needs its zero at exactly z = 1,
+    // near DC its poles amplify any leak a million fold
+    c.b1 = toFixed((b0 + b1 + b2) / a0, c.bShift) - c.b0 - c.b2;
+    // poles near z = 1: a1 near -2 and a2 near 1, give the remainders the bits
+    const double d1 = -(a1 / a0 + 2), d2 = 1 - a2 / a0;
+    c.aShift = extraShift(largest(d1, d2, 0));
+    c.a1 = toFixed(c.aShift > 0 ? d1 : a1 / a0, c.aShift);
+    c.a2 = toFixed(c.aShift > 0 ? d2 : a2 / a0, c.aShift);
+}
+
+/// @brief RBJ cookbook notch, BIQUAD_NOTCH_Q wide
+void BiquadBank::addNotch(double f0, double fs)
+{
+    if (f0 >= fs / 2)
+    {
+        return;
+    }
+    const double w0 = 2 * BIQUAD_PI * f0 / fs;
+    const double alpha = sin(w0) / (2 * BIQUAD_NOTCH_Q);
+    addSection(1, -2 * cos(w0), 1, 1 + alpha, -2 * cos(w0), 1 - alpha);
+}
+
+/// @brief 4th order Butterworth as two RBJ sections with the pole pair Qs.
+///        A low pass at or above Nyquist is left out.
+void BiquadBank::addButterworth(double fc, double fs, bool highPass)
+{
+    static const double q[2] = {0.54119610014619698, 1.3065629648763766};
+    if (fc >= fs / 2)
+    {
+        return;
+    }
+    const double w0 = 2 * BIQUAD_PI * fc / fs;
+    const double cosw = cos(w0);
+    for (int i = 0; i < 2; i++)
+    {
+        const double alpha = sin(w0) / (2 * q[i]);
+        if (highPass)
+        {
+            addSection((1 + cosw) / 2, -(1 + cosw), (1 + cosw) / 2, 1 + alpha, -2 * cosw, 1 - alpha);
+        }
+        else
+        {
+            addSection((1 - cosw) / 2, 1 - cosw, (1 - cosw) / 2, 1 + alpha, -2 * cosw, 1 - alpha);
+        }
+    }
+}
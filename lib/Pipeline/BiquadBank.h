@@ -0,0 +1,104 @@
+#pragma once
+#include <stdint.h>
+
+#define BIQUAD_CHANNELS 16
+#define BIQUAD_MAX_SECTIONS 5   // notch + 4th order high pass + 4th order low pass
+#define BIQUAD_COEFF_SHIFT 30   // Q2.30, a1 reaches -2 for poles near DC
+#define BIQUAD_INPUT_SHIFT 6    // 24 bit counts -> Q31 with 2 bits of headroom
+#define BIQUAD_LIMIT (1L << 30) // section outputs saturate here, keeps the 64 bit sum from overflowing
+#define BIQUAD_NOTCH_Q 10.0     // 5 Hz wide at 50 Hz
+#define BIQUAD_MAX_EXTRA_SHIFT 24
+
+/// @brief Per channel cascade of biquads in fixed point: Q31 samples, Q2.30
+///        coefficients, 64 bit accumulation with error feedback (direct form I).
+///        All channels share one set of coefficients, designed in double when
+///        the filter or the sample rate changes, so a section is one pass over
+///        the channels with the five coefficients in registers.
+///        A 1 Hz high pass at 16 kHz puts its poles within 4e-4 of z = 1, where
+///        Q2.30 a1/a2 move them by percent; such sections keep the feedback as
+///        2 y1 - y2 plus small corrections that get up to 24 more bits, and feed
+///        the dropped fractions back the same way (2 e1 - e2) so rounding noise
+///        is not amplified by those poles. Small low pass numerators get the
+///        extra bits too.
+class BiquadBank
+{
+public:
+    enum NOTCH
+    {
+        NOTCH_NONE,
+        NOTCH_50,
+        NOTCH_60,
+        NOTCH_END
+    };
+    enum BANDPASS
+    {
+        BANDPASS_NONE,
+        BANDPASS_1_50,
+        BANDPASS_5_50,
+        BANDPASS_3_45,
+        BANDPASS_7_13,
+        BANDPASS_15_50,
+        BANDPASS_END
+    };
+
+    BiquadBank();
+
+    void configure(NOTCH notch, BANDPASS bandpass, uint32_t sampleRateHz);
+    void setSampleRate(uint32_t sampleRateHz) { configure(_notch, _bandpass, sampleRateHz); }
+    void reset(void);
+    bool isEnabled(void) const { return _sections > 0; }
+    NOTCH getNotch(void) const { return _notch; }
+    BANDPASS getBandpass(void) const { return _bandpass; }
+    uint8_t getSections(void) const { return _sections; }
+    static const char *getName(NOTCH notch);
+    static const char *getName(BANDPASS bandpass);
+
+    /// @brief Filter `count` channels starting at `first` in place
+    /// @param data {Int *} - Sign extended 24 bit values, int or int32_t;
+    ///                       the results are rounded and clamped to 24 bits
+    template <typename Int>
+    void process(Int *data, uint8_t first, uint8_t count)
+    {
+        int32_t x[BIQUAD_CHANNELS];
+        for (uint8_t i = 0; i < count; i++)
+        {
+            x[i] = (int32_t)data[i] << BIQUAD_INPUT_SHIFT;
+        }
+        for (uint8_t s = 0; s < _sections; s++)
+        {
+            runSection(_coeff[s], _state[s], x, first, count);
+        }
+        for (uint8_t i = 0; i < count; i++)
+        {
+            int32_t y = (x[i] + (1 << (BIQUAD_INPUT_SHIFT - 1))) >> BIQUAD_INPUT_SHIFT;
+            data[i] = y > 8388607 ? 8388607 : (y < -8388608 ? -8388608 : y);
+        }
+    }
+
+private:
+    struct Coefficients
+    {
+        int32_t b0, b1, b2; // a0 normalised to 1, Q(30 + bShift)
+        int32_t a1, a2;     // or, with an aShift, d1 = -(a1 + 2) and d2 = 1 - a2 in Q(30 + aShift)
+        uint8_t bShift;
+        uint8_t aShift;     // 0: plain a1, a2 in Q2.30
+    };
+    struct State // structure of arrays, the inner loop walks channels
+    {
+        int32_t x1[BIQUAD_CHANNELS], x2[BIQUAD_CHANNELS];
+        int32_t y1[BIQUAD_CHANNELS], y2[BIQUAD_CHANNELS];
+        int32_t error[BIQUAD_CHANNELS];  // fraction dropped by the last shift, fed back in
+        int32_t error2[BIQUAD_CHANNELS]; // and the one before, for sections with an aShift
+    };
+
+    static void runSection(const Coefficients &c, State &state, int32_t *x, uint8_t first, uint8_t count);
+    void addSection(double b0, double b1, double b2, double a0, double a1, double a2);
+    void addNotch(double f0, double fs);
+    void addButterworth(double fc, double fs, bool highPass);
+
+    NOTCH _notch;
+    BANDPASS _bandpass;
+    uint8_t _sections;
+    Coefficients _coeff[BIQUAD_MAX_SECTIONS];
+    State _state[BIQUAD_MAX_SECTIONS];
+};
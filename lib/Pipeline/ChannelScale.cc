@@ -0,0 +1,32 @@
+#include "ChannelScale.h"
+
+#define CHANNEL_SCALE_VREF_NANOVOLTS 4500000000ULL // 4.5 V reference
+#define CHANNEL_SCALE_FULL_SCALE 8388607ULL        // 2^23 - 1
+
+ChannelScale::ChannelScale()
+{
+    for (uint8_t i = 0; i < CHANNEL_SCALE_CHANNELS; i++)
+    {
+        _scale[i] = scaleForGain(24); // ADS1299 power on default
+    }
+}
+
+/// @brief Rebuild the factor for one channel
+/// @param channel {uint8_t} - 0 based, board channels first then daisy
+/// @param gain    {uint8_t} - PGA gain: 1, 2, 4, 6, 8, 12 or 24
+void ChannelScale::setGain(uint8_t channel, uint8_t gain)
+{
+    if (channel < CHANNEL_SCALE_CHANNELS)
+    {
+        _scale[channel] = scaleForGain(gain);
+    }
+}
+
+/// @brief Nanovolts per count for a gain, Q21 rounded to nearest
+/// @param gain {uint8_t} - PGA gain, 0 is treated as 1
+/// @return {int32_t} - Factor for `toNanovolts()`
+int32_t ChannelScale::scaleForGain(uint8_t gain)
+{
+    const uint64_t divisor = CHANNEL_SCALE_FULL_SCALE * (gain > 0 ? gain : 1);
+    return (int32_t)(((CHANNEL_SCALE_VREF_NANOVOLTS << CHANNEL_SCALE_SHIFT) + divisor / 2) / divisor);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+
+#define CHANNEL_SCALE_CHANNELS 16
+#define CHANNEL_SCALE_SHIFT 21 // Q21 keeps gain 1 (536 nV per count) inside an int32_t
+
+/// @brief Per channel ADS1299 count -> nanovolt factors, rebuilt only when a
+///        gain changes. Converting a frame is then one 32x32->64 multiply and
+///        a shift per channel, no double math and no switch on the gain.
+class ChannelScale
+{
+public:
+    ChannelScale();
+
+    void setGain(uint8_t channel, uint8_t gain);
+    int32_t getScale(uint8_t channel) const { return _scale[channel]; }
+    static int32_t scaleForGain(uint8_t gain);
+
+    /// @brief Convert `count` channels starting at `first`
+    /// @param raw       {const Int *} - Sign extended 24 bit values, int or int32_t
+    /// @param nanovolts {int64_t *} - Receives the rounded results
+    template <typename Int>
+    void toNanovolts(const Int *raw, int64_t *nanovolts, uint8_t first, uint8_t count) const
+    {
+        const int32_t *scale = _scale + first;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            nanovolts[i] = ((int64_t)raw[i] * scale[i] + (1 << (CHANNEL_SCALE_SHIFT - 1))) >> CHANNEL_SCALE_SHIFT;
+        }
+    }
+
+private:
+    int32_t _scale[CHANNEL_SCALE_CHANNELS];
+};
@@ -0,0 +1,230 @@
+#include <math.h>
+#include <string.h>
+#include "Decimator.h"
+
+#define DECIMATOR_PI 3.14159265358979323846
+#define DECIMATOR_STOPBAND_WEIGHT 100.0 // against 1 for the passband
+#define DECIMATOR_DESIGN_POINTS 4096
+
+Decimator::Decimator()
+{
+    setFactor(1);
+}
+
+/// @brief Choose the rate reduction and redesign the compensator
+/// @param factor {uint8_t} - 1 (off) or a power of two up to DECIMATOR_MAX_FACTOR
+/// @return {bool} - `false` if the factor is not supported, nothing changed
+bool Decimator::setFactor(uint8_t factor)
+{
+    if (factor == 0 || factor > DECIMATOR_MAX_FACTOR || (factor & (factor - 1)) != 0)
+    {
+        return false;
+    }
+    _factor = factor;
+    _cicFactor = factor > 1 ? factor / 2 : 1;
+    _cicShift = 0;
+    for (uint8_t r = _cicFactor; r > 1; r >>= 1)
+    {
+        _cicShift += DECIMATOR_CIC_ORDER;
+    }
+    design();
+    reset();
+    return true;
+}
+
+/// @brief Forget the signal history, e.g. when the stream restarts
+void Decimator::reset(void)
+{
+    _cicPhase = _firPhase = _historyNext = 0;
+    memset(_integrator, 0, sizeof(_integrator));
+    memset(_comb, 0, sizeof(_comb));
+    memset(_history, 0, sizeof(_history));
+}
+
+/// @brief Take one sample of every channel
+/// @param data  {int32_t *} - Sign extended 24 bit values, replaced by the
+///                            decimated sample when there is one
+/// @param count {uint8_t} - Channels, the same on every call
+/// @return {bool} - `true` if `data` now holds an output sample
+bool Decimator::process(int32_t *data, uint8_t count)
+{
+    if (_factor == 1)
+    {
+        return true;
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint64_t v = (uint64_t)(int64_t)data[i];
+        for (uint8_t k = 0; k < DECIMATOR_CIC_ORDER; k++)
+        {
+            _integrator[k][i] += v;
+            v = _integrator[k][i];
+        }
+    }
+    if (++_cicPhase < _cicFactor)
+    {
+        return false;
+    }
+    _cicPhase = 0;
+
+    int32_t *newest = _history[_historyNext];
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint64_t v = _integrator[DECIMATOR_CIC_ORDER - 1][i];
+        for (uint8_t k = 0; k < DECIMATOR_CIC_ORDER; k++)
+        {
+            uint64_t delayed = _comb[k][i];
+            _comb[k][i] = v;
+            v -= delayed;
+        }
+        newest[i] = (int32_t)((int64_t)v >> _cicShift); // R^order is a power of two, exact
+    }
+    const uint8_t last = _historyNext;
+    _historyNext = (_historyNext + 1) % DECIMATOR_TAPS;
+    if (++_firPhase < 2)
+    {
+        return false;
+    }
+    _firPhase = 0;
+
+    // symmetric taps: fold the ring around its middle, one multiply per pair
+    int64_t acc[DECIMATOR_CHANNELS];
+    const uint8_t middle = DECIMATOR_TAPS / 2;
+    const int32_t *centre = _history[(last + DECIMATOR_TAPS - middle) % DECIMATOR_TAPS];
+    for (uint8_t i = 0; i < count; i++)
+    {
+        acc[i] = (int64_t)_taps[middle] * centre[i];
+    }
+    for (uint8_t k = 0; k < middle; k++)
+    {
+        const int64_t tap = _taps[k];
+        const int32_t *a = _history[(last + DECIMATOR_TAPS - k) % DECIMATOR_TAPS];
+        const int32_t *b = _history[(last + 1 + k) % DECIMATOR_TAPS]; // the oldest, mirrored
+        for (uint8_t i = 0; i < count; i++)
+        {
+            acc[i] += tap * ((int64_t)a[i] + b[i]);
+        }
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        int64_t y = (acc[i] + (1LL << (DECIMATOR_COEFF_SHIFT - 1))) >> DECIMATOR_COEFF_SHIFT;
+        data[i] = y > 8388607 ? 8388607 : (y < -8388608 ? -8388608 : (int32_t)y);
+    }
+    return true;
+}
+
+/// @brief How far an output lags the input that completed it
+/// @return {uint32_t} - Input samples, both stages are linear phase
+uint32_t Decimator::getDelay(void) const
+{
+    if (_factor == 1)
+    {
+        return 0;
+    }
+    return DECIMATOR_CIC_ORDER * (_cicFactor - 1) / 2 + (DECIMATOR_TAPS - 1) / 2 * _cicFactor;
+}
+
+/// @brief CIC magnitude at `f` cycles per CIC output sample, 1 at DC
+static double cicGain(double f, uint8_t r)
+{
+    if (f == 0 || r == 1)
+    {
+        return 1;
+    }
+    return pow(fabs(sin(DECIMATOR_PI * f) / (r * sin(DECIMATOR_PI * f / r))), DECIMATOR_CIC_ORDER);
+}
+
+/// @brief Weighted least squares compensator: 1 / CIC gain over the passband,
+///        0 over the stopband, the transition left free. A symmetric FIR is
+///        a cosine series, so that is a (DECIMATOR_TAPS / 2 + 1) square
+///        system. Runs when the factor changes, double is fine there.
+void Decimator::design(void)
+{
+    const int terms = DECIMATOR_TAPS / 2 + 1;
+    const double passband = DECIMATOR_PASSBAND / 2; // the FIR runs at twice the output rate
+    const double stopband = DECIMATOR_STOPBAND / 2;
+    double q[terms][terms + 1]; // normal equations, right hand side in the last column
+    memset(q, 0, sizeof(q));
+    for (int p = 0; p < DECIMATOR_DESIGN_POINTS; p++)
+    {
+        double f = (p + 0.5) / (2.0 * DECIMATOR_DESIGN_POINTS);
+        double weight, target;
+        if (f <= passband)
+        {
+            weight = 1;
+            target = 1 / cicGain(f, _cicFactor);
+        }
+        else if (f >= stopband)
+        {
+            weight = DECIMATOR_STOPBAND_WEIGHT;
+            target = 0;
+        }
+        else
+        {
+            continue;
+        }
+        double basis[terms];
+        for (int k = 0; k < terms; k++)
+        {
+            basis[k] = cos(2 * DECIMATOR_PI * f * k);
+        }
+        for (int i = 0; i < terms; i++)
+        {
+            for (int j = 0; j < terms; j++)
+            {
+                q[i][j] += weight * basis[i] * basis[j];
+            }
+            q[i][terms] += weight * target * basis[i];
+        }
+    }
+    // Gaussian elimination with partial pivoting
+    for (int c = 0; c < terms; c++)
+    {
+        int pivot = c;
+        for (int r = c + 1; r < terms; r++)
+        {
+            if (fabs(q[r][c]) > fabs(q[pivot][c]))
+            {
+                pivot = r;
+            }
+        }
+        for (int k = 0; k <= terms; k++)
+        {
+            double t = q[c][k];
+            q[c][k] = q[pivot][k];
+            q[pivot][k] = t;
+        }
+        for (int r = 0; r < terms; r++)
+        {
+            if (r != c)
+            {
+                double factor = q[r][c] / q[c][c];
+                for (int k = c; k <= terms; k++)
+                {
+                    q[r][k] -= factor * q[c][k];
+                }
+            }
+        }
+    }
+    // H(f) = a0 + sum a_k cos(2 pi f k): the centre tap is a0, the others a_k / 2
+    const int middle = DECIMATOR_TAPS / 2;
+    double taps[DECIMATOR_TAPS];
+    double dc = 0;
+    for (int k = 0; k < terms; k++)
+    {
+        double a = q[k][terms] / q[k][k];
+        taps[middle + k] = taps[middle - k] = k == 0 ? a : a / 2;
+    }
+    for (int n = 0; n < DECIMATOR_TAPS; n++)
+    {
+        dc += taps[n];
+    }
+    // quantize, then put the rounding into the centre tap so DC passes exactly
+    int64_t total = 0;
+    for (int n = 0; n < DECIMATOR_TAPS; n++)
+    {
+        _taps[n] = (int32_t)floor(taps[n] / dc * (1L << DECIMATOR_COEFF_SHIFT) + 0.5);
+        total += _taps[n];
+    }
+    _taps[middle] += (int32_t)((1LL << DECIMATOR_COEFF_SHIFT) - total);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+
+#define DECIMATOR_CHANNELS 16
+#define DECIMATOR_MAX_FACTOR 64   // 16 kHz ADS data down to 250 Hz
+#define DECIMATOR_CIC_ORDER 4
+#define DECIMATOR_TAPS 47         // compensator, odd so its delay is whole samples
+#define DECIMATOR_COEFF_SHIFT 30
+#define DECIMATOR_PASSBAND 0.4    // of the output rate, flat to within the compensator ripple
+#define DECIMATOR_STOPBAND 0.6    // of the output rate, from here on aliases into the passband are cut
+
+/// @brief Integer rate reduction for all channels: a CIC filter decimates by
+///        factor / 2 with adds only, then an FIR that undoes the CIC droop
+///        decimates by the last 2 (polyphase, only the kept outputs are
+///        computed). Lets the ADS run at a high rate for its lower noise while
+///        the stream goes out at a rate the link carries.
+class Decimator
+{
+public:
+    Decimator();
+
+    bool setFactor(uint8_t factor);
+    uint8_t getFactor(void) const { return _factor; }
+    void reset(void);
+    bool process(int32_t *data, uint8_t count);
+    uint32_t getDelay(void) const;
+
+private:
+    void design(void);
+
+    uint8_t _factor;
+    uint8_t _cicFactor;   // R, factor / 2
+    uint8_t _cicShift;    // log2(R^order), the CIC gain
+    uint8_t _cicPhase;    // inputs since the last CIC output
+    uint8_t _firPhase;    // CIC outputs since the last FIR output
+    uint8_t _historyNext; // ring position of the next CIC output
+    int32_t _taps[DECIMATOR_TAPS];
+    // unsigned: the integrators are meant to wrap, the combs undo it
+    uint64_t _integrator[DECIMATOR_CIC_ORDER][DECIMATOR_CHANNELS];
+    uint64_t _comb[DECIMATOR_CIC_ORDER][DECIMATOR_CHANNELS];
+    int32_t _history[DECIMATOR_TAPS][DECIMATOR_CHANNELS];
+};
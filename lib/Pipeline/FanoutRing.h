@@ -0,0 +1,198 @@
+#pragma once
+#include <stdint.h>
+
+/// @brief One producer, several readers, each with its own cursor. The
+///        producer never waits: it overwrites the oldest slot, and a reader
+///        that fell too far behind loses packets the way its policy says on
+///        its next `peek()`. A stalled reader therefore costs only itself.
+///        Indices run freely and are masked on access, so `N` must be a
+///        power of two.
+///
+///        Unlike SpscRing there is no synchronisation: the producer and the
+///        readers must run on the same task, e.g. `loop()` serializing packets
+///        and handing them to its sockets.
+template <typename T, uint32_t N, uint8_t READERS>
+class FanoutRing
+{
+    static_assert(N > 1 && (N & (N - 1)) == 0, "FanoutRing size must be a power of two");
+
+public:
+    enum POLICY
+    {
+        POLICY_DROP_OLDEST, // keep the newest `limit` items, e.g. a recorder
+        POLICY_LATEST       // drop the whole backlog, e.g. a live viewer
+    };
+
+    FanoutRing() : _head(0)
+    {
+        closeAll();
+    }
+
+    /// @brief Add a reader, it sees what is committed from now on
+    /// @param policy {POLICY} - What to drop once it lags more than `limit`
+    /// @param limit  {uint32_t} - Most items it may lag, capped at N - 1 so
+    ///                            the slot being filled is never readable
+    /// @return {int8_t} - Reader id, -1 if all READERS are taken
+    int8_t open(POLICY policy, uint32_t limit = N - 1)
+    {
+        for (uint8_t i = 0; i < READERS; i++)
+        {
+            Reader &reader = _readers[i];
+            if (!reader.open)
+            {
+                reader.open = true;
+                reader.policy = policy;
+                reader.limit = limit == 0 || limit > N - 1 ? N - 1 : limit;
+                reader.tail = _head;
+                reader.dropped = 0;
+                return (int8_t)i;
+            }
+        }
+        return -1;
+    }
+
+    void close(int8_t id)
+    {
+        if (id >= 0 && id < READERS)
+        {
+            _readers[id].open = false;
+        }
+    }
+
+    /// @brief Closes every reader, e.g. on a reset
+    void closeAll(void)
+    {
+        for (uint8_t i = 0; i < READERS; i++)
+        {
+            _readers[i].open = false;
+        }
+    }
+
+    bool isOpen(int8_t id) const
+    {
+        return id >= 0 && id < READERS && _readers[id].open;
+    }
+
+    uint8_t getReaders(void) const
+    {
+        uint8_t count = 0;
+        for (uint8_t i = 0; i < READERS; i++)
+        {
+            count += _readers[i].open ? 1 : 0;
+        }
+        return count;
+    }
+
+    /// @brief Producer side. Never refuses, the slots may still hold items a
+    ///        lagging reader has not read; those are gone once committed.
+    /// @param count {uint32_t &} - In: most slots wanted. Out: slots granted,
+    ///                             cut short at the end of the array or at N - 1
+    /// @return {T *} - First slot, filled in place and published by `commit()`
+    T *claim(uint32_t &count)
+    {
+        count = clamp(count, N - 1, _head);
+        return &_items[_head & (N - 1)];
+    }
+
+    /// @brief Producer side. Publishes `count` slots from the last `claim()`.
+    void commit(uint32_t count)
+    {
+        _head += count;
+    }
+
+    /// @brief Apply the reader's policy if it lags more than its limit
+    /// @return {uint32_t} - Items it lost just now
+    uint32_t catchUp(int8_t id)
+    {
+        Reader &reader = _readers[id];
+        const uint32_t lag = _head - reader.tail;
+        if (lag <= reader.limit)
+        {
+            return 0;
+        }
+        const uint32_t lost = reader.policy == POLICY_LATEST ? lag : lag - reader.limit;
+        reader.tail += lost;
+        reader.dropped += lost;
+        return lost;
+    }
+
+    /// @brief Reader side. Its oldest items that sit back to back in memory,
+    ///        after `catchUp()`.
+    /// @param count {uint32_t &} - In: most items wanted. Out: items available,
+    ///                             0 when it is up to date, cut short at the end of the array
+    /// @return {const T *} - Oldest item, valid until the producer's next `claim()`
+    const T *peek(int8_t id, uint32_t &count)
+    {
+        catchUp(id);
+        const uint32_t tail = _readers[id].tail;
+        count = clamp(count, _head - tail, tail);
+        return &_items[tail & (N - 1)];
+    }
+
+    /// @brief Reader side. Releases `count` items from the last `peek()`.
+    void consume(int8_t id, uint32_t count)
+    {
+        _readers[id].tail += count;
+    }
+
+    /// @brief Items the reader has yet to read, before its policy is applied
+    uint32_t size(int8_t id) const
+    {
+        return _head - _readers[id].tail;
+    }
+
+    POLICY getPolicy(int8_t id) const
+    {
+        return _readers[id].policy;
+    }
+
+    uint32_t getLimit(int8_t id) const
+    {
+        return _readers[id].limit;
+    }
+
+    /// @brief Items the reader lost since `open()`
+    uint32_t getDropped(int8_t id) const
+    {
+        return _readers[id].dropped;
+    }
+
+    /// @brief Drops everything queued so far, for every reader
+    void clear(void)
+    {
+        for (uint8_t i = 0; i < READERS; i++)
+        {
+            _readers[i].tail = _head;
+        }
+    }
+
+    static uint32_t capacity(void)
+    {
+        return N;
+    }
+
+private:
+    struct Reader
+    {
+        bool open;
+        POLICY policy;
+        uint32_t limit;
+        uint32_t tail;
+        uint32_t dropped;
+    };
+
+    /// @brief Limit a request to what is available and to the end of the array
+    static uint32_t clamp(uint32_t wanted, uint32_t available, uint32_t index)
+    {
+        uint32_t contiguous = N - (index & (N - 1));
+        if (wanted > available)
+        {
+            wanted = available;
+        }
+        return wanted > contiguous ? contiguous : wanted;
+    }
+
+    T _items[N];
+    uint32_t _head;
+    Reader _readers[READERS];
+};
@@ -0,0 +1,144 @@
+#include <math.h>
+#include <string.h>
+#include "ImpedanceMonitor.h"
+
+#define IMPEDANCE_PI 3.14159265358979323846
+#define IMPEDANCE_MODULATOR_HZ 1024000.0 // fMOD, fCLK / 2
+
+ImpedanceMonitor::ImpedanceMonitor()
+    : _toneHz(0), _driveAmps(0), _sampleRate(0), _blockSamples(0), _mask(0), _filterGain(1)
+{
+    memset(_amplitude, 0, sizeof(_amplitude));
+    memset(_flags, 0, sizeof(_flags));
+    reset();
+}
+
+/// @brief Set the excitation and the rate the samples arrive at
+/// @param toneHz       {float} - Lead-off frequency, e.g. 31.25 for LOFF_FREQ_31p2HZ
+/// @param sampleRateHz {uint32_t} - ADS data rate
+/// @param driveAmps    {float} - Lead-off current magnitude, e.g. 6e-9 for LOFF_MAG_6NA
+/// @return {bool} - `false` if the tone is not below a quarter of the rate
+///                  (DC lead-off, or fDR / 4 inside the ADS's own filter roll-off);
+///                  only the lead-off flags are collected then
+bool ImpedanceMonitor::configure(float toneHz, uint32_t sampleRateHz, float driveAmps)
+{
+    _toneHz = toneHz;
+    _driveAmps = driveAmps;
+    _sampleRate = sampleRateHz;
+    _blockSamples = 0;
+    reset();
+    if (toneHz <= 0 || sampleRateHz == 0 || driveAmps <= 0 || 4 * toneHz >= sampleRateHz)
+    {
+        return false;
+    }
+    // whole periods, so the offset and the tone's harmonics fall between bins
+    const double period = sampleRateHz / (double)toneHz;
+    double periods = floor(sampleRateHz * IMPEDANCE_BLOCK_MS / 1000.0 / period);
+    periods = periods < 2 ? 2 : periods;
+    _blockSamples = (uint32_t)floor(periods * period + 0.5);
+    const double w = 2 * IMPEDANCE_PI * toneHz / sampleRateHz;
+    _toneStepRe = (float)cos(w);
+    _toneStepIm = (float)-sin(w);
+    _hannStepRe = (float)cos(2 * IMPEDANCE_PI / _blockSamples);
+    _hannStepIm = (float)sin(2 * IMPEDANCE_PI / _blockSamples);
+    _weightSum = _blockSamples / 2.0f;
+    // the ADS's sinc^3 decimation filter: 0.93 at fDR / 8, 7.5% of the tone
+    // lost at 250 SPS that would otherwise read as lower impedance
+    const double decimation = IMPEDANCE_MODULATOR_HZ / sampleRateHz;
+    const double x = IMPEDANCE_PI * toneHz / IMPEDANCE_MODULATOR_HZ;
+    _filterGain = (float)pow(sin(decimation * x) / (decimation * sin(x)), 3);
+    return true;
+}
+
+/// @brief Choose the channels the lead-off current drives
+/// @param mask {uint16_t} - Bit n for channel n, board then daisy
+void ImpedanceMonitor::setChannels(uint16_t mask)
+{
+    if (mask != _mask)
+    {
+        _mask = mask;
+        reset();
+    }
+}
+
+/// @brief Start a new block, the last estimates stay readable
+void ImpedanceMonitor::reset(void)
+{
+    _position = 0;
+    _seenP = _seenN = 0;
+    _toneRe = _hannRe = 1;
+    _toneIm = _hannIm = 0;
+    memset(_re, 0, sizeof(_re));
+    memset(_im, 0, sizeof(_im));
+}
+
+/// @brief Take one sample of every channel
+/// @param data     {const int32_t *} - Sign extended 24 bit values
+/// @param count    {uint8_t} - Channels
+/// @param leadOffP {uint16_t} - LOFF_STATP of the sample, board in the low byte
+/// @param leadOffN {uint16_t} - LOFF_STATN of the sample, board in the low byte
+/// @return {bool} - `true` if a block completed, `getOhms()` and `getFlags()` are new
+bool ImpedanceMonitor::add(const int32_t *data, uint8_t count, uint16_t leadOffP, uint16_t leadOffN)
+{
+    if (count > IMPEDANCE_CHANNELS)
+    {
+        count = IMPEDANCE_CHANNELS;
+    }
+    _seenP |= leadOffP;
+    _seenN |= leadOffN;
+    if (_blockSamples > 0 && _mask != 0)
+    {
+        if (_position == 0)
+        {
+            memcpy(_reference, data, count * sizeof(int32_t));
+        }
+        const float weight = 0.5f - 0.5f * _hannRe;
+        const float wr = weight * _toneRe, wi = weight * _toneIm;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            const float x = (float)(data[i] - _reference[i]);
+            _re[i] += wr * x;
+            _im[i] += wi * x;
+        }
+        // rotate both phasors, and pull them back onto the unit circle
+        float re = _toneRe * _toneStepRe - _toneIm * _toneStepIm;
+        float im = _toneRe * _toneStepIm + _toneIm * _toneStepRe;
+        float fix = 1.5f - 0.5f * (re * re + im * im);
+        _toneRe = re * fix;
+        _toneIm = im * fix;
+        re = _hannRe * _hannStepRe - _hannIm * _hannStepIm;
+        im = _hannRe * _hannStepIm + _hannIm * _hannStepRe;
+        fix = 1.5f - 0.5f * (re * re + im * im);
+        _hannRe = re * fix;
+        _hannIm = im * fix;
+    }
+    // without a tone the flags still come in blocks of IMPEDANCE_BLOCK_MS
+    if (++_position < (_blockSamples > 0 ? _blockSamples : _sampleRate * IMPEDANCE_BLOCK_MS / 1000 + 1))
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < IMPEDANCE_CHANNELS; i++)
+    {
+        const bool measured = _blockSamples > 0 && i < count && (_mask >> i) & 1;
+        _amplitude[i] = measured ? 2 * sqrtf(_re[i] * _re[i] + _im[i] * _im[i]) / _weightSum : 0;
+        _flags[i] = ((_seenP >> i) & 1 ? IMPEDANCE_FLAG_P_OFF : 0) | ((_seenN >> i) & 1 ? IMPEDANCE_FLAG_N_OFF : 0) |
+                    (measured ? IMPEDANCE_FLAG_MEASURED : 0);
+    }
+    reset();
+    return true;
+}
+
+/// @brief Electrode impedance from the last block
+/// @param channel           {uint8_t} - Board then daisy
+/// @param nanovoltsPerCount {float} - Channel scale at its current gain
+/// @return {float} - Ohms without the series resistor, 0 if not measured
+float ImpedanceMonitor::getOhms(uint8_t channel, float nanovoltsPerCount) const
+{
+    if (!(_flags[channel] & IMPEDANCE_FLAG_MEASURED))
+    {
+        return 0;
+    }
+    const float volts = _amplitude[channel] * nanovoltsPerCount * 1e-9f;
+    const float ohms = volts / (4 / (float)IMPEDANCE_PI * _driveAmps * _filterGain) - IMPEDANCE_SERIES_OHMS;
+    return ohms > 0 ? ohms : 0;
+}
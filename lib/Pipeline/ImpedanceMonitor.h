@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+
+#define IMPEDANCE_CHANNELS 16
+#define IMPEDANCE_BLOCK_MS 500      // one estimate per block, whole tone periods
+#define IMPEDANCE_SERIES_OHMS 2200  // Cyton input resistors, in series with every electrode
+#define IMPEDANCE_FLAG_P_OFF 0x01   // LOFF_STATP was set during the block
+#define IMPEDANCE_FLAG_N_OFF 0x02   // LOFF_STATN was set during the block
+#define IMPEDANCE_FLAG_MEASURED 0x04 // the channel was driven, getOhms() holds an estimate
+
+/// @brief Electrode impedance from the ADS1299 AC lead-off excitation while
+///        the stream runs. The lead-off current is a +-I square wave at a
+///        fixed tone; each driven channel sees it as I * Z, and the tone's
+///        fundamental (4 / pi of the square) is measured per channel with a
+///        single DFT bin over a Hann weighted block, which ignores the
+///        electrode offset, the EEG and mains. The bin is correlated directly
+///        against a phasor shared by all channels instead of Goertzel's
+///        recursion: at 31.25 Hz in 16 kHz data that recursion has a pole gain
+///        near 6600 and single precision would drown the tone.
+///        The lead-off comparator flags are ORed over the same block.
+class ImpedanceMonitor
+{
+public:
+    ImpedanceMonitor();
+
+    bool configure(float toneHz, uint32_t sampleRateHz, float driveAmps);
+    void setSampleRate(uint32_t sampleRateHz) { configure(_toneHz, sampleRateHz, _driveAmps); }
+    void setChannels(uint16_t mask);
+    void reset(void);
+    bool add(const int32_t *data, uint8_t count, uint16_t leadOffP, uint16_t leadOffN);
+    bool isEnabled(void) const { return _mask != 0 && _blockSamples > 0; }
+    uint16_t getChannels(void) const { return _mask; }
+    uint32_t getBlockSamples(void) const { return _blockSamples; }
+    float getToneHz(void) const { return _toneHz; }
+    /// @brief Tone amplitude of the last block, in counts
+    float getAmplitude(uint8_t channel) const { return _amplitude[channel]; }
+    float getOhms(uint8_t channel, float nanovoltsPerCount) const;
+    uint8_t getFlags(uint8_t channel) const { return _flags[channel]; }
+
+private:
+    float _toneHz;
+    float _driveAmps;
+    uint32_t _sampleRate;
+    uint32_t _blockSamples; // 0: the tone does not fit the rate, nothing is measured
+    uint32_t _position;     // samples into the current block
+    uint16_t _mask;         // driven channels
+    uint16_t _seenP, _seenN;
+    float _weightSum;
+    float _filterGain; // ADS decimation filter at the tone
+    // phasor e^(-i w n) and the Hann phasor, advanced once per sample for all channels
+    float _toneRe, _toneIm, _toneStepRe, _toneStepIm;
+    float _hannRe, _hannIm, _hannStepRe, _hannStepIm;
+    int32_t _reference[IMPEDANCE_CHANNELS]; // first sample of the block, keeps the sums small
+    float _re[IMPEDANCE_CHANNELS];
+    float _im[IMPEDANCE_CHANNELS];
+    float _amplitude[IMPEDANCE_CHANNELS];
+    uint8_t _flags[IMPEDANCE_CHANNELS];
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SIGN_EXTEND_24_FRAME 8 // channels in one ADS1299 frame
+
+// Where an unaligned 32 bit load and a byte swap are one instruction each,
+// four values come out of three word loads. The Xtensa cores have neither:
+// the 128 bit PIE loads of the S3 want 16 byte alignment the 3 byte status
+// word in front of the channels never gives, and the vector unit has no
+// 24 bit lane unpack, so there the byte path is already the shortest.
+#if (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SIGN_EXTEND_24_WORDS
+#endif
+
+/// @brief 24 bit big endian two's complement, as the ADS1299 frames and the
+///        OpenBCI packets carry it, to 32 bit integers. Branch free: the three
+///        bytes go to the top of a word and an arithmetic shift brings the
+///        sign bit down.
+class SignExtend24
+{
+public:
+    /// @brief The channel data of one ADS1299 frame
+    /// @param in  {const uint8_t *} - 24 bytes, no alignment needed
+    /// @param out {Int *} - Receives 8 values, int or int32_t
+    template <typename Int>
+    static void frame(const uint8_t *in, Int *out)
+    {
+        convert(in, out, SIGN_EXTEND_24_FRAME);
+    }
+
+    /// @brief Convert `count` values with the fastest path for the target
+    template <typename Int>
+    static void convert(const uint8_t *in, Int *out, size_t count)
+    {
+#ifdef SIGN_EXTEND_24_WORDS
+        convertWords(in, out, count);
+#else
+        convertBytes(in, out, count);
+#endif
+    }
+
+    /// @brief Portable path, three byte loads per value
+    template <typename Int>
+    static void convertBytes(const uint8_t *in, Int *out, size_t count)
+    {
+        for (size_t i = 0; i < count; i++, in += 3)
+        {
+            out[i] = (int32_t)(((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8)) >> 8;
+        }
+    }
+
+    /// @brief Four values from three big endian words, the rest bytewise.
+    ///        Only a gain where SIGN_EXTEND_24_WORDS is defined.
+    template <typename Int>
+    static void convertWords(const uint8_t *in, Int *out, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4, in += 12)
+        {
+            const uint32_t a = loadBigEndian(in), b = loadBigEndian(in + 4), c = loadBigEndian(in + 8);
+            out[i] = (int32_t)a >> 8;
+            out[i + 1] = (int32_t)((a << 24) | (b >> 8)) >> 8;
+            out[i + 2] = (int32_t)((b << 16) | (c >> 16)) >> 8;
+            out[i + 3] = (int32_t)(c << 8) >> 8;
+        }
+        convertBytes(in, out + i, count - i);
+    }
+
+private:
+    static uint32_t loadBigEndian(const uint8_t *p)
+    {
+        uint32_t word;
+        memcpy(&word, p, sizeof(word)); // one unaligned load where the target has it
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return __builtin_bswap32(word);
+#else
+        return word;
+#endif
+    }
+};
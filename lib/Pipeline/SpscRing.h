@@ -0,0 +1,155 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+#ifndef SPSC_CACHE_LINE
+#define SPSC_CACHE_LINE 64 // ESP32-S3 data cache lines are 32 or 64 bytes, 64 covers both
+#endif
+
+/// @brief Lock-free ring for exactly one producer and one consumer, e.g. an
+///        ISR-woken task handing frames to `loop()`. Indices run freely and are
+///        masked on access, so `N` must be a power of two.
+///
+///        Each side owns one cache line holding its index and its last view
+///        of the other side's index, so the two never write the same line and
+///        only re-read the other index when the cached one says full/empty.
+///
+///        `push()`/`pop()` copy single items. `claim()`/`commit()` and
+///        `peek()`/`consume()` hand out runs of slots to fill or drain in place.
+///
+///        Before C++17 `new` ignores the cache line alignment, so keep rings,
+///        and objects holding one such as ADS1299, static or on the stack.
+template <typename T, uint32_t N>
+class SpscRing
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    SpscRing() : _head(0), _tailCache(0), _tail(0), _headCache(0) {}
+
+    /// @brief Producer side. Copies `item` in, fails without blocking when full.
+    /// @return {bool} - `true` if the item was queued
+    bool push(const T &item)
+    {
+        uint32_t count = 1;
+        T *slot = claim(count);
+        if (count == 0)
+        {
+            return false;
+        }
+        *slot = item;
+        commit(1);
+        return true;
+    }
+
+    /// @brief Consumer side. Copies the oldest item out.
+    /// @return {bool} - `true` if an item was available
+    bool pop(T &item)
+    {
+        uint32_t count = 1;
+        const T *slot = peek(count);
+        if (count == 0)
+        {
+            return false;
+        }
+        item = *slot;
+        consume(1);
+        return true;
+    }
+
+    /// @brief Producer side. Free slots that sit back to back in memory.
+    /// @param count {uint32_t &} - In: most slots wanted. Out: slots granted,
+    ///                             0 when full, cut short at the end of the array
+    /// @return {T *} - First slot, filled in place and published by `commit()`
+    T *claim(uint32_t &count)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t free = N - (head - _tailCache);
+        if (free < count || free > N) // free > N: cache fell behind a commit() without claim()
+        {
+            _tailCache = _tail.load(std::memory_order_acquire);
+            free = N - (head - _tailCache);
+        }
+        count = clamp(count, free, head);
+        return &_items[head & (N - 1)];
+    }
+
+    /// @brief Producer side. Publishes `count` slots from the last `claim()`.
+    void commit(uint32_t count)
+    {
+        _head.store(_head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    /// @brief Consumer side. The oldest items that sit back to back in memory.
+    /// @param count {uint32_t &} - In: most items wanted. Out: items available,
+    ///                             0 when empty, cut short at the end of the array
+    /// @return {const T *} - Oldest item, valid until `consume()`
+    const T *peek(uint32_t &count)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t used = _headCache - tail;
+        if (used < count || used > N) // used > N: cache fell behind a consume() without peek()
+        {
+            _headCache = _head.load(std::memory_order_acquire);
+            used = _headCache - tail;
+        }
+        count = clamp(count, used, tail);
+        return &_items[tail & (N - 1)];
+    }
+
+    /// @brief Consumer side. Releases `count` items from the last `peek()`.
+    void consume(uint32_t count)
+    {
+        _tail.store(_tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    /// @brief Consumer side. Drops everything queued so far.
+    void clear(void)
+    {
+        _headCache = _head.load(std::memory_order_acquire);
+        _tail.store(_headCache, std::memory_order_release);
+    }
+
+    uint32_t size(void) const
+    {
+        uint32_t tail = _tail.load(std::memory_order_acquire);
+        return _head.load(std::memory_order_acquire) - tail;
+    }
+
+    bool empty(void) const
+    {
+        return size() == 0;
+    }
+
+    bool full(void) const
+    {
+        return size() >= N;
+    }
+
+    static uint32_t capacity(void)
+    {
+        return N;
+    }
+
+private:
+    /// @brief Limit a request to what is available and to the end of the array
+    static uint32_t clamp(uint32_t wanted, uint32_t available, uint32_t index)
+    {
+        uint32_t contiguous = N - (index & (N - 1));
+        if (wanted > available)
+        {
+            wanted = available;
+        }
+        return wanted > contiguous ? contiguous : wanted;
+    }
+
+    T _items[N];
+
+    // producer line
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> _head;
+    uint32_t _tailCache;
+
+    // consumer line
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> _tail;
+    uint32_t _headCache;
+};
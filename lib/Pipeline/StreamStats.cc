@@ -0,0 +1,69 @@
+#include "StreamStats.h"
+
+#define STREAM_STATS_WINDOW_MS 1000
+
+StreamStats::StreamStats()
+{
+    reset(0);
+}
+
+uint32_t StreamStats::getTotal(COUNTER counter) const
+{
+    return _totals[counter].load(std::memory_order_relaxed);
+}
+
+/// @brief Events per second over the last complete window
+/// @param counter {COUNTER} - The counter to read
+/// @return {uint32_t} - The rate, 0 until the first window has closed
+uint32_t StreamStats::getRate(COUNTER counter) const
+{
+    return _rates[counter];
+}
+
+/// @brief Key used for the counter in the stats JSON
+const char *StreamStats::getName(COUNTER counter)
+{
+    switch (counter)
+    {
+    case COUNTER_OVERRUN:
+        return "overrun";
+    case COUNTER_DRDY_MISSED:
+        return "drdy_missed";
+    case COUNTER_SPI_LATE:
+        return "spi_late";
+    case COUNTER_SEND_FAILURE:
+        return "send_failure";
+    default:
+        return "";
+    }
+}
+
+void StreamStats::reset(uint32_t nowMillis)
+{
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        _totals[i].store(0, std::memory_order_relaxed);
+        _windowTotals[i] = 0;
+        _rates[i] = 0;
+    }
+    _windowStart = nowMillis;
+}
+
+/// @brief Close the rate window once a second has passed. Call from `loop()`,
+///        a late call averages over however long the window actually was.
+/// @param nowMillis {uint32_t} - millis()
+void StreamStats::tick(uint32_t nowMillis)
+{
+    uint32_t elapsed = nowMillis - _windowStart;
+    if (elapsed < STREAM_STATS_WINDOW_MS)
+    {
+        return;
+    }
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        uint32_t total = _totals[i].load(std::memory_order_relaxed);
+        _rates[i] = (uint32_t)(((uint64_t)(total - _windowTotals[i]) * 1000) / elapsed);
+        _windowTotals[i] = total;
+    }
+    _windowStart = nowMillis;
+}
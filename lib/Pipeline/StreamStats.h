@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+/// @brief Data loss counters shared by the acquisition task and `loop()`.
+///        Totals only ever grow; `tick()` turns them into per second rates.
+class StreamStats
+{
+public:
+    enum COUNTER
+    {
+        COUNTER_OVERRUN,      // a buffer was full, data was discarded
+        COUNTER_DRDY_MISSED,  // DRDY fired again before the previous frame was read
+        COUNTER_SPI_LATE,     // frame read finished after the next DRDY was due
+        COUNTER_SEND_FAILURE, // TCP/UDP write did not go out in full
+        COUNTER_COUNT
+    };
+
+    StreamStats();
+
+    /// @brief Safe to call from any task, lock free
+    void add(COUNTER counter, uint32_t n = 1)
+    {
+        _totals[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint32_t getTotal(COUNTER counter) const;
+    uint32_t getRate(COUNTER counter) const;
+    static const char *getName(COUNTER counter);
+    void reset(uint32_t nowMillis);
+    void tick(uint32_t nowMillis);
+
+private:
+    std::atomic<uint32_t> _totals[COUNTER_COUNT];
+    uint32_t _windowTotals[COUNTER_COUNT];
+    uint32_t _rates[COUNTER_COUNT];
+    uint32_t _windowStart;
+};
@@ -0,0 +1,67 @@
+#include <math.h>
+#include "BandPacket.h"
+
+/// @brief Write one window
+/// @param windowNumber {uint16_t} - Counts windows, lets the client spot a lost packet
+/// @param powers       {const float *} - uV^2, channel major: [channel * numBands + band]
+/// @param numChannels  {uint8_t} - Up to BAND_PACKET_MAX_CHANNELS
+/// @param numBands     {uint8_t} - Up to BAND_PACKET_MAX_BANDS
+/// @param out          {uint8_t *} - Room for BAND_PACKET_MAX bytes
+/// @return {size_t} - Bytes written
+size_t BandPacket::encode(uint16_t windowNumber, const float *powers, uint8_t numChannels, uint8_t numBands, uint8_t *out)
+{
+    if (numChannels > BAND_PACKET_MAX_CHANNELS)
+    {
+        numChannels = BAND_PACKET_MAX_CHANNELS;
+    }
+    if (numBands > BAND_PACKET_MAX_BANDS)
+    {
+        numBands = BAND_PACKET_MAX_BANDS;
+    }
+    uint8_t *p = out;
+    *p++ = BAND_PACKET_TYPE;
+    *p++ = (uint8_t)(windowNumber >> 8);
+    *p++ = (uint8_t)windowNumber;
+    *p++ = numChannels;
+    *p++ = numBands;
+    for (uint16_t i = 0; i < numChannels * numBands; i++)
+    {
+        int32_t q = BAND_PACKET_ZERO;
+        if (powers[i] > 0)
+        {
+            const float steps = floorf(2560 * log10f(powers[i]) + 0.5f);
+            q = steps > 32767 ? 32767 : (steps < -32767 ? -32767 : (int32_t)steps);
+        }
+        *p++ = (uint8_t)((uint16_t)q >> 8);
+        *p++ = (uint8_t)q;
+    }
+    return p - out;
+}
+
+/// @brief Reference decoder
+/// @param powers {float *} - Receives numChannels * numBands values in uV^2
+/// @return {size_t} - Bytes consumed, 0 if the packet is incomplete or not a band packet
+size_t BandPacket::decode(const uint8_t *in, size_t length, float *powers, uint8_t &numChannels, uint8_t &numBands,
+                          uint16_t &windowNumber)
+{
+    if (length < BAND_PACKET_HEADER || in[0] != BAND_PACKET_TYPE || in[3] > BAND_PACKET_MAX_CHANNELS ||
+        in[4] > BAND_PACKET_MAX_BANDS)
+    {
+        return 0;
+    }
+    const size_t values = (size_t)in[3] * in[4];
+    if (length < BAND_PACKET_HEADER + 2 * values)
+    {
+        return 0;
+    }
+    windowNumber = (uint16_t)((in[1] << 8) | in[2]);
+    numChannels = in[3];
+    numBands = in[4];
+    const uint8_t *p = in + BAND_PACKET_HEADER;
+    for (size_t i = 0; i < values; i++, p += 2)
+    {
+        const int16_t q = (int16_t)((p[0] << 8) | p[1]);
+        powers[i] = q == BAND_PACKET_ZERO ? 0 : powf(10, q / 2560.0f);
+    }
+    return BAND_PACKET_HEADER + 2 * values;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/** [0xD8][window number, 2 bytes big endian][channel count][band count]
+ *  [channel 0 band 0][channel 0 band 1]..[channel 1 band 0]..
+ *  each power as dB re 1 uV^2 in 1/256 dB steps, int16 big endian */
+#define BAND_PACKET_TYPE 0xD8 // 0xB0 is taken by the UDP batch header
+#define BAND_PACKET_HEADER 5
+#define BAND_PACKET_MAX_CHANNELS 16
+#define BAND_PACKET_MAX_BANDS 5
+#define BAND_PACKET_MAX (BAND_PACKET_HEADER + BAND_PACKET_MAX_CHANNELS * BAND_PACKET_MAX_BANDS * 2)
+#define BAND_PACKET_ZERO -32768 // no power at all; the scale ends at -128 dB
+
+/// @brief One window of band powers in two bytes a value. A log scale keeps
+///        a fixed 0.09% resolution from the noise floor to saturation, which
+///        is all a power spectrum needs; 16 channels by 5 bands are 165 bytes
+///        where the raw samples of a 64 sample hop are 2 kB.
+class BandPacket
+{
+public:
+    static size_t encode(uint16_t windowNumber, const float *powers, uint8_t numChannels, uint8_t numBands, uint8_t *out);
+    static size_t decode(const uint8_t *in, size_t length, float *powers, uint8_t &numChannels, uint8_t &numBands,
+                         uint16_t &windowNumber);
+};
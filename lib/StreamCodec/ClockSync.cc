@@ -0,0 +1,194 @@
+#include <string.h>
+#include "ClockSync.h"
+
+static void put64(uint8_t *out, int64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        out[i] = (uint8_t)((uint64_t)value >> (56 - i * 8));
+    }
+}
+
+static int64_t get64(const uint8_t *in)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        value = (value << 8) | in[i];
+    }
+    return (int64_t)value;
+}
+
+ClockSync::ClockSync()
+{
+    reset();
+}
+
+/// @brief Forget every exchange, e.g. when the stream goes to another host
+void ClockSync::reset(void)
+{
+    _filterCount = _filterNext = 0;
+    _points = _historyNext = 0;
+    _lastPoint = INT64_MIN;
+    _sequence = 0;
+    _requestTime = 0;
+    _delay = 0;
+    _anchorLocal = _anchorOffset = 0;
+    _drift = 0;
+    _exchanges = _steps = 0;
+}
+
+/// @brief Start an exchange. Any request still unanswered is given up.
+/// @param localMicros {int64_t} - Device time now, t1
+/// @param out         {uint8_t *} - Receives CLOCK_SYNC_REQUEST_SIZE bytes
+/// @return {size_t} - Bytes to send
+size_t ClockSync::makeRequest(int64_t localMicros, uint8_t *out)
+{
+    _sequence++;
+    _requestTime = localMicros;
+    out[0] = CLOCK_SYNC_TYPE_REQUEST;
+    out[1] = _sequence;
+    put64(out + 2, localMicros);
+    return CLOCK_SYNC_REQUEST_SIZE;
+}
+
+/// @brief Complete the outstanding exchange
+/// @param data        {const uint8_t *} - A datagram from the host
+/// @param length      {size_t} - Its length
+/// @param localMicros {int64_t} - Device time it arrived, t4
+/// @return {bool} - `false` if it is not the response to the outstanding request
+bool ClockSync::handleResponse(const uint8_t *data, size_t length, int64_t localMicros)
+{
+    if (length != CLOCK_SYNC_RESPONSE_SIZE || data[0] != CLOCK_SYNC_TYPE_RESPONSE || data[1] != _sequence ||
+        _requestTime == 0 || get64(data + 2) != _requestTime)
+    {
+        return false; // late, duplicated or foreign
+    }
+    const int64_t t1 = _requestTime;
+    const int64_t t2 = get64(data + 10);
+    const int64_t t3 = get64(data + 18);
+    const int64_t t4 = localMicros;
+    _requestTime = 0;
+    _exchanges++;
+
+    Exchange e;
+    e.local = t1 + (t4 - t1) / 2;
+    e.offset = ((t2 - t1) + (t3 - t4)) / 2;
+    e.delay = (t4 - t1) - (t3 - t2);
+    if (e.delay < 0)
+    {
+        e.delay = 0;
+    }
+    _filter[_filterNext] = e;
+    _filterNext = (_filterNext + 1) % CLOCK_SYNC_FILTER;
+    if (_filterCount < CLOCK_SYNC_FILTER)
+    {
+        _filterCount++;
+    }
+
+    // the least delayed exchange is the least skewed by asymmetric queueing
+    const Exchange *best = &_filter[0];
+    for (uint8_t i = 1; i < _filterCount; i++)
+    {
+        if (_filter[i].delay < best->delay)
+        {
+            best = &_filter[i];
+        }
+    }
+    _delay = best->delay;
+    if (best->local > _lastPoint)
+    {
+        addPoint(*best);
+    }
+    return true;
+}
+
+/// @brief Map a device time, e.g. a DRDY stamp, onto the host clock
+/// @param localMicros {int64_t} - esp_timer microseconds
+/// @return {int64_t} - Host microseconds, `localMicros` itself until the first exchange
+int64_t ClockSync::toHost(int64_t localMicros) const
+{
+    if (_points == 0)
+    {
+        return localMicros;
+    }
+    return localMicros + _anchorOffset + (int64_t)(_drift * (float)(localMicros - _anchorLocal));
+}
+
+void ClockSync::addPoint(const Exchange &e)
+{
+    if (_points > 0)
+    {
+        int64_t error = e.offset - getOffset(e.local);
+        if (error > CLOCK_SYNC_STEP_US || error < -CLOCK_SYNC_STEP_US)
+        {
+            _points = _historyNext = 0; // the host clock was set, the old fit is worthless
+            _steps++;
+        }
+    }
+    _history[_historyNext] = e;
+    _historyNext = (_historyNext + 1) % CLOCK_SYNC_HISTORY;
+    if (_points < CLOCK_SYNC_HISTORY)
+    {
+        _points++;
+    }
+    _lastPoint = e.local;
+    fit();
+}
+
+/// @brief Weighted least squares line through the history, anchored at the
+///        newest point. An offset is off by at most half the delay it had above
+///        the shortest round trip, so those points count for less. Runs once
+///        per exchange, double is fine there.
+void ClockSync::fit(void)
+{
+    const Exchange &newest = _history[(_historyNext + CLOCK_SYNC_HISTORY - 1) % CLOCK_SYNC_HISTORY];
+    int64_t minDelay = newest.delay;
+    for (uint8_t i = 0; i < _points; i++)
+    {
+        if (_history[i].delay < minDelay)
+        {
+            minDelay = _history[i].delay;
+        }
+    }
+    double sw = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (uint8_t i = 0; i < _points; i++)
+    {
+        double excess = (double)(_history[i].delay - minDelay) / CLOCK_SYNC_WEIGHT_US;
+        double w = 1 / ((1 + excess) * (1 + excess));
+        double x = (double)(_history[i].local - newest.local);
+        double y = (double)(_history[i].offset - newest.offset);
+        sw += w;
+        sx += w * x;
+        sy += w * y;
+        sxx += w * x * x;
+        sxy += w * x * y;
+    }
+    double variance = sxx - sx * sx / sw;
+    double slope = variance > 0 ? (sxy - sx * sy / sw) / variance : 0;
+    _anchorLocal = newest.local;
+    _anchorOffset = newest.offset + (int64_t)(sy / sw - slope * sx / sw);
+    _drift = (float)slope;
+}
+
+/// @brief Answer a ClockSync request
+/// @param request        {const uint8_t *} - Datagram from the device
+/// @param length         {size_t} - Its length
+/// @param receiveMicros  {int64_t} - Host time the request arrived, t2
+/// @param transmitMicros {int64_t} - Host time the response goes out, t3
+/// @param out            {uint8_t *} - Receives CLOCK_SYNC_RESPONSE_SIZE bytes
+/// @return {size_t} - Bytes to send back to the sender, 0 if it was no request
+size_t ClockSyncResponder::respond(const uint8_t *request, size_t length, int64_t receiveMicros,
+                                   int64_t transmitMicros, uint8_t *out)
+{
+    if (length != CLOCK_SYNC_REQUEST_SIZE || request[0] != CLOCK_SYNC_TYPE_REQUEST)
+    {
+        return 0;
+    }
+    out[0] = CLOCK_SYNC_TYPE_RESPONSE;
+    out[1] = request[1];
+    memcpy(out + 2, request + 2, 8);
+    put64(out + 10, receiveMicros);
+    put64(out + 18, transmitMicros);
+    return CLOCK_SYNC_RESPONSE_SIZE;
+}
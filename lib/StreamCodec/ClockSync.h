@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/** Request:  [0xB2][sequence][t1, 8 bytes]                            device -> host
+ *  Response: [0xB3][sequence][t1, 8 bytes][t2, 8 bytes][t3, 8 bytes]  host -> device
+ *  t1 device send time, t2 host receive time, t3 host send time, all in
+ *  microseconds, big endian. The device takes t4 when the response arrives. */
+#define CLOCK_SYNC_TYPE_REQUEST 0xB2
+#define CLOCK_SYNC_TYPE_RESPONSE 0xB3
+#define CLOCK_SYNC_REQUEST_SIZE 10
+#define CLOCK_SYNC_RESPONSE_SIZE 26
+#define CLOCK_SYNC_FILTER 8     // exchanges the minimum delay filter looks back over
+#define CLOCK_SYNC_HISTORY 16   // filtered offsets the drift is fitted to
+#define CLOCK_SYNC_WEIGHT_US 100 // round trip above the shortest that cuts a point's weight to a quarter
+#define CLOCK_SYNC_STEP_US 100000 // a filtered offset this far off the fit is a clock step, start over
+
+/// @brief Device side of an NTP style exchange with a host. Keeps the exchange
+///        with the shortest round trip of the last few (queueing only ever adds
+///        delay), and fits offset and drift to those so every sample time can
+///        be mapped onto the host clock between exchanges.
+class ClockSync
+{
+public:
+    ClockSync();
+
+    void reset(void);
+    size_t makeRequest(int64_t localMicros, uint8_t *out);
+    bool handleResponse(const uint8_t *data, size_t length, int64_t localMicros);
+    int64_t toHost(int64_t localMicros) const;
+
+    bool isSynced(void) const { return _points > 0; }
+    int64_t getDelay(void) const { return _delay; }
+    float getDriftPpm(void) const { return _drift * 1e6f; }
+    int64_t getOffset(int64_t localMicros) const { return toHost(localMicros) - localMicros; }
+    uint32_t getExchanges(void) const { return _exchanges; }
+    uint32_t getSteps(void) const { return _steps; }
+
+private:
+    struct Exchange
+    {
+        int64_t local;  // device time halfway through the exchange
+        int64_t offset; // host minus device
+        int64_t delay;  // round trip without the host's turnaround
+    };
+
+    void addPoint(const Exchange &e);
+    void fit(void);
+
+    Exchange _filter[CLOCK_SYNC_FILTER];
+    Exchange _history[CLOCK_SYNC_HISTORY];
+    uint8_t _filterCount;
+    uint8_t _filterNext;
+    uint8_t _points;
+    uint8_t _historyNext;
+    int64_t _lastPoint;   // local time of the last exchange that made it into the history
+    uint8_t _sequence;    // of the outstanding request
+    int64_t _requestTime; // its t1, 0 once answered
+    int64_t _delay;       // of the last filtered exchange
+
+    int64_t _anchorLocal; // toHost(): offset + drift * (local - anchor)
+    int64_t _anchorOffset;
+    float _drift;         // applied per sample, the ESP32-S3 FPU is single precision
+    uint32_t _exchanges;
+    uint32_t _steps;
+};
+
+/// @brief Host side counterpart of ClockSync. Call from the socket that receives
+///        the stream: timestamp a request as soon as it arrives and answer it
+///        right away.
+class ClockSyncResponder
+{
+public:
+    static size_t respond(const uint8_t *request, size_t length, int64_t receiveMicros, int64_t transmitMicros,
+                          uint8_t *out);
+};
@@ -0,0 +1,188 @@
+#include "DeltaCodec.h"
+
+static inline uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+/// @brief Sign extend a 24 bit two's complement value
+static inline int32_t wrap24(int32_t v)
+{
+    return (int32_t)((uint32_t)v << 8) >> 8;
+}
+
+DeltaEncoder::DeltaEncoder() : _keyframeInterval(DELTA_KEYFRAME_INTERVAL)
+{
+    reset();
+}
+
+/// @brief Make the next record a keyframe
+void DeltaEncoder::reset(void)
+{
+    _numChannels = 0;
+    _sinceKeyframe = 0;
+    _haveReference = false;
+}
+
+void DeltaEncoder::setKeyframeInterval(uint16_t interval)
+{
+    _keyframeInterval = interval == 0 ? 1 : interval;
+}
+
+/// @brief Append one sample
+/// @param channels      {const int32_t *} - Sign extended 24 bit channel values
+/// @param numChannels   {uint8_t} - Up to DELTA_MAX_CHANNELS
+/// @param sampleNumber  {uint8_t} - Wire sample counter, lets the decoder spot gaps
+/// @param out           {uint8_t *} - Room for DELTA_MAX_RECORD bytes
+/// @return {size_t} - Bytes written
+size_t DeltaEncoder::encode(const int32_t *channels, uint8_t numChannels, uint8_t sampleNumber, uint8_t *out)
+{
+    if (numChannels > DELTA_MAX_CHANNELS)
+    {
+        numChannels = DELTA_MAX_CHANNELS;
+    }
+    uint8_t *p = out;
+    if (!_haveReference || numChannels != _numChannels || _sinceKeyframe >= _keyframeInterval)
+    {
+        *p++ = DELTA_TYPE_KEYFRAME;
+        *p++ = sampleNumber;
+        *p++ = numChannels;
+        for (uint8_t i = 0; i < numChannels; i++)
+        {
+            const uint32_t v = (uint32_t)channels[i];
+            *p++ = (uint8_t)(v >> 16);
+            *p++ = (uint8_t)(v >> 8);
+            *p++ = (uint8_t)v;
+            _previous[i] = wrap24(channels[i]);
+        }
+        _numChannels = numChannels;
+        _haveReference = true;
+        _sinceKeyframe = 1;
+        return p - out;
+    }
+
+    *p++ = DELTA_TYPE_DELTA;
+    *p++ = sampleNumber;
+    for (uint8_t i = 0; i < numChannels; i++)
+    {
+        const int32_t value = wrap24(channels[i]);
+        uint32_t z = zigzag(wrap24(value - _previous[i]));
+        while (z >= 0x80)
+        {
+            *p++ = (uint8_t)(z | 0x80);
+            z >>= 7;
+        }
+        *p++ = (uint8_t)z;
+        _previous[i] = value;
+    }
+    _sinceKeyframe++;
+    return p - out;
+}
+
+DeltaDecoder::DeltaDecoder()
+{
+    reset();
+}
+
+void DeltaDecoder::reset(void)
+{
+    _numChannels = 0;
+    _lastSampleNumber = 0;
+    _haveReference = false;
+    _skipped = 0;
+}
+
+/// @brief Decode the record at the start of `in`
+/// @param in            {const uint8_t *} - Encoded stream
+/// @param length        {size_t} - Bytes available
+/// @param channels      {int32_t *} - Receives DELTA_MAX_CHANNELS values at most
+/// @param numChannels   {uint8_t &} - Receives the channel count
+/// @param sampleNumber  {uint8_t &} - Receives the sample number
+/// @param valid         {bool &} - `false` if the record was a delta with no reference
+///                                 (start of stream or after a lost record)
+/// @return {size_t} - Bytes consumed, 0 if the record is incomplete, not a record,
+///                    or a delta before the first keyframe (drop the rest of the datagram)
+size_t DeltaDecoder::decode(const uint8_t *in, size_t length, int32_t *channels, uint8_t &numChannels,
+                            uint8_t &sampleNumber, bool &valid)
+{
+    valid = false;
+    if (length < 2)
+    {
+        return 0;
+    }
+    const uint8_t *p = in;
+    const uint8_t *end = in + length;
+    const uint8_t type = *p++;
+    const uint8_t sample = *p++;
+
+    if (type == DELTA_TYPE_KEYFRAME)
+    {
+        if (p == end || *p > DELTA_MAX_CHANNELS || end - (p + 1) < *p * 3)
+        {
+            return 0;
+        }
+        const uint8_t n = *p++;
+        for (uint8_t i = 0; i < n; i++, p += 3)
+        {
+            _previous[i] = wrap24(((int32_t)p[0] << 16) | ((int32_t)p[1] << 8) | p[2]);
+        }
+        _numChannels = n;
+        _haveReference = true;
+    }
+    else if (type == DELTA_TYPE_DELTA)
+    {
+        // Varints are self delimiting, but their count is only known from a keyframe
+        if (_numChannels == 0)
+        {
+            return 0;
+        }
+        int32_t deltas[DELTA_MAX_CHANNELS];
+        const uint8_t n = _numChannels;
+        for (uint8_t i = 0; i < n; i++)
+        {
+            uint32_t z = 0;
+            uint8_t shift = 0;
+            do
+            {
+                if (p == end || shift >= 7 * DELTA_MAX_VARINT)
+                {
+                    return 0;
+                }
+                z |= (uint32_t)(*p & 0x7F) << shift;
+                shift += 7;
+            } while (*p++ & 0x80);
+            deltas[i] = unzigzag(z);
+        }
+        if (!_haveReference || sample != (uint8_t)(_lastSampleNumber + 1))
+        {
+            // Lost a record: nothing to add to until the next keyframe
+            _haveReference = false;
+            _skipped++;
+            _lastSampleNumber = sample;
+            return p - in;
+        }
+        for (uint8_t i = 0; i < n; i++)
+        {
+            _previous[i] = wrap24(_previous[i] + deltas[i]);
+        }
+    }
+    else
+    {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < _numChannels; i++)
+    {
+        channels[i] = _previous[i];
+    }
+    numChannels = _numChannels;
+    sampleNumber = sample;
+    _lastSampleNumber = sample;
+    valid = true;
+    return p - in;
+}
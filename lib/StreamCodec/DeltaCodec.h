@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/** Keyframe: [0xD0][sample number][channel count][channels, 3 bytes big endian each]
+ *  Delta:    [0xD1][sample number][channels, zigzag varint of the change since the last record] */
+#define DELTA_TYPE_KEYFRAME 0xD0
+#define DELTA_TYPE_DELTA 0xD1
+#define DELTA_MAX_CHANNELS 16
+#define DELTA_MAX_VARINT 4 // a 24 bit difference needs at most 25 bits zigzagged
+#define DELTA_MAX_RECORD (3 + DELTA_MAX_CHANNELS * DELTA_MAX_VARINT)
+#define DELTA_KEYFRAME_INTERVAL 256 // records, bounds how long a decoder waits after a loss
+
+/// @brief Encodes successive samples as the change from the previous sample.
+///        EEG moves little between samples, so most channels fit in 1-2 bytes
+///        instead of 3, and daisy boards send one record instead of two packets.
+class DeltaEncoder
+{
+public:
+    DeltaEncoder();
+
+    size_t encode(const int32_t *channels, uint8_t numChannels, uint8_t sampleNumber, uint8_t *out);
+    void reset(void);
+    void setKeyframeInterval(uint16_t interval);
+
+private:
+    int32_t _previous[DELTA_MAX_CHANNELS];
+    uint8_t _numChannels;
+    uint16_t _keyframeInterval;
+    uint16_t _sinceKeyframe;
+    bool _haveReference;
+};
+
+/// @brief Reference decoder for the DeltaEncoder stream
+class DeltaDecoder
+{
+public:
+    DeltaDecoder();
+
+    size_t decode(const uint8_t *in, size_t length, int32_t *channels, uint8_t &numChannels,
+                  uint8_t &sampleNumber, bool &valid);
+    void reset(void);
+
+    uint32_t getSkipped(void) { return _skipped; }
+
+private:
+    int32_t _previous[DELTA_MAX_CHANNELS];
+    uint8_t _numChannels;
+    uint8_t _lastSampleNumber;
+    bool _haveReference;
+    uint32_t _skipped; // delta records dropped for want of a reference
+};
@@ -0,0 +1,91 @@
+#include "FlushController.h"
+
+FlushController::FlushController()
+{
+    begin(1000, 100000, 1);
+}
+
+/// @brief Start over at the shortest interval, one packet per send
+/// @param minInterval {uint32_t} - Microseconds, the interval never goes below
+/// @param maxInterval {uint32_t} - Microseconds, nor above
+/// @param maxBatch    {uint16_t} - Most packets one send carries
+void FlushController::begin(uint32_t minInterval, uint32_t maxInterval, uint16_t maxBatch)
+{
+    _minInterval = minInterval;
+    _maxInterval = maxInterval < minInterval ? minInterval : maxInterval;
+    _maxBatch = maxBatch == 0 ? 1 : maxBatch;
+    _interval = _minInterval;
+    _batch = 1;
+    _sendTime8 = 0;
+    _rate = 0;
+    _backlog = 0;
+    _produced = _lastProduced = 0;
+    _lastUpdate = 0;
+    _started = false;
+}
+
+/// @brief Time one flush spent in its writes, averaged over about eight
+void FlushController::addSend(uint32_t sendMicros)
+{
+    _sendTime8 = _sendTime8 - _sendTime8 / 8 + sendMicros;
+}
+
+bool FlushController::isUpdateDue(uint32_t nowMicros) const
+{
+    return !_started || nowMicros - _lastUpdate >= FLUSH_CONTROL_PERIOD_US;
+}
+
+/// @brief Recompute interval and batch, once per FLUSH_CONTROL_PERIOD_US
+/// @param nowMicros {uint32_t} - micros()
+/// @param backlog   {uint32_t} - Packets still waiting right after this loop's
+///                               flushes, the most any subscriber holds
+/// @param rssi      {int8_t} - dBm, 0 if unknown
+void FlushController::update(uint32_t nowMicros, uint32_t backlog, int8_t rssi)
+{
+    if (!_started)
+    {
+        _started = true;
+        _lastUpdate = nowMicros;
+        _lastProduced = _produced;
+        return;
+    }
+    const uint32_t elapsed = nowMicros - _lastUpdate;
+    if (elapsed < FLUSH_CONTROL_PERIOD_US)
+    {
+        return;
+    }
+    const uint32_t rate = (uint32_t)((uint64_t)(_produced - _lastProduced) * 1000000 / elapsed);
+    _rate = _rate == 0 ? rate : (_rate * 3 + rate) / 4;
+    _lastUpdate = nowMicros;
+    _lastProduced = _produced;
+    _backlog = backlog;
+
+    uint32_t shortest = getSendTime() * FLUSH_SEND_SHARE;
+    shortest = shortest < _minInterval ? _minInterval : shortest;
+    if (rssi != 0 && rssi <= FLUSH_RSSI_POOR)
+    {
+        shortest *= 4;
+    }
+    else if (rssi != 0 && rssi <= FLUSH_RSSI_WEAK)
+    {
+        shortest *= 2;
+    }
+    shortest = shortest > _maxInterval ? _maxInterval : shortest;
+
+    if (backlog > _batch)
+    {
+        // the last sends did not drain the ring, make them fewer and larger
+        _interval = _interval > _maxInterval / 2 ? _maxInterval : _interval * 2;
+    }
+    else
+    {
+        _interval = _interval > shortest ? shortest + (_interval - shortest) / 2 : shortest;
+    }
+    if (_interval < shortest)
+    {
+        _interval = shortest;
+    }
+
+    const uint64_t batch = ((uint64_t)_rate * _interval + 999999) / 1000000;
+    _batch = batch < 1 ? 1 : batch > _maxBatch ? _maxBatch : (uint16_t)batch;
+}
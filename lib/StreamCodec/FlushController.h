@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+
+#define FLUSH_CONTROL_PERIOD_US 100000 // how often interval and batch are recomputed
+#define FLUSH_SEND_SHARE 4             // flushes at least this many send times apart, sending takes at most a quarter of loop()
+#define FLUSH_RSSI_WEAK -75            // dBm, retries start to stretch each send: double the shortest interval
+#define FLUSH_RSSI_POOR -85            // dBm, most frames need retries: four times the shortest interval
+
+/// @brief Picks how long `loop()` lets packets collect before a flush, and how
+///        many make a full send, from what the link does instead of a fixed
+///        DEFAULT_LATENCY. The shortest interval is as close to nothing as the
+///        send time and the signal allow; packets left waiting after a flush
+///        mean the link did not keep up, then the interval doubles so fewer,
+///        larger sends carry the same data. Otherwise it falls back halfway to
+///        the shortest each period. The batch is what arrives in one interval.
+class FlushController
+{
+public:
+    FlushController();
+
+    void begin(uint32_t minInterval, uint32_t maxInterval, uint16_t maxBatch);
+    void addPackets(uint32_t count) { _produced += count; }
+    void addSend(uint32_t sendMicros);
+    bool isUpdateDue(uint32_t nowMicros) const;
+    void update(uint32_t nowMicros, uint32_t backlog, int8_t rssi);
+
+    /// @brief Microseconds a partial batch may wait
+    uint32_t getInterval(void) const { return _interval; }
+    /// @brief Packets that make a full send, at most `maxBatch`
+    uint16_t getBatch(void) const { return _batch; }
+    /// @brief Average microseconds one flush spends writing
+    uint32_t getSendTime(void) const { return _sendTime8 / 8; }
+    /// @brief Packets per second, measured over the last periods
+    uint32_t getRate(void) const { return _rate; }
+    /// @brief Packets still waiting at the last update
+    uint32_t getBacklog(void) const { return _backlog; }
+
+private:
+    uint32_t _minInterval;
+    uint32_t _maxInterval;
+    uint16_t _maxBatch;
+    uint32_t _interval;
+    uint16_t _batch;
+    uint32_t _sendTime8; // 8 x the moving average, no fraction lost to rounding
+    uint32_t _rate;
+    uint32_t _backlog;
+    uint32_t _produced; // packets since begin(), counted by addPackets()
+    uint32_t _lastProduced;
+    uint32_t _lastUpdate;
+    bool _started;
+};
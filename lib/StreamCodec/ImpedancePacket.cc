@@ -0,0 +1,58 @@
+#include "ImpedancePacket.h"
+
+/// @brief Write one block
+/// @param blockNumber {uint16_t} - Counts blocks, lets the client spot a lost packet
+/// @param ohms        {const float *} - Per channel, negative if not measured
+/// @param flags       {const uint8_t *} - Per channel lead-off flags
+/// @param numChannels {uint8_t} - Up to IMPEDANCE_PACKET_MAX_CHANNELS
+/// @param out         {uint8_t *} - Room for IMPEDANCE_PACKET_MAX bytes
+/// @return {size_t} - Bytes written
+size_t ImpedancePacket::encode(uint16_t blockNumber, const float *ohms, const uint8_t *flags, uint8_t numChannels,
+                               uint8_t *out)
+{
+    if (numChannels > IMPEDANCE_PACKET_MAX_CHANNELS)
+    {
+        numChannels = IMPEDANCE_PACKET_MAX_CHANNELS;
+    }
+    uint8_t *p = out;
+    *p++ = IMPEDANCE_PACKET_TYPE;
+    *p++ = (uint8_t)(blockNumber >> 8);
+    *p++ = (uint8_t)blockNumber;
+    *p++ = numChannels;
+    for (uint8_t i = 0; i < numChannels; i++)
+    {
+        uint16_t q = IMPEDANCE_PACKET_NONE;
+        if (ohms[i] >= 0 && ohms[i] < 100.0f * IMPEDANCE_PACKET_NONE - 50)
+        {
+            q = (uint16_t)(ohms[i] / 100 + 0.5f);
+        }
+        *p++ = (uint8_t)(q >> 8);
+        *p++ = (uint8_t)q;
+        *p++ = flags[i];
+    }
+    return p - out;
+}
+
+/// @brief Reference decoder
+/// @param ohms  {float *} - Receives numChannels values, -1 where none was sent
+/// @param flags {uint8_t *} - Receives numChannels flag bytes
+/// @return {size_t} - Bytes consumed, 0 if the packet is incomplete or not an impedance packet
+size_t ImpedancePacket::decode(const uint8_t *in, size_t length, float *ohms, uint8_t *flags, uint8_t &numChannels,
+                               uint16_t &blockNumber)
+{
+    if (length < IMPEDANCE_PACKET_HEADER || in[0] != IMPEDANCE_PACKET_TYPE || in[3] > IMPEDANCE_PACKET_MAX_CHANNELS ||
+        length < IMPEDANCE_PACKET_HEADER + 3 * (size_t)in[3])
+    {
+        return 0;
+    }
+    blockNumber = (uint16_t)((in[1] << 8) | in[2]);
+    numChannels = in[3];
+    const uint8_t *p = in + IMPEDANCE_PACKET_HEADER;
+    for (uint8_t i = 0; i < numChannels; i++, p += 3)
+    {
+        const uint16_t q = (uint16_t)((p[0] << 8) | p[1]);
+        ohms[i] = q == IMPEDANCE_PACKET_NONE ? -1 : q * 100.0f;
+        flags[i] = p[2];
+    }
+    return IMPEDANCE_PACKET_HEADER + 3 * (size_t)numChannels;
+}
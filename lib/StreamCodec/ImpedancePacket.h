@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/** [0xE0][block number, 2 bytes big endian][channel count]
+ *  [channel 0 impedance, 2 bytes big endian][channel 0 flags][channel 1 ..
+ *  impedance in 100 ohm steps, flags as IMPEDANCE_FLAG_* */
+#define IMPEDANCE_PACKET_TYPE 0xE0
+#define IMPEDANCE_PACKET_HEADER 4
+#define IMPEDANCE_PACKET_MAX_CHANNELS 16
+#define IMPEDANCE_PACKET_MAX (IMPEDANCE_PACKET_HEADER + IMPEDANCE_PACKET_MAX_CHANNELS * 3)
+#define IMPEDANCE_PACKET_NONE 0xFFFF // not measured, or above 6.5 Mohm
+
+/// @brief One impedance block: per channel kohm estimate and lead-off flags,
+///        52 bytes for 16 channels twice a second
+class ImpedancePacket
+{
+public:
+    static size_t encode(uint16_t blockNumber, const float *ohms, const uint8_t *flags, uint8_t numChannels, uint8_t *out);
+    static size_t decode(const uint8_t *in, size_t length, float *ohms, uint8_t *flags, uint8_t &numChannels,
+                         uint16_t &blockNumber);
+};
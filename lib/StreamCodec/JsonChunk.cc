@@ -0,0 +1,164 @@
+#include "JsonChunk.h"
+#include <string.h>
+
+#define JSON_CHUNK_OPEN "{\"chunk\":["
+
+JsonChunkWriter::JsonChunkWriter()
+    : _out(NULL), _capacity(0), _length(0), _samples(0), _timestamps(true), _sampleNumbers(false), _config(-1)
+{
+}
+
+/// @brief Start a new chunk
+/// @param out      {uint8_t *} - Where the document is written
+/// @param capacity {size_t} - Size of `out`, must hold at least one sample
+///                 plus JSON_CHUNK_CLOSE_SIZE
+void JsonChunkWriter::begin(uint8_t *out, size_t capacity)
+{
+    _out = out;
+    _capacity = capacity;
+    _length = 0;
+    _samples = 0;
+    put(JSON_CHUNK_OPEN);
+}
+
+/// @brief Append one sample, unless it might not leave room to close the chunk
+/// @param timestamp    {uint64_t} - Written when timestamps are on
+/// @param sampleNumber {uint8_t} - Written when sample numbers are on
+/// @param nanovolts    {const int64_t *} - One value per channel
+/// @param numChannels  {uint8_t} - At most JSON_CHUNK_MAX_CHANNELS
+/// @return {bool} - `false` if the chunk is full, `finish()` it and begin another
+bool JsonChunkWriter::addSample(uint64_t timestamp, uint8_t sampleNumber, const int64_t *nanovolts, uint8_t numChannels)
+{
+    if (numChannels > JSON_CHUNK_MAX_CHANNELS)
+    {
+        numChannels = JSON_CHUNK_MAX_CHANNELS;
+    }
+    if (_length + getMaxSampleSize(numChannels) + JSON_CHUNK_CLOSE_SIZE > _capacity)
+    {
+        return false;
+    }
+
+    if (_samples > 0)
+    {
+        put(',');
+    }
+    put('{');
+    if (_timestamps)
+    {
+        put("\"timestamp\":");
+        putUnsigned(timestamp);
+        put(',');
+    }
+    if (_sampleNumbers)
+    {
+        put("\"sampleNumber\":");
+        putUnsigned(sampleNumber);
+        put(',');
+    }
+    if (_config >= 0)
+    {
+        put("\"config\":");
+        putUnsigned((uint8_t)_config);
+        put(',');
+        _config = -1;
+    }
+    put("\"data\":[");
+    for (uint8_t i = 0; i < numChannels; i++)
+    {
+        if (i > 0)
+        {
+            put(',');
+        }
+        putSigned(nanovolts[i]);
+    }
+    put("]}");
+    _samples++;
+    return true;
+}
+
+/// @brief Close the chunk
+/// @param count     {uint32_t} - Chunk counter, lets a client notice lost chunks
+/// @param delimiter {bool} - Terminate with "\r\n" for line based TCP clients
+/// @return {size_t} - Length of the document in bytes
+size_t JsonChunkWriter::finish(uint32_t count, bool delimiter)
+{
+    put("],\"count\":");
+    putUnsigned(count);
+    put('}');
+    if (delimiter)
+    {
+        put("\r\n");
+    }
+    return _length;
+}
+
+/// @brief Choose the optional per sample fields
+void JsonChunkWriter::setFields(bool timestamps, bool sampleNumbers)
+{
+    _timestamps = timestamps;
+    _sampleNumbers = sampleNumbers;
+}
+
+/// @brief Tag the next sample with `"config":<sequence>`, the first sample
+///        taken after the ADS settings changed while streaming
+void JsonChunkWriter::markConfig(uint8_t sequence)
+{
+    _config = sequence;
+}
+
+/// @brief Worst case size of one sample, used to decide if another one fits
+/// @param numChannels {uint8_t} - Channels per sample
+/// @return {size_t} - Bytes
+size_t JsonChunkWriter::getMaxSampleSize(uint8_t numChannels)
+{
+    // ,{"timestamp":<20>,"sampleNumber":<3>,"config":<3>,"data":[ ... ]}
+    // each channel: optional comma, sign and up to 19 digits
+    return 2 + 12 + 20 + 1 + 15 + 3 + 1 + 9 + 3 + 1 + 8 + numChannels * 21 + 2;
+}
+
+void JsonChunkWriter::put(char c)
+{
+    _out[_length++] = (uint8_t)c;
+}
+
+void JsonChunkWriter::put(const char *s)
+{
+    size_t n = strlen(s);
+    memcpy(_out + _length, s, n);
+    _length += n;
+}
+
+void JsonChunkWriter::putUnsigned(uint64_t n)
+{
+    char digits[20];
+    uint8_t count = 0;
+    // 32 bit divides are much cheaper on the ESP32, use them once the value fits
+    while (n > 0xFFFFFFFFULL)
+    {
+        digits[count++] = (char)('0' + n % 10);
+        n /= 10;
+    }
+    uint32_t small = (uint32_t)n;
+    do
+    {
+        digits[count++] = (char)('0' + small % 10);
+        small /= 10;
+    } while (small > 0);
+    while (count > 0)
+    {
+        _out[_length++] = (uint8_t)digits[--count];
+    }
+}
+
+void JsonChunkWriter::putSigned(int64_t n)
+{
+    if (n < 0)
+    {
+        put('-');
+        putUnsigned(0 - (uint64_t)n);
+    }
+    else
+    {
+        putUnsigned((uint64_t)n);
+    }
+}
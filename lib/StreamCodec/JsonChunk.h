@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define JSON_CHUNK_MAX_CHANNELS 16
+#define JSON_CHUNK_CLOSE_SIZE 27 // `],"count":4294967295}` plus "\r\n"
+
+/// @brief Writes `{"chunk":[{"timestamp":..,"sampleNumber":..,"data":[..]},..],"count":..}`
+///        straight into a caller owned buffer. Same document the ArduinoJson
+///        version produced, without a JsonDocument, heap or doubles: channel
+///        values arrive as integer nanovolts and are formatted digit by digit.
+class JsonChunkWriter
+{
+public:
+    JsonChunkWriter();
+
+    void begin(uint8_t *out, size_t capacity);
+    bool addSample(uint64_t timestamp, uint8_t sampleNumber, const int64_t *nanovolts, uint8_t numChannels);
+    size_t finish(uint32_t count, bool delimiter);
+    void setFields(bool timestamps, bool sampleNumbers);
+    void markConfig(uint8_t sequence);
+
+    size_t getLength(void) { return _length; }
+    uint8_t getSamples(void) { return _samples; }
+    static size_t getMaxSampleSize(uint8_t numChannels);
+
+private:
+    void put(char c);
+    void put(const char *s);
+    void putUnsigned(uint64_t n);
+    void putSigned(int64_t n);
+
+    uint8_t *_out;
+    size_t _capacity;
+    size_t _length;
+    uint8_t _samples;
+    bool _timestamps;
+    bool _sampleNumbers;
+    int16_t _config; // configSequence for the next sample, -1 for none
+};
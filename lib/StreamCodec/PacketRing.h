@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+#include "FanoutRing.h"
+
+#define OPENBCI_PACKET_SIZE 33 // [0xA0][sample number][24 channel bytes][6 aux bytes][0xCX stop byte]
+
+/// @brief One packet in its final wire layout. A run of these from
+///        `PacketFanout::peek()` is a run of bytes ready for the socket.
+typedef struct
+{
+    uint8_t bytes[OPENBCI_PACKET_SIZE];
+} OpenBCIPacket;
+
+static_assert(sizeof(OpenBCIPacket) == OPENBCI_PACKET_SIZE, "OpenBCIPacket must not be padded");
+
+/// @brief Ring of wire packets read by several sinks at their own pace. The
+///        producer serializes straight into the slot from `claim()`, each
+///        sink writes its `peek()` runs without copying, see FanoutRing.
+template <uint32_t N, uint8_t READERS>
+using PacketFanout = FanoutRing<OpenBCIPacket, N, READERS>;
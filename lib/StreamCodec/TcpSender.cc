@@ -0,0 +1,209 @@
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "TcpSender.h"
+
+#ifdef MSG_NOSIGNAL
+#define TCP_SENDER_FLAGS (MSG_DONTWAIT | MSG_NOSIGNAL) // a peer gone mid write must not raise SIGPIPE on the host
+#else
+#define TCP_SENDER_FLAGS MSG_DONTWAIT
+#endif
+
+TcpSender::TcpSender()
+{
+    begin(-1, POLICY_DROP_OLDEST, 0);
+}
+
+/// @brief Start writing to a connected socket, with an empty queue
+/// @param fd     {int} - The socket, e.g. `WiFiClient::fd()`; -1 for none
+/// @param policy {POLICY} - Which units go once the queue is full
+/// @param limit  {size_t} - Queue bytes before the policy applies, 0 for
+///                          TCP_SENDER_QUEUE; never less than one largest unit
+void TcpSender::begin(int fd, POLICY policy, size_t limit)
+{
+    _fd = fd;
+    _failed = _paused = _skip = false;
+    _policy = policy;
+    _limit = limit == 0 || limit > TCP_SENDER_QUEUE ? TCP_SENDER_QUEUE : limit < TCP_SENDER_UNIT_MAX ? TCP_SENDER_UNIT_MAX : limit;
+    _sent = _dropped = _droppedBytes = 0;
+    _partialLength = _partialSent = 0;
+    _start = _end = 0;
+    _first = _count = 0;
+}
+
+/// @brief Forget the socket and whatever still waits for it
+void TcpSender::end(void)
+{
+    begin(-1, _policy, _limit);
+}
+
+/// @brief Send what the socket takes now, queue the rest as the policy allows
+/// @param data   {const uint8_t *} - Whole units back to back
+/// @param length {size_t} - Bytes
+/// @param unit   {size_t} - Bytes per unit, up to TCP_SENDER_UNIT_MAX; the
+///                          last one may be shorter
+/// @return {size_t} - Units sent or queued, the others were dropped
+size_t TcpSender::write(const uint8_t *data, size_t length, size_t unit)
+{
+    if (unit == 0 || unit > TCP_SENDER_UNIT_MAX || !flush())
+    {
+        return 0;
+    }
+    size_t offset = 0;
+    size_t accepted = 0;
+    if (getQueued() == 0)
+    {
+        // nothing waiting, straight from the caller's buffer
+        const size_t n = transmit(data, length);
+        offset = n / unit * unit;
+        accepted = n / unit;
+        if (n > offset)
+        {
+            const size_t cut = length - offset < unit ? length - offset : unit;
+            memcpy(_partial, data + offset, cut);
+            _partialLength = cut;
+            _partialSent = n - offset;
+            offset += cut;
+            accepted++;
+        }
+    }
+    for (; offset < length && isOpen(); offset += unit)
+    {
+        const size_t size = length - offset < unit ? length - offset : unit;
+        accepted += enqueue(data + offset, size) ? 1 : 0;
+    }
+    return accepted;
+}
+
+/// @brief Hand the socket what waits, the cut unit first
+/// @return {bool} - `false` once the connection failed
+bool TcpSender::flush(void)
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+    while (_partialSent < _partialLength)
+    {
+        const size_t n = transmit(_partial + _partialSent, _partialLength - _partialSent);
+        if (n == 0)
+        {
+            return isOpen();
+        }
+        _partialSent += n;
+    }
+    _partialLength = _partialSent = 0;
+
+    while (_count > 0)
+    {
+        size_t n = transmit(_queue + _start, _end - _start);
+        if (n == 0)
+        {
+            return isOpen();
+        }
+        // pop the units that went out whole, a cut one moves to _partial
+        while (n > 0)
+        {
+            const uint16_t unit = _units[_first];
+            if (n < unit)
+            {
+                memcpy(_partial, _queue + _start, unit);
+                _partialLength = unit;
+                _partialSent = n;
+                n = unit;
+            }
+            _start += unit;
+            _first = (_first + 1) % TCP_SENDER_UNITS;
+            _count--;
+            n -= unit;
+        }
+        if (_partialLength > 0)
+        {
+            return true; // the socket is full
+        }
+    }
+    _start = _end = 0;
+    _paused = false;
+    return true;
+}
+
+/// @brief One non-blocking send
+/// @return {size_t} - Bytes the socket took, 0 if full or failed
+size_t TcpSender::transmit(const uint8_t *data, size_t length)
+{
+    if (length == 0 || !isOpen())
+    {
+        return 0;
+    }
+    const ssize_t n = send(_fd, data, length, TCP_SENDER_FLAGS);
+    if (n < 0)
+    {
+        if (errno != EWOULDBLOCK && errno != EAGAIN && errno != EINTR)
+        {
+            _failed = true;
+        }
+        return 0;
+    }
+    _sent += n;
+    return n;
+}
+
+/// @brief Queue one unit, or drop what the policy says
+/// @return {bool} - `false` if this unit was dropped
+bool TcpSender::enqueue(const uint8_t *data, size_t length)
+{
+    if (_paused)
+    {
+        drop(length);
+        return false;
+    }
+    if (_policy == POLICY_DECIMATE && (size_t)(_end - _start) > _limit / 2)
+    {
+        _skip = !_skip;
+        if (_skip)
+        {
+            drop(length);
+            return false;
+        }
+    }
+    while ((size_t)(_end - _start) + length > _limit || _count == TCP_SENDER_UNITS)
+    {
+        if (_count == 0 || _policy == POLICY_DECIMATE || _policy == POLICY_PAUSE)
+        {
+            _paused = _policy == POLICY_PAUSE;
+            drop(length);
+            return false;
+        }
+        dropOldest();
+        while (_policy == POLICY_LATEST && _count > 0)
+        {
+            dropOldest();
+        }
+    }
+    if (_end + length > TCP_SENDER_QUEUE)
+    {
+        memmove(_queue, _queue + _start, _end - _start);
+        _end -= _start;
+        _start = 0;
+    }
+    memcpy(_queue + _end, data, length);
+    _end += length;
+    _units[(_first + _count) % TCP_SENDER_UNITS] = length;
+    _count++;
+    return true;
+}
+
+void TcpSender::dropOldest(void)
+{
+    const uint16_t unit = _units[_first];
+    drop(unit);
+    _start += unit;
+    _first = (_first + 1) % TCP_SENDER_UNITS;
+    _count--;
+}
+
+void TcpSender::drop(size_t length)
+{
+    _dropped++;
+    _droppedBytes += length;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define TCP_SENDER_QUEUE 4096    // bytes a subscriber's socket has not taken yet
+#define TCP_SENDER_UNITS 128     // packets or records waiting in the queue
+#define TCP_SENDER_UNIT_MAX 1472 // largest packet or record batch, BUFFER_SIZE fits
+
+/// @brief Non-blocking writer for one TCP stream socket. What the socket does
+///        not take at once waits in a queue of whole units (raw packets or
+///        record batches) and goes out on the next `flush()`; a unit the
+///        socket took only part of is finished before anything else, so the
+///        stream never carries a torn packet. When the queue is full the
+///        policy decides which units are lost, and they are counted.
+///        The caller keeps the socket; this never closes it.
+class TcpSender
+{
+public:
+    enum POLICY
+    {
+        POLICY_DROP_OLDEST, // make room by dropping the oldest queued units
+        POLICY_LATEST,      // drop the whole backlog, resume with the newest
+        POLICY_DECIMATE,    // above half full queue every other unit, then drop new ones
+        POLICY_PAUSE        // once full take nothing until the queue drained
+    };
+
+    TcpSender();
+
+    void begin(int fd, POLICY policy, size_t limit);
+    void end(void);
+    size_t write(const uint8_t *data, size_t length, size_t unit);
+    bool flush(void);
+    bool isOpen(void) const { return _fd >= 0 && !_failed; }
+    bool isPaused(void) const { return _paused; }
+    POLICY getPolicy(void) const { return _policy; }
+    /// @brief Bytes waiting, the rest of a cut unit included
+    size_t getQueued(void) const { return _end - _start + _partialLength - _partialSent; }
+    /// @brief Bytes the socket took since begin()
+    uint32_t getSent(void) const { return _sent; }
+    /// @brief Units the policy dropped since begin()
+    uint32_t getDropped(void) const { return _dropped; }
+    uint32_t getDroppedBytes(void) const { return _droppedBytes; }
+
+private:
+    size_t transmit(const uint8_t *data, size_t length);
+    bool enqueue(const uint8_t *data, size_t length);
+    void dropOldest(void);
+    void drop(size_t length);
+
+    int _fd;
+    bool _failed;
+    bool _paused;
+    bool _skip; // POLICY_DECIMATE: the next unit is the one left out
+    POLICY _policy;
+    size_t _limit; // queue bytes before the policy applies
+    uint32_t _sent;
+    uint32_t _dropped;
+    uint32_t _droppedBytes;
+    uint16_t _partialLength; // unit the socket took part of, finished first
+    uint16_t _partialSent;
+    uint16_t _start; // queue[start, end) waits, whole units only
+    uint16_t _end;
+    uint16_t _first; // units[first, first + count) are their lengths
+    uint16_t _count;
+    uint16_t _units[TCP_SENDER_UNITS];
+    uint8_t _partial[TCP_SENDER_UNIT_MAX];
+    uint8_t _queue[TCP_SENDER_QUEUE];
+};
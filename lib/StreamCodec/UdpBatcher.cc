@@ -0,0 +1,181 @@
+#include <string.h>
+#include "UdpBatcher.h"
+
+UdpBatcher::UdpBatcher()
+{
+    configure(UDP_BATCH_MAX_DATAGRAM, true, 0, 1);
+}
+
+/// @brief Set the datagram layout, then start a new sequence
+/// @param datagramSize {uint16_t} - Largest datagram to send, clamped to UDP_BATCH_MAX_DATAGRAM
+/// @param header       {bool} - Prefix each datagram with the sequence header
+/// @param copies       {uint8_t} - Extra copies of every datagram
+/// @param spacing      {uint8_t} - Datagrams between two copies
+/// @param fecData      {uint8_t} - Data datagrams per FEC block, 0 for no FEC
+/// @param fecParity    {uint8_t} - Parity datagrams per FEC block
+void UdpBatcher::configure(uint16_t datagramSize, bool header, uint8_t copies, uint8_t spacing,
+                           uint8_t fecData, uint8_t fecParity)
+{
+    const uint16_t reserved = clamp(datagramSize, header, copies, spacing, fecData, fecParity);
+    _fec.configure(fecData, fecParity);
+    _header = header;
+    _copies = copies;
+    _spacing = spacing;
+    _datagramSize = datagramSize;
+    _packetsPerDatagram = (datagramSize - reserved) / UDP_BATCH_PACKET_SIZE;
+    reset();
+}
+
+/// @brief Whether configure() with these settings would keep the datagram
+///        layout as it is, its receivers need not notice a change then
+/// @return {bool} - `true` if the settings come down to the current ones
+bool UdpBatcher::isConfigured(uint16_t datagramSize, bool header, uint8_t copies, uint8_t spacing,
+                              uint8_t fecData, uint8_t fecParity)
+{
+    clamp(datagramSize, header, copies, spacing, fecData, fecParity);
+    return datagramSize == _datagramSize && header == _header && copies == _copies && spacing == _spacing &&
+           fecData == _fec.getData() && fecParity == _fec.getParity();
+}
+
+/// @brief Bring the settings into range, as configure() applies them
+/// @return {uint16_t} - Bytes of each datagram taken by its headers
+uint16_t UdpBatcher::clamp(uint16_t &datagramSize, bool &header, uint8_t &copies, uint8_t &spacing,
+                           uint8_t &fecData, uint8_t &fecParity)
+{
+    // Parity needs the sequence header and replaces the copies
+    UdpFecEncoder::clamp(fecData, fecParity);
+    const bool fec = fecData > 0;
+    if (fec)
+    {
+        header = true;
+        copies = 0;
+    }
+    // Room for the FEC length/count bytes so a parity datagram fits the MTU too
+    const uint16_t reserved = header ? UDP_BATCH_HEADER_SIZE + (fec ? UDP_FEC_OVERHEAD : 0) : 0;
+    if (datagramSize > UDP_BATCH_MAX_DATAGRAM)
+    {
+        datagramSize = UDP_BATCH_MAX_DATAGRAM;
+    }
+    if (datagramSize < reserved + UDP_BATCH_PACKET_SIZE)
+    {
+        datagramSize = reserved + UDP_BATCH_PACKET_SIZE;
+    }
+    if (spacing == 0)
+    {
+        spacing = 1;
+    }
+    // The last copy must still be in the history when it is due
+    while (copies > 0 && copies * spacing >= UDP_BATCH_HISTORY)
+    {
+        if (spacing > 1)
+        {
+            spacing--;
+        }
+        else
+        {
+            copies--;
+        }
+    }
+    return reserved;
+}
+
+void UdpBatcher::reset(void)
+{
+    _pending = 0;
+    _sequence = 0;
+    _sent = 0;
+    memset(_lengths, 0, sizeof(_lengths));
+    _fec.reset();
+}
+
+/// @brief Append one wire packet, sending the datagram once it is full
+/// @param packet {const uint8_t *} - UDP_BATCH_PACKET_SIZE bytes
+/// @param sink   {DatagramSink &} - Receives finished datagrams
+/// @return {bool} - `true` if a datagram went out
+bool UdpBatcher::addPacket(const uint8_t *packet, DatagramSink &sink)
+{
+    uint8_t *datagram = _datagrams[_sequence & (UDP_BATCH_HISTORY - 1)];
+    const uint16_t offset = (_header ? UDP_BATCH_HEADER_SIZE : 0) + _pending * UDP_BATCH_PACKET_SIZE;
+    memcpy(datagram + offset, packet, UDP_BATCH_PACKET_SIZE);
+    _pending++;
+    if (_pending < _packetsPerDatagram)
+    {
+        return false;
+    }
+    return flush(sink);
+}
+
+/// @brief Append a run of back to back wire packets, one copy per datagram filled
+/// @param packets {const uint8_t *} - count * UDP_BATCH_PACKET_SIZE bytes
+/// @param count   {uint32_t} - Number of packets
+/// @param sink    {DatagramSink &} - Receives finished datagrams
+/// @return {uint32_t} - Datagrams sent
+uint32_t UdpBatcher::addPackets(const uint8_t *packets, uint32_t count, DatagramSink &sink)
+{
+    uint32_t sent = 0;
+    while (count > 0)
+    {
+        uint8_t *datagram = _datagrams[_sequence & (UDP_BATCH_HISTORY - 1)];
+        const uint16_t offset = (_header ? UDP_BATCH_HEADER_SIZE : 0) + _pending * UDP_BATCH_PACKET_SIZE;
+        uint32_t n = _packetsPerDatagram - _pending;
+        if (n > count)
+        {
+            n = count;
+        }
+        memcpy(datagram + offset, packets, n * UDP_BATCH_PACKET_SIZE);
+        _pending += n;
+        packets += n * UDP_BATCH_PACKET_SIZE;
+        count -= n;
+        if (_pending >= _packetsPerDatagram && flush(sink))
+        {
+            sent++;
+        }
+    }
+    return sent;
+}
+
+/// @brief Send the datagram being filled, even if it is not full, followed by
+///        the copies of older datagrams that are due.
+/// @param sink {DatagramSink &} - Receives the datagrams
+/// @return {bool} - `true` if a datagram went out
+bool UdpBatcher::flush(DatagramSink &sink)
+{
+    if (_pending == 0)
+    {
+        return false;
+    }
+    const uint8_t slot = _sequence & (UDP_BATCH_HISTORY - 1);
+    uint8_t *datagram = _datagrams[slot];
+    uint16_t length = _pending * UDP_BATCH_PACKET_SIZE;
+    if (_header)
+    {
+        datagram[0] = UDP_BATCH_TYPE_DATA;
+        datagram[1] = (uint8_t)_pending;
+        datagram[2] = (uint8_t)(_sequence >> 24);
+        datagram[3] = (uint8_t)(_sequence >> 16);
+        datagram[4] = (uint8_t)(_sequence >> 8);
+        datagram[5] = (uint8_t)_sequence;
+        datagram[6] = _fec.getData();
+        datagram[7] = _fec.getParity();
+        length += UDP_BATCH_HEADER_SIZE;
+    }
+    _lengths[slot] = length;
+    sink.sendDatagram(datagram, length);
+    _sent++;
+    _fec.add(datagram, length, sink);
+
+    for (uint8_t copy = 1; copy <= _copies; copy++)
+    {
+        const uint32_t distance = (uint32_t)copy * _spacing;
+        if (distance >= _sent)
+        {
+            break;
+        }
+        const uint8_t old = (_sequence - distance) & (UDP_BATCH_HISTORY - 1);
+        sink.sendDatagram(_datagrams[old], _lengths[old]);
+    }
+
+    _sequence++;
+    _pending = 0;
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "UdpDatagram.h"
+#include "UdpFec.h"
+
+#define UDP_BATCH_HISTORY 8 // datagrams kept for delayed redundant copies, power of two
+
+/// @brief Packs 33 byte OpenBCI packets into datagrams of up to the path MTU.
+///        Redundant copies of datagram k go out after datagrams k+s, k+2s... so
+///        a burst shorter than `spacing` datagrams cannot take out every copy.
+///        Alternatively every block of data datagrams is followed by XOR parity.
+class UdpBatcher
+{
+public:
+    UdpBatcher();
+
+    void configure(uint16_t datagramSize, bool header, uint8_t copies, uint8_t spacing,
+                   uint8_t fecData = 0, uint8_t fecParity = 0);
+    bool isConfigured(uint16_t datagramSize, bool header, uint8_t copies, uint8_t spacing,
+                      uint8_t fecData = 0, uint8_t fecParity = 0);
+    void reset(void);
+    bool addPacket(const uint8_t *packet, DatagramSink &sink);
+    uint32_t addPackets(const uint8_t *packets, uint32_t count, DatagramSink &sink);
+    bool flush(DatagramSink &sink);
+
+    uint8_t getCopies(void) { return _copies; }
+    uint16_t getDatagramSize(void) { return _datagramSize; }
+    uint8_t getFecData(void) { return _fec.getData(); }
+    uint8_t getFecParity(void) { return _fec.getParity(); }
+    uint16_t getPacketsPerDatagram(void) { return _packetsPerDatagram; }
+    uint16_t getPending(void) { return _pending; }
+    uint32_t getSequence(void) { return _sequence; }
+    uint8_t getSpacing(void) { return _spacing; }
+
+private:
+    static uint16_t clamp(uint16_t &datagramSize, bool &header, uint8_t &copies, uint8_t &spacing,
+                          uint8_t &fecData, uint8_t &fecParity);
+
+    uint8_t _datagrams[UDP_BATCH_HISTORY][UDP_BATCH_MAX_DATAGRAM];
+    uint16_t _lengths[UDP_BATCH_HISTORY];
+    UdpFecEncoder _fec;
+
+    bool _header;
+    uint8_t _copies;
+    uint8_t _spacing;
+    uint16_t _datagramSize;
+    uint16_t _packetsPerDatagram;
+    uint16_t _pending;   // packets in the datagram being filled
+    uint32_t _sequence;  // sequence number of the datagram being filled
+    uint32_t _sent;      // datagrams finished since reset
+};
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/** Data datagram:   [0xB0][packet count][sequence, 4 bytes big endian][FEC data][FEC parity] packets...
+ *  Parity datagram: [0xB1][parity index][first sequence of the block][FEC data][FEC parity] XOR of the block */
+#define UDP_BATCH_HEADER_SIZE 8
+#define UDP_BATCH_TYPE_DATA 0xB0
+#define UDP_BATCH_TYPE_PARITY 0xB1
+#define UDP_BATCH_PACKET_SIZE 33 // one OpenBCI wire packet, 0xA0 ... stop byte
+#ifndef UDP_BATCH_MAX_DATAGRAM
+#define UDP_BATCH_MAX_DATAGRAM 1440
+#endif
+
+/// @brief Where finished datagrams go, e.g. a WiFiUDP or a test capture
+class DatagramSink
+{
+public:
+    virtual ~DatagramSink() {}
+    /// @return {bool} - `false` if the datagram could not be sent
+    virtual bool sendDatagram(const uint8_t *data, size_t length) = 0;
+};
+
+/// @brief Big endian sequence number at bytes 2..5 of a header
+inline uint32_t udpDatagramSequence(const uint8_t *datagram)
+{
+    return ((uint32_t)datagram[2] << 24) | ((uint32_t)datagram[3] << 16) | ((uint32_t)datagram[4] << 8) | datagram[5];
+}
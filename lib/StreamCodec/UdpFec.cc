@@ -0,0 +1,278 @@
+#include <string.h>
+#include "UdpFec.h"
+
+/// @brief The protected form of a data datagram: [body length, 2 bytes][packet count][body]
+static uint16_t symbolLength(uint16_t datagramLength)
+{
+    return datagramLength - UDP_BATCH_HEADER_SIZE + UDP_FEC_OVERHEAD;
+}
+
+static uint8_t symbolByte(const uint8_t *datagram, uint16_t length, uint16_t i)
+{
+    const uint16_t body = length - UDP_BATCH_HEADER_SIZE;
+    switch (i)
+    {
+    case 0:
+        return (uint8_t)(body >> 8);
+    case 1:
+        return (uint8_t)body;
+    case 2:
+        return datagram[1];
+    default:
+        return datagram[UDP_BATCH_HEADER_SIZE + i - UDP_FEC_OVERHEAD];
+    }
+}
+
+static void writeHeader(uint8_t *datagram, uint8_t type, uint8_t second, uint32_t sequence, uint8_t data, uint8_t parity)
+{
+    datagram[0] = type;
+    datagram[1] = second;
+    datagram[2] = (uint8_t)(sequence >> 24);
+    datagram[3] = (uint8_t)(sequence >> 16);
+    datagram[4] = (uint8_t)(sequence >> 8);
+    datagram[5] = (uint8_t)sequence;
+    datagram[6] = data;
+    datagram[7] = parity;
+}
+
+UdpFecEncoder::UdpFecEncoder()
+{
+    configure(0, 0);
+}
+
+/// @brief Bring a block geometry into range, as configure() applies it
+/// @param data   {uint8_t &} - Data datagrams per block, up to UDP_FEC_MAX_DATA
+/// @param parity {uint8_t &} - Parity datagrams per block, up to UDP_FEC_MAX_PARITY and `data`
+void UdpFecEncoder::clamp(uint8_t &data, uint8_t &parity)
+{
+    if (data > UDP_FEC_MAX_DATA)
+    {
+        data = UDP_FEC_MAX_DATA;
+    }
+    if (parity > UDP_FEC_MAX_PARITY)
+    {
+        parity = UDP_FEC_MAX_PARITY;
+    }
+    if (parity > data)
+    {
+        parity = data;
+    }
+    if (parity == 0)
+    {
+        data = 0;
+    }
+}
+
+/// @brief Set the block geometry, `data` 0 turns FEC off
+/// @param data   {uint8_t} - Data datagrams per block, see clamp()
+/// @param parity {uint8_t} - Parity datagrams per block
+void UdpFecEncoder::configure(uint8_t data, uint8_t parity)
+{
+    clamp(data, parity);
+    _data = data;
+    _parity = parity;
+    reset();
+}
+
+void UdpFecEncoder::reset(void)
+{
+    _position = 0;
+    _blockStart = 0;
+    memset(_lengths, 0, sizeof(_lengths));
+    memset(_accumulators, 0, sizeof(_accumulators));
+}
+
+/// @brief Fold a data datagram that was just sent into its parity, sending the
+///        parity datagrams once the block is complete
+/// @param datagram {const uint8_t *} - Data datagram with header, bytes 6/7 set to the geometry
+/// @param length   {uint16_t} - Its length in bytes
+/// @param sink     {DatagramSink &} - Receives the parity datagrams
+void UdpFecEncoder::add(const uint8_t *datagram, uint16_t length, DatagramSink &sink)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    if (_position == 0)
+    {
+        _blockStart = udpDatagramSequence(datagram);
+    }
+    const uint8_t j = _position % _parity;
+    uint8_t *acc = _accumulators[j] + UDP_BATCH_HEADER_SIZE;
+    const uint16_t n = symbolLength(length);
+    for (uint16_t i = 0; i < n; i++)
+    {
+        acc[i] ^= symbolByte(datagram, length, i);
+    }
+    if (n > _lengths[j])
+    {
+        _lengths[j] = n;
+    }
+
+    if (++_position < _data)
+    {
+        return;
+    }
+    for (uint8_t p = 0; p < _parity; p++)
+    {
+        writeHeader(_accumulators[p], UDP_BATCH_TYPE_PARITY, p, _blockStart, _data, _parity);
+        sink.sendDatagram(_accumulators[p], UDP_BATCH_HEADER_SIZE + _lengths[p]);
+    }
+    reset();
+}
+
+UdpFecDecoder::UdpFecDecoder()
+{
+    reset();
+}
+
+void UdpFecDecoder::reset(void)
+{
+    _blocks.clear();
+    _delivered = 0;
+    _duplicates = 0;
+    _recovered = 0;
+}
+
+/// @brief Find or start the block beginning at `start`
+/// @return {Block *} - NULL if the block is older than every block still kept
+UdpFecDecoder::Block *UdpFecDecoder::getBlock(uint32_t start, uint8_t data, uint8_t parity)
+{
+    std::map<uint32_t, Block>::iterator it = _blocks.find(start);
+    if (it != _blocks.end())
+    {
+        return &it->second;
+    }
+    if (_blocks.size() >= UDP_FEC_DECODER_BLOCKS && start < _blocks.begin()->first)
+    {
+        return NULL;
+    }
+    // Forget the oldest block, it is too old to still receive its parity
+    if (_blocks.size() >= UDP_FEC_DECODER_BLOCKS)
+    {
+        _blocks.erase(_blocks.begin());
+    }
+    Block &block = _blocks[start];
+    block.data = data;
+    block.parity = parity;
+    block.have = 0;
+    block.symbols.resize(data);
+    block.parities.resize(parity);
+    return &block;
+}
+
+/// @brief Accept one datagram off the wire
+/// @param datagram {const uint8_t *} - Data or parity datagram with header
+/// @param length   {size_t} - Its length in bytes
+/// @param out      {DatagramSink &} - Receives every data datagram exactly once
+void UdpFecDecoder::receive(const uint8_t *datagram, size_t length, DatagramSink &out)
+{
+    if (length < UDP_BATCH_HEADER_SIZE)
+    {
+        return;
+    }
+    const uint32_t sequence = udpDatagramSequence(datagram);
+    const uint8_t data = datagram[6];
+    const uint8_t parity = datagram[7];
+    const bool fec = data > 0 && data <= UDP_FEC_MAX_DATA && parity > 0 && parity <= UDP_FEC_MAX_PARITY;
+
+    if (datagram[0] == UDP_BATCH_TYPE_DATA)
+    {
+        if (!fec)
+        {
+            _delivered++;
+            out.sendDatagram(datagram, length);
+            return;
+        }
+        const uint32_t start = sequence - sequence % data;
+        const uint8_t position = sequence % data;
+        Block *block = getBlock(start, data, parity);
+        if (block == NULL)
+        {
+            return;
+        }
+        if (block->have & (1UL << position))
+        {
+            _duplicates++;
+            return;
+        }
+        block->have |= 1UL << position;
+        std::vector<uint8_t> &symbol = block->symbols[position];
+        symbol.resize(symbolLength(length));
+        for (uint16_t i = 0; i < symbol.size(); i++)
+        {
+            symbol[i] = symbolByte(datagram, length, i);
+        }
+        _delivered++;
+        out.sendDatagram(datagram, length);
+        tryRecover(start, *block, position % parity, out);
+    }
+    else if (datagram[0] == UDP_BATCH_TYPE_PARITY && fec && datagram[1] < parity)
+    {
+        Block *block = getBlock(sequence, data, parity);
+        if (block == NULL)
+        {
+            return;
+        }
+        if (!block->parities[datagram[1]].empty())
+        {
+            _duplicates++;
+            return;
+        }
+        block->parities[datagram[1]].assign(datagram + UDP_BATCH_HEADER_SIZE, datagram + length);
+        tryRecover(sequence, *block, datagram[1], out);
+    }
+}
+
+/// @brief Rebuild the one missing member of a parity class, if exactly one is missing
+void UdpFecDecoder::tryRecover(uint32_t start, Block &block, uint8_t parityIndex, DatagramSink &out)
+{
+    const std::vector<uint8_t> &parity = block.parities[parityIndex];
+    if (parity.empty())
+    {
+        return;
+    }
+    int missing = -1;
+    for (uint8_t p = parityIndex; p < block.data; p += block.parity)
+    {
+        if (block.have & (1UL << p))
+        {
+            continue;
+        }
+        if (missing >= 0)
+        {
+            return; // two holes in this class, parity cannot help
+        }
+        missing = p;
+    }
+    if (missing < 0 || parity.size() < UDP_FEC_OVERHEAD)
+    {
+        return;
+    }
+
+    std::vector<uint8_t> symbol(parity);
+    for (uint8_t p = parityIndex; p < block.data; p += block.parity)
+    {
+        const std::vector<uint8_t> &member = block.symbols[p];
+        for (size_t i = 0; p != missing && i < member.size() && i < symbol.size(); i++)
+        {
+            symbol[i] ^= member[i];
+        }
+    }
+    const uint16_t body = ((uint16_t)symbol[0] << 8) | symbol[1];
+    if ((size_t)body + UDP_FEC_OVERHEAD > symbol.size())
+    {
+        return; // corrupt parity
+    }
+    symbol.resize(body + UDP_FEC_OVERHEAD);
+
+    std::vector<uint8_t> datagram(UDP_BATCH_HEADER_SIZE + body);
+    writeHeader(&datagram[0], UDP_BATCH_TYPE_DATA, symbol[2], start + missing, block.data, block.parity);
+    memcpy(&datagram[UDP_BATCH_HEADER_SIZE], &symbol[UDP_FEC_OVERHEAD], body);
+
+    block.have |= 1UL << missing;
+    block.symbols[missing] = symbol;
+    _delivered++;
+    _recovered++;
+    out.sendDatagram(&datagram[0], datagram.size());
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include "UdpDatagram.h"
+
+#define UDP_FEC_MAX_DATA 32   // data datagrams per block
+#define UDP_FEC_MAX_PARITY 4  // parity datagrams per block
+#define UDP_FEC_OVERHEAD 3    // body length (2) and packet count (1) are protected too
+#define UDP_FEC_DECODER_BLOCKS 8 // blocks a decoder keeps waiting for parity
+
+/// @brief Interleaved XOR parity over blocks of `data` datagrams. Parity j covers
+///        every data datagram whose position in the block is j modulo `parity`,
+///        so any loss pattern with at most one hole per parity class, e.g. a
+///        burst of up to `parity` data datagrams, is recovered.
+class UdpFecEncoder
+{
+public:
+    UdpFecEncoder();
+
+    static void clamp(uint8_t &data, uint8_t &parity);
+    void configure(uint8_t data, uint8_t parity);
+    void reset(void);
+    void add(const uint8_t *datagram, uint16_t length, DatagramSink &sink);
+
+    bool isEnabled(void) { return _data > 0; }
+    uint8_t getData(void) { return _data; }
+    uint8_t getParity(void) { return _parity; }
+
+private:
+    uint8_t _accumulators[UDP_FEC_MAX_PARITY][UDP_BATCH_MAX_DATAGRAM];
+    uint16_t _lengths[UDP_FEC_MAX_PARITY]; // longest symbol folded into each accumulator
+
+    uint8_t _data;
+    uint8_t _parity;
+    uint8_t _position;    // position of the next data datagram in the block
+    uint32_t _blockStart; // sequence of the first data datagram in the block
+};
+
+/// @brief Host side counterpart of UdpFecEncoder. Feed it datagrams as they
+///        arrive; it forwards each data datagram of a FEC stream once, plus
+///        any it rebuilds from parity.
+class UdpFecDecoder
+{
+public:
+    UdpFecDecoder();
+
+    void receive(const uint8_t *datagram, size_t length, DatagramSink &out);
+    void reset(void);
+
+    uint32_t getDelivered(void) { return _delivered; }
+    uint32_t getDuplicates(void) { return _duplicates; }
+    uint32_t getRecovered(void) { return _recovered; }
+
+private:
+    struct Block
+    {
+        uint8_t data;
+        uint8_t parity;
+        uint32_t have; // bit per data position already delivered
+        std::vector<std::vector<uint8_t> > symbols;
+        std::vector<std::vector<uint8_t> > parities;
+    };
+
+    Block *getBlock(uint32_t start, uint8_t data, uint8_t parity);
+    void tryRecover(uint32_t start, Block &block, uint8_t parityIndex, DatagramSink &out);
+
+    std::map<uint32_t, Block> _blocks;
+    uint32_t _delivered;
+    uint32_t _duplicates;
+    uint32_t _recovered;
+};
@@ -0,0 +1,504 @@
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "WebSocketServer.h"
+
+#ifdef MSG_NOSIGNAL
+#define WEB_SOCKET_SEND_FLAGS (MSG_DONTWAIT | MSG_NOSIGNAL) // a client gone mid write must not raise SIGPIPE on the host
+#else
+#define WEB_SOCKET_SEND_FLAGS MSG_DONTWAIT
+#endif
+
+static const char webSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+static const char keyHeader[] = "Sec-WebSocket-Key:";
+static const char badRequest[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+
+static uint32_t rotate(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+/// @brief SHA-1 of up to a few blocks, only the handshake needs it
+static void sha1(const uint8_t *data, size_t length, uint8_t *digest)
+{
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    const size_t total = ((length + 8) / 64 + 1) * 64; // message, 0x80, zeros, 64 bit bit length
+    for (size_t block = 0; block < total; block += 64)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++)
+        {
+            uint32_t word = 0;
+            for (int j = 0; j < 4; j++)
+            {
+                const size_t at = block + 4 * i + j;
+                uint8_t byte = 0;
+                if (at < length)
+                {
+                    byte = data[at];
+                }
+                else if (at == length)
+                {
+                    byte = 0x80;
+                }
+                else if (at >= total - 8)
+                {
+                    byte = (uint8_t)(((uint64_t)length * 8) >> (8 * (total - 1 - at)));
+                }
+                word = (word << 8) | byte;
+            }
+            w[i] = word;
+        }
+        for (int i = 16; i < 80; i++)
+        {
+            w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++)
+        {
+            uint32_t f, k;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            const uint32_t t = rotate(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotate(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 20; i++)
+    {
+        digest[i] = (uint8_t)(h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+WebSocketServer::WebSocketServer()
+    : _listener(-1), _port(0), _framesSent(0), _framesDropped(0)
+{
+    for (int i = 0; i < WEB_SOCKET_MAX_CLIENTS; i++)
+    {
+        _clients[i].fd = -1;
+        _clients[i].state = STATE_FREE;
+    }
+}
+
+WebSocketServer::~WebSocketServer()
+{
+    end();
+}
+
+/// @brief Start listening
+/// @param port {uint16_t} - TCP port, 0 picks a free one, see getPort()
+/// @return {bool} - `false` if the socket could not be set up
+bool WebSocketServer::begin(uint16_t port)
+{
+    end();
+    _listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (_listener < 0)
+    {
+        return false;
+    }
+    int on = 1;
+    setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    socklen_t addressLength = sizeof(address);
+    if (bind(_listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(_listener, WEB_SOCKET_MAX_CLIENTS) != 0 ||
+        getsockname(_listener, (struct sockaddr *)&address, &addressLength) != 0)
+    {
+        end();
+        return false;
+    }
+    fcntl(_listener, F_SETFL, fcntl(_listener, F_GETFL, 0) | O_NONBLOCK);
+    _port = ntohs(address.sin_port);
+    _framesSent = _framesDropped = 0;
+    return true;
+}
+
+/// @brief Drop every client and stop listening
+void WebSocketServer::end(void)
+{
+    for (int i = 0; i < WEB_SOCKET_MAX_CLIENTS; i++)
+    {
+        close(_clients[i]);
+    }
+    if (_listener >= 0)
+    {
+        ::close(_listener);
+        _listener = -1;
+    }
+    _port = 0;
+}
+
+/// @brief Accept new clients, read handshakes and control frames, and push
+///        out what the sockets would not take before. Call it from the loop.
+void WebSocketServer::poll(void)
+{
+    if (_listener < 0)
+    {
+        return;
+    }
+    accept();
+    for (int i = 0; i < WEB_SOCKET_MAX_CLIENTS; i++)
+    {
+        Client &client = _clients[i];
+        if (client.state != STATE_FREE)
+        {
+            receive(client);
+        }
+        if (client.state != STATE_FREE && flush(client) && client.state == STATE_CLOSING && client.sent == client.queued)
+        {
+            close(client);
+        }
+    }
+}
+
+/// @brief Queue one frame for every open client
+/// @param data   {const uint8_t *} - Payload
+/// @param length {size_t} - Up to WEB_SOCKET_QUEUE - WEB_SOCKET_HEADER_MAX bytes
+/// @param opcode {uint8_t} - WEB_SOCKET_OPCODE_BINARY or WEB_SOCKET_OPCODE_TEXT
+/// @return {uint8_t} - Clients that got the frame; the others had no room and
+///                     lost it, see getFramesDropped()
+uint8_t WebSocketServer::broadcast(const uint8_t *data, size_t length, uint8_t opcode)
+{
+    uint8_t header[WEB_SOCKET_HEADER_MAX];
+    const size_t headerLength = frameHeader(opcode, length, header);
+    uint8_t delivered = 0;
+    for (int i = 0; i < WEB_SOCKET_MAX_CLIENTS; i++)
+    {
+        Client &client = _clients[i];
+        if (client.state != STATE_OPEN)
+        {
+            continue;
+        }
+        flush(client); // make room first, a client that caught up takes the frame straight away
+        if (client.state != STATE_OPEN)
+        {
+            continue;
+        }
+        if (enqueue(client, header, headerLength, data, length))
+        {
+            _framesSent++;
+            delivered++;
+            flush(client);
+        }
+        else
+        {
+            _framesDropped++;
+        }
+    }
+    return delivered;
+}
+
+/// @return {uint8_t} - Clients past the handshake
+uint8_t WebSocketServer::getClients(void) const
+{
+    uint8_t count = 0;
+    for (int i = 0; i < WEB_SOCKET_MAX_CLIENTS; i++)
+    {
+        count += _clients[i].state == STATE_OPEN;
+    }
+    return count;
+}
+
+/// @brief The Sec-WebSocket-Accept value for a client's Sec-WebSocket-Key
+/// @param out {char *} - Receives WEB_SOCKET_ACCEPT_LENGTH characters and a NUL
+void WebSocketServer::acceptKey(const char *key, size_t keyLength, char *out)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint8_t text[64 + sizeof(webSocketGuid)];
+    if (keyLength > 64)
+    {
+        keyLength = 64; // a real key is 24 characters
+    }
+    memcpy(text, key, keyLength);
+    memcpy(text + keyLength, webSocketGuid, sizeof(webSocketGuid) - 1);
+    uint8_t digest[21];
+    sha1(text, keyLength + sizeof(webSocketGuid) - 1, digest);
+    digest[20] = 0;
+    for (int i = 0; i < 7; i++)
+    {
+        const uint32_t group = (digest[3 * i] << 16) | (digest[3 * i + 1] << 8) | digest[3 * i + 2];
+        for (int j = 0; j < 4; j++)
+        {
+            out[4 * i + j] = alphabet[(group >> (18 - 6 * j)) & 0x3F];
+        }
+    }
+    out[WEB_SOCKET_ACCEPT_LENGTH - 1] = '='; // 20 bytes are 6 groups and 2 bytes
+    out[WEB_SOCKET_ACCEPT_LENGTH] = 0;
+}
+
+/// @brief Header of a final, unmasked frame
+/// @param out {uint8_t *} - Room for WEB_SOCKET_HEADER_MAX bytes
+/// @return {size_t} - Header bytes written
+size_t WebSocketServer::frameHeader(uint8_t opcode, size_t length, uint8_t *out)
+{
+    out[0] = 0x80 | opcode;
+    if (length < 126)
+    {
+        out[1] = (uint8_t)length;
+        return 2;
+    }
+    if (length <= 0xFFFF)
+    {
+        out[1] = 126;
+        out[2] = (uint8_t)(length >> 8);
+        out[3] = (uint8_t)length;
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; i++)
+    {
+        out[2 + i] = (uint8_t)((uint64_t)length >> (56 - 8 * i));
+    }
+    return 10;
+}
+
+void WebSocketServer::accept(void)
+{
+    for (;;)
+    {
+        const int fd = ::accept(_listener, NULL, NULL);
+        if (fd < 0)
+        {
+            return; // EWOULDBLOCK: nobody waiting
+        }
+        Client *client = NULL;
+        for (int i = 0; i < WEB_SOCKET_MAX_CLIENTS && client == NULL; i++)
+        {
+            client = _clients[i].state == STATE_FREE ? &_clients[i] : NULL;
+        }
+        if (client == NULL)
+        {
+            ::close(fd); // full
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        client->fd = fd;
+        client->state = STATE_HANDSHAKE;
+        client->received = client->sent = client->queued = 0;
+    }
+}
+
+void WebSocketServer::receive(Client &client)
+{
+    const ssize_t n = recv(client.fd, client.in + client.received, WEB_SOCKET_REQUEST_MAX - client.received, MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EWOULDBLOCK && errno != EAGAIN))
+    {
+        close(client); // gone
+        return;
+    }
+    if (n < 0 || client.state == STATE_CLOSING)
+    {
+        client.received = 0; // nothing new, or nothing of interest any more
+        return;
+    }
+    client.received += n;
+    if (client.state == STATE_HANDSHAKE ? !handshake(client) : !frames(client))
+    {
+        client.state = STATE_CLOSING;
+    }
+}
+
+/// @brief Answer the upgrade request once all of it is in
+/// @return {bool} - `false` if it is not one, a 400 is queued then
+bool WebSocketServer::handshake(Client &client)
+{
+    const char *request = (const char *)client.in;
+    const uint8_t *end = NULL;
+    for (uint16_t i = 4; i <= client.received && end == NULL; i++)
+    {
+        end = memcmp(client.in + i - 4, "\r\n\r\n", 4) == 0 ? client.in + i : NULL; // just past the blank line
+    }
+    if (end == NULL)
+    {
+        if (client.received < WEB_SOCKET_REQUEST_MAX)
+        {
+            return true; // wait for the rest
+        }
+        enqueue(client, (const uint8_t *)badRequest, sizeof(badRequest) - 1, NULL, 0);
+        return false;
+    }
+    const char *key = NULL;
+    size_t keyLength = 0;
+    for (const char *line = request; line < (const char *)end && key == NULL;)
+    {
+        const char *next = (const char *)memchr(line, '\n', (const char *)end - line);
+        next = next == NULL ? (const char *)end : next + 1;
+        if (next - line > (long)sizeof(keyHeader) && strncasecmp(line, keyHeader, sizeof(keyHeader) - 1) == 0)
+        {
+            key = line + sizeof(keyHeader) - 1;
+            while (*key == ' ')
+            {
+                key++;
+            }
+            while (key + keyLength < next && key[keyLength] > ' ')
+            {
+                keyLength++;
+            }
+        }
+        line = next;
+    }
+    if (strncmp(request, "GET ", 4) != 0 || key == NULL || keyLength == 0)
+    {
+        enqueue(client, (const uint8_t *)badRequest, sizeof(badRequest) - 1, NULL, 0);
+        return false;
+    }
+    char accept[WEB_SOCKET_ACCEPT_LENGTH + 1];
+    acceptKey(key, keyLength, accept);
+    static const char switching[] = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                                    "Sec-WebSocket-Accept: ";
+    enqueue(client, (const uint8_t *)switching, sizeof(switching) - 1, (const uint8_t *)accept, WEB_SOCKET_ACCEPT_LENGTH);
+    enqueue(client, (const uint8_t *)"\r\n\r\n", 4, NULL, 0);
+    const uint16_t rest = client.received - (end - client.in);
+    memmove(client.in, end, rest);
+    client.received = rest;
+    client.state = STATE_OPEN;
+    return frames(client);
+}
+
+/// @brief Handle the complete frames a client sent: ping gets its pong, close
+///        its close, data is not used. Frames from a client must be masked.
+/// @return {bool} - `false` once the connection is to close
+bool WebSocketServer::frames(Client &client)
+{
+    while (client.received >= 2)
+    {
+        const uint8_t *in = client.in;
+        const uint8_t opcode = in[0] & 0x0F;
+        size_t length = in[1] & 0x7F;
+        size_t at = 2;
+        if ((in[1] & 0x80) == 0 || length == 127)
+        {
+            return false; // unmasked, or far more than we take
+        }
+        if (length == 126)
+        {
+            if (client.received < 4)
+            {
+                return true;
+            }
+            length = (in[2] << 8) | in[3];
+            at = 4;
+        }
+        if (at + 4 + length > WEB_SOCKET_REQUEST_MAX)
+        {
+            return false;
+        }
+        if (client.received < at + 4 + length)
+        {
+            return true;
+        }
+        uint8_t *payload = client.in + at + 4;
+        for (size_t i = 0; i < length; i++)
+        {
+            payload[i] ^= in[at + (i & 3)];
+        }
+        if (opcode == WEB_SOCKET_OPCODE_CLOSE || opcode == WEB_SOCKET_OPCODE_PING)
+        {
+            uint8_t header[WEB_SOCKET_HEADER_MAX];
+            const uint8_t reply = opcode == WEB_SOCKET_OPCODE_PING ? WEB_SOCKET_OPCODE_PONG : WEB_SOCKET_OPCODE_CLOSE;
+            enqueue(client, header, frameHeader(reply, length, header), payload, length);
+            if (opcode == WEB_SOCKET_OPCODE_CLOSE)
+            {
+                return false;
+            }
+        }
+        const uint16_t used = at + 4 + length;
+        memmove(client.in, client.in + used, client.received - used);
+        client.received -= used;
+    }
+    return true;
+}
+
+/// @brief Append header and data to a client's queue, both or nothing
+bool WebSocketServer::enqueue(Client &client, const uint8_t *header, size_t headerLength, const uint8_t *data, size_t length)
+{
+    if (client.sent == client.queued)
+    {
+        client.sent = client.queued = 0;
+    }
+    if (client.queued + headerLength + length > WEB_SOCKET_QUEUE && client.sent > 0)
+    {
+        memmove(client.queue, client.queue + client.sent, client.queued - client.sent);
+        client.queued -= client.sent;
+        client.sent = 0;
+    }
+    if (client.queued + headerLength + length > WEB_SOCKET_QUEUE)
+    {
+        return false;
+    }
+    memcpy(client.queue + client.queued, header, headerLength);
+    if (length > 0)
+    {
+        memcpy(client.queue + client.queued + headerLength, data, length);
+    }
+    client.queued += headerLength + length;
+    return true;
+}
+
+/// @brief Hand the socket what it takes without waiting
+/// @return {bool} - `false` if the client is gone
+bool WebSocketServer::flush(Client &client)
+{
+    while (client.sent < client.queued)
+    {
+        const ssize_t n = send(client.fd, client.queue + client.sent, client.queued - client.sent, WEB_SOCKET_SEND_FLAGS);
+        if (n < 0)
+        {
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
+            {
+                return true; // full, the rest waits for the next poll
+            }
+            close(client);
+            return false;
+        }
+        client.sent += n;
+    }
+    return true;
+}
+
+void WebSocketServer::close(Client &client)
+{
+    if (client.fd >= 0)
+    {
+        ::close(client.fd);
+    }
+    client.fd = -1;
+    client.state = STATE_FREE;
+    client.received = client.sent = client.queued = 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define WEB_SOCKET_PORT 81             // the HTTP routes keep port 80
+#define WEB_SOCKET_MAX_CLIENTS 4
+#define WEB_SOCKET_QUEUE 4096          // bytes per client its socket has not taken yet
+#define WEB_SOCKET_REQUEST_MAX 512     // handshake request, and control frames from a client
+#define WEB_SOCKET_HEADER_MAX 10       // server frames are not masked
+#define WEB_SOCKET_ACCEPT_LENGTH 28    // base64 of a SHA-1
+#define WEB_SOCKET_OPCODE_TEXT 0x1
+#define WEB_SOCKET_OPCODE_BINARY 0x2
+#define WEB_SOCKET_OPCODE_CLOSE 0x8
+#define WEB_SOCKET_OPCODE_PING 0x9
+#define WEB_SOCKET_OPCODE_PONG 0xA
+
+/// @brief RFC 6455 server for streaming to browsers, on plain BSD sockets
+///        (lwIP on the ESP32) so it never blocks the caller. Every client has
+///        its own queue for what its socket could not take yet. A frame that
+///        does not fit is dropped for that client only, whole, so its stream
+///        stays well formed and the other clients do not wait for it.
+///        Everything runs from `poll()` and `broadcast()`, no task of its own.
+class WebSocketServer
+{
+public:
+    WebSocketServer();
+    ~WebSocketServer();
+
+    bool begin(uint16_t port);
+    void end(void);
+    void poll(void);
+    uint8_t broadcast(const uint8_t *data, size_t length, uint8_t opcode);
+    uint8_t getClients(void) const;
+    uint16_t getPort(void) const { return _port; }
+    /// @brief Frames queued for a client since begin(), one per client per broadcast
+    uint32_t getFramesSent(void) const { return _framesSent; }
+    /// @brief Frames a client had no room for since begin()
+    uint32_t getFramesDropped(void) const { return _framesDropped; }
+
+    static void acceptKey(const char *key, size_t keyLength, char *out);
+    static size_t frameHeader(uint8_t opcode, size_t length, uint8_t *out);
+
+private:
+    enum STATE
+    {
+        STATE_FREE,
+        STATE_HANDSHAKE,
+        STATE_OPEN,
+        STATE_CLOSING // close frame or 400 queued, the socket goes once it is out
+    };
+
+    struct Client
+    {
+        int fd;
+        STATE state;
+        uint16_t received; // bytes in `in`
+        uint16_t sent;     // queue[sent, queued) is still to go
+        uint16_t queued;
+        uint8_t in[WEB_SOCKET_REQUEST_MAX];
+        uint8_t queue[WEB_SOCKET_QUEUE];
+    };
+
+    void accept(void);
+    void receive(Client &client);
+    bool handshake(Client &client);
+    bool frames(Client &client);
+    bool enqueue(Client &client, const uint8_t *header, size_t headerLength, const uint8_t *data, size_t length);
+    bool flush(Client &client);
+    void close(Client &client);
+
+    int _listener;
+    uint16_t _port;
+    uint32_t _framesSent;
+    uint32_t _framesDropped;
+    Client _clients[WEB_SOCKET_MAX_CLIENTS];
+};
@@ -47,11 +47,10 @@
 #define MCP_SCALE_FACTOR_VOLTS 0.00000000186995
 #define MCP3912_VREF 1.2
 #define NUM_PACKETS_IN_RING_BUFFER_JSON 28
-#define NUM_PACKETS_IN_RING_BUFFER_RAW 1
-#else
-#define NUM_PACKETS_IN_RING_BUFFER_RAW 200
-#define MAX_PACKETS_PER_SEND_TCP 42
 #endif
+#define NUM_PACKETS_IN_RING_BUFFER_RAW 256 // power of two, see PacketFanout
+#define MAX_PACKETS_PER_SEND_TCP 42
+#define MAX_STREAM_SUBSCRIBERS 4 // TCP, UDP and WebSocket sinks reading the raw ring at once
 #define BYTES_PER_SPI_PACKET 32
 #define BYTES_PER_OBCI_PACKET 33
 #define BYTES_PER_CHANNEL 3
@@ -66,6 +65,11 @@
 #define LED_PROG 0
 #define LED_NOTIFY 5
 #define DEFAULT_LATENCY 10000
+#define LATENCY_ADAPTIVE_MIN 1000   // microseconds, the adaptive flush interval never goes below
+#define LATENCY_ADAPTIVE_MAX 100000 // nor above
+#define UDP_REDUNDANT_COPIES 2 // extra copies of each datagram when redundancy is on
+#define UDP_REDUNDANT_SPACING 2 // datagrams between two copies of the same data
+#define CLOCK_SYNC_INTERVAL_MS 1000 // ClockSync requests to the UDP client
 #define DEFAULT_MQTT_PORT 1883
 // #define bit(b) (1UL << (b)) // Taken directly from Arduino.h
 // Arduino JSON needs bytes for duplication
@@ -87,36 +91,71 @@
 #define BOARD_TYPE_GANGLION "ganglion"
 #define BOARD_TYPE_NONE "none"
 
+#define OUTPUT_BANDS "bands"
+#define OUTPUT_DELTA "delta"
 #define OUTPUT_JSON "json"
 #define OUTPUT_MQTT "mqtt"
 #define OUTPUT_NONE "none"
 #define OUTPUT_RAW "raw"
 #define OUTPUT_SERIAL "serial"
 #define OUTPUT_TCP "tcp"
+#define OUTPUT_UDP "udp"
 #define OUTPUT_WEB_SOCKETS "ws"
 
+#define LATENCY_AUTO "auto" // JSON_LATENCY value: let FlushController pick interval and batch
+
+#define SUBSCRIBER_POLICY_DECIMATE "decimate"       // it sends every other packet while behind
+#define SUBSCRIBER_POLICY_DROP_OLDEST "drop_oldest" // a lagging TCP subscriber keeps its newest packets
+#define SUBSCRIBER_POLICY_LATEST "latest"           // it skips its backlog and resumes live
+#define SUBSCRIBER_POLICY_PAUSE "pause"             // it stops taking packets until its backlog went out
+
+#define JSON_ADAPTIVE "adaptive"
+#define JSON_BAND_HOP "band_hop"
+#define JSON_BAND_WINDOW "band_window"
+#define JSON_BATCH "batch"
 #define JSON_BOARD_CONNECTED "board_connected"
 #define JSON_BOARD_TYPE "board_type"
+#define JSON_CLOCK "clock"
+#define JSON_CLOCK_DELAY "clock_delay_us"
+#define JSON_CLOCK_DRIFT "clock_drift_ppm"
+#define JSON_CLOCK_OFFSET "clock_offset_us"
 #define JSON_COMMAND "command"
+#define JSON_CLIENTS "clients"
 #define JSON_CONNECTED "connected"
+#define JSON_DROPPED "dropped"
+#define JSON_FEC_DATA "fec_data"
+#define JSON_FEC_PARITY "fec_parity"
 #define JSON_GAINS "gains"
 #define JSON_HEAP "heap"
+#define JSON_IMPEDANCE_KOHMS "kohms"
+#define JSON_IMPEDANCE_LEAD_OFF "lead_off"
+#define JSON_IMPEDANCE_TONE "tone"
+#define JSON_LAG "lag"
 #define JSON_LATENCY "latency"
 #define JSON_MAC "mac"
 #define JSON_MQTT_BROKER_ADDR "broker_address"
 #define JSON_MQTT_PASSWORD "password"
 #define JSON_MQTT_USERNAME "username"
 #define JSON_MQTT_PORT "port"
+#define JSON_MTU "mtu"
 #define JSON_NAME "name"
 #define JSON_NUM_CHANNELS "num_channels"
+#define JSON_PER_SEC "per_sec"
+#define JSON_POLICY "policy"
+#define JSON_PROTOCOL "protocol"
+#define JSON_QUEUED "queued"
 #define JSON_REDUNDANCY "redundancy"
 #define JSON_SAMPLE_NUMBERS "sample_numbers"
 #define JSON_SAMPLE_NUMBER "sampleNumber"
+#define JSON_SENT "sent"
+#define JSON_SEQUENCE "sequence"
+#define JSON_SUBSCRIBERS "subscribers"
 #define JSON_TCP_DELIMITER "delimiter"
 #define JSON_TCP_IP "ip"
 #define JSON_TCP_OUTPUT "output"
 #define JSON_TCP_PORT "port"
 #define JSON_TIMESTAMPS "timestamps"
+#define JSON_TOTAL "total"
 #define JSON_VERSION "version"
 
 // Used to determine the result of processing a packet
@@ -133,6 +172,7 @@
 #define PROCESS_RAW_PASS_MIDDLE 0x06
 #define STREAM_PACKET_BYTE_START 0xA0
 #define STREAM_PACKET_BYTE_STOP 0xC0
+#define CONFIG_MARKER_BYTE 'C' // first aux byte of a PACKET_TYPE_USER_DEFINED packet after a live reconfiguration
 
 #define MQTT_ROUTE_KEY "openbci:eeg"
 
@@ -150,6 +190,10 @@
 #define HTTP_ROUTE_COMMAND "/command"
 #define HTTP_ROUTE_LATENCY "/latency"
 #define HTTP_ROUTE_ALL "/all"
+#define HTTP_ROUTE_STATS "/stats"
+#define HTTP_ROUTE_SUBSCRIBERS "/subscribers"
+#define HTTP_ROUTE_IMPEDANCE "/impedance"
+#define HTTP_ROUTE_WEB_SOCKET "/websocket"
 #define HTTP_ROUTE_BOARD "/board"
 #define HTTP_ROUTE_WIFI "/wifi"
 #define HTTP_ROUTE_WIFI_CONFIG "/wifi/config"
@@ -289,12 +333,23 @@
 /** Set sample rate */
 #define OPENBCI_SAMPLE_RATE_SET '~'
 
+/** Decimation: '|' <k> streams one sample per 2^k ADS samples (k 0-6), "||" reports the stream rate */
+#define OPENBCI_DECIMATION_SET '|'
+
+/** On board filter: 'f' <notch 0-2> <bandpass 0-5>, "ff" reports it, "f00" streams raw data */
+#define OPENBCI_FILTER_SET 'f'
+
+/** Impedance monitor: "m1" drives the lead-off current into every powered channel and
+ *  streams impedance packets, "m0" stops it, "mm" reports the last estimates */
+#define OPENBCI_IMPEDANCE_MONITOR 'm'
+
 /** Insert marker into the stream */
 #define OPENBCI_INSERT_MARKER '`'
 
 /** Sync Clocks */
 #define OPENBCI_TIME_SET '<'
 #define OPENBCI_TIME_STOP '>'
+#define OPENBCI_TIME_SET_MICROS '(' // every packet carries the 48 bit DRDY time in us instead of aux data
 
 /** Wifi Stuff */
 #define OPENBCI_WIFI_ATTACH '{'
@@ -6,7 +6,7 @@ extern ADS1299 ads1299;
 
 WifiServer::WifiServer()
     : ledState(false), startWifiManager(false), tryConnectToAP(false), underSelfTest(false),
-      wifiReset(false), lastHeadMove(0), lastSendToClient(0), ledFlashes(0), ledInterval(300),
+      wifiReset(false), lastHeadMove(0), lastSendToClient(0), lastClockSync(0), ledFlashes(0), ledInterval(300),
       ledLastFlash(millis()), wifiConnectTimeout(millis()), jsonStr(""), bufferPosition(0),
       buffer{}, _serial(Serial0), _ads1299(ads1299), _WiFi(WiFi),
       curPacketType(PACKET_TYPE_ACCEL), curTimeSyncMode(TIME_SYNC_MODE_OFF),
@@ -22,6 +22,7 @@ void WifiServer::begin(void)
     initVariables();
     initArrays();
     initObjects();
+    _ads1299.stats = &stats;
     if (connectToWiFi(WIFI_SSID, WIFI_PASSWD))
     {
         printWifiStatus();
@@ -110,11 +111,7 @@ void WifiServer::debugPrintLLNumber(unsigned long long n, uint8_t base)
 /// @param numChannels  {uint8_t} The number of channels to pull out of `arr`
 void WifiServer::extractRaws(uint8_t *arr, int32_t *output, uint8_t numChannels)
 {
-    for (uint8_t i = 0; i < numChannels; i++)
-    {
-        output[i] = int24To32(arr + (i * 3));
-        // _serial.printf("%d\n", output[i]);
-    }
+    SignExtend24::convert(arr, output, numChannels);
 }
 
 void WifiServer::gainReset(void)
@@ -216,7 +213,7 @@ uint8_t WifiServer::getHead(void)
 
 String WifiServer::getInfoAll(void)
 {
-    const size_t argBufferSize = JSON_OBJECT_SIZE(8) + 135;
+    const size_t argBufferSize = JSON_OBJECT_SIZE(13) + 215;
     DynamicJsonDocument JsonDoc(argBufferSize);
     JsonObject root = JsonDoc.to<JsonObject>();
 
@@ -229,12 +226,116 @@ String WifiServer::getInfoAll(void)
     root[JSON_NUM_CHANNELS] = getNumChannels();
     root[JSON_VERSION] = getVersion();
     root[JSON_LATENCY] = getLatency();
+    root[JSON_ADAPTIVE] = latencyAdaptive;
+    root[JSON_BATCH] = getBatch();
+    if (clockSync.isSynced())
+    {
+        root[JSON_CLOCK_OFFSET] = clockSync.getOffset(esp_timer_get_time());
+        root[JSON_CLOCK_DRIFT] = clockSync.getDriftPpm();
+        root[JSON_CLOCK_DELAY] = clockSync.getDelay();
+    }
 
     String output;
     serializeJson(root, output);
     return output;
 }
 
+/// @brief Data loss counters with their per second rates
+/// @return {String} - JSON object keyed by counter name
+String WifiServer::getInfoStats(void)
+{
+    const size_t bufferSize = JSON_OBJECT_SIZE(StreamStats::COUNTER_COUNT) + StreamStats::COUNTER_COUNT * JSON_OBJECT_SIZE(2);
+    StaticJsonDocument<bufferSize> jsonDoc;
+
+    for (int i = 0; i < StreamStats::COUNTER_COUNT; i++)
+    {
+        StreamStats::COUNTER counter = (StreamStats::COUNTER)i;
+        JsonObject obj = jsonDoc.createNestedObject(StreamStats::getName(counter));
+        obj[JSON_TOTAL] = stats.getTotal(counter);
+        obj[JSON_PER_SEC] = stats.getRate(counter);
+    }
+
+    String json;
+    serializeJson(jsonDoc, json);
+    return json;
+}
+
+/// @brief Every stream sink with how far behind it is and what it lost
+/// @return {String} - JSON object holding the subscriber list
+String WifiServer::getInfoSubscribers(void)
+{
+    const size_t bufferSize = JSON_OBJECT_SIZE(1) + JSON_ARRAY_SIZE(MAX_STREAM_SUBSCRIBERS) + MAX_STREAM_SUBSCRIBERS * (JSON_OBJECT_SIZE(9) + 40 * 9);
+    DynamicJsonDocument jsonDoc(bufferSize);
+
+    JsonArray list = jsonDoc.createNestedArray(JSON_SUBSCRIBERS);
+    for (uint8_t i = 0; i < MAX_STREAM_SUBSCRIBERS; i++)
+    {
+        Subscriber &subscriber = subscribers[i];
+        if (subscriber.protocol == OUTPUT_PROTOCOL_NONE)
+        {
+            continue;
+        }
+        JsonObject obj = list.createNestedObject();
+        const boolean tcp = subscriber.protocol == OUTPUT_PROTOCOL_TCP;
+        obj[JSON_PROTOCOL] = getOutputProtocolString(subscriber.protocol);
+        obj[JSON_TCP_IP] = subscriber.address.toString();
+        obj[JSON_TCP_PORT] = subscriber.port;
+        switch (subscriber.protocol)
+        {
+        case OUTPUT_PROTOCOL_TCP:
+            obj[JSON_CONNECTED] = (bool)subscriber.client.connected();
+            break;
+        case OUTPUT_PROTOCOL_WEB_SOCKETS:
+            obj[JSON_CONNECTED] = webSocket.getClients() > 0;
+            break;
+        default:
+            obj[JSON_CONNECTED] = true;
+            break;
+        }
+        obj[JSON_POLICY] = getSubscriberPolicy(i);
+        obj[JSON_LAG] = rawRing.size(subscriber.reader);
+        obj[JSON_QUEUED] = tcp ? subscriber.sender.getQueued() : 0;
+        // a TCP subscriber's socket backlog drops packets, or whole records
+        // outside raw mode, next to the ring
+        obj[JSON_DROPPED] = rawRing.getDropped(subscriber.reader) + (tcp ? subscriber.sender.getDropped() : 0);
+        obj[JSON_CLOCK] = subscriber.clockPeer;
+    }
+
+    String json;
+    serializeJson(jsonDoc, json);
+    return json;
+}
+
+/// @brief The impedance monitor's last block: kohm per channel, null where
+///         nothing was measured, and the lead-off comparator flags
+String WifiServer::getInfoImpedance(void)
+{
+    const uint8_t numChannels = _ads1299.daisyPresent ? OPENBCI_NUMBER_OF_CHANNELS_DAISY : OPENBCI_ADS_CHANS_PER_BOARD;
+    const size_t bufferSize = JSON_OBJECT_SIZE(3) + 2 * JSON_ARRAY_SIZE(IMPEDANCE_CHANNELS);
+    StaticJsonDocument<bufferSize> jsonDoc;
+
+    jsonDoc[JSON_IMPEDANCE_TONE] = _ads1299.impedance.getChannels() != 0 ? _ads1299.impedance.getToneHz() : 0;
+    JsonArray kohms = jsonDoc.createNestedArray(JSON_IMPEDANCE_KOHMS);
+    JsonArray leadOff = jsonDoc.createNestedArray(JSON_IMPEDANCE_LEAD_OFF);
+    for (uint8_t i = 0; i < numChannels; i++)
+    {
+        const uint8_t flags = _ads1299.impedance.getFlags(i);
+        if (flags & IMPEDANCE_FLAG_MEASURED)
+        {
+            kohms.add(_ads1299.impedance.getOhms(i, _ads1299.channelScale.getScale(i) / (float)(1L << CHANNEL_SCALE_SHIFT)) / 1000);
+        }
+        else
+        {
+            kohms.add(nullptr);
+        }
+        leadOff.add((bool)(flags & (IMPEDANCE_FLAG_P_OFF | IMPEDANCE_FLAG_N_OFF)));
+    }
+
+    String json;
+    serializeJson(jsonDoc, json);
+    return json;
+}
+
 String WifiServer::getInfoBoard(void)
 {
     const size_t argBufferSize = JSON_OBJECT_SIZE(4) + 150 + JSON_ARRAY_SIZE(getNumChannels());
@@ -276,7 +377,7 @@ String WifiServer::getInfoMQTT(boolean clientMQTTConnected)
 
 String WifiServer::getInfoTCP(boolean clientTCPConnected)
 {
-    const size_t bufferSize = JSON_OBJECT_SIZE(6) + 40 * 6;
+    const size_t bufferSize = JSON_OBJECT_SIZE(11) + 40 * 11;
     StaticJsonDocument<bufferSize> jsonDoc;
 
     jsonDoc[JSON_CONNECTED] = clientTCPConnected ? true : false;
@@ -285,6 +386,31 @@ String WifiServer::getInfoTCP(boolean clientTCPConnected)
     jsonDoc[JSON_TCP_OUTPUT] = getCurOutputModeString();
     jsonDoc[JSON_TCP_PORT] = tcpPort;
     jsonDoc[JSON_LATENCY] = getLatency();
+    jsonDoc[JSON_ADAPTIVE] = latencyAdaptive;
+    jsonDoc[JSON_BATCH] = getBatch();
+    jsonDoc[JSON_BAND_WINDOW] = bandPower.getWindow();
+    jsonDoc[JSON_BAND_HOP] = bandPower.getHop();
+    jsonDoc[JSON_SUBSCRIBERS] = getSubscribers(OUTPUT_PROTOCOL_TCP);
+
+    String json;
+    serializeJson(jsonDoc, json);
+    return json;
+}
+
+/// @brief WebSocket endpoint state: where to connect, who is connected and
+///         what the slow clients lost
+String WifiServer::getInfoWebSocket(void)
+{
+    const size_t bufferSize = JSON_OBJECT_SIZE(7) + 40 * 7;
+    StaticJsonDocument<bufferSize> jsonDoc;
+
+    jsonDoc[JSON_CONNECTED] = getSubscribers(OUTPUT_PROTOCOL_WEB_SOCKETS) > 0;
+    jsonDoc[JSON_TCP_PORT] = webSocket.getPort();
+    jsonDoc[JSON_CLIENTS] = webSocket.getClients();
+    jsonDoc[JSON_SENT] = webSocket.getFramesSent();
+    jsonDoc[JSON_DROPPED] = webSocket.getFramesDropped();
+    jsonDoc[JSON_TCP_OUTPUT] = getCurOutputModeString();
+    jsonDoc[JSON_LATENCY] = getLatency();
 
     String json;
     serializeJson(jsonDoc, json);
@@ -403,6 +529,8 @@ void WifiServer::startWebServer(void)
     // printWifiStatus();
     _serial.printf("Starting HTTP...\n");
 #endif
+    // The root page and the SSDP description read no stream state, they are
+    // built and sent without the lock
     server.on(HTTP_ROUTE, HTTP_GET, [this]()
               {
 #ifdef DEBUG
@@ -451,8 +579,8 @@ void WifiServer::startWebServer(void)
 
     server.send(200, "text/html", out); });
 
-    server.on(HTTP_ROUTE, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
+    on(HTTP_ROUTE, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
 
     server.on("/description.xml", HTTP_GET, [this]()
               {
@@ -466,60 +594,96 @@ void WifiServer::startWebServer(void)
 
     // Add other routes...
 
-    server.on(HTTP_ROUTE_YT, HTTP_GET, [this]()
-              {
+    on(HTTP_ROUTE_YT, HTTP_GET, [this]()
+       {
 #ifdef DEBUG
     debugPrintGet();
 #endif
     returnOK("Keep going! Push The World!"); });
-    server.on(HTTP_ROUTE_YT, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_YT, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
 
-    server.on(HTTP_ROUTE_TCP, HTTP_GET, [this]()
-              {
+    on(HTTP_ROUTE_TCP, HTTP_GET, [this]()
+       {
 #ifdef DEBUG
         debugPrintGet();
 #endif
         sendHeadersForCORS();
-        String out = getInfoTCP(clientTCP.connected());
+        String out = getInfoTCP(getSubscribers(OUTPUT_PROTOCOL_TCP) > 0);
         server.setContentLength(out.length());
-        server.send(200, "application/json", out.c_str()); });
+        reply(200, "application/json", out.c_str()); });
+
+    on(HTTP_ROUTE_TCP, HTTP_POST, [this]()
+       { tcpSetup(); });
+    on(HTTP_ROUTE_TCP, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_TCP, HTTP_DELETE, [this]()
+       {
+#ifdef DEBUG
+    debugPrintDelete();
+#endif
+    subscribersDelete(OUTPUT_PROTOCOL_TCP);
+    sendHeadersForCORS();
+    jsonStr = getInfoTCP(getSubscribers(OUTPUT_PROTOCOL_TCP) > 0);
+    server.setContentLength(jsonStr.length());
+    reply(200, "text/json", jsonStr.c_str());
+    jsonStr = ""; });
 
-    server.on(HTTP_ROUTE_TCP, HTTP_POST, [this]()
-              { tcpSetup(); });
-    server.on(HTTP_ROUTE_TCP, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
-    server.on(HTTP_ROUTE_TCP, HTTP_DELETE, [this]()
-              {
+    on(HTTP_ROUTE_WEB_SOCKET, HTTP_GET, [this]()
+       {
+#ifdef DEBUG
+    debugPrintGet();
+#endif
+    sendHeadersForCORS();
+    String output = getInfoWebSocket();
+    server.setContentLength(output.length());
+    reply(200, RETURN_TEXT_JSON, output); });
+    on(HTTP_ROUTE_WEB_SOCKET, HTTP_POST, [this]()
+       { webSocketSetup(); });
+    on(HTTP_ROUTE_WEB_SOCKET, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_WEB_SOCKET, HTTP_DELETE, [this]()
+       {
 #ifdef DEBUG
     debugPrintDelete();
 #endif
+    subscribersDelete(OUTPUT_PROTOCOL_WEB_SOCKETS);
     sendHeadersForCORS();
-    clientTCP.stop();
-    setOutputProtocol(OUTPUT_PROTOCOL_NONE);
-    jsonStr = getInfoTCP(false);
+    jsonStr = getInfoWebSocket();
     server.setContentLength(jsonStr.length());
-    server.send(200, "text/json", jsonStr.c_str());
+    reply(200, RETURN_TEXT_JSON, jsonStr.c_str());
     jsonStr = ""; });
 
-    server.on(HTTP_ROUTE_UDP, HTTP_POST, [this]()
-              { udpSetup(); });
-    server.on(HTTP_ROUTE_UDP, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
-    server.on(HTTP_ROUTE_UDP, HTTP_DELETE, [this]()
-              {
+    on(HTTP_ROUTE_UDP, HTTP_POST, [this]()
+       { udpSetup(); });
+    on(HTTP_ROUTE_UDP, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_UDP, HTTP_DELETE, [this]()
+       {
 #ifdef DEBUG
     debugPrintDelete();
 #endif
+    subscribersDelete(OUTPUT_PROTOCOL_UDP);
     sendHeadersForCORS();
-    setOutputProtocol(OUTPUT_PROTOCOL_NONE);
     jsonStr = getInfoTCP(false);
     server.setContentLength(jsonStr.length());
-    server.send(200, RETURN_TEXT_JSON, jsonStr.c_str());
+    reply(200, RETURN_TEXT_JSON, jsonStr.c_str());
     jsonStr = ""; });
+
+    on(HTTP_ROUTE_SUBSCRIBERS, HTTP_GET, [this]()
+       {
+#ifdef DEBUG
+    debugPrintGet();
+#endif
+    sendHeadersForCORS();
+    String output = getInfoSubscribers();
+    server.setContentLength(output.length());
+    reply(200, RETURN_TEXT_JSON, output); });
+    on(HTTP_ROUTE_SUBSCRIBERS, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
     // These could be helpful...
-    server.on(HTTP_ROUTE_STREAM_START, HTTP_GET, [this]()
-              {
+    on(HTTP_ROUTE_STREAM_START, HTTP_GET, [this]()
+       {
 #ifdef DEBUG
     debugPrintGet();
 #endif
@@ -527,11 +691,11 @@ void WifiServer::startWebServer(void)
     passthroughCommands("b");
     // SPISlave.setData(wifi.passthroughBuffer, BYTES_PER_SPI_PACKET);
     returnOK(); });
-    server.on(HTTP_ROUTE_STREAM_START, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_STREAM_START, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
 
-    server.on(HTTP_ROUTE_STREAM_STOP, HTTP_GET, [this]()
-              {
+    on(HTTP_ROUTE_STREAM_STOP, HTTP_GET, [this]()
+       {
 #ifdef DEBUG
     debugPrintGet();
 #endif
@@ -539,72 +703,94 @@ void WifiServer::startWebServer(void)
     passthroughCommands("s");
     // SPISlave.setData(wifi.passthroughBuffer, BYTES_PER_SPI_PACKET);
     returnOK(); });
-    server.on(HTTP_ROUTE_STREAM_STOP, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_STREAM_STOP, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
 
-    server.on(HTTP_ROUTE_VERSION, HTTP_GET, [this]()
-              {
+    on(HTTP_ROUTE_VERSION, HTTP_GET, [this]()
+       {
 #ifdef DEBUG
     debugPrintGet();
 #endif
     returnOK(getVersion()); });
 
-    server.on(HTTP_ROUTE_VERSION, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_VERSION, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
 
-    server.on(HTTP_ROUTE_COMMAND, HTTP_POST, [this]()
-              { passthroughCommand(); });
-    server.on(HTTP_ROUTE_COMMAND, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
-    server.on(HTTP_ROUTE_LATENCY, HTTP_GET, [this]()
-              { returnOK(String(getLatency()).c_str()); });
+    on(HTTP_ROUTE_COMMAND, HTTP_POST, [this]()
+       { passthroughCommand(); });
+    on(HTTP_ROUTE_COMMAND, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_LATENCY, HTTP_GET, [this]()
+       { returnOK(String(getLatency()).c_str()); });
 
-    server.on(HTTP_ROUTE_LATENCY, HTTP_POST, [this]()
-              { setLatency(); });
-    server.on(HTTP_ROUTE_LATENCY, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_LATENCY, HTTP_POST, [this]()
+       { setLatency(); });
+    on(HTTP_ROUTE_LATENCY, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
 
     // get heap status, analog input value and all GPIO statuses in one json call
-    server.on(HTTP_ROUTE_ALL, HTTP_GET, [this]()
-              {
+    on(HTTP_ROUTE_ALL, HTTP_GET, [this]()
+       {
 #ifdef DEBUG
     debugPrintGet();
 #endif
     sendHeadersForCORS();
     String output = getInfoAll();
     server.setContentLength(output.length());
-    server.send(200, RETURN_TEXT_JSON, output); });
-    server.on(HTTP_ROUTE_ALL, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
-    server.on(HTTP_ROUTE_BOARD, HTTP_GET, [this]()
-              {
+    reply(200, RETURN_TEXT_JSON, output); });
+    on(HTTP_ROUTE_ALL, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_STATS, HTTP_GET, [this]()
+       {
+#ifdef DEBUG
+    debugPrintGet();
+#endif
+    sendHeadersForCORS();
+    String output = getInfoStats();
+    server.setContentLength(output.length());
+    reply(200, RETURN_TEXT_JSON, output); });
+    on(HTTP_ROUTE_STATS, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_IMPEDANCE, HTTP_GET, [this]()
+       {
+#ifdef DEBUG
+    debugPrintGet();
+#endif
+    sendHeadersForCORS();
+    String output = getInfoImpedance();
+    server.setContentLength(output.length());
+    reply(200, RETURN_TEXT_JSON, output); });
+    on(HTTP_ROUTE_IMPEDANCE, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_BOARD, HTTP_GET, [this]()
+       {
 #ifdef DEBUG
     debugPrintGet();
 #endif
     sendHeadersForCORS();
     String output = getInfoBoard();
     server.setContentLength(output.length());
-    server.send(200, RETURN_TEXT_JSON, output); });
-    server.on(HTTP_ROUTE_BOARD, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
-    server.on(HTTP_ROUTE_WIFI, HTTP_GET, [this]()
-              { requestWifiManagerStart(); });
-    server.on(HTTP_ROUTE_WIFI, HTTP_DELETE, [this]()
-              {
+    reply(200, RETURN_TEXT_JSON, output); });
+    on(HTTP_ROUTE_BOARD, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_WIFI, HTTP_GET, [this]()
+       { requestWifiManagerStart(); });
+    on(HTTP_ROUTE_WIFI, HTTP_DELETE, [this]()
+       {
 #ifdef DEBUG
     debugPrintDelete();
 #endif
     returnOK("Reseting wifi. Please power cycle your board in 10 seconds");
     wifiReset = true; });
-    server.on(HTTP_ROUTE_WIFI, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
-
-    server.on(HTTP_ROUTE_WIFI_CONFIG, HTTP_GET, [this]()
-              { requestWifiManagerStart(); });
-    server.on(HTTP_ROUTE_WIFI_CONFIG, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
-    server.on(HTTP_ROUTE_WIFI_DELETE, HTTP_GET, [this]()
-              {
+    on(HTTP_ROUTE_WIFI, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
+
+    on(HTTP_ROUTE_WIFI_CONFIG, HTTP_GET, [this]()
+       { requestWifiManagerStart(); });
+    on(HTTP_ROUTE_WIFI_CONFIG, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_WIFI_DELETE, HTTP_GET, [this]()
+       {
 #ifdef DEBUG
                   debugPrintDelete();
 #endif
@@ -612,8 +798,8 @@ void WifiServer::startWebServer(void)
                   wifiReset = true;
                   digitalWrite(PIN_LED, LOW); // 指示灯亮
               });
-    server.on(HTTP_ROUTE_WIFI_DELETE, HTTP_OPTIONS, [this]()
-              { sendHeadersForOptions(); });
+    on(HTTP_ROUTE_WIFI_DELETE, HTTP_OPTIONS, [this]()
+       { sendHeadersForOptions(); });
 
     if (!MDNS.begin(getName().c_str()))
     {
@@ -631,14 +817,20 @@ void WifiServer::startWebServer(void)
 
     // Set up not found route
     server.onNotFound([this]()
-                      {
+                      { serveLocked([this]()
+                                    {
 #ifdef DEBUG
     _serial.printf("HTTP NOT FOUND :%s", server.uri());
 #endif
-        returnFail(404, "Route Not Found"); });
-    // Start the server
+        returnFail(404, "Route Not Found"); }); });
+    // Start the server, its routes run on a task of their own
     server.begin();
+    control.begin(httpPoll, this);
     MDNS.addService("http", "tcp", 80);
+    if (webSocket.begin(WEB_SOCKET_PORT))
+    {
+        MDNS.addService("ws", "tcp", WEB_SOCKET_PORT);
+    }
 
 #ifdef DEBUG
     _serial.println("WebServer Ready!");
@@ -706,14 +898,65 @@ void WifiServer::sendHeadersForOptions()
     server.sendHeader("Access-Control-Allow-Origin", "*");
     server.sendHeader("Access-Control-Allow-Methods", "POST,DELETE,GET,OPTIONS");
     server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-    server.send(200, "text/plain", "");
+    reply(200, "text/plain", "");
+}
+
+/// @brief One pass of the HTTP server, on control's task
+void WifiServer::httpPoll(void *context)
+{
+    (void)context;
+    server.handleClient();
+}
+
+/// @brief Add a route whose handler runs under control's lock; what it
+///         replies is sent after it let go of it
+void WifiServer::on(const char *uri, HTTPMethod method, WebServer::THandlerFunction handler)
+{
+    server.on(uri, method, [this, handler]()
+              { serveLocked(handler); });
+}
+
+void WifiServer::serveLocked(WebServer::THandlerFunction handler)
+{
+    control.lock();
+    replyCode = 0;
+    handler();
+    control.unlock();
+    sendReply();
+}
+
+/// @brief Keep the response of the running route, the first one counts
+/// @param code {int} - HTTP status
+/// @param type {const char *} - Content type
+/// @param body {const String &} - Content
+void WifiServer::reply(int code, const char *type, const String &body)
+{
+    if (replyCode != 0)
+    {
+        return;
+    }
+    replyCode = code;
+    replyType = type;
+    replyBody = body;
+}
+
+/// @brief Write the kept response to the client, headers set by the route included
+void WifiServer::sendReply(void)
+{
+    if (replyCode == 0)
+    {
+        return;
+    }
+    server.send(replyCode, replyType.c_str(), replyBody);
+    replyCode = 0;
+    replyBody = String();
 }
 
 void WifiServer::serverReturn(int code, String s)
 {
     digitalWrite(PIN_LED, LOW); // 指示灯亮
     sendHeadersForCORS();
-    server.send(code, "text/plain", s + "\r\n");
+    reply(code, "text/plain", s + "\r\n");
     digitalWrite(PIN_LED, HIGH); // 指示灯灭
 #ifdef DEBUG
     _serial.printf("server return: %s\r", s.c_str());
@@ -764,6 +1007,13 @@ void WifiServer::returnFail(int code, String msg)
     serverReturn(code, msg);
 }
 
+/// @brief Return if a new subscriber asks for another output mode than the
+///         subscribers already streaming get
+void WifiServer::returnOutputModeTaken()
+{
+    returnFail(409, "Error: the other subscribers stream '" + getCurOutputModeString() + "', ask for it or DELETE them first");
+}
+
 JsonObject &WifiServer::getArgFromArgs(int args)
 {
     DynamicJsonDocument jsonDoc(JSON_OBJECT_SIZE(args) + (40 * args));
@@ -811,7 +1061,7 @@ void WifiServer::requestWifiManagerStart()
     out += "'>Click to Go To WiFi Manager</a></p><html>";
 
     // 发送 HTML 响应
-    server.send(200, "text/html", out);
+    reply(200, "text/html", out);
 
     // 设置 LED 闪烁
     ledFlashes = 5;
@@ -832,11 +1082,9 @@ void WifiServer::setLatency()
 
     JsonObject &root = getArgFromArgs();
 
-    // 检查是否包含 JSON_LATENCY 键
-    if (root.containsKey(JSON_LATENCY) && root[JSON_LATENCY].is<unsigned long>())
+    // 检查是否包含 JSON_LATENCY 键, 微秒数或 LATENCY_AUTO
+    if (root.containsKey(JSON_LATENCY) && parseLatency(root[JSON_LATENCY]))
     {
-        // 从 JSON 对象中获取 JSON_LATENCY 的值，并设置 Latency
-        setLatency(static_cast<unsigned long>(root[JSON_LATENCY]));
         returnOK();
     }
     else
@@ -898,7 +1146,7 @@ void WifiServer::tcpSetup()
     {
         return returnNoBodyInPost(); // no body
     }
-    JsonObject &root = getArgFromArgs(8);
+    JsonObject &root = getArgFromArgs(12);
     if (!root.containsKey(JSON_TCP_IP))
     {
         return returnMissingRequiredParam(JSON_TCP_IP);
@@ -914,20 +1162,61 @@ void WifiServer::tcpSetup()
         return returnMissingRequiredParam(JSON_TCP_PORT);
     }
     int port = root[JSON_TCP_PORT];
+    // The sender applies it to the socket backlog, the ring only once the
+    // sender itself cannot keep up with the ring
+    TcpSender::POLICY senderPolicy = TcpSender::POLICY_DROP_OLDEST;
+    RawRing::POLICY policy = RawRing::POLICY_DROP_OLDEST;
+    if (root.containsKey(JSON_POLICY))
+    {
+        String policyStr = root[JSON_POLICY];
+        if (policyStr.equals(SUBSCRIBER_POLICY_LATEST))
+        {
+            senderPolicy = TcpSender::POLICY_LATEST;
+            policy = RawRing::POLICY_LATEST;
+        }
+        else if (policyStr.equals(SUBSCRIBER_POLICY_DECIMATE))
+        {
+            senderPolicy = TcpSender::POLICY_DECIMATE;
+        }
+        else if (policyStr.equals(SUBSCRIBER_POLICY_PAUSE))
+        {
+            senderPolicy = TcpSender::POLICY_PAUSE;
+        }
+        else if (!policyStr.equals(SUBSCRIBER_POLICY_DROP_OLDEST))
+        {
+            return returnFail(508, "Error: '" + String(JSON_POLICY) + "' must be " + SUBSCRIBER_POLICY_DROP_OLDEST + ", " + SUBSCRIBER_POLICY_LATEST + ", " + SUBSCRIBER_POLICY_DECIMATE + " or " + SUBSCRIBER_POLICY_PAUSE);
+        }
+    }
+    // packets it may fall behind before the policy applies, 0 for the whole ring
+    uint32_t lag = root.containsKey(JSON_LAG) ? root[JSON_LAG].as<uint32_t>() : 0;
+    // Without one it joins the mode the others stream in
+    OUTPUT_MODE mode = curOutputMode;
     if (root.containsKey(JSON_TCP_OUTPUT))
     {
         String outputModeStr = root[JSON_TCP_OUTPUT];
         if (outputModeStr.equals(getOutputModeString(OUTPUT_MODE_RAW)))
         {
-            setOutputMode(OUTPUT_MODE_RAW);
+            mode = OUTPUT_MODE_RAW;
         }
         else if (outputModeStr.equals(getOutputModeString(OUTPUT_MODE_JSON)))
         {
-            setOutputMode(OUTPUT_MODE_JSON);
+            mode = OUTPUT_MODE_JSON;
+        }
+        else if (outputModeStr.equals(getOutputModeString(OUTPUT_MODE_DELTA)))
+        {
+            mode = OUTPUT_MODE_DELTA;
+        }
+        else if (outputModeStr.equals(getOutputModeString(OUTPUT_MODE_BANDS)))
+        {
+            mode = OUTPUT_MODE_BANDS;
         }
         else
         {
-            return returnFail(506, "Error: '" + String(JSON_TCP_OUTPUT) + "' must be either " + getOutputModeString(OUTPUT_MODE_RAW) + " or " + getOutputModeString(OUTPUT_MODE_JSON));
+            return returnFail(506, "Error: '" + String(JSON_TCP_OUTPUT) + "' must be one of " + getOutputModeString(OUTPUT_MODE_RAW) + ", " + getOutputModeString(OUTPUT_MODE_JSON) + ", " + getOutputModeString(OUTPUT_MODE_DELTA) + " or " + getOutputModeString(OUTPUT_MODE_BANDS));
+        }
+        if (!joinOutputMode(OUTPUT_PROTOCOL_TCP, tempIPAddr, port, mode))
+        {
+            return returnOutputModeTaken();
         }
 #ifdef DEBUG
         _serial.print("Set output mode to ");
@@ -935,6 +1224,16 @@ void WifiServer::tcpSetup()
 #endif
     }
 
+    if (root.containsKey(JSON_BAND_WINDOW) || root.containsKey(JSON_BAND_HOP))
+    {
+        int window = root.containsKey(JSON_BAND_WINDOW) ? root[JSON_BAND_WINDOW].as<int>() : bandPower.getWindow();
+        int hop = root.containsKey(JSON_BAND_HOP) ? root[JSON_BAND_HOP].as<int>() : bandPower.getHop();
+        if (window < 0 || hop < 0 || window > BAND_POWER_MAX_WINDOW || !bandPower.configure(window, hop, _ads1299.getStreamRate()))
+        {
+            return returnFail(507, "Error: '" + String(JSON_BAND_WINDOW) + "' must be a power of two from " + String(BAND_POWER_MIN_WINDOW) + " to " + String(BAND_POWER_MAX_WINDOW) + " and '" + String(JSON_BAND_HOP) + "' from 1 to the window");
+        }
+    }
+
     if (root.containsKey(JSON_REDUNDANCY))
     {
         redundancy = root[JSON_REDUNDANCY];
@@ -946,8 +1245,7 @@ void WifiServer::tcpSetup()
 
     if (root.containsKey(JSON_LATENCY))
     {
-        int latency = root[JSON_LATENCY];
-        setLatency(latency);
+        parseLatency(root[JSON_LATENCY]);
 #ifdef DEBUG
         _serial.print("Set latency to ");
         _serial.print(getLatency());
@@ -999,32 +1297,122 @@ void WifiServer::tcpSetup()
 
     setOutputProtocol(OUTPUT_PROTOCOL_TCP);
 
+    // Next to the subscribers already there, the same ip and port reconnects
+    int8_t index = addSubscriber(OUTPUT_PROTOCOL_TCP, tcpAddress, tcpPort, policy, lag);
+    if (index < 0)
+    {
+        return returnFail(509, "Error: all " + String(MAX_STREAM_SUBSCRIBERS) + " subscribers are taken, DELETE one first");
+    }
+
     // const size_t bufferSize = JSON_OBJECT_SIZE(6) + 40*6;
     // DynamicJsonBuffer jsonBuffer(bufferSize);
     // JsonObject& rootOut = jsonBuffer.createObject();
     sendHeadersForCORS();
 
-    if (clientTCP.connect(tcpAddress, tcpPort))
+    // The entry is reserved, the stream skips it until it is connected.
+    // Connecting blocks for up to the connect timeout, loop() goes on meanwhile.
+    const IPAddress address = tcpAddress;
+    const uint16_t remotePort = tcpPort;
+    subscribers[index].connecting = true;
+    WiFiClient client;
+    boolean connected;
+    {
+        ControlTask::Unlocked unlocked(control);
+        connected = client.connect(address, remotePort);
+    }
+    Subscriber &subscriber = subscribers[index];
+    const boolean reserved = subscriber.protocol == OUTPUT_PROTOCOL_TCP && subscriber.connecting &&
+                             subscriber.address == address && subscriber.port == remotePort;
+    if (!reserved)
+    {
+        client.stop(); // its entry went away meanwhile
+        connected = false;
+        index = -1;
+    }
+    if (connected)
     {
 #ifdef DEBUG
         _serial.println("Connected to server");
 #endif
-        clientTCP.setNoDelay(1);
+        client.setNoDelay(1);
+        subscriber.client = client;
+        subscriber.connecting = false;
+        subscriber.sender.begin(client.fd(), senderPolicy, lag * BYTES_PER_OBCI_PACKET);
+        if (curOutputMode == OUTPUT_MODE_DELTA)
+        {
+            deltaEncoder.reset(); // its first record is a keyframe
+        }
         jsonStr = getInfoTCP(true);
         server.setContentLength(jsonStr.length());
-        return server.send(200, RETURN_TEXT_JSON, jsonStr.c_str());
+        return reply(200, RETURN_TEXT_JSON, jsonStr.c_str());
     }
     else
     {
 #ifdef DEBUG
         _serial.println("Failed to connect to server");
 #endif
+        if (index >= 0)
+        {
+            removeSubscriber(index);
+        }
         jsonStr = getInfoTCP(false);
         server.setContentLength(jsonStr.length());
-        return server.send(504, RETURN_TEXT_JSON, jsonStr.c_str());
+        return reply(504, RETURN_TEXT_JSON, jsonStr.c_str());
     }
 }
 
+/// @brief Stream to the WebSocket clients on WEB_SOCKET_PORT. Browsers connect
+///         there whenever they like; the optional body picks the output mode
+///         and latency as for HTTP_ROUTE_TCP. Binary frames carry raw packets,
+///         delta or band records, text frames the JSON chunks.
+void WifiServer::webSocketSetup()
+{
+#ifdef DEBUG
+    debugPrintGet();
+#endif
+    if (webSocket.getPort() == 0)
+    {
+        return returnFail(503, "Error: the WebSocket endpoint is not listening");
+    }
+    if (!noBodyInParam())
+    {
+        JsonObject &root = getArgFromArgs(2);
+        if (root.containsKey(JSON_TCP_OUTPUT))
+        {
+            String outputModeStr = root[JSON_TCP_OUTPUT];
+            int mode = OUTPUT_MODE_RAW;
+            while (mode <= OUTPUT_MODE_BANDS && !outputModeStr.equals(getOutputModeString((OUTPUT_MODE)mode)))
+            {
+                mode++;
+            }
+            if (mode > OUTPUT_MODE_BANDS)
+            {
+                return returnFail(506, "Error: '" + String(JSON_TCP_OUTPUT) + "' must be one of " + getOutputModeString(OUTPUT_MODE_RAW) + ", " + getOutputModeString(OUTPUT_MODE_JSON) + ", " + getOutputModeString(OUTPUT_MODE_DELTA) + " or " + getOutputModeString(OUTPUT_MODE_BANDS));
+            }
+            if (!joinOutputMode(OUTPUT_PROTOCOL_WEB_SOCKETS, IPAddress(), webSocket.getPort(), (OUTPUT_MODE)mode))
+            {
+                return returnOutputModeTaken();
+            }
+        }
+        if (root.containsKey(JSON_LATENCY))
+        {
+            parseLatency(root[JSON_LATENCY]);
+        }
+    }
+    // its clients' own queues absorb a slow browser, the ring reader never lags
+    if (addSubscriber(OUTPUT_PROTOCOL_WEB_SOCKETS, IPAddress(), webSocket.getPort(), RawRing::POLICY_DROP_OLDEST, 0) < 0)
+    {
+        return returnFail(509, "Error: all " + String(MAX_STREAM_SUBSCRIBERS) + " subscribers are taken, DELETE one first");
+    }
+    setOutputProtocol(OUTPUT_PROTOCOL_WEB_SOCKETS);
+
+    sendHeadersForCORS();
+    jsonStr = getInfoWebSocket();
+    server.setContentLength(jsonStr.length());
+    reply(200, RETURN_TEXT_JSON, jsonStr.c_str());
+    jsonStr = "";
+}
+
 void WifiServer::udpSetup()
 {
 #ifdef DEBUG
@@ -1035,7 +1423,7 @@ void WifiServer::udpSetup()
     {
         return returnNoBodyInPost(); // no body
     }
-    JsonObject &root = getArgFromArgs(7);
+    JsonObject &root = getArgFromArgs(14);
     if (!root.containsKey(JSON_TCP_IP))
     {
         return returnMissingRequiredParam(JSON_TCP_IP);
@@ -1052,41 +1440,60 @@ void WifiServer::udpSetup()
     }
     int port = root[JSON_TCP_PORT];
 
-    setOutputMode(OUTPUT_MODE_RAW);
+    // Without one it joins the mode the others stream in, alone it streams raw packets
+    OUTPUT_MODE mode = getOtherSubscribers(OUTPUT_PROTOCOL_UDP, tempIPAddr, port, OUTPUT_PROTOCOL_NONE) > 0 ? curOutputMode : OUTPUT_MODE_RAW;
     if (root.containsKey(JSON_TCP_OUTPUT))
     {
         String outputModeStr = root[JSON_TCP_OUTPUT];
         if (outputModeStr.equals(getOutputModeString(OUTPUT_MODE_RAW)))
         {
-            // No need to change output mode since it's already set to RAW
+            mode = OUTPUT_MODE_RAW;
         }
         else if (outputModeStr.equals(getOutputModeString(OUTPUT_MODE_JSON)))
         {
-            setOutputMode(OUTPUT_MODE_JSON);
+            mode = OUTPUT_MODE_JSON;
+        }
+        else if (outputModeStr.equals(getOutputModeString(OUTPUT_MODE_DELTA)))
+        {
+            mode = OUTPUT_MODE_DELTA;
+        }
+        else if (outputModeStr.equals(getOutputModeString(OUTPUT_MODE_BANDS)))
+        {
+            mode = OUTPUT_MODE_BANDS;
         }
         else
         {
-            return returnFail(506, "Error: '" + String(JSON_TCP_OUTPUT) + "' must be either " + getOutputModeString(OUTPUT_MODE_RAW) + " or " + getOutputModeString(OUTPUT_MODE_JSON));
+            return returnFail(506, "Error: '" + String(JSON_TCP_OUTPUT) + "' must be one of " + getOutputModeString(OUTPUT_MODE_RAW) + ", " + getOutputModeString(OUTPUT_MODE_JSON) + ", " + getOutputModeString(OUTPUT_MODE_DELTA) + " or " + getOutputModeString(OUTPUT_MODE_BANDS));
         }
+    }
+    if (!joinOutputMode(OUTPUT_PROTOCOL_UDP, tempIPAddr, port, mode))
+    {
+        return returnOutputModeTaken();
+    }
 #ifdef DEBUG
-        _serial.print("Set output mode to ");
-        _serial.println(getCurOutputModeString());
+    _serial.print("Set output mode to ");
+    _serial.println(getCurOutputModeString());
 #endif
+
+    if (root.containsKey(JSON_BAND_WINDOW) || root.containsKey(JSON_BAND_HOP))
+    {
+        int window = root.containsKey(JSON_BAND_WINDOW) ? root[JSON_BAND_WINDOW].as<int>() : bandPower.getWindow();
+        int hop = root.containsKey(JSON_BAND_HOP) ? root[JSON_BAND_HOP].as<int>() : bandPower.getHop();
+        if (window < 0 || hop < 0 || window > BAND_POWER_MAX_WINDOW || !bandPower.configure(window, hop, _ads1299.getStreamRate()))
+        {
+            return returnFail(507, "Error: '" + String(JSON_BAND_WINDOW) + "' must be a power of two from " + String(BAND_POWER_MIN_WINDOW) + " to " + String(BAND_POWER_MAX_WINDOW) + " and '" + String(JSON_BAND_HOP) + "' from 1 to the window");
+        }
     }
 
+    boolean _redundancy = redundancy;
     if (root.containsKey(JSON_REDUNDANCY))
     {
-        redundancy = root[JSON_REDUNDANCY];
-#ifdef DEBUG
-        _serial.print("Set redundancy to ");
-        _serial.println(redundancy);
-#endif
+        _redundancy = root[JSON_REDUNDANCY];
     }
 
     if (root.containsKey(JSON_LATENCY))
     {
-        int latency = root[JSON_LATENCY];
-        setLatency(latency);
+        parseLatency(root[JSON_LATENCY]);
 #ifdef DEBUG
         _serial.print("Set latency to ");
         _serial.print(getLatency());
@@ -1103,7 +1510,66 @@ void WifiServer::udpSetup()
         _serial.println(_tcpDelimiter ? "true" : "false");
 #endif
     }
+
+    uint16_t mtu = UDP_BATCH_MAX_DATAGRAM;
+    if (root.containsKey(JSON_MTU))
+    {
+        mtu = root[JSON_MTU];
+    }
+    // Off by default, existing clients expect bare 33 byte packets
+    boolean sequence = false;
+    if (root.containsKey(JSON_SEQUENCE))
+    {
+        sequence = root[JSON_SEQUENCE];
+    }
+    // XOR parity instead of redundant copies, implies the sequence header
+    uint8_t fecData = 0;
+    uint8_t fecParity = 0;
+    if (root.containsKey(JSON_FEC_DATA))
+    {
+        fecData = root[JSON_FEC_DATA];
+        fecParity = 1;
+    }
+    if (root.containsKey(JSON_FEC_PARITY))
+    {
+        fecParity = root[JSON_FEC_PARITY];
+    }
+    // One batcher serves every UDP subscriber, a new layout would break the others'
+    if (!isInfoUDPBatching(mtu, sequence, _redundancy, fecData, fecParity))
+    {
+        if (getOtherSubscribers(OUTPUT_PROTOCOL_UDP, tempIPAddr, port, OUTPUT_PROTOCOL_UDP) > 0)
+        {
+            return returnFail(409, "Error: the other UDP subscribers use another '" + String(JSON_MTU) + "', '" + String(JSON_SEQUENCE) + "', '" + String(JSON_REDUNDANCY) + "' or FEC, DELETE them first");
+        }
+        redundancy = _redundancy;
+        setInfoUDPBatching(mtu, sequence, fecData, fecParity);
+    }
+#ifdef DEBUG
+    _serial.print("Set redundancy to ");
+    _serial.println(redundancy);
+    _serial.print("UDP datagram size: ");
+    _serial.print(udpBatcher.getDatagramSize());
+    _serial.print(" packets per datagram: ");
+    _serial.println(udpBatcher.getPacketsPerDatagram());
+    _serial.print("FEC data/parity: ");
+    _serial.print(udpBatcher.getFecData());
+    _serial.print("/");
+    _serial.println(udpBatcher.getFecParity());
+#endif
+    // Off by default, ClockSync requests would land in a legacy client's packet stream
+    boolean clock = false;
+    if (root.containsKey(JSON_CLOCK))
+    {
+        clock = root[JSON_CLOCK];
+    }
     setInfoUDP(tempAddr, port, _tcpDelimiter);
+    int8_t index = addSubscriber(OUTPUT_PROTOCOL_UDP, tcpAddress, tcpPort, RawRing::POLICY_DROP_OLDEST, 0);
+    if (index < 0)
+    {
+        return returnFail(509, "Error: all " + String(MAX_STREAM_SUBSCRIBERS) + " subscribers are taken, DELETE one first");
+    }
+    subscribers[index].clockWanted = clock;
+    pickClockPeer();
 
 #ifdef DEBUG
     _serial.print("Got ip: ");
@@ -1119,7 +1585,7 @@ void WifiServer::udpSetup()
 #endif
 
     sendHeadersForCORS();
-    return server.send(200, "text/json", jsonStr.c_str());
+    return reply(200, "text/json", jsonStr.c_str());
 }
 
 void WifiServer::removeWifiAPInfo(void)
@@ -1170,6 +1636,15 @@ boolean WifiServer::processChar(char character)
         case MULTI_CHAR_CMD_INSERT_MARKER:
             processInsertMarker(character);
             break;
+        case MULTI_CHAR_CMD_SETTINGS_FILTER:
+            processIncomingFilter(character);
+            break;
+        case MULTI_CHAR_CMD_SETTINGS_DECIMATION:
+            processIncomingDecimation(character);
+            break;
+        case MULTI_CHAR_CMD_SETTINGS_IMPEDANCE:
+            processIncomingImpedance(character);
+            break;
         default:
             break;
         }
@@ -1402,6 +1877,12 @@ boolean WifiServer::processChar(char character)
             setCurPacketType();
             break;
 
+        case OPENBCI_TIME_SET_MICROS:
+            printlnWifi("Time stamp us ON");
+            curTimeSyncMode = TIME_SYNC_MODE_MICROS;
+            setCurPacketType();
+            break;
+
         case OPENBCI_TIME_STOP:
             // Stop the Sync
             printlnWifi("Time stamp OFF");
@@ -1420,6 +1901,22 @@ boolean WifiServer::processChar(char character)
             startMultiCharCmdTimer(MULTI_CHAR_CMD_SETTINGS_SAMPLE_RATE);
             break;
 
+        // Stream rate below the ADS rate
+        case OPENBCI_DECIMATION_SET:
+            startMultiCharCmdTimer(MULTI_CHAR_CMD_SETTINGS_DECIMATION);
+            break;
+
+        // On board notch/bandpass
+        case OPENBCI_FILTER_SET:
+            startMultiCharCmdTimer(MULTI_CHAR_CMD_SETTINGS_FILTER);
+            optionalArgCounter = 0;
+            break;
+
+        // Electrode impedance while streaming
+        case OPENBCI_IMPEDANCE_MONITOR:
+            startMultiCharCmdTimer(MULTI_CHAR_CMD_SETTINGS_IMPEDANCE);
+            break;
+
         // Insert Marker into the EEG data stream
         case OPENBCI_INSERT_MARKER:
             startMultiCharCmdTimer(MULTI_CHAR_CMD_INSERT_MARKER);
@@ -1734,25 +2231,111 @@ void WifiServer::processIncomingSampleRate(char c)
     endMultiCharCmdTimer();
 }
 
-/// @brief When a '`x' is found on the serial port it is a signal to insert a marker
-///         of value x into the AUX1 stream (auxData[0]). This function sets the flag
-///         to indicate that a new marker is available. The marker will be inserted
-///         during the serial and sd write functions
-/// @param c {char} - The character that will be inserted into the data stream
-void WifiServer::processInsertMarker(char c)
+/// @brief After a '|': the decimation as a power of two. A second '|' reports
+///         the rate the samples are streamed at.
+/// @param c {char} - The character that followed
+void WifiServer::processIncomingDecimation(char c)
 {
-    markerValue = c;
-    newMarkerReceived = true;
+    if (c == OPENBCI_DECIMATION_SET)
+    {
+        printfWifi("Success: Stream rate is %luHz\r\n", (unsigned long)_ads1299.getStreamRate());
+    }
+    else if (isDigit(c) && _ads1299.setDecimation(1 << (c - '0')))
+    {
+        printfWifi("Success: Stream rate is %luHz\r\n", (unsigned long)_ads1299.getStreamRate());
+    }
+    else
+    {
+        printFailureWifi("invalid decimation value");
+    }
     endMultiCharCmdTimer();
-    printlnWifi("Marker recieved");
 }
 
-/// @brief Start the timer on multi char commands
-/// @param cmd {char} the command received on the serial stream. See enum MULTI_CHAR_COMMAND
-void WifiServer::startMultiCharCmdTimer(char cmd)
+/// @brief After an 'f': the notch digit, then the bandpass digit. A second
+///         'f' reports the current filter instead.
+/// @param c {char} - The character that followed
+void WifiServer::processIncomingFilter(char c)
 {
-    // if (curDebugMode == DEBUG_MODE_ON)
-    // {
+    if (c == OPENBCI_FILTER_SET && optionalArgCounter == 0)
+    {
+        printfWifi("Success: notch %s bandpass %s\r\n", BiquadBank::getName(_ads1299.filterBank.getNotch()),
+                   BiquadBank::getName(_ads1299.filterBank.getBandpass()));
+    }
+    else if (!isDigit(c))
+    {
+        printFailureWifi("invalid filter value");
+    }
+    else if (optionalArgCounter == 0)
+    {
+        if (c - '0' < BiquadBank::NOTCH_END)
+        {
+            optionalArgBuffer7[0] = c - '0';
+            optionalArgCounter++;
+            return; // wait for the bandpass
+        }
+        printFailureWifi("notch value out of bounds");
+    }
+    else if (c - '0' < BiquadBank::BANDPASS_END)
+    {
+        _ads1299.setFilter((BiquadBank::NOTCH)optionalArgBuffer7[0], (BiquadBank::BANDPASS)(c - '0'));
+        printfWifi("Success: notch %s bandpass %s\r\n", BiquadBank::getName(_ads1299.filterBank.getNotch()),
+                   BiquadBank::getName(_ads1299.filterBank.getBandpass()));
+    }
+    else
+    {
+        printFailureWifi("bandpass value out of bounds");
+    }
+    endMultiCharCmdTimer();
+}
+
+/// @brief After an 'm': '1' starts the impedance monitor, '0' stops it, a
+///         second 'm' reports the last estimates as on HTTP_ROUTE_IMPEDANCE
+/// @param c {char} - The character that followed
+void WifiServer::processIncomingImpedance(char c)
+{
+    if (c == OPENBCI_IMPEDANCE_MONITOR)
+    {
+        printfWifi("Success: %s\r\n", getInfoImpedance().c_str());
+    }
+    else if (c == '0' || c == '1')
+    {
+        _ads1299.setImpedanceMonitor(c == '1');
+        impedanceBlockNumber = 0;
+        if (c == '1' && _ads1299.impedance.getBlockSamples() == 0)
+        {
+            printfWifi("Success: lead-off on, tone not measurable, flags only\r\n");
+        }
+        else
+        {
+            printfWifi("Success: impedance monitor %s\r\n", c == '1' ? "on" : "off");
+        }
+    }
+    else
+    {
+        printFailureWifi("invalid impedance monitor value");
+    }
+    endMultiCharCmdTimer();
+}
+
+/// @brief When a '`x' is found on the serial port it is a signal to insert a marker
+///         of value x into the AUX1 stream (auxData[0]). This function sets the flag
+///         to indicate that a new marker is available. The marker will be inserted
+///         during the serial and sd write functions
+/// @param c {char} - The character that will be inserted into the data stream
+void WifiServer::processInsertMarker(char c)
+{
+    markerValue = c;
+    newMarkerReceived = true;
+    endMultiCharCmdTimer();
+    printlnWifi("Marker recieved");
+}
+
+/// @brief Start the timer on multi char commands
+/// @param cmd {char} the command received on the serial stream. See enum MULTI_CHAR_COMMAND
+void WifiServer::startMultiCharCmdTimer(char cmd)
+{
+    // if (curDebugMode == DEBUG_MODE_ON)
+    // {
     //     Serial1.printf("Start multi char: %c\n", cmd);
     // }
 #ifdef DEBUG
@@ -1767,7 +2350,11 @@ void WifiServer::startMultiCharCmdTimer(char cmd)
 /// @param
 void WifiServer::setCurPacketType(void)
 {
-    if (curAccelMode == ACCEL_MODE_ON && curTimeSyncMode == TIME_SYNC_MODE_ON)
+    if (curTimeSyncMode == TIME_SYNC_MODE_MICROS)
+    {
+        curPacketType = PACKET_TYPE_TIME_MICROS; // the time takes all six aux bytes, accel or not
+    }
+    else if (curAccelMode == ACCEL_MODE_ON && curTimeSyncMode == TIME_SYNC_MODE_ON)
     {
         curPacketType = PACKET_TYPE_ACCEL_TIME_SET;
     }
@@ -1890,34 +2477,256 @@ void WifiServer::sendChannelDataWifi(boolean daisy)
             _ads1299.auxData[i] = 0; // reset auxData bytes to 0
         }
     }
-    sendChannelDataWifi(curPacketType, daisy);
+    if (_ads1299.impedanceReady && !daisy)
+    {
+        _ads1299.impedanceReady = false;
+        sendImpedanceWifi();
+    }
+    if (curOutputMode == OUTPUT_MODE_DELTA || curOutputMode == OUTPUT_MODE_JSON || curOutputMode == OUTPUT_MODE_BANDS)
+    {
+        // One record carries board and daisy, nothing to do for the daisy call
+        if (!daisy)
+        {
+            if (curOutputMode == OUTPUT_MODE_DELTA)
+            {
+                if (_ads1299.configChanged)
+                {
+                    deltaEncoder.reset(); // realign on a keyframe at the first reconfigured sample
+                }
+                sendChannelDataDelta();
+            }
+            else if (curOutputMode == OUTPUT_MODE_BANDS)
+            {
+                if (_ads1299.configChanged)
+                {
+                    bandPower.reset(); // a new gain or rate must not share a window with the old one
+                }
+                sendChannelDataBands();
+            }
+            else
+            {
+                if (_ads1299.configChanged)
+                {
+                    jsonChunk.markConfig(_ads1299.configSequence);
+                }
+                sendChannelDataJson();
+            }
+            sampleCounter++;
+            flushController.addPackets(1);
+        }
+        return;
+    }
+    // The first sample after a live reconfiguration goes out as a user defined
+    // packet whose aux bytes carry the marker, see writeConfigMarkerWifi()
+    sendChannelDataWifi(_ads1299.configChanged ? PACKET_TYPE_USER_DEFINED : curPacketType, daisy);
     sampleCounter++;
+    flushController.addPackets(1);
 }
 
-/// @brief Writes channel data to wifi in the correct stream packet format.
-/// @param packetType {PACKET_TYPE} - The type of packet to send
-/// @param daisy {boolean} - If this packet for the daisy
-///     Adds stop byte see `OpenBCI_32bit_Library.h` enum PACKET_TYPE
-void WifiServer::sendChannelDataWifi(PACKET_TYPE packetType, boolean daisy)
+/// @brief Delta encode the current sample (board and daisy channels) straight
+///         into the send buffer, sending the buffer first if the record might not fit.
+void WifiServer::sendChannelDataDelta(void)
 {
-    storeByteBufTx((uint8_t)(PCKT_END | packetType)); // 1 byte
-    storeByteBufTx(sampleCounter);                    // 1 byte
-    if (daisy)
+    if (bufferPosition + DELTA_MAX_RECORD > getRecordLimit())
+    {
+        sendBufferDelta();
+    }
+    int32_t channels[DELTA_MAX_CHANNELS];
+    uint8_t numChannels = OPENBCI_ADS_CHANS_PER_BOARD;
+    memcpy(channels, _ads1299.boardChannelDataInt, OPENBCI_ADS_CHANS_PER_BOARD * sizeof(int32_t));
+    if (_ads1299.daisyPresent)
+    {
+        memcpy(channels + OPENBCI_ADS_CHANS_PER_BOARD, _ads1299.daisyChannelDataInt, OPENBCI_ADS_CHANS_PER_BOARD * sizeof(int32_t));
+        numChannels += OPENBCI_ADS_CHANS_PER_BOARD;
+    }
+    bufferPosition += deltaEncoder.encode(channels, numChannels, sampleCounter, buffer + bufferPosition);
+}
+
+/// @brief Push the current sample into the band power windows and, when one
+///         completes, append its band packet (powers in uV^2) to the send buffer.
+void WifiServer::sendChannelDataBands(void)
+{
+    int32_t channels[BAND_POWER_CHANNELS];
+    uint8_t numChannels = OPENBCI_ADS_CHANS_PER_BOARD;
+    memcpy(channels, _ads1299.boardChannelDataInt, OPENBCI_ADS_CHANS_PER_BOARD * sizeof(int32_t));
+    if (_ads1299.daisyPresent)
+    {
+        memcpy(channels + OPENBCI_ADS_CHANS_PER_BOARD, _ads1299.daisyChannelDataInt, OPENBCI_ADS_CHANS_PER_BOARD * sizeof(int32_t));
+        numChannels += OPENBCI_ADS_CHANS_PER_BOARD;
+    }
+    if (bandPower.getSampleRate() != _ads1299.getStreamRate())
+    {
+        bandPower.setSampleRate(_ads1299.getStreamRate());
+    }
+    if (!bandPower.add(channels, numChannels))
+    {
+        return;
+    }
+
+    float powers[BAND_POWER_CHANNELS * BandPower::BAND_END];
+    for (uint8_t c = 0; c < numChannels; c++)
+    {
+        const float microvoltsPerCount = _ads1299.channelScale.getScale(c) / (1000.0f * (1L << CHANNEL_SCALE_SHIFT));
+        for (uint8_t b = 0; b < BandPower::BAND_END; b++)
+        {
+            powers[c * BandPower::BAND_END + b] = bandPower.getPower(c, (BandPower::BAND)b) * microvoltsPerCount * microvoltsPerCount;
+        }
+    }
+    if (bufferPosition + BAND_PACKET_MAX > getRecordLimit())
+    {
+        sendBufferDelta();
+    }
+    bufferPosition += BandPacket::encode(bandWindowNumber++, powers, numChannels, BandPower::BAND_END, buffer + bufferPosition);
+}
+
+/// @brief Publish the impedance block that just completed. The delta and band
+///         power streams carry the packet as one more record; over UDP and
+///         WebSocket it is a datagram or frame of its own. Raw and JSON TCP
+///         streams have no room for it, their clients poll HTTP_ROUTE_IMPEDANCE.
+void WifiServer::sendImpedanceWifi(void)
+{
+    const uint8_t numChannels = _ads1299.daisyPresent ? OPENBCI_NUMBER_OF_CHANNELS_DAISY : OPENBCI_ADS_CHANS_PER_BOARD;
+    float ohms[IMPEDANCE_CHANNELS];
+    uint8_t flags[IMPEDANCE_CHANNELS];
+    for (uint8_t i = 0; i < numChannels; i++)
     {
-        // Send daisy
-        for (int i = 0; i < 24; i++)
+        flags[i] = _ads1299.impedance.getFlags(i);
+        ohms[i] = flags[i] & IMPEDANCE_FLAG_MEASURED
+                      ? _ads1299.impedance.getOhms(i, _ads1299.channelScale.getScale(i) / (float)(1L << CHANNEL_SCALE_SHIFT))
+                      : -1;
+    }
+    if (curOutputMode == OUTPUT_MODE_DELTA || curOutputMode == OUTPUT_MODE_BANDS)
+    {
+        if (bufferPosition + IMPEDANCE_PACKET_MAX > getRecordLimit())
         {
-            storeByteBufTx(_ads1299.daisyChannelDataRaw[i]);
+            sendBufferDelta();
         }
+        bufferPosition += ImpedancePacket::encode(impedanceBlockNumber++, ohms, flags, numChannels, buffer + bufferPosition);
     }
     else
     {
-        // Send on board
-        for (int i = 0; i < 24; i++)
+        uint8_t packet[IMPEDANCE_PACKET_MAX];
+        const size_t length = ImpedancePacket::encode(impedanceBlockNumber++, ohms, flags, numChannels, packet);
+        sendRecord(packet, length, WEB_SOCKET_OPCODE_BINARY, false);
+    }
+}
+
+/// @brief Send the delta or band power records collected so far. Records never
+///         straddle two UDP datagrams, so a lost datagram costs only the records inside it.
+void WifiServer::sendBufferDelta(void)
+{
+    if (bufferPosition == 0)
+    {
+        return;
+    }
+    sendRecord(buffer, bufferPosition, WEB_SOCKET_OPCODE_BINARY, true);
+    bufferPosition = 0;
+    lastSendToClient = micros();
+}
+
+/// @brief Send one delta, band power, impedance or JSON record to every
+///         subscriber, whole: one datagram for UDP, one frame for WebSocket
+/// @param data   {const uint8_t *} - The record
+/// @param length {size_t} - Its length in bytes
+/// @param opcode {uint8_t} - WEB_SOCKET_OPCODE_BINARY or WEB_SOCKET_OPCODE_TEXT
+/// @param tcp    {boolean} - Also write it to the TCP subscribers
+void WifiServer::sendRecord(const uint8_t *data, size_t length, uint8_t opcode, boolean tcp)
+{
+    const unsigned long started = micros();
+    boolean datagram = false;
+    for (uint8_t i = 0; i < MAX_STREAM_SUBSCRIBERS; i++)
+    {
+        Subscriber &subscriber = subscribers[i];
+        if (subscriber.protocol == OUTPUT_PROTOCOL_TCP && tcp && !subscriber.connecting)
+        {
+            tcpWrite(i, data, length, length); // a record is sent or dropped whole
+        }
+        else if (subscriber.protocol == OUTPUT_PROTOCOL_UDP)
+        {
+            datagram = true;
+        }
+        else if (subscriber.protocol == OUTPUT_PROTOCOL_WEB_SOCKETS)
+        {
+            webSocket.broadcast(data, length, opcode);
+        }
+    }
+    if (datagram)
+    {
+        sendDatagram(data, length); // to every UDP subscriber
+    }
+    flushController.addSend(micros() - started);
+}
+
+/// @brief Largest record batch, a UDP subscriber needs it to fit one datagram
+uint16_t WifiServer::getRecordLimit(void)
+{
+    return getSubscribers(OUTPUT_PROTOCOL_UDP) > 0 ? udpBatcher.getDatagramSize() : BUFFER_SIZE;
+}
+
+/// @brief Start a JSON chunk at the front of the send buffer
+void WifiServer::jsonChunkBegin(void)
+{
+    jsonChunk.setFields(jsonHasTimeStamps, jsonHasSampleNumbers);
+    jsonChunk.begin(buffer, getRecordLimit());
+}
+
+/// @brief Append the current sample (board and daisy channels, in nanovolts)
+///         to the JSON chunk, sending the chunk first if the sample might not fit.
+void WifiServer::sendChannelDataJson(void)
+{
+    int64_t nanovolts[JSON_CHUNK_MAX_CHANNELS];
+    uint8_t numChannels = OPENBCI_ADS_CHANS_PER_BOARD;
+    _ads1299.channelScale.toNanovolts(_ads1299.boardChannelDataInt, nanovolts, 0, OPENBCI_ADS_CHANS_PER_BOARD);
+    if (_ads1299.daisyPresent)
+    {
+        _ads1299.channelScale.toNanovolts(_ads1299.daisyChannelDataInt, nanovolts + numChannels, numChannels, OPENBCI_ADS_CHANS_PER_BOARD);
+        numChannels += OPENBCI_ADS_CHANS_PER_BOARD;
+    }
+
+    if (jsonChunk.getSamples() == 0)
+    {
+        jsonChunkBegin(); // picks up the latest fields, protocol and MTU
+    }
+    const unsigned long long timestamp = getSampleTime();
+    if (!jsonChunk.addSample(timestamp, sampleCounter, nanovolts, numChannels))
+    {
+        sendBufferJson();
+        if (!jsonChunk.addSample(timestamp, sampleCounter, nanovolts, numChannels))
         {
-            storeByteBufTx(_ads1299.boardChannelDataRaw[i]);
+            stats.add(StreamStats::COUNTER_OVERRUN); // MTU too small for one sample
         }
     }
+}
+
+/// @brief Close and send the JSON chunk collected so far, then start the next one
+void WifiServer::sendBufferJson(void)
+{
+    if (jsonChunk.getSamples() == 0)
+    {
+        return;
+    }
+    const size_t length = jsonChunk.finish(_counter++, tcpDelimiter);
+    sendRecord(buffer, length, WEB_SOCKET_OPCODE_TEXT, true);
+    jsonChunkBegin();
+    lastSendToClient = micros();
+}
+
+/// @brief Writes channel data to wifi in the correct stream packet format.
+/// @param packetType {PACKET_TYPE} - The type of packet to send
+/// @param daisy {boolean} - If this packet for the daisy
+///     Adds stop byte see `OpenBCI_32bit_Library.h` enum PACKET_TYPE
+void WifiServer::sendChannelDataWifi(PACKET_TYPE packetType, boolean daisy)
+{
+    // Never refused: a subscriber that is not keeping up loses its own
+    // oldest packets when it next reads, see streamSendRaw()
+    uint32_t count = 1;
+    bufferTx = rawRing.claim(count)->bytes;
+
+    // Serialize in wire order straight into the ring slot, nothing copies it again before send
+    bufferTx[0] = STREAM_PACKET_BYTE_START;
+    bufferTx[1] = sampleCounter;
+    memcpy(bufferTx + 2, daisy ? _ads1299.daisyChannelDataRaw : _ads1299.boardChannelDataRaw, 24);
+    bufferTxPosition = 26;
 
     switch (packetType)
     {
@@ -1938,12 +2747,19 @@ void WifiServer::sendChannelDataWifi(PACKET_TYPE packetType, boolean daisy)
     case PACKET_TYPE_RAW_AUX_TIME_SYNC:
         sendTimeWithRawAuxWifi();
         break;
+    case PACKET_TYPE_USER_DEFINED:
+        writeConfigMarkerWifi(); // 6 bytes
+        break;
+    case PACKET_TYPE_TIME_MICROS:
+        writeTimeMicrosWifi(); // 6 bytes
+        break;
     case PACKET_TYPE_RAW_AUX:
     default:
         writeAuxDataWifi(); // 6 bytes
         break;
     }
 
+    bufferTx[BYTES_PER_OBCI_PACKET - 1] = (uint8_t)(PCKT_END | packetType); // stop byte
     flushBufferTx();
 }
 
@@ -1956,6 +2772,16 @@ void WifiServer::writeAuxDataWifi(void)
     }
 }
 
+/// @brief Aux bytes of the packet that marks a live reconfiguration: 'C', the
+///         configSequence and the 4 byte sample time in ms, so a client can
+///         tell which samples were taken with the old settings.
+void WifiServer::writeConfigMarkerWifi(void)
+{
+    storeByteBufTx(CONFIG_MARKER_BYTE);
+    storeByteBufTx(_ads1299.configSequence);
+    writeTimeCurrentWifi(_ads1299.lastSampleTime); // 4 bytes
+}
+
 /// @brief Writes channel data, `auxData[0]` 2 bytes, and 4 byte unsigned
 ///         time stamp in ms to serial port in the correct stream packet format.
 /// @param
@@ -2023,21 +2849,29 @@ void WifiServer::writeTimeCurrentWifi(uint32_t newTime)
     }
 }
 
-void WifiServer::flushBufferTx()
+/// @brief Aux bytes of a PACKET_TYPE_TIME_MICROS packet: when DRDY announced
+///         this sample, 48 bits MSB first, microseconds since boot or since
+///         the epoch once NTP is running. Wraps after 8.9 years.
+void WifiServer::writeTimeMicrosWifi(void)
 {
-    int newHead = rawBufferHead + 1;
-    if (newHead >= NUM_PACKETS_IN_RING_BUFFER_RAW)
+    unsigned long long sampleTime = getSampleTime();
+    for (int j = 5; j >= 0; j--)
     {
-        newHead = 0;
+        storeByteBufTx((uint8_t)(sampleTime >> (j * 8)));
     }
-    memcpy(rawBuffer + newHead, bufferTx, BYTES_PER_SPI_PACKET);
-    rawBufferHead = newHead;
+}
+
+void WifiServer::flushBufferTx()
+{
+    rawRing.commit(1);
+    bufferTx = NULL;
     bufferTxPosition = 0;
 }
 
 boolean WifiServer::storeByteBufTx(uint8_t b)
 {
-    if (bufferTxPosition >= 32)
+    // the last byte of the slot is the stop byte, aux data may not run into it
+    if (bufferTx == NULL || bufferTxPosition >= BYTES_PER_OBCI_PACKET - 1)
         return false;
     bufferTx[bufferTxPosition] = b;
     bufferTxPosition++;
@@ -2046,10 +2880,7 @@ boolean WifiServer::storeByteBufTx(uint8_t b)
 
 void WifiServer::bufferTxClear()
 {
-    for (uint8_t i = 0; i < 32; i++)
-    {
-        bufferTx[i] = 0;
-    }
+    bufferTx = NULL;
     bufferTxPosition = 0;
 }
 
@@ -2086,14 +2917,31 @@ void WifiServer::initVariables(void)
     lastTimeWasPolled = 0;
     mqttPort = DEFAULT_MQTT_PORT;
     passthroughPosition = 0;
-    rawBufferHead = 0;
-    rawBufferTail = 0;
+    for (uint8_t i = 0; i < MAX_STREAM_SUBSCRIBERS; i++)
+    {
+        subscribers[i].sender.end();
+        subscribers[i].client.stop();
+        subscribers[i].protocol = OUTPUT_PROTOCOL_NONE;
+        subscribers[i].reader = -1;
+        subscribers[i].clockPeer = false;
+        subscribers[i].clockWanted = false;
+        subscribers[i].connecting = false;
+    }
+    clockSync.reset();
+    rawRing.closeAll();
+    rawRing.clear();
+    udpReader = -1;
+    webSocketClients = 0;
     tail = 0;
     tcpPort = 80;
     timePassthroughBufferLoaded = 0;
     _counter = 0;
     _latency = DEFAULT_LATENCY;
+    latencyAdaptive = false;
+    replyCode = 0;
     _ntpOffset = 0;
+    bandWindowNumber = 0;
+    impedanceBlockNumber = 0;
     currentChannelSetting = 0;
 
 #ifdef MQTT
@@ -2136,12 +2984,16 @@ void WifiServer::initObjects(void)
 }
 
 /// @brief Get a string version of the output mode
-/// @param outputMode   {OUTPUT_MODE} The output mode is either 'raw' or 'json'
+/// @param outputMode   {OUTPUT_MODE} The output mode is 'raw', 'json', 'delta' or 'bands'
 /// @return             {String} String version of the output mode
 String WifiServer::getOutputModeString(OUTPUT_MODE outputMode)
 {
     switch (outputMode)
     {
+    case OUTPUT_MODE_BANDS:
+        return OUTPUT_BANDS;
+    case OUTPUT_MODE_DELTA:
+        return OUTPUT_DELTA;
     case OUTPUT_MODE_JSON:
         return OUTPUT_JSON;
     case OUTPUT_MODE_RAW:
@@ -2160,6 +3012,8 @@ String WifiServer::getOutputProtocolString(OUTPUT_PROTOCOL outputProtocol)
     {
     case OUTPUT_PROTOCOL_TCP:
         return OUTPUT_TCP;
+    case OUTPUT_PROTOCOL_UDP:
+        return OUTPUT_UDP;
     case OUTPUT_PROTOCOL_MQTT:
         return OUTPUT_MQTT;
     case OUTPUT_PROTOCOL_SERIAL:
@@ -2267,6 +3121,26 @@ unsigned long long WifiServer::getTime(void)
     }
 }
 
+/// @brief When DRDY announced the sample in the channel data arrays: on the
+///         clock peer's clock once ClockSync has exchanges and it is the only
+///         subscriber, else on the same clock as getTime(). Every subscriber
+///         gets the same packets, so one host's clock is only right while
+///         nobody else reads them. Unlike getTime() it does not depend on
+///         how long the sample waited in the frame queue.
+/// @return {unsigned long long} - Microseconds
+unsigned long long WifiServer::getSampleTime(void)
+{
+    if (clockSync.isSynced() && getSubscribers(OUTPUT_PROTOCOL_NONE) == MAX_STREAM_SUBSCRIBERS - 1)
+    {
+        return (unsigned long long)clockSync.toHost(_ads1299.lastSampleMicros);
+    }
+    if (ntpActive())
+    {
+        return getTime() - (unsigned long long)(esp_timer_get_time() - _ads1299.lastSampleMicros);
+    }
+    return (unsigned long long)_ads1299.lastSampleMicros;
+}
+
 String WifiServer::getVersion()
 {
     return SOFTWARE_VERSION;
@@ -2277,18 +3151,9 @@ String WifiServer::getVersion()
 /// @return     int32 - The converted number
 int32_t WifiServer::int24To32(uint8_t *arr)
 {
-    uint32_t raw = 0;
-    raw = arr[0] << 16 | arr[1] << 8 | arr[2];
-    // carry through the sign
-    if (bitRead(raw, 23) == 1)
-    {
-        raw |= 0xFF000000;
-    }
-    else
-    {
-        raw &= 0x00FFFFFF;
-    }
-    return (int32_t)raw;
+    int32_t value;
+    SignExtend24::convertBytes(arr, &value, 1);
+    return value;
 }
 
 /// @brief Test to see if a char follows the stream tail byte format
@@ -2316,8 +3181,20 @@ void WifiServer::loop(void)
         }
     }
 
-    // WebServer
-    server.handleClient();
+    // WebServer: the HTTP routes run on control's task, see httpPoll()
+    webSocket.poll();
+    if (webSocket.getClients() > webSocketClients && curOutputMode == OUTPUT_MODE_DELTA)
+    {
+        deltaEncoder.reset(); // a browser that just connected starts on a keyframe
+    }
+    webSocketClients = webSocket.getClients();
+
+    stats.tick(millis());
+
+    if (udpReader >= 0)
+    {
+        clockSyncLoop();
+    }
 
     //     // 客户端等待响应已完成
     //     if (clientWaitingForResponseFullfilled)
@@ -2353,74 +3230,231 @@ void WifiServer::loop(void)
     //     }
 
     // 发送脑电数据包
-    int packetsToSend = rawBufferHead - rawBufferTail;
-    if (packetsToSend < 0)
+    tcpFlush();
+    if (latencyAdaptive && flushController.isUpdateDue(micros()))
     {
-        packetsToSend = NUM_PACKETS_IN_RING_BUFFER_RAW + packetsToSend; // for wrap around
+        flushController.update(micros(), getBacklog(), WiFi.RSSI());
     }
+    if (curOutputMode == OUTPUT_MODE_DELTA || curOutputMode == OUTPUT_MODE_BANDS)
+    {
+        if (micros() > (lastSendToClient + getLatency()))
+        {
+            sendBufferDelta();
+        }
+        return;
+    }
+    if (curOutputMode == OUTPUT_MODE_JSON)
+    {
+        if (micros() > (lastSendToClient + getLatency()))
+        {
+            sendBufferJson();
+        }
+        return;
+    }
+    if (udpReader >= 0)
+    {
+        udpSendRaw();
+    }
+    for (uint8_t i = 0; i < MAX_STREAM_SUBSCRIBERS; i++)
+    {
+        if ((subscribers[i].protocol == OUTPUT_PROTOCOL_TCP && !subscribers[i].connecting) || subscribers[i].protocol == OUTPUT_PROTOCOL_WEB_SOCKETS)
+        {
+            streamSendRaw(i);
+        }
+    }
+}
+
+/// @brief Send a TCP or WebSocket subscriber what it has not read from the raw
+///         ring yet, once its latency timer runs out or a full batch is waiting.
+///         One that fell behind loses packets as its policy says, the others
+///         never notice. A TCP subscriber whose client went away is removed.
+/// @param index {uint8_t} - Into `subscribers`
+void WifiServer::streamSendRaw(uint8_t index)
+{
+    Subscriber &subscriber = subscribers[index];
+    if (subscriber.protocol == OUTPUT_PROTOCOL_TCP && (!subscriber.client.connected() || !subscriber.sender.isOpen()))
+    {
+        removeSubscriber(index);
+        return;
+    }
+    stats.add(StreamStats::COUNTER_OVERRUN, rawRing.catchUp(subscriber.reader));
+    uint32_t packetsToSend = rawRing.size(subscriber.reader);
     if (packetsToSend > MAX_PACKETS_PER_SEND_TCP)
     {
         packetsToSend = MAX_PACKETS_PER_SEND_TCP;
     }
+    if (packetsToSend == 0 || (micros() <= (subscriber.lastSend + getLatency()) && packetsToSend < getBatch()))
+    {
+        return;
+    }
+    const unsigned long started = micros();
+
+    digitalWrite(PIN_LED, LOW); // 指示灯亮
+    // At most two writes, the ring can wrap once inside packetsToSend
+    while (packetsToSend > 0)
+    {
+        uint32_t count = packetsToSend;
+        const uint8_t *packets = rawRing.peek(subscriber.reader, count)->bytes;
+        size_t length = count * BYTES_PER_OBCI_PACKET;
+        if (subscriber.protocol == OUTPUT_PROTOCOL_TCP)
+        {
+            tcpWrite(index, packets, length, BYTES_PER_OBCI_PACKET);
+        }
+        else
+        {
+            // one binary frame per run, straight from the ring
+            webSocket.broadcast(packets, length, WEB_SOCKET_OPCODE_BINARY);
+        }
+        rawRing.consume(subscriber.reader, count);
+        packetsToSend -= count;
+    }
+    subscriber.lastSend = micros();
+    flushController.addSend(subscriber.lastSend - started);
+    digitalWrite(PIN_LED, HIGH); // 指示灯灭
+}
 
-    // 是否存在客户端连接或者输出协议是串行（serial）或 UDP
-    // 当前微秒数是否大于（过去）最后一次向客户端发送数据的时间加上延迟（latency）|| 要发送的数据包数量是否等于最大允许的 TCP 发送包数量
-    // 要发送的数据包数量是否大于零
-    if ((clientTCP.connected() || curOutputProtocol == OUTPUT_PROTOCOL_SERIAL || curOutputProtocol == OUTPUT_PROTOCOL_UDP) && (micros() > (lastSendToClient + getLatency()) || packetsToSend == MAX_PACKETS_PER_SEND_TCP) && (packetsToSend > 0))
+/// @brief Hand a TCP subscriber whole units without blocking. What its socket
+///         does not take waits in its sender; units its policy drops count as
+///         overruns, a failed socket as a send failure.
+/// @param index  {uint8_t} - Into `subscribers`
+/// @param data   {const uint8_t *} - Raw packets or one record
+/// @param length {size_t} - Bytes
+/// @param unit   {size_t} - Bytes per unit, BYTES_PER_OBCI_PACKET or `length`
+void WifiServer::tcpWrite(uint8_t index, const uint8_t *data, size_t length, size_t unit)
+{
+    TcpSender &sender = subscribers[index].sender;
+    const uint32_t dropped = sender.getDropped();
+    sender.write(data, length, unit);
+    if (!sender.isOpen())
     {
-        // Serial.printf("LS2C: %lums H: %u T: %u P2S: %d", (micros() - lastSendToClient)/1000, rawBufferHead, rawBufferTail, packetsToSend);
-        digitalWrite(PIN_LED, LOW); // 指示灯亮
+        stats.add(StreamStats::COUNTER_SEND_FAILURE);
+        return;
+    }
+    stats.add(StreamStats::COUNTER_OVERRUN, sender.getDropped() - dropped);
+}
 
-        uint32_t taily = rawBufferTail;
-        for (uint8_t i = 0; i < packetsToSend; i++)
+/// @brief Give each TCP subscriber's socket what its sender still holds, in
+///         every output mode. One whose connection failed is removed.
+void WifiServer::tcpFlush(void)
+{
+    for (uint8_t i = 0; i < MAX_STREAM_SUBSCRIBERS; i++)
+    {
+        if (subscribers[i].protocol == OUTPUT_PROTOCOL_TCP && !subscribers[i].connecting && !subscribers[i].sender.flush())
         {
-            if (taily >= NUM_PACKETS_IN_RING_BUFFER_RAW)
-            {
-                taily = 0;
-            }
-            uint8_t *buf = rawBuffer[taily];
-            uint8_t stopByte = buf[0];
-            buffer[bufferPosition++] = STREAM_PACKET_BYTE_START;
-            for (int i = 1; i < BYTES_PER_SPI_PACKET; i++)
-            {
-                buffer[bufferPosition++] = buf[i];
-            }
-            buffer[bufferPosition++] = stopByte;
-            taily += 1;
+            stats.add(StreamStats::COUNTER_SEND_FAILURE);
+            removeSubscriber(i);
+        }
+    }
+}
+
+/// @brief Packets waiting for the slowest subscriber, in the ring and in its
+///         TCP sender, for the adaptive flush interval
+uint32_t WifiServer::getBacklog(void)
+{
+    uint32_t backlog = 0;
+    for (uint8_t i = 0; i < MAX_STREAM_SUBSCRIBERS; i++)
+    {
+        const Subscriber &subscriber = subscribers[i];
+        if (subscriber.protocol == OUTPUT_PROTOCOL_NONE || subscriber.connecting)
+        {
+            continue;
+        }
+        uint32_t waiting = rawRing.size(subscriber.reader);
+        if (subscriber.protocol == OUTPUT_PROTOCOL_TCP)
+        {
+            waiting += subscriber.sender.getQueued() / BYTES_PER_OBCI_PACKET;
+        }
+        backlog = waiting > backlog ? waiting : backlog;
+    }
+    return backlog;
+}
+
+/// @brief Move every packet in the raw ring into MTU sized datagrams. Full
+///        datagrams go out at once, a partial one waits for the latency timer.
+void WifiServer::udpSendRaw(void)
+{
+    const unsigned long started = micros();
+    uint32_t sequence = udpBatcher.getSequence();
+    stats.add(StreamStats::COUNTER_OVERRUN, rawRing.catchUp(udpReader));
+    // At most two runs, the ring can wrap once. The batcher keeps its own
+    // copy of each datagram since redundancy and FEC resend from it.
+    for (int run = 0; run < 2; run++)
+    {
+        uint32_t count = rawRing.capacity();
+        const uint8_t *packets = rawRing.peek(udpReader, count)->bytes;
+        if (count == 0)
+        {
+            break;
         }
+        udpBatcher.addPackets(packets, count, *this);
+        rawRing.consume(udpReader, count);
+    }
+
+    if (udpBatcher.getPending() > 0 && micros() > (lastSendToClient + getLatency()))
+    {
+        udpBatcher.flush(*this);
+    }
+    if (udpBatcher.getSequence() != sequence)
+    {
         lastSendToClient = micros();
-        if (curOutputProtocol == OUTPUT_PROTOCOL_TCP)
+        flushController.addSend(lastSendToClient - started);
+    }
+}
+
+/// @brief Keep the ClockSync exchange with the clock peer going on the
+///         streaming socket: pick up a response, send a request every
+///         CLOCK_SYNC_INTERVAL_MS. The response is only stamped when loop()
+///         gets here, that shows up as extra delay and the filter drops it.
+void WifiServer::clockSyncLoop(void)
+{
+    const int8_t peer = getClockPeer();
+    int size = clientUDP.parsePacket();
+    if (size > 0)
+    {
+        int64_t arrived = esp_timer_get_time();
+        uint8_t datagram[CLOCK_SYNC_RESPONSE_SIZE];
+        int length = clientUDP.read(datagram, sizeof(datagram));
+        clientUDP.flush(); // drop what did not fit, or parsePacket() never sees the next one
+        if (peer >= 0 && length > 0 && size == length && clientUDP.remoteIP() == subscribers[peer].address &&
+            clientUDP.remotePort() == subscribers[peer].port)
         {
-            clientTCP.write(buffer, bufferPosition);
+            clockSync.handleResponse(datagram, length, arrived);
         }
-        else if (curOutputProtocol == OUTPUT_PROTOCOL_UDP)
+    }
+    if (peer >= 0 && millis() - lastClockSync >= CLOCK_SYNC_INTERVAL_MS)
+    {
+        lastClockSync = millis();
+        uint8_t request[CLOCK_SYNC_REQUEST_SIZE];
+        clientUDP.beginPacket(subscribers[peer].address, subscribers[peer].port);
+        clientUDP.write(request, clockSync.makeRequest(esp_timer_get_time(), request));
+        clientUDP.endPacket();
+    }
+}
+
+/// @brief DatagramSink for the UDP batcher, sends to every UDP subscriber
+/// @param data   {const uint8_t *} - The datagram
+/// @param length {size_t} - Its length in bytes
+/// @return {bool} - `true` if every copy was handed to the stack
+bool WifiServer::sendDatagram(const uint8_t *data, size_t length)
+{
+    bool sent = true;
+    digitalWrite(PIN_LED, LOW); // 指示灯亮
+    for (uint8_t i = 0; i < MAX_STREAM_SUBSCRIBERS; i++)
+    {
+        if (subscribers[i].protocol != OUTPUT_PROTOCOL_UDP)
         {
-            clientUDP.beginPacket(tcpAddress, tcpPort);
-            clientUDP.write(buffer, bufferPosition);
-            if (clientUDP.endPacket() == 1)
-            {
-                // Serial.println(" udp0");
-            }
-            if (redundancy)
-            {
-                clientUDP.beginPacket(tcpAddress, tcpPort);
-                clientUDP.write(buffer, bufferPosition);
-                if (clientUDP.endPacket() == 1)
-                {
-                    // Serial.println(" udp1");
-                }
-                clientUDP.beginPacket(tcpAddress, tcpPort);
-                clientUDP.write(buffer, bufferPosition);
-                if (clientUDP.endPacket() == 1)
-                {
-                    // Serial.println(" udp2");
-                }
-            }
+            continue;
+        }
+        clientUDP.beginPacket(subscribers[i].address, subscribers[i].port);
+        clientUDP.write(data, length);
+        if (clientUDP.endPacket() != 1)
+        {
+            stats.add(StreamStats::COUNTER_SEND_FAILURE);
+            sent = false;
         }
-        bufferPosition = 0;
-        rawBufferTail = taily;
-        digitalWrite(PIN_LED, HIGH); // 指示灯灭
     }
+    digitalWrite(PIN_LED, HIGH); // 指示灯灭
+    return sent;
 }
 
 void WifiServer::ProcessPacketResponse(String message)
@@ -2484,6 +3518,28 @@ void WifiServer::printFailureWifi(const char *msg)
     ProcessPacketResponse(message);
 }
 
+/// @brief The policy a subscriber was added with, as JSON_POLICY takes it
+const char *WifiServer::getSubscriberPolicy(uint8_t index)
+{
+    const Subscriber &subscriber = subscribers[index];
+    if (subscriber.protocol != OUTPUT_PROTOCOL_TCP)
+    {
+        return rawRing.getPolicy(subscriber.reader) == RawRing::POLICY_LATEST ? SUBSCRIBER_POLICY_LATEST : SUBSCRIBER_POLICY_DROP_OLDEST;
+    }
+    switch (subscriber.sender.getPolicy())
+    {
+    case TcpSender::POLICY_LATEST:
+        return SUBSCRIBER_POLICY_LATEST;
+    case TcpSender::POLICY_DECIMATE:
+        return SUBSCRIBER_POLICY_DECIMATE;
+    case TcpSender::POLICY_PAUSE:
+        return SUBSCRIBER_POLICY_PAUSE;
+    case TcpSender::POLICY_DROP_OLDEST:
+    default:
+        return SUBSCRIBER_POLICY_DROP_OLDEST;
+    }
+}
+
 const char *WifiServer::getBoardMode(void)
 {
     switch (curBoardMode)
@@ -2740,6 +3796,35 @@ void WifiServer::setInfoUDP(String address, int port, boolean delimiter)
     setOutputProtocol(OUTPUT_PROTOCOL_UDP);
 }
 
+/// @brief Used to configure how raw packets are batched into UDP datagrams,
+///         call after `redundancy` is set.
+/// @param mtu       {uint16_t} - Largest datagram to send, capped at BUFFER_SIZE
+/// @param sequence  {boolean} - Prefix each datagram with the sequence header
+/// @param fecData   {uint8_t} - Data datagrams per parity block, 0 for no FEC
+/// @param fecParity {uint8_t} - Parity datagrams per block
+void WifiServer::setInfoUDPBatching(uint16_t mtu, boolean sequence, uint8_t fecData, uint8_t fecParity)
+{
+    if (mtu > BUFFER_SIZE)
+    {
+        mtu = BUFFER_SIZE;
+    }
+    udpBatcher.configure(mtu, sequence, redundancy ? UDP_REDUNDANT_COPIES : 0, UDP_REDUNDANT_SPACING,
+                         fecData, fecParity);
+}
+
+/// @brief Whether the UDP datagrams are already batched this way, see setInfoUDPBatching()
+/// @param redundant {boolean} - Redundant copies, as `redundancy`
+/// @return {boolean} - `true` if setInfoUDPBatching() would change nothing
+boolean WifiServer::isInfoUDPBatching(uint16_t mtu, boolean sequence, boolean redundant, uint8_t fecData, uint8_t fecParity)
+{
+    if (mtu > BUFFER_SIZE)
+    {
+        mtu = BUFFER_SIZE;
+    }
+    return udpBatcher.isConfigured(mtu, sequence, redundant ? UDP_REDUNDANT_COPIES : 0, UDP_REDUNDANT_SPACING,
+                                   fecData, fecParity);
+}
+
 /// @brief Used to configure the requried internal variables for TCP communication
 /// @param address   {IPAddress} - The ip address in string form: "192.168.0.1"
 /// @param port      {int} - The port number as an int
@@ -2752,11 +3837,255 @@ void WifiServer::setInfoTCP(String address, int port, boolean delimiter)
     setOutputProtocol(OUTPUT_PROTOCOL_UDP);
 }
 
+/// @brief Add a stream sink next to the ones already there. One with the same
+///         protocol, address and port is replaced, so a client that posts
+///         again starts over instead of taking a second entry.
+/// @param protocol {OUTPUT_PROTOCOL} - TCP, UDP or WebSocket
+/// @param address  {IPAddress} - Where TCP and UDP send to
+/// @param port     {uint16_t} - Its port, the WebSocket endpoint's own for WebSocket
+/// @param policy   {RawRing::POLICY} - What it loses once it falls `lag` packets behind
+/// @param lag      {uint32_t} - Packets it may fall behind, 0 for the whole ring
+/// @return {int8_t} - Index into `subscribers`, -1 if the table is full
+int8_t WifiServer::addSubscriber(OUTPUT_PROTOCOL protocol, IPAddress address, uint16_t port, RawRing::POLICY policy, uint32_t lag)
+{
+    int8_t index = -1;
+    for (uint8_t i = 0; i < MAX_STREAM_SUBSCRIBERS; i++)
+    {
+        if (subscribers[i].protocol == protocol && subscribers[i].address == address && subscribers[i].port == port)
+        {
+            removeSubscriber(i);
+        }
+        if (subscribers[i].protocol == OUTPUT_PROTOCOL_NONE && index < 0)
+        {
+            index = i;
+        }
+    }
+    if (index < 0)
+    {
+        return -1;
+    }
+
+    // One reader per entry at most, the ring has as many as the table
+    Subscriber &subscriber = subscribers[index];
+    if (protocol == OUTPUT_PROTOCOL_UDP)
+    {
+        if (udpReader < 0)
+        {
+            udpReader = rawRing.open(RawRing::POLICY_DROP_OLDEST);
+        }
+        subscriber.reader = udpReader;
+    }
+    else
+    {
+        subscriber.reader = rawRing.open(policy, lag);
+    }
+    subscriber.protocol = protocol;
+    subscriber.address = address;
+    subscriber.port = port;
+    subscriber.lastSend = micros();
+    subscriber.clockPeer = false;
+    subscriber.clockWanted = false;
+    subscriber.connecting = false;
+    pickClockPeer();
+    if (curOutputMode == OUTPUT_MODE_DELTA && protocol != OUTPUT_PROTOCOL_TCP)
+    {
+        deltaEncoder.reset(); // it decodes from the next record on, a TCP subscriber once connected
+    }
+    return index;
+}
+
+/// @brief Close a stream sink and its reader
+/// @param index {uint8_t} - Into `subscribers`
+void WifiServer::removeSubscriber(uint8_t index)
+{
+    Subscriber &subscriber = subscribers[index];
+    const OUTPUT_PROTOCOL protocol = subscriber.protocol;
+    if (protocol == OUTPUT_PROTOCOL_NONE)
+    {
+        return;
+    }
+    subscriber.sender.end();
+    subscriber.client.stop();
+    subscriber.protocol = OUTPUT_PROTOCOL_NONE;
+    subscriber.connecting = false;
+    if (subscriber.clockPeer)
+    {
+        subscriber.clockPeer = false;
+        clockSync.reset(); // its fit is of no use for the next peer
+        pickClockPeer();
+    }
+    if (protocol != OUTPUT_PROTOCOL_UDP)
+    {
+        rawRing.close(subscriber.reader);
+    }
+    else if (getSubscribers(OUTPUT_PROTOCOL_UDP) == 0)
+    {
+        rawRing.close(udpReader);
+        udpReader = -1;
+    }
+    subscriber.reader = -1;
+    if (getSubscribers(OUTPUT_PROTOCOL_NONE) == MAX_STREAM_SUBSCRIBERS)
+    {
+        setOutputProtocol(OUTPUT_PROTOCOL_NONE);
+    }
+}
+
+/// @brief Make the first UDP subscriber in the table that asked for clock
+///         sync the clock peer, unless one already is. Its clock starts from scratch.
+void WifiServer::pickClockPeer(void)
+{
+    if (getClockPeer() >= 0)
+    {
+        return;
+    }
+    for (uint8_t i = 0; i < MAX_STREAM_SUBSCRIBERS; i++)
+    {
+        if (subscribers[i].protocol == OUTPUT_PROTOCOL_UDP && subscribers[i].clockWanted)
+        {
+            subscribers[i].clockPeer = true;
+            clockSync.reset();
+            lastClockSync = 0;
+            return;
+        }
+    }
+}
+
+/// @brief The UDP subscriber clockSync exchanges with
+/// @return {int8_t} - Index into `subscribers`, -1 without UDP subscribers
+int8_t WifiServer::getClockPeer(void)
+{
+    for (uint8_t i = 0; i < MAX_STREAM_SUBSCRIBERS; i++)
+    {
+        if (subscribers[i].clockPeer)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/// @brief DELETE on a stream route: the subscriber at the body's ip (and
+///         port, if given), or every one of `protocol` without a body
+/// @param protocol {OUTPUT_PROTOCOL} - The route's protocol
+void WifiServer::subscribersDelete(OUTPUT_PROTOCOL protocol)
+{
+    boolean all = true;
+    IPAddress address;
+    int port = 0;
+    if (!noBodyInParam())
+    {
+        JsonObject &root = getArgFromArgs(2);
+        if (root.containsKey(JSON_TCP_IP))
+        {
+            String tempAddr = root[JSON_TCP_IP];
+            address.fromString(tempAddr);
+            port = root.containsKey(JSON_TCP_PORT) ? root[JSON_TCP_PORT].as<int>() : 0;
+            all = false;
+        }
+    }
+    for (uint8_t i = 0; i < MAX_STREAM_SUBSCRIBERS; i++)
+    {
+        Subscriber &subscriber = subscribers[i];
+        if (subscriber.protocol == protocol && (all || (subscriber.address == address && (port == 0 || subscriber.port == port))))
+        {
+            removeSubscriber(i);
+        }
+    }
+}
+
+/// @brief Count the subscribers of one protocol
+/// @param protocol {OUTPUT_PROTOCOL} - OUTPUT_PROTOCOL_NONE counts the free entries
+/// @return {uint8_t} - Entries in `subscribers`
+uint8_t WifiServer::getSubscribers(OUTPUT_PROTOCOL protocol)
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < MAX_STREAM_SUBSCRIBERS; i++)
+    {
+        count += subscribers[i].protocol == protocol ? 1 : 0;
+    }
+    return count;
+}
+
+/// @brief Count the subscribers a new one would stream next to
+/// @param protocol {OUTPUT_PROTOCOL} - The new one's, an entry with its
+///                 protocol, address and port is replaced and not counted
+/// @param address  {IPAddress} - Its address
+/// @param port     {uint16_t} - Its port
+/// @param of       {OUTPUT_PROTOCOL} - Count only these, OUTPUT_PROTOCOL_NONE for all
+/// @return {uint8_t} - Entries in `subscribers`
+uint8_t WifiServer::getOtherSubscribers(OUTPUT_PROTOCOL protocol, IPAddress address, uint16_t port, OUTPUT_PROTOCOL of)
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < MAX_STREAM_SUBSCRIBERS; i++)
+    {
+        const Subscriber &subscriber = subscribers[i];
+        if (subscriber.protocol == OUTPUT_PROTOCOL_NONE || (of != OUTPUT_PROTOCOL_NONE && subscriber.protocol != of))
+        {
+            continue;
+        }
+        if (subscriber.protocol == protocol && subscriber.address == address && subscriber.port == port)
+        {
+            continue;
+        }
+        count++;
+    }
+    return count;
+}
+
+/// @brief Switch to the output mode a new subscriber asks for. Every
+///         subscriber gets the one encoded stream, so while others stream
+///         it can only ask for theirs.
+/// @param protocol {OUTPUT_PROTOCOL} - The new subscriber, see getOtherSubscribers()
+/// @param address  {IPAddress} - Its address
+/// @param port     {uint16_t} - Its port
+/// @param mode     {OUTPUT_MODE} - The mode it asks for
+/// @return {boolean} - `false` if the others stream in another mode, nothing changed
+boolean WifiServer::joinOutputMode(OUTPUT_PROTOCOL protocol, IPAddress address, uint16_t port, OUTPUT_MODE mode)
+{
+    if (mode == curOutputMode)
+    {
+        return true;
+    }
+    if (getOtherSubscribers(protocol, address, port, OUTPUT_PROTOCOL_NONE) > 0)
+    {
+        return false;
+    }
+    setOutputMode(mode);
+    return true;
+}
+
 /// @brief Sets the latency
 /// @param latency {unsigned long} - The latency of the system
 void WifiServer::setLatency(unsigned long latency)
 {
     _latency = latency;
+    latencyAdaptive = false;
+}
+
+/// @brief Let FlushController pick the interval and batch from send time,
+///         backlog and RSSI, starting over at the shortest interval
+void WifiServer::setLatencyAdaptive(void)
+{
+    flushController.begin(LATENCY_ADAPTIVE_MIN, LATENCY_ADAPTIVE_MAX, MAX_PACKETS_PER_SEND_TCP);
+    latencyAdaptive = true;
+}
+
+/// @brief A JSON_LATENCY value: microseconds, or LATENCY_AUTO
+/// @param latency {JsonVariant} - From the request body
+/// @return {boolean} - `false` if it is neither
+boolean WifiServer::parseLatency(JsonVariant latency)
+{
+    if (latency.is<const char *>() && String(latency.as<const char *>()).equals(LATENCY_AUTO))
+    {
+        setLatencyAdaptive();
+        return true;
+    }
+    if (latency.is<unsigned long>())
+    {
+        setLatency(latency.as<unsigned long>());
+        return true;
+    }
+    return false;
 }
 
 /// @brief Gets the latency
@@ -2764,7 +4093,14 @@ void WifiServer::setLatency(unsigned long latency)
 /// @return {unsigned long} - The latency of the system
 unsigned long WifiServer::getLatency(void)
 {
-    return _latency;
+    return latencyAdaptive ? flushController.getInterval() : _latency;
+}
+
+/// @brief Raw packets that make a full send, sent before the latency runs out
+/// @return {uint16_t} - At most MAX_PACKETS_PER_SEND_TCP
+uint16_t WifiServer::getBatch(void)
+{
+    return latencyAdaptive ? flushController.getBatch() : MAX_PACKETS_PER_SEND_TCP;
 }
 
 /// @brief Used to get the last two bytes of the max addresses
@@ -2886,13 +4222,35 @@ void WifiServer::setNTPOffset(unsigned long ntpOffset)
 /// @param newOutputMode {OUTPUT_MODE} The output mode you want to switch to
 void WifiServer::setOutputMode(OUTPUT_MODE newOutputMode)
 {
+    if (newOutputMode == OUTPUT_MODE_DELTA && curOutputMode != OUTPUT_MODE_DELTA)
+    {
+        bufferPosition = 0;
+        deltaEncoder.reset(); // start the new stream on a keyframe
+    }
+    if (newOutputMode == OUTPUT_MODE_BANDS && curOutputMode != OUTPUT_MODE_BANDS)
+    {
+        bufferPosition = 0;
+        bandPower.reset();
+        bandWindowNumber = 0;
+    }
     curOutputMode = newOutputMode;
+    if (newOutputMode == OUTPUT_MODE_JSON)
+    {
+        jsonChunkBegin();
+    }
 }
 
+/// @brief Run passthrough commands, from a route under control's lock.
+///        loop() gets its pass between two of them.
+/// @param commands {String} - One command per character
 void WifiServer::processCommands(String commands)
 {
     for (int i = 0; i < commands.length(); i++)
     {
+        if (i > 0)
+        {
+            control.yield();
+        }
         processChar(commands[i]);
     }
 }
@@ -2935,6 +4293,6 @@ void WifiServer::setBoardMode(uint8_t newBoardMode)
     default:
         break;
     }
-    delay(10);
+    control.sleep(10); // called from a route, see processCommands()
     setCurPacketType();
 }
@@ -9,6 +9,20 @@
 #include "ESP32SSDP.h"
 #include "ESPmDNS.h"
 #include "WebServer.h"
+#include "StreamStats.h"
+#include "UdpBatcher.h"
+#include "DeltaCodec.h"
+#include "JsonChunk.h"
+#include "ClockSync.h"
+#include "PacketRing.h"
+#include "BandPower.h"
+#include "BandPacket.h"
+#include "ImpedancePacket.h"
+#include "SignExtend24.h"
+#include "TcpSender.h"
+#include "FlushController.h"
+#include "ControlTask.h"
+#include "WebSocketServer.h"
 
 class ADS1299;
 
@@ -17,7 +31,6 @@ class ADS1299;
 extern WebServer server;
 extern WiFiClass WiFi;
 extern WiFiUDP clientUDP;
-extern WiFiClient clientTCP;
 
 #ifndef BUFFER_SIZE
 #define BUFFER_SIZE 1440
@@ -27,7 +40,7 @@ extern WiFiClient clientTCP;
 #define WIFI_SSID "HUAWEI-AE86_Wi-Fi5"
 #define WIFI_PASSWD "20030717"
 
-class WifiServer
+class WifiServer : public DatagramSink
 {
 public:
     // ENUMS
@@ -40,7 +53,9 @@ public:
     enum OUTPUT_MODE
     {
         OUTPUT_MODE_RAW,
-        OUTPUT_MODE_JSON
+        OUTPUT_MODE_JSON,
+        OUTPUT_MODE_DELTA,
+        OUTPUT_MODE_BANDS
     };
 
     enum OUTPUT_PROTOCOL
@@ -73,7 +88,10 @@ public:
         MULTI_CHAR_CMD_SERIAL_PASSTHROUGH,
         MULTI_CHAR_CMD_SETTINGS_BOARD_MODE,
         MULTI_CHAR_CMD_SETTINGS_SAMPLE_RATE,
-        MULTI_CHAR_CMD_INSERT_MARKER
+        MULTI_CHAR_CMD_INSERT_MARKER,
+        MULTI_CHAR_CMD_SETTINGS_FILTER,
+        MULTI_CHAR_CMD_SETTINGS_DECIMATION,
+        MULTI_CHAR_CMD_SETTINGS_IMPEDANCE
     };
 
     enum PACKET_TYPE
@@ -84,13 +102,15 @@ public:
         PACKET_TYPE_ACCEL_TIME_SET,
         PACKET_TYPE_ACCEL_TIME_SYNC,
         PACKET_TYPE_RAW_AUX_TIME_SET,
-        PACKET_TYPE_RAW_AUX_TIME_SYNC
+        PACKET_TYPE_RAW_AUX_TIME_SYNC,
+        PACKET_TYPE_TIME_MICROS // aux bytes: 48 bit DRDY time in us, see writeTimeMicrosWifi()
     };
 
     enum TIME_SYNC_MODE
     {
         TIME_SYNC_MODE_ON,
-        TIME_SYNC_MODE_OFF
+        TIME_SYNC_MODE_OFF,
+        TIME_SYNC_MODE_MICROS
     };
 
     enum DEBUG_MODE
@@ -126,6 +146,23 @@ public:
     } Sample;
 #endif
 
+    typedef PacketFanout<NUM_PACKETS_IN_RING_BUFFER_RAW, MAX_STREAM_SUBSCRIBERS> RawRing;
+
+    /// @brief One sink of the stream, see addSubscriber()
+    typedef struct
+    {
+        OUTPUT_PROTOCOL protocol; // OUTPUT_PROTOCOL_NONE: free entry
+        IPAddress address;        // TCP and UDP
+        uint16_t port;
+        int8_t reader;            // its cursor in rawRing, UDP subscribers share udpReader
+        unsigned long lastSend;   // micros() of its last raw send, for the latency timer
+        WiFiClient client;        // OUTPUT_PROTOCOL_TCP
+        TcpSender sender;         // writes to `client` without blocking, queues and drops as its policy says
+        boolean clockPeer;        // the one UDP subscriber clockSync exchanges with
+        boolean clockWanted;      // UDP subscriber that posted "clock": true, may become clockPeer
+        boolean connecting;       // TCP entry held while tcpSetup() connects without control's lock
+    } Subscriber;
+
     // Functions and Methods
     WifiServer();
     void begin(void);
@@ -149,10 +186,14 @@ public:
     uint8_t getHead(void);
     String getInfoAll(void);
     String getInfoBoard(void);
+    String getInfoStats(void);
+    String getInfoSubscribers(void);
+    String getInfoImpedance(void);
 #ifdef MQTT
     String getInfoMQTT(boolean);
 #endif
     String getInfoTCP(boolean);
+    String getInfoWebSocket(void);
     int getJSONAdditionalBytes(uint8_t);
     size_t getJSONBufferSize(void);
 #ifdef RAW_TO_JSON
@@ -161,6 +202,7 @@ public:
     uint8_t getJSONMaxPackets(void);
     uint8_t getJSONMaxPackets(uint8_t);
     unsigned long getLatency(void);
+    uint16_t getBatch(void);
     String getMacLastFourBytes(void);
     String getMac(void);
     String getModelNumber(void);
@@ -179,6 +221,7 @@ public:
 #endif
     uint8_t getTail(void);
     unsigned long long getTime(void);
+    unsigned long long getSampleTime(void);
     String getVersion();
     int32_t int24To32(uint8_t *);
     boolean isAStreamByte(uint8_t);
@@ -212,8 +255,11 @@ public:
     void setInfoMQTT(String, String, String, int);
 #endif
     void setInfoUDP(String, int, boolean);
+    void setInfoUDPBatching(uint16_t, boolean, uint8_t, uint8_t);
+    boolean isInfoUDPBatching(uint16_t, boolean, boolean, uint8_t, uint8_t);
     void setInfoTCP(String, int, boolean);
     void setLatency(unsigned long);
+    void setLatencyAdaptive(void);
     void setNumChannels(uint8_t);
     void setNTPOffset(unsigned long);
     void setOutputMode(OUTPUT_MODE);
@@ -228,6 +274,7 @@ public:
     void spiProcessPacketStreamJSON(uint8_t *);
     void spiProcessPacketStreamRaw(uint8_t *);
     void spiProcessPacketResponse(uint8_t *);
+    bool sendDatagram(const uint8_t *, size_t);
     void transformRawsToScaledCyton(int32_t *, uint8_t *, uint8_t, double *);
     void transformRawsToScaledGanglion(int32_t *, double *);
 
@@ -250,7 +297,22 @@ public:
     OUTPUT_MODE curOutputMode;
     OUTPUT_PROTOCOL curOutputProtocol;
 
-    uint8_t rawBuffer[NUM_PACKETS_IN_RING_BUFFER_RAW][BYTES_PER_SPI_PACKET];
+    StreamStats stats; // data loss counters, served on HTTP_ROUTE_STATS
+    UdpBatcher udpBatcher;
+    DeltaEncoder deltaEncoder;
+    JsonChunkWriter jsonChunk; // OUTPUT_MODE_JSON, writes into buffer
+    ClockSync clockSync;       // device -> clock peer's clock mapping, see clockSyncLoop()
+    BandPower bandPower;       // OUTPUT_MODE_BANDS, windows over the stream rate
+    uint16_t bandWindowNumber;
+    uint16_t impedanceBlockNumber;
+    WebSocketServer webSocket; // OUTPUT_PROTOCOL_WEB_SOCKETS, on WEB_SOCKET_PORT next to the HTTP routes
+    uint8_t webSocketClients;  // after the last poll, one more needs a delta keyframe
+
+    RawRing rawRing;                                // packets in wire order, each subscriber reads at its own pace
+    Subscriber subscribers[MAX_STREAM_SUBSCRIBERS]; // listed on HTTP_ROUTE_SUBSCRIBERS
+    int8_t udpReader;                               // one cursor for every UDP subscriber, a datagram never waits
+    FlushController flushController;                // picks interval and batch while latencyAdaptive
+    boolean latencyAdaptive;
 
 #ifdef RAW_TO_JSON
     Sample sampleBuffer[NUM_PACKETS_IN_RING_BUFFER_JSON];
@@ -273,13 +335,18 @@ public:
 
     volatile uint8_t head;
     volatile uint8_t tail;
-    volatile uint32_t rawBufferHead;
-    volatile uint32_t rawBufferTail;
 
     void startWebServer(void);
     boolean connectToWiFi(const char *, const char *);
 
+    ControlTask control; // runs the HTTP routes; loop() holds its lock for a pass
+
     // HTTP Rest Helpers
+    static void httpPoll(void *context);
+    void on(const char *uri, HTTPMethod method, WebServer::THandlerFunction handler);
+    void serveLocked(WebServer::THandlerFunction handler);
+    void reply(int code, const char *type, const String &body);
+    void sendReply(void);
     boolean noBodyInParam();
     void debugPrintDelete();
     void debugPrintGet();
@@ -293,6 +360,7 @@ public:
     void returnNoBodyInPost();
     void returnMissingRequiredParam(const char *err);
     void returnFail(int code, String msg);
+    void returnOutputModeTaken();
     void requestWifiManagerStart();
     JsonObject &getArgFromArgs(int args);
     JsonObject &getArgFromArgs();
@@ -300,6 +368,23 @@ public:
     void passthroughCommand();
     void tcpSetup();
     void udpSetup();
+    void webSocketSetup();
+    void udpSendRaw();
+    void streamSendRaw(uint8_t index);
+    void tcpWrite(uint8_t index, const uint8_t *data, size_t length, size_t unit);
+    void tcpFlush(void);
+    uint32_t getBacklog(void);
+    boolean parseLatency(JsonVariant latency);
+    const char *getSubscriberPolicy(uint8_t index);
+    void clockSyncLoop(void);
+    int8_t addSubscriber(OUTPUT_PROTOCOL protocol, IPAddress address, uint16_t port, RawRing::POLICY policy, uint32_t lag);
+    void removeSubscriber(uint8_t index);
+    void pickClockPeer(void);
+    int8_t getClockPeer(void);
+    void subscribersDelete(OUTPUT_PROTOCOL protocol);
+    uint8_t getSubscribers(OUTPUT_PROTOCOL protocol);
+    uint8_t getOtherSubscribers(OUTPUT_PROTOCOL protocol, IPAddress address, uint16_t port, OUTPUT_PROTOCOL of);
+    boolean joinOutputMode(OUTPUT_PROTOCOL protocol, IPAddress address, uint16_t port, OUTPUT_MODE mode);
     void removeWifiAPInfo(void);
 
     boolean processChar(char character);
@@ -310,6 +395,9 @@ public:
     void processIncomingBoardMode(char);
     void processIncomingSampleRate(char);
     void processInsertMarker(char);
+    void processIncomingFilter(char);
+    void processIncomingDecimation(char);
+    void processIncomingImpedance(char);
     void startMultiCharCmdTimer(char cmd);
     void setCurPacketType(void);
     void endMultiCharCmdTimer(void);
@@ -318,13 +406,24 @@ public:
     char getGainForAsciiChar(char asciiChar);
     void sendChannelDataWifi(boolean daisy);
     void sendChannelDataWifi(PACKET_TYPE packetType, boolean daisy);
+    void sendChannelDataDelta(void);
+    void sendBufferDelta(void);
+    void sendRecord(const uint8_t *data, size_t length, uint8_t opcode, boolean tcp);
+    uint16_t getRecordLimit(void);
+    void sendChannelDataBands(void);
+    void sendImpedanceWifi(void);
+    void sendChannelDataJson(void);
+    void sendBufferJson(void);
+    void jsonChunkBegin(void);
     void accelWriteAxisDataWifi(void);
     void LIS3DH_writeAxisDataWifi(void);
     void sendTimeWithAccelWifi(void);
     void sendTimeWithRawAuxWifi(void);
     void LIS3DH_writeAxisDataForAxisWifi(uint8_t axis);
     void writeAuxDataWifi(void);
+    void writeConfigMarkerWifi(void);
     void writeTimeCurrentWifi(uint32_t newTime);
+    void writeTimeMicrosWifi(void);
 
     void flushBufferTx();
     boolean storeByteBufTx(uint8_t b);
@@ -361,6 +460,11 @@ private:
 
     unsigned long _counter;
     unsigned long _latency;
+
+    // response of the route running now, sent once it let go of the lock
+    int replyCode;
+    String replyType;
+    String replyBody;
     unsigned long _ntpOffset;
 
     ADS1299 &_ads1299;
@@ -384,13 +488,14 @@ private:
     JsonObject _root;
 
     unsigned long lastSendToClient;
+    unsigned long lastClockSync;
     unsigned long lastHeadMove;
     unsigned long wifiConnectTimeout;
 
     uint8_t buffer[BUFFER_SIZE];
     uint32_t bufferPosition;
 
-    uint8_t bufferTx[32];
+    uint8_t *bufferTx; // slot claimed in rawRing while a packet is being serialized
     uint8_t bufferTxPosition;
 
     // Functions
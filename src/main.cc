@@ -12,7 +12,6 @@ SPIClass *hspi = NULL;
 ADS1299 ads1299;
 
 WiFiUDP clientUDP;
-WiFiClient clientTCP;
 
 WebServer server(80);
 WifiServer board;
@@ -27,17 +26,23 @@ void setup()
     digitalWrite(PIN_LED, LOW);
     digitalWrite(PIN_IMU_CS, HIGH);
     board.begin();
+    ads1299.beginAcquisitionTask();
 }
 
 void loop()
 {
-    if (ads1299.streaming && ads1299.channelDataAvailable)
     {
-        // Read from the ADS(s), store data, set channelDataAvailable flag to false
-        ads1299.updateChannelData();
-        board.sendChannelDataWifi(false);
-        if (ads1299.daisyPresent)
-            board.sendChannelDataWifi(true);
+        // The HTTP routes run on their own task and change the stream state
+        // only between two passes
+        ControlTask::Guard guard(board.control);
+        // Frames are read by the acquisition task on DRDY, drain what it queued
+        while (ads1299.popFrame())
+        {
+            board.sendChannelDataWifi(false);
+            if (ads1299.daisyPresent)
+                board.sendChannelDataWifi(true);
+        }
+        board.loop();
     }
-    board.loop();
+    board.control.handOver();
 }
@@ -0,0 +1,93 @@
+#include <unity.h>
+#include <SPI.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include "ADS1299.h"
+#include "ADS1299Sim.h"
+#include "DeltaCodec.h"
+#include "JsonChunk.h"
+
+// Host throughput of the whole sample path against the simulated ADS,
+// printed rather than asserted: pio test -e native_bench
+
+SPIClass *hspi = NULL;
+
+#define BENCH_FRAMES 20000
+
+static ADS1299Sim *sim;
+static ADS1299 *ads;
+alignas(ADS1299) static uint8_t adsStorage[sizeof(ADS1299)]; // new ignores its cache line alignment before C++17
+
+void setUp(void)
+{
+    hspi = new SPIClass(HSPI);
+    sim = new ADS1299Sim();
+    nativeAttachSPIDevice(sim);
+    ads = new (adsStorage) ADS1299();
+}
+
+void tearDown(void)
+{
+    ads->~ADS1299();
+    nativeAttachSPIDevice(NULL);
+    delete sim;
+    delete hspi;
+    hspi = NULL;
+}
+
+/// @brief Whole host pipeline for a daisy board: conversion, SPI read, frame
+///        queue, popFrame, then the delta and JSON encoders the senders use
+void bench_daisy_pipeline(void)
+{
+    ads->initialize();
+    ads->updateChannelScale();
+    ads->streamStart();
+
+    ADS1299::Frame frame;
+    DeltaEncoder delta;
+    JsonChunkWriter json;
+    static uint8_t record[DELTA_MAX_RECORD];
+    static uint8_t chunk[1440];
+    int32_t raw[OPENBCI_NUMBER_OF_CHANNELS_DAISY];
+    int64_t nv[OPENBCI_NUMBER_OF_CHANNELS_DAISY];
+    size_t deltaBytes = 0, jsonBytes = 0;
+    double nsRead = 0;
+
+    json.begin(chunk, sizeof(chunk));
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < BENCH_FRAMES; n++)
+    {
+        auto readStart = std::chrono::steady_clock::now();
+        sim->convert();
+        ads->readChannelData(frame);
+        nsRead += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - readStart).count();
+        ads->frameQueue.push(frame);
+        TEST_ASSERT_TRUE(ads->popFrame());
+        memcpy(raw, ads->boardChannelDataInt, OPENBCI_ADS_CHANS_PER_BOARD * sizeof(int32_t));
+        memcpy(raw + 8, ads->daisyChannelDataInt, OPENBCI_ADS_CHANS_PER_BOARD * sizeof(int32_t));
+        deltaBytes += delta.encode(raw, 16, (uint8_t)n, record);
+        ads->channelScale.toNanovolts(raw, nv, 0, 16);
+        if (!json.addSample(frame.timestamp, (uint8_t)n, nv, 16))
+        {
+            jsonBytes += json.finish(n, true);
+            json.begin(chunk, sizeof(chunk));
+            json.addSample(frame.timestamp, (uint8_t)n, nv, 16);
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    jsonBytes += json.finish(BENCH_FRAMES, true);
+
+    double samplesPerSecond = BENCH_FRAMES / ns * 1e9;
+    printf("sim pipeline 16ch: %.0f samples/s (%.1fx 16 kSPS), %.0f ns simulated conversion+SPI, %.0f ns decode+encode; "
+           "delta %.1f B/sample, json %.1f B/sample (host)\n",
+           samplesPerSecond, samplesPerSecond / 16000, nsRead / BENCH_FRAMES, (ns - nsRead) / BENCH_FRAMES,
+           (double)deltaBytes / BENCH_FRAMES, (double)jsonBytes / BENCH_FRAMES);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(bench_daisy_pipeline);
+    return UNITY_END();
+}
@@ -0,0 +1,239 @@
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "BandPower.h"
+#include "BiquadBank.h"
+#include "ChannelScale.h"
+#include "Decimator.h"
+#include "ImpedanceMonitor.h"
+#include "SignExtend24.h"
+
+// Host timings of the per-sample kernels, printed for comparison rather than
+// asserted: pio test -e native_bench
+
+#define CHANNELS 16
+#define TONE_HZ 31.25
+#define DRIVE_AMPS 6e-9
+
+// The double path: OpenBCI_Wifi_Definitions.h ADS_SCALE_FACTOR_VOLTS_* * raw * 1e9
+static const uint8_t gains[7] = {1, 2, 4, 6, 8, 12, 24};
+static const double scaleFactorVolts[7] = {
+    0.000000536441867, 0.000000268220934, 0.000000134110467, 0.000000089406978,
+    0.000000067055233, 0.000000044703489, 0.000000022351744};
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/// @brief The old WifiServer::int24To32: sign bit test and mask
+static int32_t reference(uint32_t raw)
+{
+    return (raw & 0x800000) ? (int32_t)(raw | 0xFF000000) : (int32_t)(raw & 0x00FFFFFF);
+}
+
+typedef void (*Kernel)(const uint8_t *, int32_t *, size_t);
+
+/// @brief Samples per second of each path, one ADS frame (8 channels) per call
+///        as parseFrame() makes them, and in one long batch
+static double benchmark(Kernel kernel, size_t perCall, const std::vector<uint8_t> &in, std::vector<int32_t> &out)
+{
+    const size_t values = out.size();
+    const int rounds = 20;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (size_t i = 0; i < values; i += perCall)
+            kernel(&in[3 * i], &out[i], perCall);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return rounds * (double)values / seconds;
+}
+
+void bench_sign_extend(void)
+{
+    const size_t values = 1 << 20;
+    std::minstd_rand rng(9);
+    std::vector<uint8_t> in(3 * values);
+    std::vector<int32_t> out(values);
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = (uint8_t)rng();
+    uint32_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < 20; r++)
+        for (size_t i = 0; i < values; i++)
+        {
+            const uint8_t *p = &in[3 * i];
+            out[i] = reference(p[0] << 16 | p[1] << 8 | p[2]);
+        }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("branchy int24To32:     %7.1f M samples/s\n", 20 * values / seconds / 1e6);
+    printf("bytes, 8 per call:     %7.1f M samples/s\n", benchmark(SignExtend24::convertBytes<int32_t>, 8, in, out) / 1e6);
+    printf("words, 8 per call:     %7.1f M samples/s\n", benchmark(SignExtend24::convertWords<int32_t>, 8, in, out) / 1e6);
+    printf("bytes, 4096 per call:  %7.1f M samples/s\n", benchmark(SignExtend24::convertBytes<int32_t>, 4096, in, out) / 1e6);
+    printf("words, 4096 per call:  %7.1f M samples/s\n", benchmark(SignExtend24::convertWords<int32_t>, 4096, in, out) / 1e6);
+    for (size_t i = 0; i < values; i += 4096)
+        checksum += out[i];
+    printf("(checksum %u)\n", (unsigned)checksum);
+}
+
+
+/// @brief One 16 channel frame, table against a gain switch and double per channel
+void bench_channel_scale(void)
+{
+    const int frames = 200000;
+    ChannelScale scale;
+    uint8_t gainIndex[16];
+    for (int c = 0; c < 16; c++)
+    {
+        gainIndex[c] = c % 7;
+        scale.setGain(c, gains[gainIndex[c]]);
+    }
+    int32_t raw[16];
+    int64_t nv[16];
+    volatile int64_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++)
+    {
+        for (int c = 0; c < 16; c++)
+            raw[c] = (f * 7919 + c * 104729) % 16777216 - 8388608;
+        scale.toNanovolts(raw, nv, 0, 16);
+        sink += nv[f & 15];
+    }
+    double nsTable = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++)
+    {
+        for (int c = 0; c < 16; c++)
+            raw[c] = (f * 7919 + c * 104729) % 16777216 - 8388608;
+        for (int c = 0; c < 16; c++)
+        {
+            double volts;
+            switch (gainIndex[c])
+            {
+            case 0: volts = scaleFactorVolts[0]; break;
+            case 1: volts = scaleFactorVolts[1]; break;
+            case 2: volts = scaleFactorVolts[2]; break;
+            case 3: volts = scaleFactorVolts[3]; break;
+            case 4: volts = scaleFactorVolts[4]; break;
+            case 5: volts = scaleFactorVolts[5]; break;
+            default: volts = scaleFactorVolts[6]; break;
+            }
+            nv[c] = (int64_t)(volts * raw[c] * 1000000000);
+        }
+        sink += nv[f & 15];
+    }
+    double nsDouble = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("16 channel frame: table %.1f ns, switch+double %.1f ns (host; the ESP32-S3 FPU is single precision, double runs in software there)\n",
+           nsTable / frames, nsDouble / frames);
+}
+
+
+/// @brief Notch + bandpass on one 16 channel frame
+void bench_biquad_bank(void)
+{
+    const int frames = 200000;
+    BiquadBank bank;
+    bank.configure(BiquadBank::NOTCH_60, BiquadBank::BANDPASS_1_50, 16000);
+    int32_t data[CHANNELS];
+    std::minstd_rand rng(5);
+    int64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++)
+    {
+        for (int c = 0; c < CHANNELS; c++)
+            data[c] = (int32_t)(rng() & 0xFFFFF) - 0x80000;
+        bank.process(data, 0, CHANNELS);
+        checksum += data[i % CHANNELS];
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / frames;
+    printf("biquad bank: %d sections x 16 channels, %.1f ns per frame (checksum %lld)\n", bank.getSections(), ns,
+           (long long)checksum);
+}
+
+
+/// @brief 16 channels in at 16 kHz, out at 500 Hz: cost per input frame
+void bench_decimator(void)
+{
+    const long frames = 1000000;
+    Decimator decimator;
+    decimator.setFactor(32);
+    std::minstd_rand rng(9);
+    int32_t data[CHANNELS];
+    int64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long n = 0; n < frames; n++)
+    {
+        for (int c = 0; c < CHANNELS; c++)
+            data[c] = (int32_t)(rng() & 0xFFFFFF) - 0x800000;
+        if (decimator.process(data, CHANNELS))
+            checksum += data[n % CHANNELS];
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / frames;
+    printf("decimator x32, 16 channels: %.1f ns per input frame (checksum %lld)\n", ns, (long long)checksum);
+}
+
+
+/// @brief 16 channels, 256 sample window: cost of one window
+void bench_band_power(void)
+{
+    const int windowCount = 2000;
+    BandPower bands;
+    bands.configure(256, 1, 250);
+    std::minstd_rand rng(3);
+    int32_t data[CHANNELS];
+    for (int n = 0; n < 255; n++)
+    {
+        for (int c = 0; c < CHANNELS; c++)
+            data[c] = (int32_t)(rng() & 0xFFFFFF) - 0x800000;
+        bands.add(data, CHANNELS);
+    }
+    double checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < windowCount; n++)
+    {
+        for (int c = 0; c < CHANNELS; c++)
+            data[c] = (int32_t)(rng() & 0xFFFFFF) - 0x800000;
+        if (bands.add(data, CHANNELS))
+            checksum += bands.getPower(n % CHANNELS, BandPower::BAND_ALPHA);
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / windowCount;
+    printf("band power, 16 channels, 256 sample window: %.1f us per window (checksum %.3g)\n", us, checksum);
+}
+
+
+/// @brief 16 driven channels: cost per sample, the monitor runs at the ADS rate
+void bench_impedance_monitor(void)
+{
+    const long samples = 1000000;
+    ImpedanceMonitor monitor;
+    monitor.configure(TONE_HZ, 16000, DRIVE_AMPS);
+    monitor.setChannels(0xFFFF);
+    std::minstd_rand rng(7);
+    int32_t data[CHANNELS];
+    for (int c = 0; c < CHANNELS; c++)
+        data[c] = (int32_t)(rng() & 0xFFFFFF) - 0x800000;
+    double checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long n = 0; n < samples; n++)
+    {
+        data[n % CHANNELS] ^= (int32_t)(n & 0xFF);
+        if (monitor.add(data, CHANNELS, 0, 0))
+            checksum += monitor.getAmplitude(n % CHANNELS);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / samples;
+    printf("impedance monitor, 16 channels: %.1f ns per sample (checksum %.3g)\n", ns, checksum);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(bench_sign_extend);
+    RUN_TEST(bench_channel_scale);
+    RUN_TEST(bench_biquad_bank);
+    RUN_TEST(bench_decimator);
+    RUN_TEST(bench_band_power);
+    RUN_TEST(bench_impedance_monitor);
+    return UNITY_END();
+}
@@ -0,0 +1,573 @@
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DeltaCodec.h"
+#include "JsonChunk.h"
+#include "PacketRing.h"
+#include "WebSocketServer.h"
+
+#if defined(__has_include)
+#if __has_include(<ArduinoJson.h>)
+#include <ArduinoJson.h>
+#define HAVE_ARDUINOJSON 1
+#endif
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER 1
+#endif
+
+// Host timings of the encoders and the packet path, printed for comparison
+// rather than asserted: pio test -e native_bench
+
+#define CHUNK_SIZE 1440
+#define BENCH_CHUNKS 20000
+#define SCALE_UV_PER_COUNT 0.02235 // 4.5 V / 24 / 2^23, gain 24
+#define RAW_BYTES_PER_ADS_SAMPLE 33
+#define PACKETS_PER_FRAME 10 // what one loop() pass sends at 16 kSPS with the default latency
+#define FRAME_PAYLOAD (OPENBCI_PACKET_SIZE * PACKETS_PER_FRAME)
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static void makeChannels(uint8_t *raw, uint8_t sampleNumber)
+{
+    for (int i = 0; i < 24; i++)
+        raw[i] = (uint8_t)(sampleNumber * 7 + i);
+}
+
+/// @brief 16 channel samples near full scale, like a daisy board at gain 24
+struct Signal
+{
+    int32_t raw[16];
+    void next(uint32_t n)
+    {
+        for (int c = 0; c < 16; c++)
+            raw[c] = (int32_t)((n * 2654435761u + c * 40503u) % 16777216u) - 8388608;
+    }
+};
+
+static const double scaleVolts = 4.5 / 24 / 8388607.0;
+static const int64_t scaleQ24 = (int64_t)(scaleVolts * 1e9 * 16777216.0 + 0.5); // what WifiServer multiplies by
+
+/// @brief Chunks per second against the ArduinoJson document the RAW_TO_JSON
+///        path built (doubles, `data.add((long long)nv)`)
+void bench_json_chunk(void)
+{
+    const uint8_t samplesPerChunk = 6; // getJSONMaxPackets() for a daisy board
+    static uint8_t out[CHUNK_SIZE];
+    Signal signal;
+    uint32_t n = 0;
+    size_t bytesNew = 0, bytesOld = 0;
+
+    JsonChunkWriter writer;
+    auto start = std::chrono::steady_clock::now();
+    for (int chunk = 0; chunk < BENCH_CHUNKS; chunk++)
+    {
+        writer.begin(out, sizeof(out));
+        for (uint8_t s = 0; s < samplesPerChunk; s++, n++)
+        {
+            signal.next(n);
+            int64_t nv[16];
+            for (int c = 0; c < 16; c++)
+                nv[c] = ((int64_t)signal.raw[c] * scaleQ24 + (1 << 23)) >> 24;
+            writer.addSample(1700000000000000ULL + n * 4000, (uint8_t)n, nv, 16);
+        }
+        bytesNew += writer.finish(chunk, true);
+    }
+    double nsNew = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    n = 0;
+    start = std::chrono::steady_clock::now();
+    for (int chunk = 0; chunk < BENCH_CHUNKS; chunk++)
+    {
+#ifdef HAVE_ARDUINOJSON
+        StaticJsonDocument<4000> doc;
+        JsonArray samples = doc.createNestedArray("chunk");
+        doc["count"] = chunk;
+        for (uint8_t s = 0; s < samplesPerChunk; s++, n++)
+        {
+            signal.next(n);
+            JsonObject sample = samples.createNestedObject();
+            sample["timestamp"] = 1700000000000000ULL + n * 4000;
+            JsonArray data = sample.createNestedArray("data");
+            for (int c = 0; c < 16; c++)
+                data.add((long long)(scaleVolts * signal.raw[c] * 1000000000));
+        }
+        size_t length = serializeJson(doc, (char *)out, sizeof(out));
+        out[length++] = '\r';
+        out[length++] = '\n';
+        bytesOld += length;
+#else
+        // Without ArduinoJson on the host, compare against the same double
+        // conversion formatted with snprintf, which is cheaper than ArduinoJson
+        size_t length = snprintf((char *)out, sizeof(out), "{\"chunk\":[");
+        for (uint8_t s = 0; s < samplesPerChunk; s++, n++)
+        {
+            signal.next(n);
+            length += snprintf((char *)out + length, sizeof(out) - length, "%s{\"timestamp\":%llu,\"data\":[",
+                               s ? "," : "", 1700000000000000ULL + n * 4000);
+            for (int c = 0; c < 16; c++)
+                length += snprintf((char *)out + length, sizeof(out) - length, "%s%lld", c ? "," : "",
+                                   (long long)(scaleVolts * signal.raw[c] * 1000000000));
+            length += snprintf((char *)out + length, sizeof(out) - length, "]}");
+        }
+        length += snprintf((char *)out + length, sizeof(out) - length, "],\"count\":%d}\r\n", chunk);
+        bytesOld += length;
+#endif
+    }
+    double nsOld = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+#ifdef HAVE_ARDUINOJSON
+    const char *baseline = "ArduinoJson";
+#else
+    const char *baseline = "double+snprintf";
+#endif
+    const double samples = (double)BENCH_CHUNKS * samplesPerChunk;
+    printf("json 16ch: chunk writer %.0f ns/sample (%.1f MB/s), %s %.0f ns/sample (%.1f MB/s), %.1fx (host)\n",
+           nsNew / samples, bytesNew / nsNew * 1000.0, baseline, nsOld / samples, bytesOld / nsOld * 1000.0, nsOld / nsNew);
+}
+
+/// @brief Synthetic scalp EEG, there is no recording in the repo to replay:
+///        electrode offset, 1/f-ish background, 10 Hz alpha, 50 Hz mains, white noise
+class SyntheticEEG
+{
+public:
+    SyntheticEEG(uint8_t numChannels, double sampleRate, uint32_t seed)
+        : _numChannels(numChannels), _sampleRate(sampleRate), _n(0), _rng(seed), _white(0.0, 1.0)
+    {
+        for (uint8_t c = 0; c < numChannels; c++)
+        {
+            _offset[c] = (double)(_rng() % 20000) - 10000.0; // +-10 mV in uV
+            _drift[c] = 0.0;
+            _phase[c] = (double)(_rng() % 628) / 100.0;
+        }
+    }
+
+    void next(int32_t *channels)
+    {
+        const double t = _n++ / _sampleRate;
+        for (uint8_t c = 0; c < _numChannels; c++)
+        {
+            // Leaky random walk gives the low frequency background
+            _drift[c] = 0.999 * _drift[c] + 0.5 * _white(_rng) * sqrt(250.0 / _sampleRate);
+            double uv = _offset[c] + 10.0 * _drift[c] + 20.0 * sin(2 * M_PI * 10.0 * t + _phase[c]) + 8.0 * sin(2 * M_PI * 50.0 * t) + 1.5 * _white(_rng);
+            channels[c] = (int32_t)lround(uv / SCALE_UV_PER_COUNT);
+        }
+    }
+
+private:
+    uint8_t _numChannels;
+    double _sampleRate;
+    uint32_t _n;
+    std::minstd_rand _rng;
+    std::normal_distribution<double> _white;
+    double _offset[DELTA_MAX_CHANNELS];
+    double _drift[DELTA_MAX_CHANNELS];
+    double _phase[DELTA_MAX_CHANNELS];
+};
+
+/// @brief Compression ratio against the raw format (one 33 byte packet per ADS
+///        per sample) and encode cost, 16 channels daisy, 10 s of signal
+void bench_delta_codec(void)
+{
+    const double rates[] = {250, 1000, 2000};
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    {
+        const int samples = (int)(rates[r] * 10);
+        SyntheticEEG eeg(16, rates[r], 3);
+        std::vector<int32_t> signal(samples * 16);
+        for (int n = 0; n < samples; n++)
+            eeg.next(&signal[n * 16]);
+
+        DeltaEncoder encoder;
+        uint8_t record[DELTA_MAX_RECORD];
+        size_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < samples; n++)
+            bytes += encoder.encode(&signal[n * 16], 16, (uint8_t)n, record);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        const double raw = 2.0 * RAW_BYTES_PER_ADS_SAMPLE * samples;
+        printf("delta 16ch @ %4.0f SPS: %.1f bytes/sample vs %d raw, ratio %.2f, %.0f kB/s vs %.0f kB/s, encode %.0f ns/sample (host)\n",
+               rates[r], (double)bytes / samples, 2 * RAW_BYTES_PER_ADS_SAMPLE, raw / bytes,
+               bytes * rates[r] / samples / 1000.0, raw * rates[r] / samples / 1000.0, ns / samples);
+    }
+}
+
+#define BENCH_RING 256
+#define BENCH_SEND 42
+#define BENCH_SAMPLES 200000
+
+static uint8_t socketBuffer[BENCH_SEND * OPENBCI_PACKET_SIZE];
+static volatile uint32_t sink;
+
+/// @brief Stand-in for clientTCP.write(), which copies into the stack's buffer either way
+static void socketWrite(const uint8_t *data, size_t length)
+{
+    memcpy(socketBuffer, data, length);
+    sink += socketBuffer[length - 1];
+}
+
+/// @brief Previous path: byte by byte into bufferTx with the stop byte first,
+///        memcpy into rawBuffer, then reordered byte by byte into buffer to send
+struct LegacyPath
+{
+    uint8_t bufferTx[32];
+    uint8_t bufferTxPosition;
+    uint8_t rawBuffer[BENCH_RING][32];
+    uint32_t head, tail;
+    uint8_t buffer[BENCH_SEND * OPENBCI_PACKET_SIZE];
+
+    LegacyPath() : bufferTxPosition(0), head(0), tail(0) {}
+
+    __attribute__((noinline)) bool storeByteBufTx(uint8_t b)
+    {
+        if (bufferTxPosition >= 32)
+            return false;
+        bufferTx[bufferTxPosition++] = b;
+        return true;
+    }
+
+    void produce(const uint8_t *raw, uint8_t sampleNumber)
+    {
+        storeByteBufTx(0xC0);
+        storeByteBufTx(sampleNumber);
+        for (int i = 0; i < 24; i++)
+            storeByteBufTx(raw[i]);
+        for (int i = 0; i < 6; i++)
+            storeByteBufTx(0);
+        uint32_t newHead = head + 1 >= BENCH_RING ? 0 : head + 1;
+        memcpy(rawBuffer + newHead, bufferTx, 32);
+        head = newHead;
+        bufferTxPosition = 0;
+    }
+
+    void send(void)
+    {
+        uint32_t position = 0;
+        while (tail != head)
+        {
+            tail = tail + 1 >= BENCH_RING ? 0 : tail + 1;
+            uint8_t *buf = rawBuffer[tail];
+            buffer[position++] = 0xA0;
+            for (int i = 1; i < 32; i++)
+                buffer[position++] = buf[i];
+            buffer[position++] = buf[0];
+        }
+        socketWrite(buffer, position);
+    }
+};
+
+/// @brief Current path: one serialization into the ring slot, sent from there
+struct RingPath
+{
+    PacketFanout<BENCH_RING, 1> ring;
+    int8_t reader;
+    uint8_t *bufferTx;
+    uint8_t bufferTxPosition;
+
+    RingPath() : reader(ring.open(PacketFanout<BENCH_RING, 1>::POLICY_DROP_OLDEST)), bufferTxPosition(0) {}
+
+    __attribute__((noinline)) bool storeByteBufTx(uint8_t b)
+    {
+        if (bufferTxPosition >= OPENBCI_PACKET_SIZE - 1)
+            return false;
+        bufferTx[bufferTxPosition++] = b;
+        return true;
+    }
+
+    void produce(const uint8_t *raw, uint8_t sampleNumber)
+    {
+        uint32_t count = 1;
+        bufferTx = ring.claim(count)->bytes;
+        bufferTx[0] = 0xA0;
+        bufferTx[1] = sampleNumber;
+        memcpy(bufferTx + 2, raw, 24);
+        bufferTxPosition = 26;
+        for (int i = 0; i < 6; i++)
+            storeByteBufTx(0);
+        bufferTx[OPENBCI_PACKET_SIZE - 1] = 0xC0;
+        ring.commit(1);
+    }
+
+    void send(void)
+    {
+        for (int run = 0; run < 2; run++)
+        {
+            uint32_t count = BENCH_SEND;
+            const uint8_t *packets = ring.peek(reader, count)->bytes;
+            if (count == 0)
+                break;
+            socketWrite(packets, count * OPENBCI_PACKET_SIZE);
+            ring.consume(reader, count);
+        }
+    }
+};
+
+struct Cost
+{
+    double ns;
+    double cycles;
+};
+
+template <typename Path>
+static Cost measure(Path &path)
+{
+    uint8_t raw[24];
+    makeChannels(raw, 1);
+    Cost best = {1e30, 1e30};
+    for (int pass = 0; pass < 5; pass++)
+    {
+        auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_CYCLE_COUNTER
+        uint64_t startCycles = __rdtsc();
+#endif
+        for (int n = 0; n < BENCH_SAMPLES; n++)
+        {
+            raw[0] = (uint8_t)n;
+            path.produce(raw, (uint8_t)n);
+            if (n % BENCH_SEND == BENCH_SEND - 1)
+                path.send();
+        }
+        path.send();
+#ifdef HAVE_CYCLE_COUNTER
+        double cycles = (double)(__rdtsc() - startCycles) / BENCH_SAMPLES;
+#else
+        double cycles = 0;
+#endif
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_SAMPLES;
+        if (ns < best.ns)
+        {
+            best.ns = ns;
+            best.cycles = cycles;
+        }
+    }
+    return best;
+}
+
+/// @brief Serialize and send cost per sample, previous copy chain against the ring
+void bench_packet_ring(void)
+{
+    static LegacyPath legacy;
+    static RingPath ring;
+    ring.bufferTxPosition = 0;
+    Cost before = measure(legacy);
+    Cost after = measure(ring);
+    printf("serialize+send per sample: before %.1f ns (%.0f cycles), after %.1f ns (%.0f cycles) (host)\n",
+           before.ns, before.cycles, after.ns, after.cycles);
+}
+
+static int64_t nowNanos(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// @brief Blocking browser stand-in, the receiving half of the one in test_web_socket
+class StreamClient
+{
+public:
+    int fd;
+
+    StreamClient() : fd(socket(AF_INET, SOCK_STREAM, 0)) {}
+    ~StreamClient() { ::close(fd); }
+
+    bool open(WebSocketServer &server)
+    {
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(server.getPort());
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+            return false;
+        const char *upgrade = "GET /stream HTTP/1.1\r\nHost: bench\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                              "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+        send(fd, upgrade, strlen(upgrade), 0);
+        std::string reply;
+        for (int i = 0; i < 1000 && reply.find("\r\n\r\n") == std::string::npos; i++)
+        {
+            server.poll();
+            char buffer[512];
+            ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n == 0)
+                break;
+            if (n > 0)
+                reply.append(buffer, n);
+            else
+                usleep(1000);
+        }
+        return reply.find("101 Switching Protocols") != std::string::npos;
+    }
+
+    bool readExactly(uint8_t *out, size_t length, int timeoutMs)
+    {
+        for (size_t got = 0; got < length;)
+        {
+            struct pollfd p = {fd, POLLIN, 0};
+            if (::poll(&p, 1, timeoutMs) <= 0)
+                return false;
+            ssize_t n = recv(fd, out + got, length - got, 0);
+            if (n <= 0)
+                return false;
+            got += n;
+        }
+        return true;
+    }
+
+    /// @brief Payload of the next binary frame; `false` on timeout, close or anything else
+    bool readFrame(std::vector<uint8_t> &payload, int timeoutMs)
+    {
+        uint8_t header[4];
+        if (!readExactly(header, 2, timeoutMs) || header[0] != (0x80 | WEB_SOCKET_OPCODE_BINARY))
+            return false;
+        size_t length = header[1];
+        if (length == 126)
+        {
+            if (!readExactly(header + 2, 2, timeoutMs))
+                return false;
+            length = (header[2] << 8) | header[3];
+        }
+        else if (length > 126)
+            return false;
+        payload.resize(length);
+        return length == 0 || readExactly(payload.data(), length, timeoutMs);
+    }
+};
+
+/// @brief A frame of packets that carries its send time
+static void makeFrame(uint8_t *frame)
+{
+    int64_t stamp = nowNanos();
+    for (int p = 0; p < PACKETS_PER_FRAME; p++)
+    {
+        uint8_t *packet = frame + p * OPENBCI_PACKET_SIZE;
+        memset(packet, 0, OPENBCI_PACKET_SIZE);
+        packet[0] = 0xA0;
+        packet[OPENBCI_PACKET_SIZE - 1] = 0xC0;
+    }
+    memcpy(frame + 2, &stamp, sizeof(stamp));
+}
+
+/// @brief Reads frames on its own thread and keeps their latencies
+struct LatencyReader
+{
+    StreamClient &client;
+    std::atomic<bool> stop;
+    uint32_t frames;
+    std::vector<int64_t> latencies;
+    std::thread thread;
+
+    explicit LatencyReader(StreamClient &c) : client(c), stop(false), frames(0)
+    {
+        thread = std::thread(&LatencyReader::run, this);
+    }
+
+    void run(void)
+    {
+        std::vector<uint8_t> payload;
+        while (client.readFrame(payload, stop ? 50 : 1000))
+        {
+            int64_t stamp;
+            if (payload.size() != FRAME_PAYLOAD)
+                continue;
+            memcpy(&stamp, &payload[2], sizeof(stamp));
+            latencies.push_back(nowNanos() - stamp);
+            frames++;
+        }
+    }
+
+    void join(void)
+    {
+        stop = true;
+        thread.join();
+    }
+
+    double percentileMicros(double p)
+    {
+        if (latencies.empty())
+            return 0;
+        std::sort(latencies.begin(), latencies.end());
+        return latencies[(size_t)(p * (latencies.size() - 1))] / 1000.0;
+    }
+};
+
+/// @brief Loopback throughput and latency of one WebSocket client: first paced
+///        at the 16 kSPS daisy stream rate, then as fast as the loop can go
+void bench_web_socket(void)
+{
+    WebSocketServer server;
+    StreamClient client;
+    if (!server.begin(0) || !client.open(server))
+    {
+        printf("web socket: no loopback connection, skipped\n");
+        return;
+    }
+    uint8_t frame[FRAME_PAYLOAD];
+
+    {
+        LatencyReader reader(client);
+        const int64_t period = 1000000000LL * PACKETS_PER_FRAME / 16000;
+        int64_t next = nowNanos();
+        for (int i = 0; i < 800; i++) // 0.5 s
+        {
+            while (nowNanos() < next)
+                server.poll();
+            makeFrame(frame);
+            server.broadcast(frame, sizeof(frame), WEB_SOCKET_OPCODE_BINARY);
+            next += period;
+        }
+        for (int i = 0; i < 100; i++)
+            server.poll();
+        reader.join();
+        printf("web socket 16 kSPS (%d kB/s): %u of 800 frames, latency median %.0f us, p99 %.0f us (host)\n",
+               16000 * OPENBCI_PACKET_SIZE / 1000, reader.frames, reader.percentileMicros(0.5),
+               reader.percentileMicros(0.99));
+    }
+
+    {
+        LatencyReader reader(client);
+        const uint32_t dropped = server.getFramesDropped();
+        uint32_t offered = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500))
+        {
+            makeFrame(frame);
+            server.broadcast(frame, sizeof(frame), WEB_SOCKET_OPCODE_BINARY);
+            server.poll();
+            offered++;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for (int i = 0; i < 1000; i++)
+            server.poll();
+        reader.join();
+        printf("web socket flat out: %.1f MB/s delivered (%.0f k packets/s), %u of %u frames dropped, latency median %.0f us, p99 %.0f us (host)\n",
+               reader.frames * (double)FRAME_PAYLOAD / seconds / 1e6, reader.frames * PACKETS_PER_FRAME / seconds / 1000,
+               server.getFramesDropped() - dropped, offered, reader.percentileMicros(0.5), reader.percentileMicros(0.99));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(bench_json_chunk);
+    RUN_TEST(bench_delta_codec);
+    RUN_TEST(bench_packet_ring);
+    RUN_TEST(bench_web_socket);
+    return UNITY_END();
+}
@@ -0,0 +1,397 @@
+#include <unity.h>
+#include <SPI.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "ADS1299.h"
+
+SPIClass *hspi = NULL;
+
+#define DRDY_PERIOD_US 1000 // 1 kSPS
+#define FRAMES_TO_SEND 1000
+#define HTTP_STALL_MAX_MS 60 // longest simulated handleClient() call
+
+/// @brief Fake board ADS in RDATAC mode: each DRDY latches a new sample whose
+///        channel 1 carries the sample number, so a skipped read shows up as a gap.
+class StreamingADS : public NativeSPIDevice
+{
+public:
+    std::atomic<bool> hold;          // park the reader inside the transfer
+    std::atomic<int> holdOn;         // command byte to park the sender on until cleared, -1 for none
+    std::atomic<bool> parked;        // a sender is parked on holdOn
+    std::atomic<int> reads;          // transfers started
+    std::atomic<int> served;         // transfers finished
+    std::atomic<uint32_t> readCost;  // virtual microseconds one transfer takes
+    std::vector<uint8_t> commands;   // single byte transfers: commands and register writes
+
+    StreamingADS() : hold(false), holdOn(-1), parked(false), reads(0), served(0), readCost(0), sample(0) {}
+
+    void latch(uint32_t n)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        sample = n;
+    }
+
+    uint8_t transfer(uint8_t data)
+    {
+        if (data == holdOn)
+        {
+            parked = true;
+            while (data == holdOn)
+            {
+                std::this_thread::yield();
+            }
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        commands.push_back(data);
+        return 0x00;
+    }
+
+    void transferBytes(const uint8_t *data, uint8_t *out, uint32_t size)
+    {
+        (void)data;
+        reads++;
+        while (hold)
+        {
+            std::this_thread::yield();
+        }
+        nativeAdvanceMicros(readCost);
+        std::lock_guard<std::mutex> guard(lock);
+        uint8_t frame[OPENBCI_ADS_BYTES_PER_FRAME] = {0xC0, 0x00, 0x00};
+        frame[3] = (sample >> 16) & 0xFF;
+        frame[4] = (sample >> 8) & 0xFF;
+        frame[5] = sample & 0xFF;
+        bool selected = digitalRead(PIN_ADS_CS1) == LOW;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            out[i] = (selected && i < sizeof(frame)) ? frame[i] : 0x00;
+        }
+        served++;
+    }
+
+private:
+    std::mutex lock;
+    uint32_t sample;
+};
+
+static StreamingADS *fake;
+static ADS1299 *ads;
+alignas(ADS1299) static uint8_t adsStorage[sizeof(ADS1299)]; // new ignores its cache line alignment before C++17
+static std::atomic<bool> drdyDone;
+
+/// @brief Latch sample `n`, pull DRDY low and wait until the reader clocked it
+///        out. A host thread may wake later than a DRDY period; waiting keeps
+///        two edges from ever merging into one read, so the tests below count
+///        on every edge being read.
+/// @return {bool} - `false` if nothing read the sample within a second
+static bool drdyAndWaitForRead(uint32_t n)
+{
+    const int served = fake->served;
+    fake->latch(n);
+    nativeTriggerInterrupt(PIN_ADS_DRDY);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (fake->served == served)
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+/// @brief Simulated DRDY line for the acquisition task, one sample per period
+static void drdySource(void)
+{
+    for (uint32_t n = 0; n < FRAMES_TO_SEND; n++)
+    {
+        if (!drdyAndWaitForRead(n))
+        {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(DRDY_PERIOD_US));
+    }
+    drdyDone = true;
+}
+
+/// @brief Simulated DRDY line for the polled loop(): free running, like the
+///        ADS, whether anybody reads or not
+static void drdyFreeRunning(void)
+{
+    for (uint32_t n = 0; n < FRAMES_TO_SEND; n++)
+    {
+        fake->latch(n);
+        nativeTriggerInterrupt(PIN_ADS_DRDY);
+        std::this_thread::sleep_for(std::chrono::microseconds(DRDY_PERIOD_US));
+    }
+    drdyDone = true;
+}
+
+/// @brief Stands in for `server.handleClient()`: usually idle, sometimes a slow request.
+///        The idle pass sleeps rather than spins so the reader thread gets the CPU
+///        the way the higher priority task would on the device.
+static void httpLoad(std::minstd_rand &rng)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    if (rng() % 8 == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(rng() % (HTTP_STALL_MAX_MS + 1)));
+    }
+}
+
+void setUp(void)
+{
+    hspi = new SPIClass(HSPI);
+    fake = new StreamingADS();
+    nativeAttachSPIDevice(fake);
+    ads = new (adsStorage) ADS1299();
+    ads->daisyPresent = false;
+    ads->streaming = true;
+    ads->boardBeginADSInterrupt();
+    drdyDone = false;
+}
+
+void tearDown(void)
+{
+    ads->~ADS1299();
+    nativeAttachSPIDevice(NULL);
+    delete fake;
+    delete hspi;
+    hspi = NULL;
+}
+
+void test_acquisition_task_loses_nothing_under_http_load(void)
+{
+    TEST_ASSERT_TRUE(ads->beginAcquisitionTask());
+    std::thread drdy(drdySource);
+
+    std::minstd_rand rng(1234);
+    std::vector<int> received;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (received.size() < FRAMES_TO_SEND && std::chrono::steady_clock::now() < deadline)
+    {
+        while (ads->popFrame())
+        {
+            received.push_back(ads->boardChannelDataInt[0]);
+        }
+        httpLoad(rng);
+    }
+    drdy.join();
+    ads->endAcquisitionTask();
+
+    TEST_ASSERT_EQUAL_UINT32(0, ads->framesDropped);
+    TEST_ASSERT_EQUAL(FRAMES_TO_SEND, (int)received.size());
+    for (int i = 0; i < FRAMES_TO_SEND; i++)
+    {
+        TEST_ASSERT_EQUAL(i, received[i]);
+    }
+}
+
+void test_polled_flag_drops_samples_under_http_load(void)
+{
+    // The old loop(): one read per pass, whatever arrived during a stall is lost
+    std::thread drdy(drdyFreeRunning);
+
+    std::minstd_rand rng(1234);
+    int received = 0;
+    while (!drdyDone)
+    {
+        if (ads->channelDataAvailable)
+        {
+            ads->updateChannelData();
+            received++;
+        }
+        httpLoad(rng);
+    }
+    drdy.join();
+
+    TEST_ASSERT_LESS_THAN(FRAMES_TO_SEND, received);
+}
+
+void test_queue_full_counts_dropped_frames(void)
+{
+    // Nobody drains the queue: everything past its capacity must be counted
+    TEST_ASSERT_TRUE(ads->beginAcquisitionTask());
+    const uint32_t extra = 10;
+    for (uint32_t n = 0; n < ADS_FRAME_QUEUE_SIZE + extra; n++)
+    {
+        TEST_ASSERT_TRUE(drdyAndWaitForRead(n));
+    }
+    ads->endAcquisitionTask(); // lets the last read finish queueing
+
+    TEST_ASSERT_EQUAL_UINT32(ADS_FRAME_QUEUE_SIZE, ads->frameQueue.size());
+    TEST_ASSERT_EQUAL_UINT32(extra, ads->framesDropped);
+    TEST_ASSERT_TRUE(ads->popFrame());
+    TEST_ASSERT_EQUAL(0, ads->boardChannelDataInt[0]);
+}
+
+void test_no_reads_while_not_streaming(void)
+{
+    ads->streaming = false;
+    TEST_ASSERT_TRUE(ads->beginAcquisitionTask());
+    nativeTriggerInterrupt(PIN_ADS_DRDY);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ads->endAcquisitionTask();
+
+    TEST_ASSERT_FALSE(ads->popFrame());
+}
+
+void test_drdy_edges_during_a_read_are_counted_as_missed(void)
+{
+    StreamStats stats;
+    ads->stats = &stats;
+    TEST_ASSERT_TRUE(ads->beginAcquisitionTask());
+
+    fake->hold = true;
+    nativeTriggerInterrupt(PIN_ADS_DRDY);
+    while (fake->reads == 0)
+    {
+        std::this_thread::yield();
+    }
+    // Three more edges while the first read is stuck: only one more read can happen
+    for (int i = 0; i < 3; i++)
+    {
+        nativeTriggerInterrupt(PIN_ADS_DRDY);
+    }
+    fake->hold = false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ads->endAcquisitionTask();
+
+    TEST_ASSERT_EQUAL(2, fake->reads.load());
+    TEST_ASSERT_EQUAL_UINT32(2, stats.getTotal(StreamStats::COUNTER_DRDY_MISSED));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.getTotal(StreamStats::COUNTER_OVERRUN));
+}
+
+void test_read_slower_than_sample_period_is_spi_late(void)
+{
+    StreamStats stats;
+    ads->stats = &stats;
+    ads->curSampleRate = ADS1299::SAMPLE_RATE_250;
+    TEST_ASSERT_EQUAL_UINT32(4000, ads->getSamplePeriodMicros());
+    TEST_ASSERT_TRUE(ads->beginAcquisitionTask());
+
+    fake->readCost = 100;
+    nativeTriggerInterrupt(PIN_ADS_DRDY);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.getTotal(StreamStats::COUNTER_SPI_LATE));
+
+    fake->readCost = 5000;
+    nativeTriggerInterrupt(PIN_ADS_DRDY);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ads->endAcquisitionTask();
+
+    TEST_ASSERT_EQUAL_UINT32(1, stats.getTotal(StreamStats::COUNTER_SPI_LATE));
+}
+
+/// @brief A gain change while streaming: no stop/start, no lost sample, the
+///        registers change between two reads and one frame carries the marker
+void test_live_reconfiguration_keeps_streaming(void)
+{
+    ads->streaming = false;
+    ads->writeChannelSettings(); // registers in sync with the settings first
+    ads->streaming = true;
+    fake->commands.clear();
+    TEST_ASSERT_TRUE(ads->beginAcquisitionTask());
+    std::thread drdy(drdySource);
+
+    std::vector<int> received;
+    std::vector<int32_t> scale;
+    int requestedAt = -1;
+    int markerAt = -1;
+    int markers = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (received.size() < FRAMES_TO_SEND && std::chrono::steady_clock::now() < deadline)
+    {
+        while (ads->popFrame())
+        {
+            if (ads->configChanged)
+            {
+                markers++;
+                markerAt = received.size();
+            }
+            received.push_back(ads->boardChannelDataInt[0]);
+            scale.push_back(ads->channelScale.getScale(2));
+        }
+        if (requestedAt < 0 && received.size() >= FRAMES_TO_SEND / 4)
+        {
+            requestedAt = received.size();
+            ads->channelSettings[2][GAIN_SET] = ADS_GAIN02;
+            ads->streamSafeChannelSettingsForChannel(3);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    drdy.join();
+    ads->endAcquisitionTask();
+
+    TEST_ASSERT_TRUE(ads->streaming);
+    TEST_ASSERT_EQUAL(FRAMES_TO_SEND, (int)received.size());
+    for (int i = 0; i < FRAMES_TO_SEND; i++)
+    {
+        TEST_ASSERT_EQUAL(i, received[i]);
+    }
+    TEST_ASSERT_EQUAL(1, markers);
+    TEST_ASSERT_TRUE(markerAt >= requestedAt);
+    TEST_ASSERT_EQUAL_INT32(ChannelScale::scaleForGain(1), scale[markerAt - 1]);
+    TEST_ASSERT_EQUAL_INT32(ChannelScale::scaleForGain(2), scale[markerAt]);
+    const uint8_t expected[5] = {_SDATAC, 0x40 | CH3SET, 0x00, ADS_GAIN02, _RDATAC}; // no STOP/START
+    TEST_ASSERT_EQUAL(5, (int)fake->commands.size());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, fake->commands.data(), 5);
+    printf("gain change requested after sample %d, marked at sample %d\n", requestedAt - 1, markerAt);
+}
+
+/// @brief A stop while the reader writes queued changes: the RDATAC ending
+///        them must go out before the stop's SDATAC, or the chip is left in
+///        Read Data Continuous mode and ignores every later register write
+void test_stream_stop_waits_for_the_reader(void)
+{
+    ads->streaming = false;
+    ads->writeChannelSettings();
+    ads->streaming = true;
+    TEST_ASSERT_TRUE(ads->beginAcquisitionTask());
+    ads->channelSettings[2][GAIN_SET] = ADS_GAIN02;
+    ads->streamSafeChannelSettingsForChannel(3); // queued for the reader
+    fake->commands.clear();
+
+    fake->holdOn = 0x40 | CH3SET;
+    nativeTriggerInterrupt(PIN_ADS_DRDY);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (!fake->parked && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::yield();
+    }
+    if (!fake->parked)
+    {
+        fake->holdOn = -1;
+        TEST_FAIL_MESSAGE("the reader never wrote the queued change");
+    }
+    std::thread stopper([]()
+                        { ads->streamStop(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20)); // the stop is waiting now
+    fake->holdOn = -1;
+    stopper.join();
+    ads->endAcquisitionTask();
+
+    TEST_ASSERT_FALSE(ads->streaming);
+    const uint8_t expected[7] = {_SDATAC, 0x40 | CH3SET, 0x00, ADS_GAIN02, _RDATAC, _STOP, _SDATAC};
+    TEST_ASSERT_EQUAL(7, (int)fake->commands.size());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, fake->commands.data(), 7);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_acquisition_task_loses_nothing_under_http_load);
+    RUN_TEST(test_polled_flag_drops_samples_under_http_load);
+    RUN_TEST(test_queue_full_counts_dropped_frames);
+    RUN_TEST(test_no_reads_while_not_streaming);
+    RUN_TEST(test_drdy_edges_during_a_read_are_counted_as_missed);
+    RUN_TEST(test_read_slower_than_sample_period_is_spi_late);
+    RUN_TEST(test_live_reconfiguration_keeps_streaming);
+    RUN_TEST(test_stream_stop_waits_for_the_reader);
+    return UNITY_END();
+}
@@ -0,0 +1,241 @@
+#include <unity.h>
+#include <SPI.h>
+#include "ADS1299.h"
+
+SPIClass *hspi = NULL;
+
+/// @brief Fake ADS on the native SPI bus: replays a queued frame while its
+///        chip select is low and records how the frame was clocked out.
+class FakeADS : public NativeSPIDevice
+{
+public:
+    uint8_t frame[OPENBCI_ADS_BYTES_PER_FRAME];
+    uint8_t csPin;
+    int position;
+    int transactions;
+    int bulkCalls;
+    int bytesInLastTransaction;
+
+    FakeADS(uint8_t pin) : csPin(pin), position(0), transactions(0), bulkCalls(0), bytesInLastTransaction(0)
+    {
+        memset(frame, 0, sizeof(frame));
+    }
+
+    uint8_t transfer(uint8_t data)
+    {
+        (void)data;
+        if (digitalRead(csPin) != LOW || position >= OPENBCI_ADS_BYTES_PER_FRAME)
+            return 0x00;
+        return frame[position++];
+    }
+
+    void transferBytes(const uint8_t *data, uint8_t *out, uint32_t size)
+    {
+        bulkCalls++;
+        NativeSPIDevice::transferBytes(data, out, size);
+    }
+
+    void pinChanged(uint8_t pin, uint8_t level)
+    {
+        if (pin != csPin)
+            return;
+        if (level == LOW)
+        {
+            position = 0;
+        }
+        else
+        {
+            transactions++;
+            bytesInLastTransaction = position;
+        }
+    }
+};
+
+static void fillFrame(uint8_t *frame)
+{
+    frame[0] = 0xC0; // status: 1100 + LOFF_STATP
+    frame[1] = 0x12;
+    frame[2] = 0x34;
+    const int32_t values[OPENBCI_ADS_CHANS_PER_BOARD] = {0, 1, -1, 8388607, -8388608, 123456, -123456, 4096};
+    for (int i = 0; i < OPENBCI_ADS_CHANS_PER_BOARD; i++)
+    {
+        uint32_t v = (uint32_t)values[i];
+        frame[3 + i * 3] = (v >> 16) & 0xFF;
+        frame[4 + i * 3] = (v >> 8) & 0xFF;
+        frame[5 + i * 3] = v & 0xFF;
+    }
+}
+
+void setUp(void)
+{
+    hspi = new SPIClass(HSPI);
+}
+
+void tearDown(void)
+{
+    nativeAttachSPIDevice(NULL);
+    delete hspi;
+    hspi = NULL;
+}
+
+void test_parse_frame_splits_status_and_channels(void)
+{
+    uint8_t frame[OPENBCI_ADS_BYTES_PER_FRAME];
+    byte raw[OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE];
+    int data[OPENBCI_ADS_CHANS_PER_BOARD];
+    fillFrame(frame);
+
+    int stat = ADS1299::parseFrame(frame, raw, data);
+
+    TEST_ASSERT_EQUAL_HEX32(0xC01234, stat);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(frame + OPENBCI_ADS_BYTES_PER_STATUS, raw, OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE);
+    TEST_ASSERT_EQUAL_INT32(0, data[0]);
+    TEST_ASSERT_EQUAL_INT32(1, data[1]);
+    TEST_ASSERT_EQUAL_INT32(-1, data[2]);
+    TEST_ASSERT_EQUAL_INT32(8388607, data[3]);
+    TEST_ASSERT_EQUAL_INT32(-8388608, data[4]);
+    TEST_ASSERT_EQUAL_INT32(123456, data[5]);
+    TEST_ASSERT_EQUAL_INT32(-123456, data[6]);
+    TEST_ASSERT_EQUAL_INT32(4096, data[7]);
+}
+
+void test_parse_frame_allows_null_outputs(void)
+{
+    uint8_t frame[OPENBCI_ADS_BYTES_PER_FRAME];
+    fillFrame(frame);
+    TEST_ASSERT_EQUAL_HEX32(0xC01234, ADS1299::parseFrame(frame, NULL, NULL));
+}
+
+void test_read_frame_is_one_bulk_transaction(void)
+{
+    FakeADS fake(PIN_ADS_CS1);
+    fillFrame(fake.frame);
+    nativeAttachSPIDevice(&fake);
+
+    ADS1299 ads;
+    uint8_t frame[OPENBCI_ADS_BYTES_PER_FRAME];
+    ads.readFrame(ADS1299::BOARD_ADS, frame);
+
+    TEST_ASSERT_EQUAL(1, fake.transactions);
+    TEST_ASSERT_EQUAL(1, fake.bulkCalls);
+    TEST_ASSERT_EQUAL(OPENBCI_ADS_BYTES_PER_FRAME, fake.bytesInLastTransaction);
+    TEST_ASSERT_EQUAL_UINT32(0, hspi->byteTransfers);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(fake.frame, frame, OPENBCI_ADS_BYTES_PER_FRAME);
+}
+
+void test_update_daisy_data_fills_raw_and_int_arrays(void)
+{
+    FakeADS fake(PIN_ADS_CS2);
+    fillFrame(fake.frame);
+    nativeAttachSPIDevice(&fake);
+
+    ADS1299 ads;
+    ads.daisyPresent = true;
+    ads.updateDaisyData();
+
+    TEST_ASSERT_EQUAL(1, fake.bulkCalls);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(fake.frame + OPENBCI_ADS_BYTES_PER_STATUS, ads.daisyChannelDataRaw, OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE);
+    TEST_ASSERT_EQUAL_INT32(-1, ads.daisyChannelDataInt[2]);
+    TEST_ASSERT_EQUAL_INT32(-8388608, ads.daisyChannelDataInt[4]);
+    TEST_ASSERT_EQUAL_INT32(123456, ads.daisyChannelDataInt[5]);
+}
+
+void test_write_channel_settings_rebuilds_scale(void)
+{
+    ADS1299 ads;
+    ads.channelSettings[2][GAIN_SET] = ADS_GAIN01;
+    ads.channelSettings[3][GAIN_SET] = ADS_GAIN08;
+    ads.channelSettings[4][GAIN_SET] = ADS_GAIN24;
+    ads.writeChannelSettings(3);
+
+    TEST_ASSERT_EQUAL_INT32(ChannelScale::scaleForGain(1), ads.channelScale.getScale(2));
+    TEST_ASSERT_EQUAL_INT32(ChannelScale::scaleForGain(8), ads.channelScale.getScale(3));
+    TEST_ASSERT_EQUAL_INT32(ChannelScale::scaleForGain(24), ads.channelScale.getScale(4));
+}
+
+void test_pack_frame_inverts_parse_frame(void)
+{
+    uint8_t frame[OPENBCI_ADS_BYTES_PER_FRAME];
+    byte raw[OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE];
+    int data[OPENBCI_ADS_CHANS_PER_BOARD];
+    fillFrame(frame);
+    ADS1299::parseFrame(frame, NULL, data);
+    ADS1299::packFrame(data, raw);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(frame + OPENBCI_ADS_BYTES_PER_STATUS, raw, OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE);
+}
+
+/// @brief With a filter set, popFrame() hands out filtered ints and raw bytes
+///        that agree; "f00" gives the ADS data back untouched
+void test_pop_frame_applies_filter(void)
+{
+    ADS1299 ads;
+    ads.daisyPresent = true;
+    ADS1299::Frame frame;
+    frame.timestamp = 0;
+    frame.config = ads.configSequence;
+    fillFrame(frame.board);
+    fillFrame(frame.daisy);
+
+    ads.setFilter(BiquadBank::NOTCH_50, BiquadBank::BANDPASS_1_50);
+    TEST_ASSERT_TRUE(ads.frameQueue.push(frame));
+    TEST_ASSERT_TRUE(ads.popFrame());
+    byte packed[OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE];
+    ADS1299::packFrame(ads.daisyChannelDataInt, packed);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(packed, ads.daisyChannelDataRaw, OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE);
+    TEST_ASSERT_TRUE(ads.boardChannelDataInt[5] != 123456);
+    TEST_ASSERT_EQUAL_INT32_ARRAY(ads.boardChannelDataInt, ads.daisyChannelDataInt, OPENBCI_ADS_CHANS_PER_BOARD);
+
+    ads.setFilter(BiquadBank::NOTCH_NONE, BiquadBank::BANDPASS_NONE);
+    TEST_ASSERT_TRUE(ads.frameQueue.push(frame));
+    TEST_ASSERT_TRUE(ads.popFrame());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(frame.board + OPENBCI_ADS_BYTES_PER_STATUS, ads.boardChannelDataRaw, OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE);
+    TEST_ASSERT_EQUAL_INT32(123456, ads.boardChannelDataInt[5]);
+}
+
+/// @brief One sample out per factor frames in, stamped back by the decimator delay
+void test_pop_frame_decimates(void)
+{
+    ADS1299 ads;
+    ads.daisyPresent = true;
+    TEST_ASSERT_FALSE(ads.setDecimation(3));
+    TEST_ASSERT_TRUE(ads.setDecimation(4));
+    TEST_ASSERT_EQUAL_UINT32(62, ads.getStreamRate()); // 250 Hz ADS default
+    ADS1299::Frame frame;
+    frame.config = ads.configSequence;
+    fillFrame(frame.board);
+    fillFrame(frame.daisy);
+
+    int samples = 0;
+    for (int n = 0; n < 400; n++)
+    {
+        frame.timestamp = 1000000 + n * 4000LL;
+        TEST_ASSERT_TRUE(ads.frameQueue.push(frame));
+        if (n == 201)
+            frame.config++; // a live reconfiguration in a frame that is not output itself
+        if (!ads.popFrame())
+            continue;
+        samples++;
+        TEST_ASSERT_EQUAL(3, n % 4);
+        TEST_ASSERT_EQUAL_INT64(frame.timestamp - (int64_t)ads.decimator.getDelay() * 4000, ads.lastSampleMicros);
+        TEST_ASSERT_EQUAL(n == 203, ads.configChanged);
+    }
+    TEST_ASSERT_EQUAL(100, samples);
+    // settled on the constant input, raw bytes repacked from the decimated ints
+    TEST_ASSERT_EQUAL_INT32(123456, ads.boardChannelDataInt[5]);
+    TEST_ASSERT_EQUAL_INT32(-8388608, ads.daisyChannelDataInt[4]);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(frame.daisy + OPENBCI_ADS_BYTES_PER_STATUS, ads.daisyChannelDataRaw, OPENBCI_NUMBER_BYTES_PER_ADS_SAMPLE);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_parse_frame_splits_status_and_channels);
+    RUN_TEST(test_parse_frame_allows_null_outputs);
+    RUN_TEST(test_read_frame_is_one_bulk_transaction);
+    RUN_TEST(test_update_daisy_data_fills_raw_and_int_arrays);
+    RUN_TEST(test_write_channel_settings_rebuilds_scale);
+    RUN_TEST(test_pack_frame_inverts_parse_frame);
+    RUN_TEST(test_pop_frame_applies_filter);
+    RUN_TEST(test_pop_frame_decimates);
+    return UNITY_END();
+}
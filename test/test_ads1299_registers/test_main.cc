@@ -0,0 +1,263 @@
+#include <unity.h>
+#include <SPI.h>
+#include "ADS1299.h"
+
+SPIClass *hspi = NULL;
+
+static const uint8_t resetRegisters[ADS_NUM_REGISTERS] = {
+    ADS_ID, 0x96, 0xC0, 0x60, 0x00, 0x61, 0x61, 0x61, 0x61, 0x61, 0x61, 0x61,
+    0x61, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0F, 0x00, 0x00, 0x00};
+
+/// @brief Register file of the board and daisy ADS behind their chip selects.
+///        Decodes RESET, RREG and multi-register WREG, counts the bursts.
+class FakeADSPair : public NativeSPIDevice
+{
+public:
+    enum State
+    {
+        OPCODE,
+        COUNT,
+        DATA
+    };
+    uint8_t regs[2][ADS_NUM_REGISTERS];
+    int chip; // chip selected, -1 for none
+    State state;
+    bool writing;
+    uint8_t address;
+    int wregBursts[2];
+    int rregs[2];
+    int registersWritten[2];
+    uint8_t lastBurstStart[2];
+    uint8_t lastBurstCount[2];
+
+    FakeADSPair() : chip(-1), state(OPCODE), writing(false), address(0)
+    {
+        memcpy(regs[0], resetRegisters, ADS_NUM_REGISTERS);
+        memcpy(regs[1], resetRegisters, ADS_NUM_REGISTERS);
+        clearCounters();
+    }
+
+    void clearCounters(void)
+    {
+        for (int c = 0; c < 2; c++)
+        {
+            wregBursts[c] = rregs[c] = registersWritten[c] = 0;
+            lastBurstStart[c] = lastBurstCount[c] = 0;
+        }
+    }
+
+    uint8_t transfer(uint8_t data)
+    {
+        if (chip < 0)
+            return 0x00;
+        switch (state)
+        {
+        case OPCODE:
+            if ((data & 0xE0) == 0x40 || (data & 0xE0) == 0x20)
+            {
+                writing = (data & 0xE0) == 0x40;
+                address = data & 0x1F;
+                state = COUNT;
+                if (writing)
+                {
+                    wregBursts[chip]++;
+                    lastBurstStart[chip] = address;
+                }
+                else
+                {
+                    rregs[chip]++;
+                }
+            }
+            else if (data == _RESET)
+            {
+                memcpy(regs[chip], resetRegisters, ADS_NUM_REGISTERS);
+            }
+            return 0x00;
+        case COUNT:
+            if (writing)
+                lastBurstCount[chip] = data + 1;
+            state = DATA;
+            return 0x00;
+        default:
+            if (address >= ADS_NUM_REGISTERS)
+                return 0x00;
+            if (!writing)
+                return regs[chip][address++];
+            regs[chip][address++] = data;
+            registersWritten[chip]++;
+            return 0x00;
+        }
+    }
+
+    void pinChanged(uint8_t pin, uint8_t level)
+    {
+        if (pin != PIN_ADS_CS1 && pin != PIN_ADS_CS2)
+            return;
+        if (level == LOW)
+        {
+            chip = pin == PIN_ADS_CS1 ? 0 : 1;
+            state = OPCODE;
+        }
+        else
+        {
+            chip = -1;
+        }
+    }
+};
+
+/// @brief Channel settings the way initialize_ads() leaves them
+static void defaultSettings(ADS1299 &ads, int channels)
+{
+    for (int i = 0; i < channels; i++)
+    {
+        ads.channelSettings[i][POWER_DOWN] = NO;
+        ads.channelSettings[i][GAIN_SET] = ADS_GAIN24;
+        ads.channelSettings[i][INPUT_TYPE_SET] = ADSINPUT_NORMAL;
+        ads.channelSettings[i][BIAS_SET] = YES;
+        ads.channelSettings[i][SRB2_SET] = YES;
+        ads.channelSettings[i][SRB1_SET] = NO;
+        ads.leadOffSettings[i][PCHAN] = OFF;
+        ads.leadOffSettings[i][NCHAN] = OFF;
+    }
+}
+
+void setUp(void)
+{
+    hspi = new SPIClass(HSPI);
+}
+
+void tearDown(void)
+{
+    nativeAttachSPIDevice(NULL);
+    delete hspi;
+    hspi = NULL;
+}
+
+void test_register_image_from_settings(void)
+{
+    ADS1299 ads;
+    defaultSettings(ads, 8);
+    ads.channelSettings[1][POWER_DOWN] = YES; // off: out of SRB2 and bias whatever they say
+    ads.channelSettings[2][GAIN_SET] = ADS_GAIN01;
+    ads.channelSettings[2][INPUT_TYPE_SET] = ADSINPUT_TESTSIG;
+    ads.channelSettings[2][SRB2_SET] = NO;
+    ads.channelSettings[3][BIAS_SET] = NO;
+    ads.channelSettings[7][GAIN_SET] = ADS_GAIN08;
+    ads.channelSettings[7][INPUT_TYPE_SET] = ADSINPUT_SHORTED;
+    ads.leadOffSettings[0][PCHAN] = ON;
+    ads.leadOffSettings[5][NCHAN] = ON;
+    ads.leadOffSettings[7][PCHAN] = ads.leadOffSettings[7][NCHAN] = ON;
+    ads.boardUseSRB1 = true;
+
+    uint8_t image[ADS_NUM_REGISTERS];
+    ads.buildChannelRegisters(ADS1299::BOARD_ADS, image);
+
+    const uint8_t channels[8] = {0x68, 0xE0, 0x05, 0x68, 0x68, 0x68, 0x68, 0x49};
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(channels, image + CH1SET, 8);
+    TEST_ASSERT_EQUAL_HEX8(0xF5, image[BIAS_SENSP]); // all but channels 2 and 4
+    TEST_ASSERT_EQUAL_HEX8(0xF5, image[BIAS_SENSN]);
+    TEST_ASSERT_EQUAL_HEX8(0x81, image[LOFF_SENSP]);
+    TEST_ASSERT_EQUAL_HEX8(0xA0, image[LOFF_SENSN]);
+    TEST_ASSERT_EQUAL_HEX8(0x20, image[MISC1]);
+    // registers the channel settings do not own keep their mirrored values
+    TEST_ASSERT_EQUAL_HEX8(0x96, image[CONFIG1]);
+    TEST_ASSERT_EQUAL_HEX8(0x60, image[CONFIG3]);
+    TEST_ASSERT_EQUAL_HEX8(0x0F, image[GPIO]);
+}
+
+void test_write_channel_settings_one_burst_per_chip(void)
+{
+    FakeADSPair fake;
+    nativeAttachSPIDevice(&fake);
+    ADS1299 ads;
+    ads.daisyPresent = true;
+    defaultSettings(ads, 16);
+
+    ads.writeChannelSettings();
+
+    uint8_t image[ADS_NUM_REGISTERS];
+    for (int c = 0; c < 2; c++)
+    {
+        TEST_ASSERT_EQUAL(1, fake.wregBursts[c]);
+        TEST_ASSERT_EQUAL(0, fake.rregs[c]);
+        TEST_ASSERT_EQUAL_HEX8(CH1SET, fake.lastBurstStart[c]);
+        TEST_ASSERT_EQUAL(BIAS_SENSN - CH1SET + 1, fake.lastBurstCount[c]); // LOFF_SENSx and MISC1 already match
+        ads.buildChannelRegisters(c ? ADS1299::DAISY_ADS : ADS1299::BOARD_ADS, image);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(image, fake.regs[c], ADS_NUM_REGISTERS);
+        TEST_ASSERT_EQUAL_HEX8(0x68, fake.regs[c][CH8SET]);
+        TEST_ASSERT_EQUAL_HEX8(0xFF, fake.regs[c][BIAS_SENSN]);
+    }
+    printf("writeChannelSettings: %u SPI bytes for 16 channels\n", hspi->byteTransfers);
+}
+
+/// @brief The shadow is authoritative: only registers that differ go out
+void test_only_changed_registers_are_written(void)
+{
+    FakeADSPair fake;
+    nativeAttachSPIDevice(&fake);
+    ADS1299 ads;
+    defaultSettings(ads, 8);
+    ads.writeChannelSettings();
+    fake.clearCounters();
+
+    ads.writeChannelSettings();
+    TEST_ASSERT_EQUAL(0, fake.wregBursts[0]);
+
+    ads.channelSettings[2][GAIN_SET] = ADS_GAIN02;
+    ads.writeChannelSettings(3);
+    TEST_ASSERT_EQUAL(1, fake.wregBursts[0]);
+    TEST_ASSERT_EQUAL_HEX8(CH3SET, fake.lastBurstStart[0]);
+    TEST_ASSERT_EQUAL(1, fake.lastBurstCount[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x18, fake.regs[0][CH3SET]);
+
+    fake.clearCounters();
+    ads.leadOffSettings[7][PCHAN] = ON;
+    ads.changeChannelLeadOffDetect(8);
+    TEST_ASSERT_EQUAL(1, fake.wregBursts[0]);
+    TEST_ASSERT_EQUAL_HEX8(LOFF_SENSP, fake.lastBurstStart[0]);
+    TEST_ASSERT_EQUAL(1, fake.registersWritten[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x80, fake.regs[0][LOFF_SENSP]);
+
+    fake.clearCounters();
+    ads.channelSettings[0][SRB1_SET] = YES;
+    ads.writeChannelSettings(1);
+    TEST_ASSERT_EQUAL(1, fake.wregBursts[0]); // only MISC1
+    TEST_ASSERT_EQUAL_HEX8(0x20, fake.regs[0][MISC1]);
+    TEST_ASSERT_EQUAL(YES, ads.channelSettings[6][SRB1_SET]);
+    TEST_ASSERT_EQUAL(0, fake.rregs[0]);
+}
+
+void test_deactivate_then_activate_restores_registers(void)
+{
+    FakeADSPair fake;
+    nativeAttachSPIDevice(&fake);
+    ADS1299 ads;
+    defaultSettings(ads, 8);
+    ads.channelSettings[4][BIAS_SET] = NO;
+    ads.leadOffSettings[4][NCHAN] = ON;
+    ads.writeChannelSettings();
+    uint8_t before[ADS_NUM_REGISTERS];
+    memcpy(before, fake.regs[0], ADS_NUM_REGISTERS);
+    fake.clearCounters();
+
+    ads.streamSafeChannelDeactivate(5);
+    TEST_ASSERT_EQUAL(1, fake.wregBursts[0]);
+    TEST_ASSERT_EQUAL_HEX8(0xE0, fake.regs[0][CH5SET]); // powered down, SRB2 open
+    TEST_ASSERT_EQUAL_HEX8(0x00, fake.regs[0][LOFF_SENSN]);
+    TEST_ASSERT_EQUAL_HEX8(before[BIAS_SENSP], fake.regs[0][BIAS_SENSP]);
+
+    ads.streamSafeChannelActivate(5);
+    TEST_ASSERT_EQUAL_HEX8(0x68, fake.regs[0][CH5SET]);
+    TEST_ASSERT_EQUAL_HEX8(0xEF, fake.regs[0][BIAS_SENSP]); // still out of the bias
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(before + CH1SET, fake.regs[0] + CH1SET, BIAS_SENSN - CH1SET + 1);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_register_image_from_settings);
+    RUN_TEST(test_write_channel_settings_one_burst_per_chip);
+    RUN_TEST(test_only_changed_registers_are_written);
+    RUN_TEST(test_deactivate_then_activate_restores_registers);
+    return UNITY_END();
+}
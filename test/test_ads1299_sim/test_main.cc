@@ -0,0 +1,293 @@
+#include <unity.h>
+#include <SPI.h>
+#include <chrono>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+#include "ADS1299.h"
+#include "ADS1299Sim.h"
+
+SPIClass *hspi = NULL;
+
+#define STREAM_FRAMES 500
+#define POP_TIMEOUT_MS 2000
+#define JITTER_FRAMES 1000
+#define READ_LATENCY_MAX_US 800 // how late the reader may get to a sample, under one period
+
+static ADS1299Sim *sim;
+static ADS1299 *ads;
+alignas(ADS1299) static uint8_t adsStorage[sizeof(ADS1299)]; // new ignores its cache line alignment before C++17
+
+void setUp(void)
+{
+    hspi = new SPIClass(HSPI);
+    sim = new ADS1299Sim();
+    nativeAttachSPIDevice(sim);
+    ads = new (adsStorage) ADS1299();
+}
+
+void tearDown(void)
+{
+    ads->~ADS1299();
+    nativeAttachSPIDevice(NULL);
+    delete sim;
+    delete hspi;
+    hspi = NULL;
+}
+
+/// @brief The driver's register shadow must match what the chip really holds
+static void assertShadowMatches(ADS1299::ChipSelect targetSS)
+{
+    uint8_t chip = targetSS == ADS1299::DAISY_ADS ? 1 : 0;
+    uint8_t actual[ADS_NUM_REGISTERS], shadow[ADS_NUM_REGISTERS];
+    for (uint8_t address = 0; address < ADS_NUM_REGISTERS; address++)
+    {
+        actual[address] = sim->getRegister(chip, address);
+        shadow[address] = ads->getRegister(address, targetSS);
+    }
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(actual, shadow, ADS_NUM_REGISTERS);
+}
+
+static int32_t channelCode(const ADS1299::Frame &frame, uint8_t chip, uint8_t channel)
+{
+    int data[OPENBCI_ADS_CHANS_PER_BOARD];
+    ADS1299::parseFrame(chip ? frame.daisy : frame.board, NULL, data);
+    return data[channel];
+}
+
+void test_initialize_with_daisy(void)
+{
+    ads->initialize();
+    TEST_ASSERT_TRUE(ads->daisyPresent);
+    TEST_ASSERT_EQUAL(16, ads->numChannels);
+    TEST_ASSERT_EQUAL_HEX8(ADS1299_CONFIG1_DAISY | ADS1299::SAMPLE_RATE_250, sim->getRegister(0, CONFIG1));
+    TEST_ASSERT_EQUAL_HEX8(ADS1299_CONFIG1_DAISY_NOT | ADS1299::SAMPLE_RATE_250, sim->getRegister(1, CONFIG1));
+    for (uint8_t chip = 0; chip < 2; chip++)
+    {
+        TEST_ASSERT_EQUAL_HEX8(0xEC, sim->getRegister(chip, CONFIG3));
+        TEST_ASSERT_EQUAL_HEX8(0x68, sim->getRegister(chip, CH1SET)); // gain 24, normal, SRB2
+        TEST_ASSERT_EQUAL_HEX8(0xFF, sim->getRegister(chip, BIAS_SENSP));
+        TEST_ASSERT_FALSE(sim->isReadContinuous(chip));
+    }
+    assertShadowMatches(ADS1299::BOARD_ADS);
+    assertShadowMatches(ADS1299::DAISY_ADS);
+    TEST_ASSERT_EQUAL(0, sim->ignoredCommands);
+}
+
+void test_initialize_without_daisy(void)
+{
+    sim->setDaisyPresent(false);
+    ads->initialize();
+    TEST_ASSERT_FALSE(ads->daisyPresent);
+    TEST_ASSERT_EQUAL(8, ads->numChannels);
+    TEST_ASSERT_EQUAL_HEX8(ADS1299_CONFIG1_DAISY_NOT | ADS1299::SAMPLE_RATE_250, sim->getRegister(0, CONFIG1));
+    assertShadowMatches(ADS1299::BOARD_ADS);
+}
+
+/// @brief DRDY comes at the rate CONFIG1 asks for, at every SAMPLE_RATE
+void test_drdy_period_every_rate(void)
+{
+    sim->setDaisyPresent(false);
+    ads->initialize();
+    ads->boardBeginADSInterrupt();
+    for (uint8_t rate = ADS1299::SAMPLE_RATE_16000; rate <= ADS1299::SAMPLE_RATE_250; rate++)
+    {
+        ads->setSampleRate(rate);
+        TEST_ASSERT_EQUAL_UINT32(ads->getSamplePeriodMicros(), sim->getSamplePeriodMicros());
+        ads->streamStart();
+        TEST_ASSERT_TRUE(sim->isConverting());
+        sim->advance(0); // conversions due during startADS()'s delay(1)
+        ADS1299::channelDataAvailable = false;
+        uint32_t converted = sim->advance(100000); // 100 ms
+        TEST_ASSERT_EQUAL_UINT32(1600 >> rate, converted);
+        TEST_ASSERT_TRUE(ADS1299::channelDataAvailable);
+        ads->streamStop();
+        TEST_ASSERT_FALSE(sim->isConverting());
+        TEST_ASSERT_EQUAL(0, sim->advance(100000));
+    }
+}
+
+/// @brief The internal test signal is a square wave of 1.875 mV, counts and
+///        nanovolts must agree with the datasheet through the driver's scale
+void test_internal_test_signal(void)
+{
+    sim->setDaisyPresent(false);
+    ads->initialize();
+    ads->activateAllChannelsToTestCondition(ADSINPUT_TESTSIG, ADSTESTSIG_AMP_1X, ADSTESTSIG_PULSE_SLOW);
+    ads->updateChannelScale();
+    ads->streamStart();
+
+    ADS1299::Frame frame;
+    const uint64_t halfPeriod = 128; // fCLK / 2^21 is 0.98 Hz: 512 ms high, 512 ms low at 250 SPS
+    for (uint64_t sample = 0; sample < 2 * halfPeriod; sample++)
+    {
+        sim->convert();
+        if (sample != 0 && sample != 2 * halfPeriod - 1)
+            continue;
+        ads->readChannelData(frame);
+        int32_t raw[OPENBCI_ADS_CHANS_PER_BOARD];
+        int64_t nv[OPENBCI_ADS_CHANS_PER_BOARD];
+        for (uint8_t c = 0; c < OPENBCI_ADS_CHANS_PER_BOARD; c++)
+        {
+            raw[c] = channelCode(frame, 0, c);
+            TEST_ASSERT_EQUAL_INT32(sim->expectedCode(0, c, sample), raw[c]);
+        }
+        ads->channelScale.toNanovolts(raw, nv, 0, OPENBCI_ADS_CHANS_PER_BOARD);
+        int64_t expected = sample == 0 ? 1875000 : -1875000;
+        for (uint8_t c = 0; c < OPENBCI_ADS_CHANS_PER_BOARD; c++)
+            TEST_ASSERT_INT64_WITHIN(30, expected, nv[c]); // 1 LSB at gain 24 is 22 nV
+    }
+}
+
+/// @brief A sine on one daisy channel, the others keep the synthetic EEG
+void test_sine_on_daisy_channel(void)
+{
+    ads->initialize();
+    ads->updateChannelScale();
+    sim->setSine(9, 100, 10); // channel 10: 100 uV at 10 Hz
+    ads->streamStart();
+
+    ADS1299::Frame frame;
+    int64_t peak = 0;
+    for (uint64_t sample = 0; sample < 25; sample++) // one 10 Hz period at 250 SPS
+    {
+        sim->convert();
+        ads->readChannelData(frame);
+        int32_t raw[OPENBCI_NUMBER_OF_CHANNELS_DAISY];
+        for (uint8_t c = 0; c < OPENBCI_NUMBER_OF_CHANNELS_DAISY; c++)
+        {
+            raw[c] = channelCode(frame, c / 8, c % 8);
+            TEST_ASSERT_EQUAL_INT32(sim->expectedCode(c / 8, c % 8, sample), raw[c]);
+        }
+        int64_t nv[OPENBCI_NUMBER_OF_CHANNELS_DAISY];
+        ads->channelScale.toNanovolts(raw, nv, 0, OPENBCI_NUMBER_OF_CHANNELS_DAISY);
+        if (nv[9] > peak)
+            peak = nv[9];
+    }
+    TEST_ASSERT_INT64_WITHIN(1000, 100000, peak);
+}
+
+/// @brief RREG/WREG only work after SDATAC, in RDATAC the chip drops them
+void test_register_access_needs_sdatac(void)
+{
+    sim->setDaisyPresent(false);
+    ads->initialize();
+    ads->streamStart();
+    TEST_ASSERT_TRUE(sim->isReadContinuous(0));
+
+    digitalWrite(PIN_ADS_CS1, LOW);
+    hspi->transfer(0x40 | CH1SET); // WREG CH1SET
+    hspi->transfer(0x00);
+    hspi->transfer(0x01);
+    digitalWrite(PIN_ADS_CS1, HIGH);
+    TEST_ASSERT_EQUAL(1, sim->ignoredCommands);
+    TEST_ASSERT_EQUAL_HEX8(0x68, sim->getRegister(0, CH1SET));
+
+    ads->streamStop();
+    digitalWrite(PIN_ADS_CS1, LOW);
+    hspi->transfer(0x20 | CONFIG1); // RREG CONFIG1
+    hspi->transfer(0x00);
+    uint8_t config1 = hspi->transfer(0x00);
+    digitalWrite(PIN_ADS_CS1, HIGH);
+    TEST_ASSERT_EQUAL_HEX8(ADS1299_CONFIG1_DAISY_NOT | ADS1299::SAMPLE_RATE_250, config1);
+    TEST_ASSERT_EQUAL(1, sim->ignoredCommands);
+}
+
+/// @brief The acquisition task woken by the simulated DRDY delivers every
+///        sample of both chips in order
+void test_acquisition_task_streams_every_sample(void)
+{
+    ads->initialize();
+    ads->boardBeginADSInterrupt();
+    ads->streamStart();
+    TEST_ASSERT_TRUE(ads->beginAcquisitionTask());
+
+    uint32_t period = ads->getSamplePeriodMicros();
+    int received = 0;
+    for (uint64_t sample = 0; sample < STREAM_FRAMES; sample++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(1, sim->advance(period));
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(POP_TIMEOUT_MS);
+        while (!ads->popFrame() && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::yield();
+        for (uint8_t c = 0; c < OPENBCI_ADS_CHANS_PER_BOARD; c++)
+        {
+            TEST_ASSERT_EQUAL_INT32(sim->expectedCode(0, c, sample), ads->boardChannelDataInt[c]);
+            TEST_ASSERT_EQUAL_INT32(sim->expectedCode(1, c, sample), ads->daisyChannelDataInt[c]);
+        }
+        received++;
+    }
+    ads->endAcquisitionTask();
+    ads->streamStop();
+    TEST_ASSERT_EQUAL(STREAM_FRAMES, received);
+    TEST_ASSERT_EQUAL_UINT32(0, ads->framesDropped);
+}
+
+/// @brief Largest deviation of consecutive stamps from the nominal period
+static int64_t jitter(const std::vector<int64_t> &stamps, int64_t period)
+{
+    int64_t worst = 0;
+    for (size_t i = 1; i < stamps.size(); i++)
+    {
+        int64_t deviation = stamps[i] - stamps[i - 1] - period;
+        if (deviation < 0)
+            deviation = -deviation;
+        if (deviation > worst)
+            worst = deviation;
+    }
+    return worst;
+}
+
+/// @brief Samples are stamped in the DRDY ISR, so the time the reader and
+///        loop() get to them no longer shows up in the timestamps
+void test_drdy_timestamps_do_not_jitter(void)
+{
+    sim->setDaisyPresent(false);
+    ads->initialize();
+    ads->setSampleRate(ADS1299::SAMPLE_RATE_1000);
+    ads->boardBeginADSInterrupt();
+    ads->streamStart();
+    sim->advance(0); // conversions due during startADS()'s delay(1)
+    TEST_ASSERT_TRUE(ads->beginAcquisitionTask());
+
+    int64_t period = ads->getSamplePeriodMicros();
+    std::minstd_rand rng(42);
+    std::vector<int64_t> drdyStamps, loopStamps;
+    for (int n = 0; n < JITTER_FRAMES; n++)
+    {
+        // run up to the next DRDY edge
+        int64_t due = n == 0 ? period : drdyStamps.back() + period - (int64_t)nativeMicros();
+        TEST_ASSERT_EQUAL_UINT32(1, sim->advance(due));
+        nativeAdvanceMicros(rng() % READ_LATENCY_MAX_US); // whatever the CPU was doing first
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(POP_TIMEOUT_MS);
+        while (!ads->popFrame() && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::yield();
+        drdyStamps.push_back(ads->lastSampleMicros);
+        loopStamps.push_back(nativeMicros()); // what millis() in updateChannelData() used to see, in us
+    }
+    ads->endAcquisitionTask();
+    ads->streamStop();
+
+    int64_t drdyJitter = jitter(drdyStamps, period);
+    printf("timestamp jitter at 1 kSPS: %lld us stamped in the DRDY ISR, %lld us stamped when loop() read the sample\n",
+           (long long)drdyJitter, (long long)jitter(loopStamps, period));
+    TEST_ASSERT_EQUAL(JITTER_FRAMES, (int)drdyStamps.size());
+    TEST_ASSERT_EQUAL_UINT32(0, ads->framesDropped);
+    TEST_ASSERT_TRUE(drdyJitter < 100);
+    TEST_ASSERT_EQUAL_UINT32(drdyStamps.back() / 1000, ads->lastSampleTime);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_initialize_with_daisy);
+    RUN_TEST(test_initialize_without_daisy);
+    RUN_TEST(test_drdy_period_every_rate);
+    RUN_TEST(test_internal_test_signal);
+    RUN_TEST(test_sine_on_daisy_channel);
+    RUN_TEST(test_register_access_needs_sdatac);
+    RUN_TEST(test_acquisition_task_streams_every_sample);
+    RUN_TEST(test_drdy_timestamps_do_not_jitter);
+    return UNITY_END();
+}
@@ -0,0 +1,203 @@
+#include <unity.h>
+#include <math.h>
+#include <random>
+#include "BandPower.h"
+#include "BandPacket.h"
+
+#define CHANNELS 16
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/// @brief What numpy gives for the same window:
+///        x = x - x.mean(); X = np.fft.rfft(x * scipy.signal.get_window('hann', n));
+///        2 * sum(|X[band bins]|^2) / (n * sum(w^2)), straight DFT in double
+static void reference(const double *x, int n, double sampleRate, double *power)
+{
+    double mean = 0, energy = 0;
+    for (int i = 0; i < n; i++)
+        mean += x[i] / n;
+    for (int i = 0; i < n; i++)
+    {
+        double w = 0.5 - 0.5 * cos(2 * M_PI * i / n);
+        energy += w * w;
+    }
+    for (int b = 0; b < BandPower::BAND_END; b++)
+    {
+        power[b] = 0;
+        for (int k = 1; k < n / 2; k++)
+        {
+            double f = k * sampleRate / n;
+            if (f < BandPower::getLow((BandPower::BAND)b) || f >= BandPower::getHigh((BandPower::BAND)b))
+                continue;
+            double re = 0, im = 0;
+            for (int i = 0; i < n; i++)
+            {
+                double v = (x[i] - mean) * (0.5 - 0.5 * cos(2 * M_PI * i / n));
+                re += v * cos(2 * M_PI * k * i / n);
+                im -= v * sin(2 * M_PI * k * i / n);
+            }
+            power[b] += 2 * (re * re + im * im) / (n * energy);
+        }
+    }
+}
+
+/// @brief EEG-ish test signal: an electrode offset, one tone per band at a
+///        channel dependent level, and noise
+static int32_t signal(std::minstd_rand &rng, int channel, long n, double sampleRate)
+{
+    static const double tones[BandPower::BAND_END] = {2.5, 6.1, 10.2, 21.7, 41.3};
+    double t = n / sampleRate;
+    double v = 3000000 - channel * 400000;
+    for (int b = 0; b < BandPower::BAND_END; b++)
+        v += (2000 + 900 * ((channel + b) % 5)) * sin(2 * M_PI * tones[b] * t + channel);
+    v += (double)(rng() % 401) - 200;
+    return (int32_t)lround(v);
+}
+
+void test_configure(void)
+{
+    BandPower bands;
+    TEST_ASSERT_EQUAL(BAND_POWER_DEFAULT_WINDOW, bands.getWindow());
+    TEST_ASSERT_EQUAL(BAND_POWER_DEFAULT_HOP, bands.getHop());
+    TEST_ASSERT_FALSE(bands.configure(16, 8, 250));
+    TEST_ASSERT_FALSE(bands.configure(1024, 64, 250));
+    TEST_ASSERT_FALSE(bands.configure(200, 64, 250));
+    TEST_ASSERT_FALSE(bands.configure(256, 0, 250));
+    TEST_ASSERT_FALSE(bands.configure(256, 257, 250));
+    TEST_ASSERT_FALSE(bands.configure(256, 64, 0));
+    TEST_ASSERT_EQUAL(BAND_POWER_DEFAULT_WINDOW, bands.getWindow());
+    TEST_ASSERT_TRUE(bands.configure(512, 512, 1000));
+    TEST_ASSERT_EQUAL(512, bands.getWindow());
+    TEST_ASSERT_EQUAL(1000, bands.getSampleRate());
+    TEST_ASSERT_EQUAL_STRING("alpha", BandPower::getName(BandPower::BAND_ALPHA));
+}
+
+/// @brief A window every `hop` samples once the first one is full, odd
+///        channel counts work, and a new channel count starts over
+void test_hop_and_channels(void)
+{
+    BandPower bands;
+    bands.configure(64, 16, 250);
+    int32_t data[3] = {0, 0, 0};
+    int outputs = 0;
+    for (int n = 0; n < 64 + 16 * 10; n++)
+    {
+        if (bands.add(data, 3))
+        {
+            TEST_ASSERT_EQUAL(0, (n + 1 - 64) % 16);
+            outputs++;
+        }
+    }
+    TEST_ASSERT_EQUAL(11, outputs);
+    TEST_ASSERT_EQUAL(3, bands.getChannels());
+    for (int n = 0; n < 63; n++)
+        TEST_ASSERT_FALSE(bands.add(data, 2));
+    TEST_ASSERT_TRUE(bands.add(data, 2));
+}
+
+/// @brief Every window of every channel against the double reference, at a
+///        few window, hop and rate choices
+void test_matches_reference(void)
+{
+    const uint16_t windows[3] = {256, 512, 64};
+    const uint16_t hops[3] = {64, 100, 64};
+    const uint32_t rates[3] = {250, 500, 250};
+    for (int config = 0; config < 3; config++)
+    {
+        const int n = windows[config];
+        BandPower bands;
+        TEST_ASSERT_TRUE(bands.configure(n, hops[config], rates[config]));
+        std::minstd_rand rng(config + 1);
+        static double history[CHANNELS][4096];
+        double worst = 0;
+        int windowsChecked = 0;
+        for (long s = 0; s < 4 * n; s++)
+        {
+            int32_t data[CHANNELS];
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                data[c] = signal(rng, c, s, rates[config]);
+                history[c][s] = data[c];
+            }
+            if (!bands.add(data, CHANNELS))
+                continue;
+            windowsChecked++;
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                double expected[BandPower::BAND_END];
+                reference(history[c] + s + 1 - n, n, rates[config], expected);
+                for (int b = 0; b < BandPower::BAND_END; b++)
+                {
+                    double error = fabs(bands.getPower(c, (BandPower::BAND)b) - expected[b]) / expected[b];
+                    if (error > worst)
+                        worst = error;
+                }
+            }
+        }
+        printf("window %d, hop %d at %u Hz: %d windows, worst band power error %.2e\n", n, hops[config],
+               (unsigned)rates[config], windowsChecked, worst);
+        TEST_ASSERT_TRUE(windowsChecked >= 3);
+        TEST_ASSERT_TRUE(worst < 1e-4);
+    }
+}
+
+/// @brief A 10 Hz sine of amplitude A shows up as A^2 / 2 in alpha, nowhere else
+void test_sine_power(void)
+{
+    BandPower bands;
+    bands.configure(256, 256, 250);
+    const double amplitude = 100000;
+    bool done = false;
+    for (long n = 0; !done; n++)
+    {
+        int32_t data[1] = {(int32_t)lround(amplitude * sin(2 * M_PI * 10 * n / 250.0))};
+        done = bands.add(data, 1);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(amplitude * amplitude / 2 * 0.01, amplitude * amplitude / 2,
+                             bands.getPower(0, BandPower::BAND_ALPHA));
+    TEST_ASSERT_TRUE(bands.getPower(0, BandPower::BAND_BETA) < amplitude * amplitude * 1e-3);
+    TEST_ASSERT_TRUE(bands.getPower(0, BandPower::BAND_DELTA) < amplitude * amplitude * 1e-6);
+}
+
+void test_packet_round_trip(void)
+{
+    float powers[CHANNELS * BandPower::BAND_END];
+    for (int i = 0; i < CHANNELS * BandPower::BAND_END; i++)
+        powers[i] = powf(10, (i - 40) * 0.3f) * 1.2345f;
+    powers[7] = 0;
+    powers[8] = 1e30f; // clamps
+    uint8_t packet[BAND_PACKET_MAX];
+    size_t length = BandPacket::encode(0x1234, powers, CHANNELS, BandPower::BAND_END, packet);
+    TEST_ASSERT_EQUAL(BAND_PACKET_MAX, length);
+    TEST_ASSERT_EQUAL_HEX8(BAND_PACKET_TYPE, packet[0]);
+
+    float decoded[CHANNELS * BandPower::BAND_END];
+    uint8_t numChannels, numBands;
+    uint16_t windowNumber;
+    TEST_ASSERT_EQUAL(0, BandPacket::decode(packet, length - 1, decoded, numChannels, numBands, windowNumber));
+    TEST_ASSERT_EQUAL(length, BandPacket::decode(packet, length, decoded, numChannels, numBands, windowNumber));
+    TEST_ASSERT_EQUAL(CHANNELS, numChannels);
+    TEST_ASSERT_EQUAL(BandPower::BAND_END, numBands);
+    TEST_ASSERT_EQUAL_UINT16(0x1234, windowNumber);
+    for (int i = 0; i < CHANNELS * BandPower::BAND_END; i++)
+    {
+        if (i == 7)
+            TEST_ASSERT_TRUE(decoded[i] == 0);
+        else if (i != 8)
+            TEST_ASSERT_FLOAT_WITHIN(powers[i] * 0.0006f, powers[i], decoded[i]);
+    }
+    TEST_ASSERT_TRUE(decoded[8] > 1e12f);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_configure);
+    RUN_TEST(test_hop_and_channels);
+    RUN_TEST(test_matches_reference);
+    RUN_TEST(test_sine_power);
+    RUN_TEST(test_packet_round_trip);
+    return UNITY_END();
+}
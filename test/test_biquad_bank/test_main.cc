@@ -0,0 +1,210 @@
+#include <unity.h>
+#include <math.h>
+#include <random>
+#include "BiquadBank.h"
+
+#define CHANNELS 16
+
+static const uint32_t sampleRates[3] = {250, 1000, 16000};
+static const double edges[BiquadBank::BANDPASS_END][2] = {{0, 0}, {1, 50}, {5, 50}, {3, 45}, {7, 13}, {15, 50}};
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/// @brief The same design straight from the cookbook, in double all the way
+struct Reference
+{
+    double b[BIQUAD_MAX_SECTIONS][3], a[BIQUAD_MAX_SECTIONS][3];
+    double x1[BIQUAD_MAX_SECTIONS][CHANNELS], x2[BIQUAD_MAX_SECTIONS][CHANNELS];
+    double y1[BIQUAD_MAX_SECTIONS][CHANNELS], y2[BIQUAD_MAX_SECTIONS][CHANNELS];
+    int sections;
+
+    Reference(BiquadBank::NOTCH notch, BiquadBank::BANDPASS bandpass, double fs) : sections(0)
+    {
+        memset(x1, 0, sizeof(x1));
+        memset(x2, 0, sizeof(x2));
+        memset(y1, 0, sizeof(y1));
+        memset(y2, 0, sizeof(y2));
+        if (notch != BiquadBank::NOTCH_NONE)
+        {
+            double w0 = 2 * M_PI * (notch == BiquadBank::NOTCH_50 ? 50 : 60) / fs;
+            double alpha = sin(w0) / (2 * BIQUAD_NOTCH_Q);
+            add(1, -2 * cos(w0), 1, 1 + alpha, -2 * cos(w0), 1 - alpha);
+        }
+        if (bandpass != BiquadBank::BANDPASS_NONE)
+        {
+            const double q[2] = {1 / (2 * cos(M_PI / 8)), 1 / (2 * cos(3 * M_PI / 8))};
+            for (int i = 0; i < 2; i++)
+            {
+                double w0 = 2 * M_PI * edges[bandpass][0] / fs, c = cos(w0), alpha = sin(w0) / (2 * q[i]);
+                add((1 + c) / 2, -(1 + c), (1 + c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+            }
+            for (int i = 0; i < 2; i++)
+            {
+                double w0 = 2 * M_PI * edges[bandpass][1] / fs, c = cos(w0), alpha = sin(w0) / (2 * q[i]);
+                add((1 - c) / 2, 1 - c, (1 - c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+            }
+        }
+    }
+
+    void add(double b0, double b1, double b2, double a0, double a1, double a2)
+    {
+        b[sections][0] = b0 / a0;
+        b[sections][1] = b1 / a0;
+        b[sections][2] = b2 / a0;
+        a[sections][1] = a1 / a0;
+        a[sections][2] = a2 / a0;
+        sections++;
+    }
+
+    double run(int channel, double x)
+    {
+        for (int s = 0; s < sections; s++)
+        {
+            double y = b[s][0] * x + b[s][1] * x1[s][channel] + b[s][2] * x2[s][channel] -
+                       a[s][1] * y1[s][channel] - a[s][2] * y2[s][channel];
+            x2[s][channel] = x1[s][channel];
+            x1[s][channel] = x;
+            y2[s][channel] = y1[s][channel];
+            y1[s][channel] = y;
+            x = y;
+        }
+        return x;
+    }
+};
+
+/// @brief Electrode offset, alpha, mains and noise; every channel its own phase
+static int32_t signal(int channel, long n, double fs, std::minstd_rand &rng)
+{
+    double t = n / fs;
+    double v = 300000 - 20000 * channel + 50000 * sin(2 * M_PI * 10 * t + channel) +
+               100000 * sin(2 * M_PI * 50 * t + 0.3 * channel) + 80000 * sin(2 * M_PI * 60 * t) +
+               (double)(rng() % 2001) - 1000;
+    return (int32_t)v;
+}
+
+/// @brief Every filter choice at three rates against the double cascade
+void test_matches_double_reference(void)
+{
+    for (int r = 0; r < 3; r++)
+    {
+        const double fs = sampleRates[r];
+        double worst = 0;
+        for (int n = 0; n < BiquadBank::NOTCH_END; n++)
+        {
+            for (int b = 0; b < BiquadBank::BANDPASS_END; b++)
+            {
+                BiquadBank bank;
+                bank.configure((BiquadBank::NOTCH)n, (BiquadBank::BANDPASS)b, sampleRates[r]);
+                Reference reference((BiquadBank::NOTCH)n, (BiquadBank::BANDPASS)b, fs);
+                TEST_ASSERT_EQUAL(reference.sections, bank.getSections());
+                std::minstd_rand rng(1);
+                const long samples = (long)(fs * 3);
+                for (long i = 0; i < samples; i++)
+                {
+                    int32_t data[CHANNELS];
+                    double expected[CHANNELS];
+                    for (int c = 0; c < CHANNELS; c++)
+                    {
+                        data[c] = signal(c, i, fs, rng);
+                        expected[c] = reference.run(c, data[c]);
+                    }
+                    bank.process(data, 0, CHANNELS);
+                    for (int c = 0; c < CHANNELS; c++)
+                    {
+                        double error = fabs(data[c] - expected[c]);
+                        if (error > worst)
+                            worst = error;
+                    }
+                }
+            }
+        }
+        printf("%5u Hz: worst error against double %.2f counts over all filters\n", sampleRates[r], worst);
+        TEST_ASSERT_TRUE(worst <= 2.0);
+    }
+}
+
+/// @brief Steady mains is gone, the alpha band passes at close to unity gain
+void test_notch_and_passband(void)
+{
+    BiquadBank bank;
+    bank.configure(BiquadBank::NOTCH_50, BiquadBank::BANDPASS_1_50, 250);
+    double mains = 0, alpha = 0;
+    for (long i = 0; i < 250 * 10; i++)
+    {
+        int32_t data[2];
+        data[0] = (int32_t)(1000000 * sin(2 * M_PI * 50 * i / 250.0));
+        data[1] = (int32_t)(1000000 * sin(2 * M_PI * 10 * i / 250.0));
+        bank.process(data, 0, 2);
+        if (i >= 250 * 8)
+        {
+            if (fabs(data[0]) > mains)
+                mains = fabs(data[0]);
+            if (fabs(data[1]) > alpha)
+                alpha = fabs(data[1]);
+        }
+    }
+    printf("50 Hz left: %.0f of 1000000 counts, 10 Hz: %.0f\n", mains, alpha);
+    TEST_ASSERT_TRUE(mains < 1000);
+    TEST_ASSERT_TRUE(alpha > 950000 && alpha < 1050000);
+}
+
+/// @brief Full scale steps clamp at the 24 bit limits instead of wrapping
+void test_full_scale_steps_saturate(void)
+{
+    BiquadBank bank;
+    bank.configure(BiquadBank::NOTCH_60, BiquadBank::BANDPASS_15_50, 250);
+    Reference reference(BiquadBank::NOTCH_60, BiquadBank::BANDPASS_15_50, 250);
+    for (long i = 0; i < 2000; i++)
+    {
+        int32_t data[1] = {(i / 7) % 2 ? 8388607 : -8388608};
+        double expected = reference.run(0, data[0]);
+        bank.process(data, 0, 1);
+        TEST_ASSERT_TRUE(data[0] <= 8388607 && data[0] >= -8388608);
+        if (expected > 9000000)
+            TEST_ASSERT_EQUAL_INT32(8388607, data[0]);
+        if (expected < -9000000)
+            TEST_ASSERT_EQUAL_INT32(-8388608, data[0]);
+    }
+}
+
+/// @brief Off passes samples through, channel offsets keep their own history
+void test_disabled_and_channel_offset(void)
+{
+    BiquadBank bank;
+    TEST_ASSERT_FALSE(bank.isEnabled());
+    int data[2] = {-8388608, 12345};
+    bank.process(data, 0, 2);
+    TEST_ASSERT_EQUAL_INT(-8388608, data[0]);
+    TEST_ASSERT_EQUAL_INT(12345, data[1]);
+
+    BiquadBank split, whole;
+    split.configure(BiquadBank::NOTCH_50, BiquadBank::BANDPASS_3_45, 1000);
+    whole.configure(BiquadBank::NOTCH_50, BiquadBank::BANDPASS_3_45, 1000);
+    std::minstd_rand rng(3);
+    for (long i = 0; i < 1000; i++)
+    {
+        int32_t a[CHANNELS], b[CHANNELS];
+        for (int c = 0; c < CHANNELS; c++)
+            a[c] = b[c] = signal(c, i, 1000, rng);
+        split.process(a, 0, 8); // board
+        split.process(a + 8, 8, 8); // daisy
+        whole.process(b, 0, CHANNELS);
+        TEST_ASSERT_EQUAL_INT32_ARRAY(b, a, CHANNELS);
+    }
+    TEST_ASSERT_EQUAL_STRING("50Hz", BiquadBank::getName(split.getNotch()));
+    TEST_ASSERT_EQUAL_STRING("3-45Hz", BiquadBank::getName(split.getBandpass()));
+    split.setSampleRate(250);
+    TEST_ASSERT_EQUAL(BiquadBank::BANDPASS_3_45, split.getBandpass());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_matches_double_reference);
+    RUN_TEST(test_notch_and_passband);
+    RUN_TEST(test_full_scale_steps_saturate);
+    RUN_TEST(test_disabled_and_channel_offset);
+    return UNITY_END();
+}
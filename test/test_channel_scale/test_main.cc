@@ -0,0 +1,83 @@
+#include <unity.h>
+#include <math.h>
+#include "ChannelScale.h"
+
+// The double path: OpenBCI_Wifi_Definitions.h ADS_SCALE_FACTOR_VOLTS_* * raw * 1e9
+static const uint8_t gains[7] = {1, 2, 4, 6, 8, 12, 24};
+static const double scaleFactorVolts[7] = {
+    0.000000536441867, 0.000000268220934, 0.000000134110467, 0.000000089406978,
+    0.000000067055233, 0.000000044703489, 0.000000022351744};
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_scale_for_gain(void)
+{
+    TEST_ASSERT_EQUAL_INT32(ChannelScale::scaleForGain(1), ChannelScale::scaleForGain(0));
+    for (int g = 0; g < 7; g++)
+    {
+        double exact = 4.5e9 / 8388607.0 / gains[g] * (1 << CHANNEL_SCALE_SHIFT);
+        TEST_ASSERT_TRUE(fabs(ChannelScale::scaleForGain(gains[g]) - exact) <= 0.5);
+    }
+}
+
+/// @brief Every 24 bit value at every gain against the double path
+void test_exhaustive_against_double(void)
+{
+    ChannelScale scale;
+    for (int g = 0; g < 7; g++)
+        scale.setGain(g, gains[g]);
+
+    int32_t raw[7];
+    int64_t nv[7];
+    double maxErrorExact[7] = {0};
+    double maxErrorLegacy[7] = {0};
+    for (int32_t value = -8388608; value <= 8388607; value++)
+    {
+        for (int g = 0; g < 7; g++)
+            raw[g] = value;
+        scale.toNanovolts(raw, nv, 0, 7);
+        for (int g = 0; g < 7; g++)
+        {
+            double exact = 4.5e9 / 8388607.0 / gains[g] * value;
+            double legacy = scaleFactorVolts[g] * value * 1000000000; // what JSON output used to carry
+            double errorExact = fabs(nv[g] - exact);
+            double errorLegacy = fabs(nv[g] - legacy);
+            if (errorExact > maxErrorExact[g])
+                maxErrorExact[g] = errorExact;
+            if (errorLegacy > maxErrorLegacy[g])
+                maxErrorLegacy[g] = errorLegacy;
+        }
+    }
+    for (int g = 0; g < 7; g++)
+    {
+        printf("gain %2d: max error %.3f nV vs exact, %.3f nV vs ADS_SCALE_FACTOR_VOLTS (1 LSB = %.1f nV)\n",
+               gains[g], maxErrorExact[g], maxErrorLegacy[g], 4.5e9 / 8388607.0 / gains[g]);
+        // Q21 factor rounding adds at most 2^23 * 0.5 / 2^21 = 2 nV, plus 0.5 for the result
+        TEST_ASSERT_TRUE(maxErrorExact[g] <= 2.5);
+        // the 9 digit constants are themselves a few nV off at full scale
+        TEST_ASSERT_TRUE(maxErrorLegacy[g] <= 8.0);
+    }
+}
+
+void test_channel_offset(void)
+{
+    ChannelScale scale;
+    scale.setGain(9, 1);
+    scale.setGain(16, 1); // out of range, ignored
+    const int32_t raw[2] = {1000, 1000};
+    int64_t nv[2];
+    scale.toNanovolts(raw, nv, 8, 2);
+    TEST_ASSERT_EQUAL_INT64(22352, nv[0]); // gain 24
+    TEST_ASSERT_EQUAL_INT64(536442, nv[1]); // gain 1
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_scale_for_gain);
+    RUN_TEST(test_exhaustive_against_double);
+    RUN_TEST(test_channel_offset);
+    return UNITY_END();
+}
@@ -0,0 +1,245 @@
+#include <unity.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include "ClockSync.h"
+
+#define EXCHANGES 120
+#define LOOPBACK_EXCHANGES 50
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/// @brief Device and host clocks plus a network with queueing on both legs
+struct SimulatedLink
+{
+    int64_t hostEpoch;   // host time when the device clock read 0
+    double driftPpm;     // how much faster the host clock runs
+    int64_t baseDelay;   // one way, each leg
+    int64_t maxQueueing; // extra random delay per leg
+    std::minstd_rand rng;
+
+    SimulatedLink(int64_t epoch, double ppm, int64_t base, int64_t queueing)
+        : hostEpoch(epoch), driftPpm(ppm), baseDelay(base), maxQueueing(queueing), rng(7) {}
+
+    int64_t host(int64_t local) const
+    {
+        return hostEpoch + local + (int64_t)(local * driftPpm / 1e6);
+    }
+
+    int64_t leg(void)
+    {
+        // mostly short, sometimes a long queue: Wi-Fi retries, a busy AP
+        int64_t queueing = rng() % 4 == 0 ? rng() % (maxQueueing + 1) : rng() % (maxQueueing / 20 + 1);
+        return baseDelay + queueing;
+    }
+
+    /// @brief One request/response starting at device time `local`
+    bool exchange(ClockSync &sync, int64_t local)
+    {
+        uint8_t request[CLOCK_SYNC_REQUEST_SIZE];
+        uint8_t response[CLOCK_SYNC_RESPONSE_SIZE];
+        sync.makeRequest(local, request);
+        int64_t arrive = local + leg();
+        int64_t t2 = host(arrive);
+        int64_t t3 = t2 + 150; // turnaround
+        ClockSyncResponder::respond(request, sizeof(request), t2, t3, response);
+        int64_t back = arrive + 150 + leg();
+        return sync.handleResponse(response, sizeof(response), back);
+    }
+};
+
+void test_exchange_recovers_offset(void)
+{
+    ClockSync sync;
+    SimulatedLink link(1700000000000000LL, 0, 2000, 0); // symmetric, no queueing
+    TEST_ASSERT_FALSE(sync.isSynced());
+    TEST_ASSERT_EQUAL_INT64(12345, sync.toHost(12345));
+    TEST_ASSERT_TRUE(link.exchange(sync, 1000000));
+    TEST_ASSERT_TRUE(sync.isSynced());
+    TEST_ASSERT_EQUAL_INT64(4000, sync.getDelay());
+    TEST_ASSERT_EQUAL_INT64(link.host(2000000), sync.toHost(2000000));
+}
+
+void test_rejects_foreign_and_stale_responses(void)
+{
+    ClockSync sync;
+    uint8_t first[CLOCK_SYNC_REQUEST_SIZE], second[CLOCK_SYNC_REQUEST_SIZE];
+    uint8_t response[CLOCK_SYNC_RESPONSE_SIZE];
+    sync.makeRequest(1000, first);
+    sync.makeRequest(2000, second);
+
+    // the answer to the request that was given up
+    TEST_ASSERT_EQUAL(CLOCK_SYNC_RESPONSE_SIZE, ClockSyncResponder::respond(first, sizeof(first), 5000, 5001, response));
+    TEST_ASSERT_FALSE(sync.handleResponse(response, sizeof(response), 3000));
+    // truncated
+    ClockSyncResponder::respond(second, sizeof(second), 5000, 5001, response);
+    TEST_ASSERT_FALSE(sync.handleResponse(response, sizeof(response) - 1, 3000));
+    TEST_ASSERT_TRUE(sync.handleResponse(response, sizeof(response), 3000));
+    // duplicate
+    TEST_ASSERT_FALSE(sync.handleResponse(response, sizeof(response), 3000));
+    TEST_ASSERT_EQUAL_UINT32(1, sync.getExchanges());
+
+    // the responder only answers requests
+    TEST_ASSERT_EQUAL(0, ClockSyncResponder::respond(response, CLOCK_SYNC_REQUEST_SIZE, 0, 0, response));
+    const uint8_t data[CLOCK_SYNC_REQUEST_SIZE] = {0xB0};
+    TEST_ASSERT_EQUAL(0, ClockSyncResponder::respond(data, sizeof(data), 0, 0, response));
+}
+
+/// @brief Raw offsets scatter by milliseconds of queueing, the filtered fit
+///        must stay well inside 100 us and follow a 40 ppm crystal error
+void test_filter_and_drift_under_queueing(void)
+{
+    ClockSync sync;
+    SimulatedLink link(-5000000, 40, 1500, 30000);
+    int64_t worstRaw = 0;
+    for (int i = 0; i < EXCHANGES; i++)
+    {
+        int64_t local = 1000000LL * (i + 1); // one exchange a second
+        TEST_ASSERT_TRUE(link.exchange(sync, local));
+    }
+    // the error of a single unfiltered exchange is half its queueing asymmetry
+    for (int i = 0; i < 100; i++)
+    {
+        int64_t up = link.leg(), down = link.leg();
+        int64_t error = (up - down) / 2;
+        if (error < 0)
+            error = -error;
+        if (error > worstRaw)
+            worstRaw = error;
+    }
+
+    int64_t worstNow = 0, worstAhead = 0;
+    const int64_t end = 1000000LL * EXCHANGES;
+    for (int64_t local = end - 10000000; local <= end; local += 100000)
+    {
+        int64_t error = sync.toHost(local) - link.host(local);
+        if (error < 0)
+            error = -error;
+        if (error > worstNow)
+            worstNow = error;
+    }
+    for (int64_t local = end; local <= end + 2000000; local += 100000) // until the next exchanges land
+    {
+        int64_t error = sync.toHost(local) - link.host(local);
+        if (error < 0)
+            error = -error;
+        if (error > worstAhead)
+            worstAhead = error;
+    }
+    printf("clock sync under queueing: single exchange up to %lld us off, fit %lld us over the last 10 s, "
+           "%lld us 2 s ahead, drift %.1f ppm (true 40), filtered delay %lld us\n",
+           (long long)worstRaw, (long long)worstNow, (long long)worstAhead, sync.getDriftPpm(),
+           (long long)sync.getDelay());
+    TEST_ASSERT_TRUE(worstNow < 100);
+    TEST_ASSERT_TRUE(worstAhead < 100);
+    TEST_ASSERT_FLOAT_WITHIN(5, 40, sync.getDriftPpm());
+    TEST_ASSERT_EQUAL_UINT32(0, sync.getSteps());
+}
+
+/// @brief The host clock is set by a second: follow it instead of averaging
+void test_host_clock_step(void)
+{
+    ClockSync sync;
+    SimulatedLink link(0, 0, 1000, 0);
+    for (int i = 1; i <= 20; i++)
+        link.exchange(sync, 1000000LL * i);
+    link.hostEpoch += 1000000;
+    for (int i = 21; i <= 30; i++)
+        link.exchange(sync, 1000000LL * i);
+    TEST_ASSERT_EQUAL_UINT32(1, sync.getSteps());
+    TEST_ASSERT_INT64_WITHIN(10, link.host(31000000), sync.toHost(31000000));
+}
+
+static int64_t steadyMicros(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t wallMicros(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/// @brief Real UDP sockets on 127.0.0.1: the responder stamps with the wall
+///        clock, the "device" with the monotonic clock, a different epoch
+void test_loopback_udp(void)
+{
+    int host = socket(AF_INET, SOCK_DGRAM, 0);
+    int device = socket(AF_INET, SOCK_DGRAM, 0);
+    TEST_ASSERT_TRUE(host >= 0 && device >= 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    TEST_ASSERT_EQUAL(0, bind(host, (struct sockaddr *)&address, sizeof(address)));
+    socklen_t addressLength = sizeof(address);
+    getsockname(host, (struct sockaddr *)&address, &addressLength);
+    struct timeval timeout = {0, 200000};
+    setsockopt(host, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(device, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // the reference responder: stamp on arrival, answer the sender at once
+    std::atomic<bool> running(true);
+    std::thread responder([&]() {
+        uint8_t in[64], out[CLOCK_SYNC_RESPONSE_SIZE];
+        while (running)
+        {
+            struct sockaddr_in from;
+            socklen_t fromLength = sizeof(from);
+            ssize_t length = recvfrom(host, in, sizeof(in), 0, (struct sockaddr *)&from, &fromLength);
+            int64_t received = wallMicros();
+            if (length <= 0)
+                continue;
+            size_t reply = ClockSyncResponder::respond(in, length, received, wallMicros(), out);
+            if (reply > 0)
+                sendto(host, out, reply, 0, (struct sockaddr *)&from, fromLength);
+        }
+    });
+
+    ClockSync sync;
+    int answered = 0;
+    for (int i = 0; i < LOOPBACK_EXCHANGES; i++)
+    {
+        uint8_t request[CLOCK_SYNC_REQUEST_SIZE], response[64];
+        sync.makeRequest(steadyMicros(), request);
+        sendto(device, request, sizeof(request), 0, (struct sockaddr *)&address, sizeof(address));
+        ssize_t length = recv(device, response, sizeof(response), 0);
+        int64_t arrived = steadyMicros();
+        if (length > 0 && sync.handleResponse(response, length, arrived))
+            answered++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    running = false;
+    responder.join();
+    close(host);
+    close(device);
+
+    int64_t before = wallMicros();
+    int64_t mapped = sync.toHost(steadyMicros());
+    int64_t after = wallMicros();
+    printf("loopback: %d/%d exchanges answered, min round trip %lld us, mapped time %lld us from the wall clock\n",
+           answered, LOOPBACK_EXCHANGES, (long long)sync.getDelay(), (long long)(mapped - (before + after) / 2));
+    TEST_ASSERT_TRUE(answered >= LOOPBACK_EXCHANGES / 2);
+    TEST_ASSERT_TRUE(mapped >= before - 1000 && mapped <= after + 1000);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_exchange_recovers_offset);
+    RUN_TEST(test_rejects_foreign_and_stale_responses);
+    RUN_TEST(test_filter_and_drift_under_queueing);
+    RUN_TEST(test_host_clock_step);
+    RUN_TEST(test_loopback_udp);
+    return UNITY_END();
+}
@@ -0,0 +1,276 @@
+#include <unity.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "ControlTask.h"
+#include "SpscRing.h"
+
+#define SAMPLE_PERIOD_US 2000 // 500 SPS
+#define SAMPLES 1000
+#define PAGE_PIECES 400       // appends per response, like the root page String
+#define RESPONSE_SEND_MS 10   // writing a response to a slow client
+#define CONNECT_MS 5          // tcpSetup() connecting to its subscriber
+#define COMMANDS 4            // passthrough commands per request
+#define SETTLE_MS 2           // setBoardMode() waiting for the board
+#define REQUEST_WAITS 3       // connect, settle and send
+#define LATE_US 5000          // a sample that waited longer missed its cadence
+#define PASS_TIMEOUT_MS 1000  // loop() is stuck if it made no pass in this long
+
+typedef std::chrono::steady_clock Clock;
+
+static long long nowMicros(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+}
+
+/// @brief What loop() and the handlers share: stream settings a POST changes
+struct State
+{
+    uint32_t latency;
+    uint32_t latencyCopy; // always equal to latency outside the lock
+    uint32_t requests;
+    uint32_t commands;
+};
+
+static State state;
+static ControlTask *control;
+static SpscRing<long long, 256> samples; // DRDY time of each sample, from the acquisition task
+static std::atomic<uint32_t> passes;      // of streamLoop() under the lock
+static std::atomic<bool> streaming;
+static std::atomic<uint32_t> waits;       // of the requests, see requestWait()
+static std::atomic<uint32_t> stalls;      // waits loop() made no whole pass in
+
+/// @brief One wait of a request: for a peer, the board or a slow client.
+///        Samples keep their cadence if loop() goes on meanwhile, a wait
+///        it made no whole pass in is a stall. On the control task it
+///        waits until loop() did, up to PASS_TIMEOUT_MS, so how busy the
+///        host is decides how long that takes, not whether it happens.
+/// @param ms        {int} - How long the wait takes at least
+/// @param handshake {bool} - Wait for loop(), which it cannot be
+static void requestWait(int ms, bool handshake)
+{
+    const uint32_t seen = passes;
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(PASS_TIMEOUT_MS);
+    while (handshake && streaming && passes < seen + 2 && Clock::now() < deadline)
+        std::this_thread::yield();
+    waits++;
+    stalls += streaming && passes < seen + 2 ? 1 : 0;
+}
+
+/// @brief A wait a handler makes under the lock, without it on the control task
+static void unlockedWait(int ms, bool locked)
+{
+    if (locked)
+    {
+        ControlTask::Unlocked unlocked(*control);
+        requestWait(ms, true);
+    }
+    else
+    {
+        requestWait(ms, false);
+    }
+}
+
+/// @brief One request of a client polling as fast as it can, the way
+///        serveLocked() runs a route: the handler holds the lock but for
+///        its waits, connecting to a peer, between and during passthrough
+///        commands, and builds the response; sending it comes after the
+///        lock is let go. Inline, as `server.handleClient()` in loop()
+///        used to, it holds nothing and waits all the same.
+static void handleRequest(bool locked)
+{
+    if (locked)
+        control->lock();
+    state.latency++;
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+    state.latencyCopy = state.latency;
+    state.requests++;
+    unlockedWait(CONNECT_MS, locked);
+    for (int i = 0; i < COMMANDS; i++)
+    {
+        if (locked && i > 0)
+            control->yield();
+        state.commands++;
+    }
+    unlockedWait(SETTLE_MS, locked);
+    const uint32_t latency = state.latency;
+    std::string page;
+    for (int i = 0; i < PAGE_PIECES; i++)
+        page += "<p style=\"margin: auto;width: 80%;\">latency " + std::to_string(latency) + "</p>";
+    if (locked)
+        control->unlock();
+
+    requestWait(RESPONSE_SEND_MS, locked);
+}
+
+static void httpPoll(void *context)
+{
+    (void)context;
+    handleRequest(true);
+}
+
+/// @brief Samples at a fixed rate, the way the acquisition task queues frames
+static void drdySource(void)
+{
+    const long long start = nowMicros();
+    for (int n = 0; n < SAMPLES; n++)
+    {
+        std::this_thread::sleep_until(Clock::time_point(std::chrono::microseconds(start + (long long)n * SAMPLE_PERIOD_US)));
+        const long long drdyTime = nowMicros();
+        while (!samples.push(drdyTime))
+            std::this_thread::yield(); // a stalled loop() shows in the delays, not as lost samples
+    }
+}
+
+/// @brief loop(): drain and "send" samples under the lock, then serve HTTP
+///        inline if asked to, as `server.handleClient()` used to. Never
+///        sleeps, like the Arduino loop task. Counts the
+///        samples that waited more than LATE_US before they went out; the
+///        longest wait alone would measure the host scheduler.
+static void streamLoop(bool inlineHttp, long long &maxDelay, int &late, int &received)
+{
+    maxDelay = 0;
+    late = 0;
+    received = 0;
+    streaming = true;
+    std::thread drdy(drdySource);
+    const Clock::time_point deadline = Clock::now() + std::chrono::seconds(10);
+    while (received < SAMPLES && Clock::now() < deadline)
+    {
+        {
+            ControlTask::Guard guard(*control);
+            TEST_ASSERT_EQUAL_UINT32(state.latency, state.latencyCopy);
+            long long drdyTime;
+            while (samples.pop(drdyTime))
+            {
+                const long long delay = nowMicros() - drdyTime;
+                maxDelay = delay > maxDelay ? delay : maxDelay;
+                late += delay > LATE_US ? 1 : 0;
+                received++;
+            }
+            passes++;
+        }
+        if (inlineHttp)
+            handleRequest(false);
+        control->handOver();
+    }
+    streaming = false;
+    drdy.join();
+}
+
+void setUp(void)
+{
+    state = State();
+    control = new ControlTask();
+    passes = 0;
+    streaming = false;
+    waits = 0;
+    stalls = 0;
+    long long drop;
+    while (samples.pop(drop))
+    {
+    }
+}
+
+void tearDown(void)
+{
+    delete control;
+}
+
+/// @brief Requests served inline hold every sample for as long as a response
+///        takes, every wait of theirs stalls loop()
+void test_inline_http_delays_samples(void)
+{
+    long long maxDelay;
+    int late;
+    int received;
+    streamLoop(true, maxDelay, late, received);
+    printf("inline HTTP: %d of %d samples late, longest delay %lld us, %u requests, %u of %u waits stalled\n",
+           late, received, maxDelay, state.requests, (uint32_t)stalls, (uint32_t)waits);
+    TEST_ASSERT_EQUAL(SAMPLES, received);
+    TEST_ASSERT_TRUE(maxDelay >= RESPONSE_SEND_MS * 1000);
+    TEST_ASSERT_TRUE(late > SAMPLES / 4);
+    TEST_ASSERT_EQUAL_UINT32(state.requests * REQUEST_WAITS, waits);
+    TEST_ASSERT_EQUAL_UINT32(waits, stalls);
+}
+
+/// @brief With the routes on their own task the samples keep their cadence
+///        however hard the server is polled: no wait of a request stalls
+///        loop(), where inline every one did. loop() never sees a request
+///        half way through changing the state either. How late the samples
+///        are besides is up to the host, that is printed only.
+void test_control_task_keeps_sample_cadence(void)
+{
+    TEST_ASSERT_TRUE(control->begin(httpPoll, NULL));
+    long long maxDelay;
+    int late;
+    int received;
+    streamLoop(false, maxDelay, late, received);
+    control->end();
+    printf("control task: %d of %d samples late, longest delay %lld us, %u requests, %u of %u waits stalled\n",
+           late, received, maxDelay, state.requests, (uint32_t)stalls, (uint32_t)waits);
+    TEST_ASSERT_EQUAL(SAMPLES, received);
+    TEST_ASSERT_TRUE(state.requests > 0);
+    TEST_ASSERT_EQUAL_UINT32(state.requests * REQUEST_WAITS, waits);
+    TEST_ASSERT_EQUAL_UINT32(0, stalls);
+    TEST_ASSERT_EQUAL_UINT32(state.requests * COMMANDS, state.commands);
+}
+
+/// @brief sleep() and yield() let a lock() blocked on them in before they return
+void test_sleep_and_yield_let_go_of_the_lock(void)
+{
+    std::atomic<int> asked(0);
+    std::atomic<int> entered(0);
+    control->lock();
+    std::thread other([&asked, &entered]()
+                      {
+        for (int i = 1; i <= 2; i++)
+        {
+            while (asked < i)
+                std::this_thread::yield();
+            control->lock();
+            entered++;
+            control->unlock();
+        } });
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(PASS_TIMEOUT_MS);
+    asked = 1;
+    while (entered < 1 && Clock::now() < deadline)
+        control->sleep(1);
+    const int slept = entered;
+    asked = 2;
+    while (entered < 2 && Clock::now() < deadline)
+        control->yield();
+    const int yielded = entered;
+    control->unlock();
+    other.join();
+    TEST_ASSERT_EQUAL(1, slept);
+    TEST_ASSERT_EQUAL(2, yielded);
+}
+
+/// @brief end() waits for the poll in progress, nothing runs after it
+void test_end_stops_polling(void)
+{
+    TEST_ASSERT_TRUE(control->begin(httpPoll, NULL));
+    TEST_ASSERT_TRUE(control->begin(httpPoll, NULL)); // already running
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    control->end();
+    TEST_ASSERT_FALSE(control->isRunning());
+    const uint32_t polls = control->getPolls();
+    const uint32_t requests = state.requests;
+    TEST_ASSERT_TRUE(polls > 0);
+    TEST_ASSERT_EQUAL_UINT32(polls, requests);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    TEST_ASSERT_EQUAL_UINT32(requests, state.requests);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_inline_http_delays_samples);
+    RUN_TEST(test_control_task_keeps_sample_cadence);
+    RUN_TEST(test_sleep_and_yield_let_go_of_the_lock);
+    RUN_TEST(test_end_stops_polling);
+    return UNITY_END();
+}
@@ -0,0 +1,132 @@
+#include <unity.h>
+#include <math.h>
+#include <random>
+#include "Decimator.h"
+
+#define CHANNELS 16
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/// @brief Amplitude of a sine at `frequency` (times the output rate) after
+///        decimating by `factor`, from the RMS of 500 settled outputs
+static double gainAt(uint8_t factor, double frequency)
+{
+    Decimator decimator;
+    decimator.setFactor(factor);
+    const double amplitude = 4000000;
+    double power = 0;
+    int outputs = 0;
+    for (long n = 0; outputs < 600; n++)
+    {
+        int32_t data[1] = {(int32_t)lround(amplitude * sin(2 * M_PI * frequency * n / factor + 0.3))};
+        if (decimator.process(data, 1) && ++outputs > 100)
+            power += (double)data[0] * data[0];
+    }
+    return sqrt(2 * power / 500) / amplitude;
+}
+
+void test_factors(void)
+{
+    Decimator decimator;
+    TEST_ASSERT_EQUAL(1, decimator.getFactor());
+    TEST_ASSERT_FALSE(decimator.setFactor(0));
+    TEST_ASSERT_FALSE(decimator.setFactor(3));
+    TEST_ASSERT_FALSE(decimator.setFactor(128));
+    TEST_ASSERT_EQUAL(1, decimator.getFactor());
+    for (int factor = 1; factor <= DECIMATOR_MAX_FACTOR; factor *= 2)
+        TEST_ASSERT_TRUE(decimator.setFactor(factor));
+
+    // factor 1 hands every sample straight back
+    decimator.setFactor(1);
+    int32_t data[2] = {-8388608, 77};
+    TEST_ASSERT_TRUE(decimator.process(data, 2));
+    TEST_ASSERT_EQUAL_INT32(-8388608, data[0]);
+    TEST_ASSERT_EQUAL_INT32(77, data[1]);
+    TEST_ASSERT_EQUAL_UINT32(0, decimator.getDelay());
+}
+
+/// @brief One output per `factor` inputs; a ramp comes out exactly, `getDelay()` inputs late
+void test_rate_and_delay(void)
+{
+    for (int factor = 2; factor <= DECIMATOR_MAX_FACTOR; factor *= 2)
+    {
+        Decimator decimator;
+        decimator.setFactor(factor);
+        int outputs = 0;
+        for (long n = 0; n < 400L * factor; n++)
+        {
+            int32_t data[CHANNELS];
+            for (int c = 0; c < CHANNELS; c++)
+                data[c] = (int32_t)(n * 3 - 600000 + c * 1000);
+            if (!decimator.process(data, CHANNELS))
+                continue;
+            TEST_ASSERT_EQUAL(0, (n + 1) % factor);
+            if (++outputs > 100)
+            {
+                long at = n - (long)decimator.getDelay();
+                for (int c = 0; c < CHANNELS; c++)
+                    TEST_ASSERT_INT32_WITHIN(1, (int32_t)(at * 3 - 600000 + c * 1000), data[c]);
+            }
+        }
+        TEST_ASSERT_EQUAL(400, outputs);
+    }
+}
+
+/// @brief The compensator flattens the CIC droop over the passband and
+///        anything that would fold into it is cut; the old two sample mean
+///        barely touched either
+void test_passband_and_aliasing(void)
+{
+    const uint8_t factors[3] = {2, 8, 64};
+    for (int f = 0; f < 3; f++)
+    {
+        double worstPass = 0, worstAlias = 0;
+        for (double frequency = 0.02; frequency <= DECIMATOR_PASSBAND; frequency += 0.02)
+        {
+            double error = fabs(gainAt(factors[f], frequency) - 1);
+            if (error > worstPass)
+                worstPass = error;
+        }
+        // 1 - f aliases to f: everything from the stopband edge to 1 - 0.02
+        for (double frequency = DECIMATOR_STOPBAND; frequency <= 0.98; frequency += 0.02)
+        {
+            double gain = gainAt(factors[f], frequency);
+            if (gain > worstAlias)
+                worstAlias = gain;
+        }
+        printf("factor %2d: passband within %.3f%%, aliases into the passband at %.1f dB\n", factors[f],
+               worstPass * 100, 20 * log10(worstAlias));
+        TEST_ASSERT_TRUE(worstPass < 0.002);
+        TEST_ASSERT_TRUE(worstAlias < 0.0003); // -70 dB
+    }
+    // the two sample mean, for comparison: |cos(pi f / 2)| at f = 0.7 of the output rate
+    printf("two sample mean: aliases at %.1f dB\n", 20 * log10(fabs(cos(M_PI * 0.7 / 2))));
+}
+
+/// @brief Full scale in does not wrap the integrators or the compensator
+void test_full_scale(void)
+{
+    Decimator decimator;
+    decimator.setFactor(64);
+    for (long n = 0; n < 64L * 200; n++)
+    {
+        int32_t data[2] = {(n / 500) % 2 ? 8388607 : -8388608, -8388608};
+        if (decimator.process(data, 2) && n > 64L * 100)
+        {
+            TEST_ASSERT_TRUE(data[0] >= -8388608 && data[0] <= 8388607);
+            TEST_ASSERT_EQUAL_INT32(-8388608, data[1]);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_factors);
+    RUN_TEST(test_rate_and_delay);
+    RUN_TEST(test_passband_and_aliasing);
+    RUN_TEST(test_full_scale);
+    return UNITY_END();
+}
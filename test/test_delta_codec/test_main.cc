@@ -0,0 +1,219 @@
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <random>
+#include <vector>
+#include "DeltaCodec.h"
+
+#define SCALE_UV_PER_COUNT 0.02235 // 4.5 V / 24 / 2^23, gain 24
+#define RAW_BYTES_PER_ADS_SAMPLE 33
+
+/// @brief Synthetic scalp EEG, there is no recording in the repo to replay:
+///        electrode offset, 1/f-ish background, 10 Hz alpha, 50 Hz mains, white noise
+class SyntheticEEG
+{
+public:
+    SyntheticEEG(uint8_t numChannels, double sampleRate, uint32_t seed)
+        : _numChannels(numChannels), _sampleRate(sampleRate), _n(0), _rng(seed), _white(0.0, 1.0)
+    {
+        for (uint8_t c = 0; c < numChannels; c++)
+        {
+            _offset[c] = (double)(_rng() % 20000) - 10000.0; // +-10 mV in uV
+            _drift[c] = 0.0;
+            _phase[c] = (double)(_rng() % 628) / 100.0;
+        }
+    }
+
+    void next(int32_t *channels)
+    {
+        const double t = _n++ / _sampleRate;
+        for (uint8_t c = 0; c < _numChannels; c++)
+        {
+            // Leaky random walk gives the low frequency background
+            _drift[c] = 0.999 * _drift[c] + 0.5 * _white(_rng) * sqrt(250.0 / _sampleRate);
+            double uv = _offset[c] + 10.0 * _drift[c] + 20.0 * sin(2 * M_PI * 10.0 * t + _phase[c]) + 8.0 * sin(2 * M_PI * 50.0 * t) + 1.5 * _white(_rng);
+            channels[c] = (int32_t)lround(uv / SCALE_UV_PER_COUNT);
+        }
+    }
+
+private:
+    uint8_t _numChannels;
+    double _sampleRate;
+    uint32_t _n;
+    std::minstd_rand _rng;
+    std::normal_distribution<double> _white;
+    double _offset[DELTA_MAX_CHANNELS];
+    double _drift[DELTA_MAX_CHANNELS];
+    double _phase[DELTA_MAX_CHANNELS];
+};
+
+static void decodeAll(const std::vector<uint8_t> &stream, std::vector<int32_t> &out, uint8_t &numChannels)
+{
+    DeltaDecoder decoder;
+    size_t pos = 0;
+    int32_t channels[DELTA_MAX_CHANNELS];
+    uint8_t sample;
+    bool valid;
+    while (pos < stream.size())
+    {
+        size_t used = decoder.decode(&stream[pos], stream.size() - pos, channels, numChannels, sample, valid);
+        TEST_ASSERT_TRUE(used > 0);
+        TEST_ASSERT_TRUE(valid);
+        out.insert(out.end(), channels, channels + numChannels);
+        pos += used;
+    }
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_round_trip_is_lossless(void)
+{
+    DeltaEncoder encoder;
+    SyntheticEEG eeg(16, 1000, 1);
+    std::vector<int32_t> in;
+    std::vector<uint8_t> stream;
+    uint8_t record[DELTA_MAX_RECORD];
+    for (int n = 0; n < 5000; n++)
+    {
+        int32_t channels[16];
+        eeg.next(channels);
+        in.insert(in.end(), channels, channels + 16);
+        size_t len = encoder.encode(channels, 16, (uint8_t)n, record);
+        TEST_ASSERT_TRUE(len <= DELTA_MAX_RECORD);
+        stream.insert(stream.end(), record, record + len);
+    }
+    std::vector<int32_t> out;
+    uint8_t numChannels = 0;
+    decodeAll(stream, out, numChannels);
+
+    TEST_ASSERT_EQUAL(16, numChannels);
+    TEST_ASSERT_TRUE(in == out);
+}
+
+void test_full_scale_swings(void)
+{
+    // Rail to rail steps need the widest varint and must still round trip
+    DeltaEncoder encoder;
+    const int32_t values[][2] = {{8388607, -8388608}, {-8388608, 8388607}, {0, 0}, {8388607, 8388607}, {-1, 1}};
+    std::vector<uint8_t> stream;
+    std::vector<int32_t> in;
+    uint8_t record[DELTA_MAX_RECORD];
+    for (int n = 0; n < 5; n++)
+    {
+        size_t len = encoder.encode(values[n], 2, (uint8_t)n, record);
+        TEST_ASSERT_TRUE(len <= 3 + 2 * DELTA_MAX_VARINT);
+        stream.insert(stream.end(), record, record + len);
+        in.insert(in.end(), values[n], values[n] + 2);
+    }
+    std::vector<int32_t> out;
+    uint8_t numChannels = 0;
+    decodeAll(stream, out, numChannels);
+    TEST_ASSERT_TRUE(in == out);
+}
+
+void test_keyframe_interval(void)
+{
+    DeltaEncoder encoder;
+    encoder.setKeyframeInterval(4);
+    int32_t channels[8] = {0};
+    uint8_t record[DELTA_MAX_RECORD];
+    for (int n = 0; n < 12; n++)
+    {
+        encoder.encode(channels, 8, (uint8_t)n, record);
+        TEST_ASSERT_EQUAL_HEX8(n % 4 == 0 ? DELTA_TYPE_KEYFRAME : DELTA_TYPE_DELTA, record[0]);
+    }
+    // A change in channel count forces one too
+    encoder.encode(channels, 16, 12, record);
+    TEST_ASSERT_EQUAL_HEX8(DELTA_TYPE_KEYFRAME, record[0]);
+}
+
+void test_lost_record_resyncs_on_keyframe(void)
+{
+    DeltaEncoder encoder;
+    encoder.setKeyframeInterval(10);
+    SyntheticEEG eeg(8, 250, 2);
+    std::vector<std::vector<uint8_t> > records;
+    std::vector<std::vector<int32_t> > samples;
+    for (int n = 0; n < 30; n++)
+    {
+        int32_t channels[8];
+        uint8_t record[DELTA_MAX_RECORD];
+        eeg.next(channels);
+        size_t len = encoder.encode(channels, 8, (uint8_t)n, record);
+        records.push_back(std::vector<uint8_t>(record, record + len));
+        samples.push_back(std::vector<int32_t>(channels, channels + 8));
+    }
+
+    DeltaDecoder decoder;
+    int32_t channels[DELTA_MAX_CHANNELS];
+    uint8_t numChannels, sample;
+    bool valid;
+    for (int n = 0; n < 30; n++)
+    {
+        if (n == 5)
+            continue; // lost
+        size_t used = decoder.decode(&records[n][0], records[n].size(), channels, numChannels, sample, valid);
+        TEST_ASSERT_EQUAL((int)records[n].size(), (int)used);
+        // Nothing valid between the loss and the keyframe at 10
+        TEST_ASSERT_EQUAL(n < 5 || n >= 10, valid);
+        if (valid)
+        {
+            TEST_ASSERT_EQUAL(n, sample);
+            TEST_ASSERT_EQUAL_INT32_ARRAY(&samples[n][0], channels, 8);
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(4, decoder.getSkipped());
+}
+
+void test_incomplete_record(void)
+{
+    DeltaEncoder encoder;
+    int32_t channels[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    uint8_t record[DELTA_MAX_RECORD];
+    size_t len = encoder.encode(channels, 8, 0, record);
+
+    DeltaDecoder decoder;
+    int32_t out[DELTA_MAX_CHANNELS];
+    uint8_t numChannels, sample;
+    bool valid;
+    TEST_ASSERT_EQUAL(0, (int)decoder.decode(record, len - 1, out, numChannels, sample, valid));
+    TEST_ASSERT_FALSE(valid);
+    TEST_ASSERT_EQUAL((int)len, (int)decoder.decode(record, len, out, numChannels, sample, valid));
+    TEST_ASSERT_TRUE(valid);
+}
+
+/// @brief Against the raw format, one 33 byte packet per ADS per sample, a
+///        daisy board sends well under two thirds of the bytes at any rate
+void test_compression_ratio(void)
+{
+    const double rates[] = {250, 1000, 2000};
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    {
+        const int samples = (int)(rates[r] * 10);
+        SyntheticEEG eeg(16, rates[r], 3);
+        DeltaEncoder encoder;
+        int32_t channels[16];
+        uint8_t record[DELTA_MAX_RECORD];
+        size_t bytes = 0;
+        for (int n = 0; n < samples; n++)
+        {
+            eeg.next(channels);
+            bytes += encoder.encode(channels, 16, (uint8_t)n, record);
+        }
+        TEST_ASSERT_TRUE(2.0 * RAW_BYTES_PER_ADS_SAMPLE * samples / bytes > 1.5);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_is_lossless);
+    RUN_TEST(test_full_scale_swings);
+    RUN_TEST(test_keyframe_interval);
+    RUN_TEST(test_lost_record_resyncs_on_keyframe);
+    RUN_TEST(test_incomplete_record);
+    RUN_TEST(test_compression_ratio);
+    return UNITY_END();
+}
@@ -0,0 +1,206 @@
+#include <unity.h>
+#include <string.h>
+#include <random>
+#include "FanoutRing.h"
+
+#define STRESS_ITEMS 1000000
+
+typedef FanoutRing<uint32_t, 8, 3> Ring;
+
+static void produce(Ring &ring, uint32_t value)
+{
+    uint32_t count = 1;
+    uint32_t *slot = ring.claim(count);
+    TEST_ASSERT_EQUAL_UINT32(1, count);
+    *slot = value;
+    ring.commit(1);
+}
+
+/// @brief Everything the reader can get without wrapping
+static const uint32_t *peekAll(Ring &ring, int8_t id, uint32_t &count)
+{
+    count = ring.capacity();
+    return ring.peek(id, count);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/// @brief Each reader has its own cursor, reading on one leaves the others alone
+void test_independent_cursors(void)
+{
+    Ring ring;
+    int8_t a = ring.open(Ring::POLICY_DROP_OLDEST);
+    int8_t b = ring.open(Ring::POLICY_DROP_OLDEST);
+    TEST_ASSERT_TRUE(a >= 0 && b >= 0 && a != b);
+    for (uint32_t i = 0; i < 5; i++)
+        produce(ring, 100 + i);
+
+    uint32_t count;
+    const uint32_t *items = peekAll(ring, a, count);
+    TEST_ASSERT_EQUAL_UINT32(5, count);
+    TEST_ASSERT_EQUAL_UINT32(100, items[0]);
+    ring.consume(a, count);
+    TEST_ASSERT_EQUAL_UINT32(0, ring.size(a));
+    TEST_ASSERT_EQUAL_UINT32(5, ring.size(b));
+
+    items = peekAll(ring, b, count);
+    TEST_ASSERT_EQUAL_UINT32(5, count);
+    for (uint32_t i = 0; i < count; i++)
+        TEST_ASSERT_EQUAL_UINT32(100 + i, items[i]);
+}
+
+/// @brief A lagging recorder keeps the newest `limit` items, in order
+void test_drop_oldest(void)
+{
+    Ring ring;
+    int8_t id = ring.open(Ring::POLICY_DROP_OLDEST, 4);
+    for (uint32_t i = 0; i < 10; i++)
+        produce(ring, i);
+
+    uint32_t count;
+    const uint32_t *items = peekAll(ring, id, count);
+    TEST_ASSERT_EQUAL_UINT32(6, ring.getDropped(id));
+    TEST_ASSERT_EQUAL_UINT32(2, count); // 6 and 7, then the array wraps
+    TEST_ASSERT_EQUAL_UINT32(6, items[0]);
+    ring.consume(id, count);
+    items = peekAll(ring, id, count);
+    TEST_ASSERT_EQUAL_UINT32(2, count);
+    TEST_ASSERT_EQUAL_UINT32(8, items[0]);
+    TEST_ASSERT_EQUAL_UINT32(9, items[1]);
+}
+
+/// @brief A lagging viewer skips its backlog and resumes at the newest item
+void test_latest(void)
+{
+    Ring ring;
+    int8_t id = ring.open(Ring::POLICY_LATEST, 4);
+    for (uint32_t i = 0; i < 4; i++)
+        produce(ring, i);
+    uint32_t count;
+    peekAll(ring, id, count);
+    TEST_ASSERT_EQUAL_UINT32(4, count); // at its limit, nothing lost yet
+    TEST_ASSERT_EQUAL_UINT32(0, ring.getDropped(id));
+
+    produce(ring, 4);
+    peekAll(ring, id, count);
+    TEST_ASSERT_EQUAL_UINT32(0, count);
+    TEST_ASSERT_EQUAL_UINT32(5, ring.getDropped(id));
+
+    produce(ring, 5);
+    const uint32_t *items = peekAll(ring, id, count);
+    TEST_ASSERT_EQUAL_UINT32(1, count);
+    TEST_ASSERT_EQUAL_UINT32(5, items[0]);
+}
+
+/// @brief The producer never waits, and a limit is never more than N - 1
+void test_producer_never_blocks(void)
+{
+    Ring ring;
+    int8_t id = ring.open(Ring::POLICY_DROP_OLDEST, 100);
+    for (uint32_t i = 0; i < 1000; i++)
+        produce(ring, i);
+    TEST_ASSERT_EQUAL_UINT32(1000, ring.size(id));
+    TEST_ASSERT_EQUAL_UINT32(1000 - 7, ring.catchUp(id));
+    TEST_ASSERT_EQUAL_UINT32(7, ring.size(id));
+
+    uint32_t count = 8;
+    ring.claim(count);
+    TEST_ASSERT_TRUE(count <= 7);
+}
+
+/// @brief The table fills up, a closed slot is reused and starts at the head
+void test_open_close(void)
+{
+    Ring ring;
+    TEST_ASSERT_EQUAL_UINT8(0, ring.getReaders());
+    int8_t ids[3];
+    for (int i = 0; i < 3; i++)
+        ids[i] = ring.open(Ring::POLICY_DROP_OLDEST);
+    TEST_ASSERT_EQUAL_UINT8(3, ring.getReaders());
+    TEST_ASSERT_EQUAL_INT8(-1, ring.open(Ring::POLICY_LATEST));
+
+    produce(ring, 1);
+    ring.close(ids[1]);
+    TEST_ASSERT_FALSE(ring.isOpen(ids[1]));
+    TEST_ASSERT_EQUAL_INT8(ids[1], ring.open(Ring::POLICY_LATEST));
+    TEST_ASSERT_EQUAL_UINT32(0, ring.size(ids[1]));
+    TEST_ASSERT_EQUAL_UINT32(1, ring.size(ids[0]));
+
+    ring.clear();
+    TEST_ASSERT_EQUAL_UINT32(0, ring.size(ids[0]));
+    TEST_ASSERT_EQUAL_UINT32(0, ring.size(ids[2]));
+}
+
+/// @brief A fast, a slow and a stalled reader under random load: each sees an
+///        increasing sequence, its gaps add up to its drop count, and the fast
+///        one loses nothing however far behind the others are
+void test_slow_reader_isolated(void)
+{
+    FanoutRing<uint32_t, 256, 3> ring;
+    const int8_t fast = ring.open(FanoutRing<uint32_t, 256, 3>::POLICY_DROP_OLDEST);
+    const int8_t slow = ring.open(FanoutRing<uint32_t, 256, 3>::POLICY_DROP_OLDEST, 64);
+    const int8_t stalled = ring.open(FanoutRing<uint32_t, 256, 3>::POLICY_LATEST);
+    const int8_t readers[3] = {fast, slow, stalled};
+    uint32_t next[3] = {0, 0, 0};
+    uint32_t gaps[3] = {0, 0, 0};
+    uint32_t received[3] = {0, 0, 0};
+    std::mt19937 random(5);
+
+    uint32_t produced = 0;
+    while (produced < STRESS_ITEMS)
+    {
+        uint32_t burst = random() % 8;
+        for (uint32_t i = 0; i < burst; i++)
+        {
+            uint32_t count = 1;
+            *ring.claim(count) = produced++;
+            ring.commit(1);
+        }
+        for (int r = 0; r < 3; r++)
+        {
+            // the fast reader keeps up, the slow one reads a little now and
+            // then, the stalled one wakes up rarely; all drain at the end
+            uint32_t budget = r == 0 ? 16 : r == 1 ? (random() % 4 == 0 ? 8 : 0) : (random() % 5000 == 0 ? 1000 : 0);
+            budget = produced < STRESS_ITEMS ? budget : ring.capacity();
+            while (budget > 0)
+            {
+                uint32_t count = budget;
+                const uint32_t *items = ring.peek(readers[r], count);
+                if (count == 0)
+                    break;
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    TEST_ASSERT_TRUE(items[i] >= next[r]);
+                    gaps[r] += items[i] - next[r];
+                    next[r] = items[i] + 1;
+                }
+                received[r] += count;
+                ring.consume(readers[r], count);
+                budget -= count;
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, ring.getDropped(fast));
+    TEST_ASSERT_TRUE(ring.getDropped(slow) > 0);
+    TEST_ASSERT_TRUE(ring.getDropped(stalled) > 0);
+    for (int r = 0; r < 3; r++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(0, ring.size(readers[r]));
+        TEST_ASSERT_EQUAL_UINT32(ring.getDropped(readers[r]), gaps[r] + produced - next[r]);
+        TEST_ASSERT_EQUAL_UINT32(produced, received[r] + ring.getDropped(readers[r]));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_independent_cursors);
+    RUN_TEST(test_drop_oldest);
+    RUN_TEST(test_latest);
+    RUN_TEST(test_producer_never_blocks);
+    RUN_TEST(test_open_close);
+    RUN_TEST(test_slow_reader_isolated);
+    return UNITY_END();
+}
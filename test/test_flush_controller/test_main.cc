@@ -0,0 +1,188 @@
+#include <unity.h>
+#include <deque>
+#include "FlushController.h"
+
+#define MIN_INTERVAL 1000
+#define MAX_INTERVAL 100000
+#define MAX_BATCH 42
+#define FIXED_LATENCY 10000 // DEFAULT_LATENCY
+#define RATE 1000           // packets per second, 16 channels at 500 Hz
+#define LOOP_US 200         // one loop() without a send
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/// @brief Feed `periods` update periods at `rate` packets per second, each
+///        flush taking `sendMicros`, with `backlog` left after each
+static void run(FlushController &controller, uint32_t &now, int periods, uint32_t rate,
+                uint32_t sendMicros, uint32_t backlog, int8_t rssi)
+{
+    for (int i = 0; i < periods; i++)
+    {
+        for (int s = 0; s < 8; s++)
+            controller.addSend(sendMicros);
+        controller.addPackets(rate * FLUSH_CONTROL_PERIOD_US / 1000000);
+        now += FLUSH_CONTROL_PERIOD_US;
+        controller.update(now, backlog, rssi);
+    }
+}
+
+/// @brief A single task loop() on a link where a send costs `overhead` plus
+///        `perPacket` microseconds. Flushes the way streamSendRaw() does:
+///        everything pending, up to MAX_BATCH, once a batch is full or the
+///        oldest waited an interval. `fixed` 0 lets the controller decide.
+struct Simulation
+{
+    double meanLatency; // microseconds from arrival to the end of its send
+    double sendShare;   // of loop() time spent writing
+    uint32_t maxBacklog;
+};
+
+static Simulation simulate(uint32_t fixed, uint32_t overhead, uint32_t perPacket, int8_t rssi, uint32_t seconds)
+{
+    FlushController controller;
+    controller.begin(MIN_INTERVAL, MAX_INTERVAL, MAX_BATCH);
+    std::deque<uint64_t> pending;
+    uint64_t now = 0;
+    uint64_t nextArrival = 0;
+    uint64_t lastSend = 0;
+    uint64_t sending = 0;
+    double latencySum = 0;
+    uint64_t sent = 0;
+    Simulation result = {0, 0, 0};
+    const uint64_t end = (uint64_t)seconds * 1000000;
+    while (now < end)
+    {
+        for (; nextArrival <= now; nextArrival += 1000000 / RATE)
+        {
+            pending.push_back(nextArrival);
+            controller.addPackets(1);
+        }
+        const uint32_t interval = fixed ? fixed : controller.getInterval();
+        const uint32_t batch = fixed ? MAX_BATCH : controller.getBatch();
+        if (!pending.empty() && (pending.size() >= batch || now - lastSend > interval))
+        {
+            const uint32_t count = pending.size() < MAX_BATCH ? pending.size() : MAX_BATCH;
+            const uint32_t cost = overhead + perPacket * count;
+            now += cost;
+            sending += cost;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                latencySum += now - pending.front();
+                pending.pop_front();
+            }
+            sent += count;
+            lastSend = now;
+            controller.addSend(cost);
+        }
+        else
+        {
+            now += LOOP_US;
+        }
+        result.maxBacklog = pending.size() > result.maxBacklog ? pending.size() : result.maxBacklog;
+        if (controller.isUpdateDue(now))
+            controller.update(now, pending.size(), rssi);
+    }
+    result.meanLatency = latencySum / sent;
+    result.sendShare = (double)sending / now;
+    return result;
+}
+
+/// @brief A fast link flushes at the shortest interval, a packet at a time
+void test_fast_link_shortest_interval(void)
+{
+    FlushController controller;
+    controller.begin(MIN_INTERVAL, MAX_INTERVAL, MAX_BATCH);
+    uint32_t now = 0;
+    controller.update(now, 0, 0);
+    run(controller, now, 20, RATE, 100, 0, -50);
+    TEST_ASSERT_EQUAL_UINT32(MIN_INTERVAL, controller.getInterval());
+    TEST_ASSERT_EQUAL_UINT16(1, controller.getBatch());
+    TEST_ASSERT_EQUAL_UINT32(RATE, controller.getRate());
+    TEST_ASSERT_EQUAL_UINT32(100, controller.getSendTime());
+}
+
+/// @brief Slow sends stretch the interval so writing keeps to its share,
+///        and the batch follows the interval
+void test_send_time_sets_interval(void)
+{
+    FlushController controller;
+    controller.begin(MIN_INTERVAL, MAX_INTERVAL, MAX_BATCH);
+    uint32_t now = 0;
+    controller.update(now, 0, 0);
+    run(controller, now, 20, RATE, 5000, 0, 0);
+    TEST_ASSERT_EQUAL_UINT32(5000 * FLUSH_SEND_SHARE, controller.getInterval());
+    TEST_ASSERT_EQUAL_UINT16(20, controller.getBatch());
+}
+
+/// @brief A weak signal doubles the shortest interval, a poor one quadruples it
+void test_rssi_stretches_interval(void)
+{
+    FlushController controller;
+    controller.begin(MIN_INTERVAL, MAX_INTERVAL, MAX_BATCH);
+    uint32_t now = 0;
+    controller.update(now, 0, 0);
+    run(controller, now, 20, RATE, 1000, 0, FLUSH_RSSI_WEAK);
+    TEST_ASSERT_EQUAL_UINT32(2 * 1000 * FLUSH_SEND_SHARE, controller.getInterval());
+    run(controller, now, 20, RATE, 1000, 0, FLUSH_RSSI_POOR);
+    TEST_ASSERT_EQUAL_UINT32(4 * 1000 * FLUSH_SEND_SHARE, controller.getInterval());
+    run(controller, now, 20, RATE, 1000, 0, -40);
+    TEST_ASSERT_EQUAL_UINT32(1000 * FLUSH_SEND_SHARE, controller.getInterval());
+}
+
+/// @brief A backlog doubles the interval up to its maximum, the batch stops
+///        at its maximum; once drained it falls back to the shortest
+void test_backlog_backs_off_and_recovers(void)
+{
+    FlushController controller;
+    controller.begin(MIN_INTERVAL, MAX_INTERVAL, MAX_BATCH);
+    uint32_t now = 0;
+    controller.update(now, 0, 0);
+    run(controller, now, 1, RATE, 100, 0, 0);
+    run(controller, now, 1, RATE, 100, 100, 0);
+    TEST_ASSERT_EQUAL_UINT32(2 * MIN_INTERVAL, controller.getInterval());
+    run(controller, now, 10, RATE, 100, 100, 0);
+    TEST_ASSERT_EQUAL_UINT32(MAX_INTERVAL, controller.getInterval());
+    TEST_ASSERT_EQUAL_UINT16(MAX_BATCH, controller.getBatch());
+    TEST_ASSERT_EQUAL_UINT32(100, controller.getBacklog());
+    run(controller, now, 20, RATE, 100, 0, 0);
+    TEST_ASSERT_EQUAL_UINT32(MIN_INTERVAL, controller.getInterval());
+}
+
+/// @brief Where DEFAULT_LATENCY is ten times too long, packets wait for the
+///        link only, and the ring stays at a few packets
+void test_fast_link_beats_fixed_latency(void)
+{
+    Simulation fixed = simulate(FIXED_LATENCY, 150, 2, -55, 10);
+    Simulation adaptive = simulate(0, 150, 2, -55, 10);
+    printf("fast link, mean latency: fixed %.0f us, adaptive %.0f us\n", fixed.meanLatency, adaptive.meanLatency);
+    TEST_ASSERT_TRUE(adaptive.meanLatency * 3 < fixed.meanLatency);
+    TEST_ASSERT_TRUE(adaptive.maxBacklog <= 4);
+}
+
+/// @brief Where each send is expensive, a short fixed latency spends most of
+///        loop() writing; the controller keeps writing to its share without
+///        the ring growing
+void test_slow_link_keeps_loop_free(void)
+{
+    Simulation fixed = simulate(MIN_INTERVAL, 4000, 10, -70, 10);
+    Simulation adaptive = simulate(0, 4000, 10, -70, 10);
+    printf("slow link, send share: fixed %.2f, adaptive %.2f, mean latency %.0f / %.0f us\n",
+           fixed.sendShare, adaptive.sendShare, fixed.meanLatency, adaptive.meanLatency);
+    TEST_ASSERT_TRUE(fixed.sendShare > 0.5);
+    TEST_ASSERT_TRUE(adaptive.sendShare < 0.3);
+    TEST_ASSERT_TRUE(adaptive.maxBacklog <= MAX_BATCH);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fast_link_shortest_interval);
+    RUN_TEST(test_send_time_sets_interval);
+    RUN_TEST(test_rssi_stretches_interval);
+    RUN_TEST(test_backlog_backs_off_and_recovers);
+    RUN_TEST(test_fast_link_beats_fixed_latency);
+    RUN_TEST(test_slow_link_keeps_loop_free);
+    return UNITY_END();
+}
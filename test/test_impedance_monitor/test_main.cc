@@ -0,0 +1,166 @@
+#include <unity.h>
+#include <math.h>
+#include <random>
+#include "ImpedanceMonitor.h"
+#include "ImpedancePacket.h"
+
+#define CHANNELS 16
+#define TONE_HZ 31.25
+#define DRIVE_AMPS 6e-9
+#define NANOVOLTS_PER_COUNT (4.5e9 / 24 / 8388607) // gain 24
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/// @brief The ADS's sinc^3 response at `hertz` for a data rate of `sampleRate`
+static double sinc3(double hertz, double sampleRate)
+{
+    const double decimation = 1024000 / sampleRate;
+    const double x = M_PI * hertz / 1024000;
+    return pow(sin(decimation * x) / (decimation * sin(x)), 3);
+}
+
+/// @brief What a channel reads with the +-I lead-off square wave through
+///        `ohms` plus the series resistor, on top of an electrode offset,
+///        mains and noise: the square's odd harmonics below Nyquist, each
+///        through the ADS filter
+static int32_t electrode(std::minstd_rand &rng, int channel, double ohms, long n, double sampleRate)
+{
+    const double t = n / sampleRate;
+    const double volts = DRIVE_AMPS * (ohms + IMPEDANCE_SERIES_OHMS);
+    double v = 0;
+    for (int k = 1; k * TONE_HZ < sampleRate / 2; k += 2)
+        v += 4 / M_PI * volts / k * sinc3(k * TONE_HZ, sampleRate) * sin(2 * M_PI * k * TONE_HZ * t + channel);
+    double code = v * 1e9 / NANOVOLTS_PER_COUNT;
+    code += 2000000 - channel * 300000;                                   // electrode offset
+    code += 3000 * sin(2 * M_PI * 50 * t + 0.3 * channel);                // mains
+    code += 1500 * sin(2 * M_PI * 10 * t) + (double)(rng() % 601) - 300; // alpha and noise
+    return (int32_t)lround(code);
+}
+
+void test_configure(void)
+{
+    ImpedanceMonitor monitor;
+    TEST_ASSERT_FALSE(monitor.isEnabled());
+    TEST_ASSERT_TRUE(monitor.configure(TONE_HZ, 250, DRIVE_AMPS));
+    TEST_ASSERT_EQUAL_UINT32(120, monitor.getBlockSamples()); // 15 periods of 8 samples
+    TEST_ASSERT_FALSE(monitor.isEnabled());
+    monitor.setChannels(0x0003);
+    TEST_ASSERT_TRUE(monitor.isEnabled());
+    TEST_ASSERT_TRUE(monitor.configure(TONE_HZ, 16000, DRIVE_AMPS));
+    TEST_ASSERT_EQUAL_UINT32(7680, monitor.getBlockSamples());
+    TEST_ASSERT_TRUE(monitor.configure(7.8125f, 250, DRIVE_AMPS));
+    TEST_ASSERT_EQUAL_UINT32(96, monitor.getBlockSamples()); // 3 periods of 32
+    TEST_ASSERT_FALSE(monitor.configure(0, 250, DRIVE_AMPS));     // DC lead-off
+    TEST_ASSERT_FALSE(monitor.configure(62.5f, 250, DRIVE_AMPS)); // fDR / 4
+    TEST_ASSERT_FALSE(monitor.isEnabled());
+}
+
+/// @brief Every channel at its own impedance, at several data rates
+void test_ohms_accuracy(void)
+{
+    const uint32_t rates[3] = {250, 1000, 16000};
+    for (int r = 0; r < 3; r++)
+    {
+        ImpedanceMonitor monitor;
+        TEST_ASSERT_TRUE(monitor.configure(TONE_HZ, rates[r], DRIVE_AMPS));
+        monitor.setChannels(0xFFFF);
+        std::minstd_rand rng(r + 1);
+        double ohms[CHANNELS];
+        for (int c = 0; c < CHANNELS; c++)
+            ohms[c] = 1000 * pow(1.5, c); // 1 k to 440 k
+        int blocks = 0;
+        double worst = 0;
+        for (long n = 0; blocks < 3; n++)
+        {
+            int32_t data[CHANNELS];
+            for (int c = 0; c < CHANNELS; c++)
+                data[c] = electrode(rng, c, ohms[c], n, rates[r]);
+            if (!monitor.add(data, CHANNELS, 0, 0))
+                continue;
+            blocks++;
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                TEST_ASSERT_EQUAL_HEX8(IMPEDANCE_FLAG_MEASURED, monitor.getFlags(c));
+                // noise sets a floor of a few hundred ohms at 250 SPS, 6 nA
+                double error = fabs(monitor.getOhms(c, NANOVOLTS_PER_COUNT) - ohms[c]) / (0.01 * ohms[c] + 500);
+                if (error > worst)
+                    worst = error;
+            }
+        }
+        printf("%u SPS, %u sample blocks: worst impedance error %.2f of 1%% + 500 ohm\n", (unsigned)rates[r],
+               (unsigned)monitor.getBlockSamples(), worst);
+        TEST_ASSERT_TRUE(worst < 1);
+    }
+}
+
+/// @brief Comparator bits seen in any sample of a block end up in its flags,
+///        undriven channels report flags only
+void test_lead_off_flags(void)
+{
+    ImpedanceMonitor monitor;
+    monitor.configure(TONE_HZ, 250, DRIVE_AMPS);
+    monitor.setChannels(0x00FF);
+    int32_t data[CHANNELS] = {0};
+    for (uint32_t n = 0; n < monitor.getBlockSamples() - 1; n++)
+        TEST_ASSERT_FALSE(monitor.add(data, CHANNELS, n == 5 ? 0x0101 : 0, n == 9 ? 0x8002 : 0));
+    TEST_ASSERT_TRUE(monitor.add(data, CHANNELS, 0, 0));
+    TEST_ASSERT_EQUAL_HEX8(IMPEDANCE_FLAG_MEASURED | IMPEDANCE_FLAG_P_OFF, monitor.getFlags(0));
+    TEST_ASSERT_EQUAL_HEX8(IMPEDANCE_FLAG_MEASURED | IMPEDANCE_FLAG_N_OFF, monitor.getFlags(1));
+    TEST_ASSERT_EQUAL_HEX8(IMPEDANCE_FLAG_MEASURED, monitor.getFlags(2));
+    TEST_ASSERT_EQUAL_HEX8(IMPEDANCE_FLAG_P_OFF, monitor.getFlags(8));
+    TEST_ASSERT_EQUAL_HEX8(IMPEDANCE_FLAG_N_OFF, monitor.getFlags(15));
+    TEST_ASSERT_TRUE(monitor.getOhms(8, NANOVOLTS_PER_COUNT) == 0);
+
+    // the next block starts clean
+    for (uint32_t n = 0; n < monitor.getBlockSamples() - 1; n++)
+        TEST_ASSERT_FALSE(monitor.add(data, CHANNELS, 0, 0));
+    TEST_ASSERT_TRUE(monitor.add(data, CHANNELS, 0, 0));
+    TEST_ASSERT_EQUAL_HEX8(IMPEDANCE_FLAG_MEASURED, monitor.getFlags(0));
+    TEST_ASSERT_EQUAL_HEX8(0, monitor.getFlags(15));
+}
+
+void test_packet_round_trip(void)
+{
+    float ohms[CHANNELS];
+    uint8_t flags[CHANNELS];
+    for (int c = 0; c < CHANNELS; c++)
+    {
+        ohms[c] = 1234.0f * (c + 1) * (c + 1);
+        flags[c] = c & 0x07;
+    }
+    ohms[3] = -1;   // not measured
+    ohms[4] = 1e8f; // off the scale
+    uint8_t packet[IMPEDANCE_PACKET_MAX];
+    size_t length = ImpedancePacket::encode(0xBEEF, ohms, flags, CHANNELS, packet);
+    TEST_ASSERT_EQUAL(IMPEDANCE_PACKET_MAX, length);
+    TEST_ASSERT_EQUAL_HEX8(IMPEDANCE_PACKET_TYPE, packet[0]);
+
+    float decoded[CHANNELS];
+    uint8_t decodedFlags[CHANNELS];
+    uint8_t numChannels;
+    uint16_t blockNumber;
+    TEST_ASSERT_EQUAL(0, ImpedancePacket::decode(packet, length - 1, decoded, decodedFlags, numChannels, blockNumber));
+    TEST_ASSERT_EQUAL(length, ImpedancePacket::decode(packet, length, decoded, decodedFlags, numChannels, blockNumber));
+    TEST_ASSERT_EQUAL(CHANNELS, numChannels);
+    TEST_ASSERT_EQUAL_UINT16(0xBEEF, blockNumber);
+    for (int c = 0; c < CHANNELS; c++)
+    {
+        TEST_ASSERT_EQUAL_HEX8(flags[c], decodedFlags[c]);
+        if (c == 3 || c == 4)
+            TEST_ASSERT_TRUE(decoded[c] == -1);
+        else
+            TEST_ASSERT_FLOAT_WITHIN(50, ohms[c], decoded[c]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_configure);
+    RUN_TEST(test_ohms_accuracy);
+    RUN_TEST(test_lead_off_flags);
+    RUN_TEST(test_packet_round_trip);
+    return UNITY_END();
+}
@@ -0,0 +1,113 @@
+#include <unity.h>
+#include <string.h>
+#include <stdio.h>
+#include <string>
+#include "JsonChunk.h"
+
+#define CHUNK_SIZE 1440
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static std::string text(const uint8_t *out, size_t length)
+{
+    return std::string((const char *)out, length);
+}
+
+void test_single_sample(void)
+{
+    uint8_t out[CHUNK_SIZE];
+    JsonChunkWriter writer;
+    const int64_t nv[3] = {0, -4500000000LL, 123};
+    writer.begin(out, sizeof(out));
+    TEST_ASSERT_TRUE(writer.addSample(1234567ULL, 9, nv, 3));
+    size_t length = writer.finish(42, false);
+    TEST_ASSERT_EQUAL_STRING("{\"chunk\":[{\"timestamp\":1234567,\"data\":[0,-4500000000,123]}],\"count\":42}",
+                             text(out, length).c_str());
+}
+
+void test_fields_and_delimiter(void)
+{
+    uint8_t out[CHUNK_SIZE];
+    JsonChunkWriter writer;
+    const int64_t nv[2] = {1, 2};
+    writer.setFields(false, true);
+    writer.begin(out, sizeof(out));
+    writer.addSample(5, 255, nv, 2);
+    writer.addSample(6, 0, nv, 2);
+    size_t length = writer.finish(4294967295UL, true);
+    TEST_ASSERT_EQUAL_STRING("{\"chunk\":[{\"sampleNumber\":255,\"data\":[1,2]},{\"sampleNumber\":0,\"data\":[1,2]}],\"count\":4294967295}\r\n",
+                             text(out, length).c_str());
+    TEST_ASSERT_EQUAL_UINT8(2, writer.getSamples());
+}
+
+/// @brief Extreme values must format exactly and the worst case must never overflow
+void test_worst_case_fits(void)
+{
+    uint8_t out[CHUNK_SIZE + 1];
+    JsonChunkWriter writer;
+    int64_t nv[JSON_CHUNK_MAX_CHANNELS];
+    for (int i = 0; i < JSON_CHUNK_MAX_CHANNELS; i++)
+        nv[i] = i % 2 ? INT64_MIN + 1 : INT64_MAX;
+    writer.setFields(true, true);
+    out[CHUNK_SIZE] = 0x5A; // guard byte
+    writer.begin(out, CHUNK_SIZE);
+    int samples = 0;
+    while (writer.addSample(UINT64_MAX, 255, nv, JSON_CHUNK_MAX_CHANNELS))
+        samples++;
+    size_t length = writer.finish(UINT32_MAX, true);
+    TEST_ASSERT_TRUE(samples > 0);
+    TEST_ASSERT_TRUE(length <= CHUNK_SIZE);
+    TEST_ASSERT_EQUAL_HEX8(0x5A, out[CHUNK_SIZE]);
+    std::string s = text(out, length);
+    TEST_ASSERT_TRUE(s.find("9223372036854775807") != std::string::npos);
+    TEST_ASSERT_TRUE(s.find("-9223372036854775807") != std::string::npos);
+    TEST_ASSERT_TRUE(s.find("18446744073709551615") != std::string::npos);
+}
+
+/// @brief A new chunk after finish() starts clean
+void test_begin_resets(void)
+{
+    uint8_t out[CHUNK_SIZE];
+    JsonChunkWriter writer;
+    const int64_t nv[1] = {-1};
+    writer.begin(out, sizeof(out));
+    writer.addSample(1, 1, nv, 1);
+    writer.finish(0, false);
+    writer.begin(out, sizeof(out));
+    TEST_ASSERT_EQUAL_UINT8(0, writer.getSamples());
+    writer.addSample(2, 2, nv, 1);
+    size_t length = writer.finish(1, false);
+    TEST_ASSERT_EQUAL_STRING("{\"chunk\":[{\"timestamp\":2,\"data\":[-1]}],\"count\":1}", text(out, length).c_str());
+}
+
+/// @brief The marker lands on the next sample only, even if it had to wait for a new chunk
+void test_config_marker(void)
+{
+    uint8_t out[CHUNK_SIZE];
+    JsonChunkWriter writer;
+    const int64_t nv[1] = {5};
+    writer.begin(out, JsonChunkWriter::getMaxSampleSize(1) + JSON_CHUNK_CLOSE_SIZE + 20);
+    writer.addSample(1, 1, nv, 1);
+    writer.markConfig(7);
+    TEST_ASSERT_FALSE(writer.addSample(2, 2, nv, 1)); // full
+    writer.finish(0, false);
+    writer.begin(out, sizeof(out));
+    writer.addSample(2, 2, nv, 1);
+    writer.addSample(3, 3, nv, 1);
+    size_t length = writer.finish(1, false);
+    TEST_ASSERT_EQUAL_STRING("{\"chunk\":[{\"timestamp\":2,\"config\":7,\"data\":[5]},{\"timestamp\":3,\"data\":[5]}],\"count\":1}",
+                             text(out, length).c_str());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_single_sample);
+    RUN_TEST(test_fields_and_delimiter);
+    RUN_TEST(test_worst_case_fits);
+    RUN_TEST(test_begin_resets);
+    RUN_TEST(test_config_marker);
+    return UNITY_END();
+}
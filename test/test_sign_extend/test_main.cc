@@ -0,0 +1,102 @@
+#include <unity.h>
+#include <random>
+#include <vector>
+#include "SignExtend24.h"
+
+#define VALUES (1 << 24)
+#define CHUNK 4096 // values per pass, a multiple of 4 so every path sees full groups
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/// @brief The old WifiServer::int24To32: sign bit test and mask
+static int32_t reference(uint32_t raw)
+{
+    return (raw & 0x800000) ? (int32_t)(raw | 0xFF000000) : (int32_t)(raw & 0x00FFFFFF);
+}
+
+static void pack(uint32_t raw, uint8_t *out)
+{
+    out[0] = (uint8_t)(raw >> 16);
+    out[1] = (uint8_t)(raw >> 8);
+    out[2] = (uint8_t)raw;
+}
+
+typedef void (*Kernel)(const uint8_t *, int32_t *, size_t);
+
+/// @brief All 2^24 inputs through `kernel`, starting `offset` bytes into the
+///        buffer so the word loads are misaligned like a frame's channels are
+static void exhaustive(Kernel kernel, size_t offset)
+{
+    static uint8_t in[3 * CHUNK + 16];
+    static int32_t out[CHUNK];
+    uint32_t mismatches = 0;
+    for (uint32_t first = 0; first < VALUES; first += CHUNK)
+    {
+        for (uint32_t i = 0; i < CHUNK; i++)
+            pack(first + i, in + offset + 3 * i);
+        kernel(in + offset, out, CHUNK);
+        for (uint32_t i = 0; i < CHUNK; i++)
+            mismatches += out[i] != reference(first + i);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, mismatches);
+}
+
+void test_exhaustive_bytes(void)
+{
+    exhaustive(SignExtend24::convertBytes<int32_t>, 3);
+}
+
+void test_exhaustive_words(void)
+{
+    for (size_t offset = 0; offset < 4; offset++)
+        exhaustive(SignExtend24::convertWords<int32_t>, offset);
+}
+
+void test_exhaustive_default(void)
+{
+    exhaustive(SignExtend24::convert<int32_t>, 3);
+}
+
+/// @brief Counts that leave a tail after the groups of four, and the frame
+///        call straight out of a status word prefixed ADS frame
+void test_tails_and_frame(void)
+{
+    std::minstd_rand rng(5);
+    uint8_t in[3 * 11 + 3];
+    uint32_t raw[11];
+    for (int i = 0; i < 11; i++)
+    {
+        raw[i] = rng() & 0xFFFFFF;
+        pack(raw[i], in + 3 + 3 * i);
+    }
+    for (size_t count = 0; count <= 11; count++)
+    {
+        int32_t words[12], bytes[12];
+        words[count] = bytes[count] = 0x5A5A5A5A; // must stay untouched
+        SignExtend24::convertWords(in + 3, words, count);
+        SignExtend24::convertBytes(in + 3, bytes, count);
+        for (size_t i = 0; i < count; i++)
+        {
+            TEST_ASSERT_EQUAL_INT32(reference(raw[i]), words[i]);
+            TEST_ASSERT_EQUAL_INT32(reference(raw[i]), bytes[i]);
+        }
+        TEST_ASSERT_EQUAL_INT32(0x5A5A5A5A, words[count]);
+        TEST_ASSERT_EQUAL_INT32(0x5A5A5A5A, bytes[count]);
+    }
+    int data[SIGN_EXTEND_24_FRAME];
+    SignExtend24::frame(in + 3, data);
+    for (int i = 0; i < SIGN_EXTEND_24_FRAME; i++)
+        TEST_ASSERT_EQUAL_INT32(reference(raw[i]), data[i]);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_exhaustive_bytes);
+    RUN_TEST(test_exhaustive_words);
+    RUN_TEST(test_exhaustive_default);
+    RUN_TEST(test_tails_and_frame);
+    return UNITY_END();
+}
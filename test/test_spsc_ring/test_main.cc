@@ -0,0 +1,176 @@
+#include <unity.h>
+#include <string.h>
+#include <thread>
+#include <random>
+#include "SpscRing.h"
+
+#define STRESS_ITEMS 2000000
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_push_pop(void)
+{
+    SpscRing<uint32_t, 4> ring;
+    uint32_t value;
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_FALSE(ring.pop(value));
+    for (uint32_t i = 0; i < 4; i++)
+        TEST_ASSERT_TRUE(ring.push(i));
+    TEST_ASSERT_TRUE(ring.full());
+    TEST_ASSERT_FALSE(ring.push(99));
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_TRUE(ring.pop(value));
+        TEST_ASSERT_EQUAL_UINT32(i, value);
+    }
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+/// @brief Runs stop at the end of the array and never exceed what was asked for
+void test_claim_and_peek_runs(void)
+{
+    SpscRing<uint32_t, 8> ring;
+    uint32_t count = 5;
+    uint32_t *slots = ring.claim(count);
+    TEST_ASSERT_EQUAL_UINT32(5, count);
+    for (uint32_t i = 0; i < count; i++)
+        slots[i] = i;
+    ring.commit(count);
+
+    count = 3;
+    const uint32_t *items = ring.peek(count);
+    TEST_ASSERT_EQUAL_UINT32(3, count);
+    TEST_ASSERT_EQUAL_UINT32(0, items[0]);
+    ring.consume(count);
+
+    count = 8;
+    slots = ring.claim(count);
+    TEST_ASSERT_EQUAL_UINT32(3, count); // slots 5..7, then the array wraps
+    ring.commit(count);
+    count = 8;
+    ring.claim(count);
+    TEST_ASSERT_EQUAL_UINT32(3, count); // slots 0..2 were freed by consume(3)
+
+    count = 8;
+    items = ring.peek(count);
+    TEST_ASSERT_EQUAL_UINT32(5, count);
+    TEST_ASSERT_EQUAL_UINT32(3, items[0]);
+}
+
+/// @brief Many laps around a small ring, indices keep running and are masked
+void test_many_laps(void)
+{
+    SpscRing<uint32_t, 4> ring;
+    uint32_t value;
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        TEST_ASSERT_TRUE(ring.push(i));
+        TEST_ASSERT_TRUE(ring.pop(value));
+        TEST_ASSERT_EQUAL_UINT32(i, value);
+    }
+    ring.clear();
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+/// @brief Producer and consumer on their own threads, both using random batch
+///        sizes. Every value must come out once, in order.
+void test_threaded_stress(void)
+{
+    static SpscRing<uint32_t, 256> ring;
+    uint32_t producerFull = 0;
+
+    std::thread producer([&]()
+                         {
+        std::minstd_rand rng(1);
+        uint32_t next = 0;
+        while (next < STRESS_ITEMS)
+        {
+            uint32_t count = 1 + rng() % 64;
+            if (count > STRESS_ITEMS - next)
+                count = STRESS_ITEMS - next;
+            uint32_t *slots = ring.claim(count);
+            if (count == 0)
+            {
+                producerFull++;
+                std::this_thread::yield();
+                continue;
+            }
+            for (uint32_t i = 0; i < count; i++)
+                slots[i] = next++;
+            ring.commit(count);
+        } });
+
+    std::minstd_rand rng(2);
+    uint32_t expected = 0;
+    uint32_t errors = 0;
+    while (expected < STRESS_ITEMS)
+    {
+        uint32_t count = 1 + rng() % 64;
+        const uint32_t *items = ring.peek(count);
+        if (count == 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (items[i] != expected++)
+                errors++;
+        }
+        ring.consume(count);
+    }
+    producer.join();
+
+    printf("stress: %u items, producer saw full %u times\n", STRESS_ITEMS, producerFull);
+    TEST_ASSERT_EQUAL_UINT32(0, errors);
+    TEST_ASSERT_EQUAL_UINT32(STRESS_ITEMS, expected);
+}
+
+/// @brief Frame sized items through push()/pop() the way ADS1299 queues them
+void test_threaded_push_pop(void)
+{
+    struct Item
+    {
+        uint32_t sequence;
+        uint8_t payload[60];
+    };
+    static SpscRing<Item, 64> ring;
+    const uint32_t total = 200000;
+
+    std::thread producer([&]()
+                         {
+        Item item;
+        for (uint32_t i = 0; i < total; i++)
+        {
+            item.sequence = i;
+            memset(item.payload, (uint8_t)i, sizeof(item.payload));
+            while (!ring.push(item))
+                std::this_thread::yield();
+        } });
+
+    Item item;
+    uint32_t errors = 0;
+    for (uint32_t i = 0; i < total; i++)
+    {
+        while (!ring.pop(item))
+            std::this_thread::yield();
+        if (item.sequence != i || item.payload[0] != (uint8_t)i || item.payload[59] != (uint8_t)i)
+            errors++;
+    }
+    producer.join();
+    TEST_ASSERT_EQUAL_UINT32(0, errors);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_push_pop);
+    RUN_TEST(test_claim_and_peek_runs);
+    RUN_TEST(test_many_laps);
+    RUN_TEST(test_threaded_stress);
+    RUN_TEST(test_threaded_push_pop);
+    return UNITY_END();
+}
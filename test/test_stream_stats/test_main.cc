@@ -0,0 +1,99 @@
+#include <unity.h>
+#include <thread>
+#include "StreamStats.h"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_totals_accumulate(void)
+{
+    StreamStats stats;
+    stats.add(StreamStats::COUNTER_OVERRUN);
+    stats.add(StreamStats::COUNTER_OVERRUN, 4);
+    stats.add(StreamStats::COUNTER_SEND_FAILURE);
+
+    TEST_ASSERT_EQUAL_UINT32(5, stats.getTotal(StreamStats::COUNTER_OVERRUN));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.getTotal(StreamStats::COUNTER_SEND_FAILURE));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.getTotal(StreamStats::COUNTER_DRDY_MISSED));
+}
+
+void test_rate_is_zero_until_window_closes(void)
+{
+    StreamStats stats;
+    stats.reset(1000);
+    stats.add(StreamStats::COUNTER_SPI_LATE, 10);
+    stats.tick(1999);
+
+    TEST_ASSERT_EQUAL_UINT32(0, stats.getRate(StreamStats::COUNTER_SPI_LATE));
+}
+
+void test_rate_per_window(void)
+{
+    StreamStats stats;
+    stats.reset(0);
+    stats.add(StreamStats::COUNTER_DRDY_MISSED, 7);
+    stats.tick(1000);
+    TEST_ASSERT_EQUAL_UINT32(7, stats.getRate(StreamStats::COUNTER_DRDY_MISSED));
+
+    // Nothing new in the next second
+    stats.tick(2000);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.getRate(StreamStats::COUNTER_DRDY_MISSED));
+    TEST_ASSERT_EQUAL_UINT32(7, stats.getTotal(StreamStats::COUNTER_DRDY_MISSED));
+}
+
+void test_late_tick_averages_over_window(void)
+{
+    StreamStats stats;
+    stats.reset(0);
+    stats.add(StreamStats::COUNTER_OVERRUN, 100);
+    stats.tick(4000);
+
+    TEST_ASSERT_EQUAL_UINT32(25, stats.getRate(StreamStats::COUNTER_OVERRUN));
+}
+
+void test_millis_rollover(void)
+{
+    StreamStats stats;
+    stats.reset(0xFFFFFF00UL);
+    stats.add(StreamStats::COUNTER_SEND_FAILURE, 3);
+    stats.tick(0x000002E8UL); // 1000 ms later
+
+    TEST_ASSERT_EQUAL_UINT32(3, stats.getRate(StreamStats::COUNTER_SEND_FAILURE));
+}
+
+void test_concurrent_adds_are_not_lost(void)
+{
+    StreamStats stats;
+    const int perThread = 100000;
+    std::thread other([&stats, perThread]()
+                      {
+        for (int i = 0; i < perThread; i++)
+            stats.add(StreamStats::COUNTER_OVERRUN); });
+    for (int i = 0; i < perThread; i++)
+        stats.add(StreamStats::COUNTER_OVERRUN);
+    other.join();
+
+    TEST_ASSERT_EQUAL_UINT32(2 * perThread, stats.getTotal(StreamStats::COUNTER_OVERRUN));
+}
+
+void test_names(void)
+{
+    TEST_ASSERT_EQUAL_STRING("overrun", StreamStats::getName(StreamStats::COUNTER_OVERRUN));
+    TEST_ASSERT_EQUAL_STRING("drdy_missed", StreamStats::getName(StreamStats::COUNTER_DRDY_MISSED));
+    TEST_ASSERT_EQUAL_STRING("spi_late", StreamStats::getName(StreamStats::COUNTER_SPI_LATE));
+    TEST_ASSERT_EQUAL_STRING("send_failure", StreamStats::getName(StreamStats::COUNTER_SEND_FAILURE));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_totals_accumulate);
+    RUN_TEST(test_rate_is_zero_until_window_closes);
+    RUN_TEST(test_rate_per_window);
+    RUN_TEST(test_late_tick_averages_over_window);
+    RUN_TEST(test_millis_rollover);
+    RUN_TEST(test_concurrent_adds_are_not_lost);
+    RUN_TEST(test_names);
+    return UNITY_END();
+}
@@ -0,0 +1,282 @@
+#include <unity.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <vector>
+#include "TcpSender.h"
+
+#define PACKET_SIZE 33
+#define SOCKET_BUFFER 4608 // the smallest the host allows, a congested Wi-Fi link holds about as little
+
+static int writer;
+static int reader;
+static TcpSender *sender;
+
+/// @brief A raw packet carrying `sequence`, every byte checkable on its own
+static void makePacket(uint32_t sequence, uint8_t *packet)
+{
+    packet[0] = 0xA0;
+    memcpy(packet + 1, &sequence, 4);
+    for (int i = 5; i < PACKET_SIZE - 1; i++)
+        packet[i] = (uint8_t)(sequence * 31 + i);
+    packet[PACKET_SIZE - 1] = 0xC0;
+}
+
+/// @brief Write packets first..first+count-1 in one call
+static size_t writePackets(uint32_t first, uint32_t count)
+{
+    std::vector<uint8_t> data(count * PACKET_SIZE);
+    for (uint32_t i = 0; i < count; i++)
+        makePacket(first + i, &data[i * PACKET_SIZE]);
+    return sender->write(data.data(), data.size(), PACKET_SIZE);
+}
+
+/// @brief Read everything that arrives until the sender has nothing left,
+///        and check that it is whole packets only
+static void drain(std::vector<uint32_t> &sequences)
+{
+    std::vector<uint8_t> bytes;
+    uint8_t chunk[4096];
+    int idle = 0;
+    while (idle < 3)
+    {
+        sender->flush();
+        ssize_t n = recv(reader, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n > 0)
+        {
+            bytes.insert(bytes.end(), chunk, chunk + n);
+            idle = 0;
+        }
+        else if (sender->getQueued() == 0)
+        {
+            idle++;
+            usleep(1000);
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, bytes.size() % PACKET_SIZE);
+    sequences.clear();
+    for (size_t at = 0; at < bytes.size(); at += PACKET_SIZE)
+    {
+        uint32_t sequence;
+        memcpy(&sequence, &bytes[at + 1], 4);
+        uint8_t expected[PACKET_SIZE];
+        makePacket(sequence, expected);
+        TEST_ASSERT_EQUAL_MEMORY(expected, &bytes[at], PACKET_SIZE);
+        sequences.push_back(sequence);
+    }
+}
+
+/// @brief Gaps in an increasing sequence, and the packets they lost
+static void countGaps(const std::vector<uint32_t> &sequences, int &gaps, uint32_t &lost)
+{
+    gaps = 0;
+    lost = 0;
+    for (size_t i = 1; i < sequences.size(); i++)
+    {
+        TEST_ASSERT_TRUE(sequences[i] > sequences[i - 1]);
+        if (sequences[i] != sequences[i - 1] + 1)
+        {
+            gaps++;
+            lost += sequences[i] - sequences[i - 1] - 1;
+        }
+    }
+}
+
+/// @brief Stall the reader and write until the sender queues and drops
+static uint32_t congest(uint32_t perWrite, uint32_t writes)
+{
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < writes; i++)
+    {
+        writePackets(next, perWrite);
+        next += perWrite;
+    }
+    return next;
+}
+
+/// @brief A loopback TCP connection with small buffers, so the writer
+///        fills up and the stack cuts sends at any byte
+void setUp(void)
+{
+    int size = SOCKET_BUFFER;
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    TEST_ASSERT_EQUAL_INT(0, bind(listener, (struct sockaddr *)&address, sizeof(address)));
+    TEST_ASSERT_EQUAL_INT(0, listen(listener, 1));
+    getsockname(listener, (struct sockaddr *)&address, &length);
+
+    reader = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(reader, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    TEST_ASSERT_EQUAL_INT(0, connect(reader, (struct sockaddr *)&address, sizeof(address)));
+    writer = accept(listener, NULL, NULL);
+    setsockopt(writer, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    close(listener);
+    sender = new TcpSender();
+}
+
+void tearDown(void)
+{
+    delete sender;
+    close(writer);
+    if (reader >= 0)
+        close(reader);
+}
+
+void test_sends_everything(void)
+{
+    sender->begin(writer, TcpSender::POLICY_DROP_OLDEST, 0);
+    TEST_ASSERT_EQUAL_UINT32(10, writePackets(0, 10));
+    TEST_ASSERT_EQUAL_UINT32(0, sender->getQueued());
+    std::vector<uint32_t> sequences;
+    drain(sequences);
+    TEST_ASSERT_EQUAL_UINT32(10, sequences.size());
+    TEST_ASSERT_EQUAL_UINT32(9, sequences.back());
+    TEST_ASSERT_EQUAL_UINT32(10 * PACKET_SIZE, sender->getSent());
+}
+
+/// @brief A socket that takes part of a packet: the rest goes out first
+///        later, nothing is torn, and every packet is either received or
+///        counted as dropped
+void test_partial_writes_resume(void)
+{
+    sender->begin(writer, TcpSender::POLICY_DROP_OLDEST, 0);
+    bool cut = false;
+    uint32_t next = 0;
+    while (sender->getQueued() < TCP_SENDER_QUEUE / 2)
+    {
+        writePackets(next, 100);
+        next += 100;
+        cut |= sender->getSent() % PACKET_SIZE != 0;
+    }
+    TEST_ASSERT_TRUE(cut);
+    std::vector<uint32_t> sequences;
+    drain(sequences);
+    TEST_ASSERT_EQUAL_UINT32(next, sequences.size() + sender->getDropped());
+    TEST_ASSERT_EQUAL_UINT32(next - 1, sequences.back());
+}
+
+/// @brief A stalled reader loses the oldest queued packets, in one gap
+void test_drop_oldest(void)
+{
+    sender->begin(writer, TcpSender::POLICY_DROP_OLDEST, 0);
+    const uint32_t written = congest(10, 100);
+    TEST_ASSERT_TRUE(sender->getDropped() > 0);
+    std::vector<uint32_t> sequences;
+    drain(sequences);
+    int gaps;
+    uint32_t lost;
+    countGaps(sequences, gaps, lost);
+    TEST_ASSERT_EQUAL_INT(1, gaps);
+    TEST_ASSERT_EQUAL_UINT32(sender->getDropped(), lost);
+    TEST_ASSERT_EQUAL_UINT32(written - 1, sequences.back());
+    TEST_ASSERT_EQUAL_UINT32(sender->getDropped() * PACKET_SIZE, sender->getDroppedBytes());
+}
+
+/// @brief Each overflow throws the backlog away, the newest still arrives
+void test_latest(void)
+{
+    sender->begin(writer, TcpSender::POLICY_LATEST, 0);
+    const uint32_t written = congest(10, 100);
+    std::vector<uint32_t> sequences;
+    drain(sequences);
+    int gaps;
+    uint32_t lost;
+    countGaps(sequences, gaps, lost);
+    TEST_ASSERT_EQUAL_UINT32(sender->getDropped(), lost);
+    TEST_ASSERT_EQUAL_UINT32(written - 1, sequences.back());
+    TEST_ASSERT_TRUE(sender->getQueued() == 0);
+}
+
+/// @brief Above half full only every other packet is queued
+void test_decimate(void)
+{
+    sender->begin(writer, TcpSender::POLICY_DECIMATE, 0);
+    const uint32_t written = congest(10, 100);
+    std::vector<uint32_t> sequences;
+    drain(sequences);
+    int gaps;
+    uint32_t lost;
+    countGaps(sequences, gaps, lost);
+    TEST_ASSERT_EQUAL_UINT32(written, sequences.size() + lost + (written - 1 - sequences.back()));
+    TEST_ASSERT_EQUAL_UINT32(sender->getDropped(), lost + (written - 1 - sequences.back()));
+    int alternate = 0;
+    for (size_t i = 1; i < sequences.size(); i++)
+        alternate += sequences[i] == sequences[i - 1] + 2 ? 1 : 0;
+    TEST_ASSERT_TRUE(alternate > 10);
+}
+
+/// @brief Once full nothing is taken until the queue drained, then it
+///        resumes: one gap, from the overflow to the first write after it
+void test_pause(void)
+{
+    sender->begin(writer, TcpSender::POLICY_PAUSE, 0);
+    uint32_t written = congest(10, 100);
+    TEST_ASSERT_TRUE(sender->isPaused());
+    TEST_ASSERT_EQUAL_UINT32(0, writePackets(written, 10));
+    written += 10;
+    std::vector<uint32_t> before;
+    drain(before);
+    TEST_ASSERT_FALSE(sender->isPaused());
+    TEST_ASSERT_EQUAL_UINT32(10, writePackets(written, 10));
+    written += 10;
+    std::vector<uint32_t> after;
+    drain(after);
+    before.insert(before.end(), after.begin(), after.end());
+    int gaps;
+    uint32_t lost;
+    countGaps(before, gaps, lost);
+    TEST_ASSERT_EQUAL_INT(1, gaps);
+    TEST_ASSERT_EQUAL_UINT32(sender->getDropped(), lost);
+    TEST_ASSERT_EQUAL_UINT32(written - 1, before.back());
+}
+
+/// @brief Writing to a stalled socket costs no more than copying
+void test_never_blocks(void)
+{
+    sender->begin(writer, TcpSender::POLICY_DROP_OLDEST, 0);
+    auto start = std::chrono::steady_clock::now();
+    congest(42, 2000);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    TEST_ASSERT_TRUE(ms < 200);
+}
+
+/// @brief A peer that went away shows up within a few writes, and from
+///        then on flush() fails and write() takes nothing
+void test_peer_closed(void)
+{
+    signal(SIGPIPE, SIG_IGN);
+    sender->begin(writer, TcpSender::POLICY_DROP_OLDEST, 0);
+    close(reader);
+    reader = -1;
+    for (int i = 0; i < 100 && sender->isOpen(); i++)
+    {
+        writePackets(0, 10);
+        usleep(1000);
+    }
+    TEST_ASSERT_FALSE(sender->isOpen());
+    TEST_ASSERT_FALSE(sender->flush());
+    TEST_ASSERT_EQUAL_UINT32(0, writePackets(0, 1));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_sends_everything);
+    RUN_TEST(test_partial_writes_resume);
+    RUN_TEST(test_drop_oldest);
+    RUN_TEST(test_latest);
+    RUN_TEST(test_decimate);
+    RUN_TEST(test_pause);
+    RUN_TEST(test_never_blocks);
+    RUN_TEST(test_peer_closed);
+    return UNITY_END();
+}
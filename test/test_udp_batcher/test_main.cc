@@ -0,0 +1,217 @@
+#include <unity.h>
+#include <string.h>
+#include <set>
+#include <vector>
+#include "UdpBatcher.h"
+
+/// @brief Records every datagram, optionally dropping some of them
+class CaptureSink : public DatagramSink
+{
+public:
+    std::vector<std::vector<uint8_t>> sent;
+    std::set<size_t> lose; // indices in send order that never arrive
+
+    bool sendDatagram(const uint8_t *data, size_t length)
+    {
+        sent.push_back(std::vector<uint8_t>(data, data + length));
+        return true;
+    }
+
+    std::vector<std::vector<uint8_t>> received(void)
+    {
+        std::vector<std::vector<uint8_t>> out;
+        for (size_t i = 0; i < sent.size(); i++)
+        {
+            if (lose.count(i) == 0)
+                out.push_back(sent[i]);
+        }
+        return out;
+    }
+};
+
+static void makePacket(uint8_t *packet, uint8_t sampleNumber)
+{
+    memset(packet, sampleNumber, UDP_BATCH_PACKET_SIZE);
+    packet[0] = 0xA0;
+    packet[1] = sampleNumber;
+    packet[UDP_BATCH_PACKET_SIZE - 1] = 0xC0;
+}
+
+static uint32_t sequenceOf(const std::vector<uint8_t> &d)
+{
+    return ((uint32_t)d[2] << 24) | ((uint32_t)d[3] << 16) | ((uint32_t)d[4] << 8) | d[5];
+}
+
+/// @brief Feed `count` packets numbered from 0
+static void feed(UdpBatcher &batcher, CaptureSink &sink, int count)
+{
+    uint8_t packet[UDP_BATCH_PACKET_SIZE];
+    for (int i = 0; i < count; i++)
+    {
+        makePacket(packet, (uint8_t)i);
+        batcher.addPacket(packet, sink);
+    }
+}
+
+/// @brief Receiver side: unique sample numbers recovered from the datagrams that arrived
+static std::set<int> samplesReceived(const std::vector<std::vector<uint8_t>> &datagrams, bool header)
+{
+    std::set<int> samples;
+    size_t offset = header ? UDP_BATCH_HEADER_SIZE : 0;
+    for (size_t i = 0; i < datagrams.size(); i++)
+    {
+        for (size_t p = offset; p + UDP_BATCH_PACKET_SIZE <= datagrams[i].size(); p += UDP_BATCH_PACKET_SIZE)
+        {
+            samples.insert(datagrams[i][p + 1]);
+        }
+    }
+    return samples;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_packs_to_mtu(void)
+{
+    UdpBatcher batcher;
+    CaptureSink sink;
+    batcher.configure(1440, true, 0, 1);
+    TEST_ASSERT_EQUAL(43, batcher.getPacketsPerDatagram()); // (1440 - 8) / 33
+
+    feed(batcher, sink, 43 * 2 + 5);
+    TEST_ASSERT_EQUAL(2, (int)sink.sent.size());
+    TEST_ASSERT_EQUAL(5, batcher.getPending());
+    TEST_ASSERT_EQUAL(UDP_BATCH_HEADER_SIZE + 43 * UDP_BATCH_PACKET_SIZE, (int)sink.sent[0].size());
+    TEST_ASSERT_TRUE(sink.sent[0].size() <= 1440);
+}
+
+void test_header_layout(void)
+{
+    UdpBatcher batcher;
+    CaptureSink sink;
+    batcher.configure(UDP_BATCH_HEADER_SIZE + 4 * UDP_BATCH_PACKET_SIZE, true, 0, 1);
+    feed(batcher, sink, 4 * 300);
+
+    TEST_ASSERT_EQUAL(300, (int)sink.sent.size());
+    for (uint32_t i = 0; i < sink.sent.size(); i++)
+    {
+        const std::vector<uint8_t> &d = sink.sent[i];
+        TEST_ASSERT_EQUAL_HEX8(UDP_BATCH_TYPE_DATA, d[0]);
+        TEST_ASSERT_EQUAL(4, d[1]);
+        TEST_ASSERT_EQUAL_UINT32(i, sequenceOf(d));
+        TEST_ASSERT_EQUAL_HEX8(0xA0, d[UDP_BATCH_HEADER_SIZE]);
+    }
+}
+
+void test_no_header_is_bare_packets(void)
+{
+    UdpBatcher batcher;
+    CaptureSink sink;
+    batcher.configure(1440, false, 0, 1);
+    TEST_ASSERT_EQUAL(43, batcher.getPacketsPerDatagram()); // 1440 / 33
+    feed(batcher, sink, 43);
+
+    TEST_ASSERT_EQUAL(1, (int)sink.sent.size());
+    TEST_ASSERT_EQUAL(43 * UDP_BATCH_PACKET_SIZE, (int)sink.sent[0].size());
+    TEST_ASSERT_EQUAL_HEX8(0xA0, sink.sent[0][0]);
+    TEST_ASSERT_EQUAL_HEX8(0xA0, sink.sent[0][UDP_BATCH_PACKET_SIZE]);
+}
+
+void test_flush_sends_partial(void)
+{
+    UdpBatcher batcher;
+    CaptureSink sink;
+    TEST_ASSERT_FALSE(batcher.flush(sink));
+    feed(batcher, sink, 3);
+    TEST_ASSERT_TRUE(batcher.flush(sink));
+
+    TEST_ASSERT_EQUAL(1, (int)sink.sent.size());
+    TEST_ASSERT_EQUAL(3, sink.sent[0][1]);
+    TEST_ASSERT_EQUAL(UDP_BATCH_HEADER_SIZE + 3 * UDP_BATCH_PACKET_SIZE, (int)sink.sent[0].size());
+    TEST_ASSERT_EQUAL(0, batcher.getPending());
+}
+
+void test_copies_are_spread(void)
+{
+    UdpBatcher batcher;
+    CaptureSink sink;
+    batcher.configure(UDP_BATCH_HEADER_SIZE + UDP_BATCH_PACKET_SIZE, true, 2, 2);
+    feed(batcher, sink, 10);
+
+    // Send order: 0 | 1 | 2 0 | 3 1 | 4 2 0 | 5 3 1 | ...
+    const uint32_t expected[] = {0, 1, 2, 0, 3, 1, 4, 2, 0, 5, 3, 1};
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(expected[i], sequenceOf(sink.sent[i]));
+    }
+    // Never two copies of the same datagram back to back
+    for (size_t i = 1; i < sink.sent.size(); i++)
+    {
+        TEST_ASSERT_TRUE(sequenceOf(sink.sent[i]) != sequenceOf(sink.sent[i - 1]));
+    }
+}
+
+void test_spread_copies_survive_a_burst(void)
+{
+    // Lose three datagrams in a row in the middle of the stream: with back to
+    // back triplicates that loses a datagram outright, spread copies do not
+    UdpBatcher batcher;
+    CaptureSink sink;
+    batcher.configure(UDP_BATCH_HEADER_SIZE + 2 * UDP_BATCH_PACKET_SIZE, true, 2, 2);
+    feed(batcher, sink, 2 * 40);
+    batcher.flush(sink);
+    for (size_t i = 40; i < 43; i++)
+        sink.lose.insert(i);
+
+    std::set<int> samples = samplesReceived(sink.received(), true);
+    for (int n = 0; n < 2 * 40 - 2 * 4; n++) // the last datagrams have no copies yet
+    {
+        TEST_ASSERT_TRUE_MESSAGE(samples.count(n) == 1, "sample lost");
+    }
+}
+
+void test_configure_clamps(void)
+{
+    UdpBatcher batcher;
+    batcher.configure(60000, true, 5, 4);
+    TEST_ASSERT_EQUAL(UDP_BATCH_MAX_DATAGRAM, batcher.getDatagramSize());
+    TEST_ASSERT_TRUE(batcher.getCopies() * batcher.getSpacing() < UDP_BATCH_HISTORY);
+
+    batcher.configure(10, true, 0, 0);
+    TEST_ASSERT_EQUAL(1, batcher.getPacketsPerDatagram());
+    TEST_ASSERT_EQUAL(1, batcher.getSpacing());
+}
+
+/// @brief Settings that clamp to the current layout count as configured, a
+///        second subscriber asking for them changes nothing for the first
+void test_is_configured_after_clamping(void)
+{
+    UdpBatcher batcher;
+    batcher.configure(60000, false, 5, 4);
+    TEST_ASSERT_TRUE(batcher.isConfigured(60000, false, 5, 4));
+    TEST_ASSERT_TRUE(batcher.isConfigured(UDP_BATCH_MAX_DATAGRAM, false, batcher.getCopies(), batcher.getSpacing()));
+    TEST_ASSERT_FALSE(batcher.isConfigured(60000, true, 5, 4));
+    TEST_ASSERT_FALSE(batcher.isConfigured(512, false, 5, 4));
+    TEST_ASSERT_FALSE(batcher.isConfigured(60000, false, 0, 4));
+
+    // FEC forces the header on and the copies off
+    batcher.configure(UDP_BATCH_MAX_DATAGRAM, false, 2, 2, 4, 1);
+    TEST_ASSERT_TRUE(batcher.isConfigured(UDP_BATCH_MAX_DATAGRAM, true, 0, 2, 4, 1));
+    TEST_ASSERT_FALSE(batcher.isConfigured(UDP_BATCH_MAX_DATAGRAM, true, 0, 2, 4, 2));
+    TEST_ASSERT_FALSE(batcher.isConfigured(UDP_BATCH_MAX_DATAGRAM, true, 0, 2));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_packs_to_mtu);
+    RUN_TEST(test_header_layout);
+    RUN_TEST(test_no_header_is_bare_packets);
+    RUN_TEST(test_flush_sends_partial);
+    RUN_TEST(test_copies_are_spread);
+    RUN_TEST(test_spread_copies_survive_a_burst);
+    RUN_TEST(test_configure_clamps);
+    RUN_TEST(test_is_configured_after_clamping);
+    return UNITY_END();
+}
@@ -0,0 +1,237 @@
+#include <unity.h>
+#include <string.h>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+#include "UdpBatcher.h"
+#include "UdpFec.h"
+
+typedef std::vector<uint8_t> Datagram;
+
+/// @brief Records datagrams in send order
+class CaptureSink : public DatagramSink
+{
+public:
+    std::vector<Datagram> sent;
+
+    bool sendDatagram(const uint8_t *data, size_t length)
+    {
+        sent.push_back(Datagram(data, data + length));
+        return true;
+    }
+};
+
+/// @brief Decoder output: data datagrams by sequence number
+class ReceiveSink : public DatagramSink
+{
+public:
+    std::map<uint32_t, Datagram> bySequence;
+    int calls;
+
+    ReceiveSink() : calls(0) {}
+
+    bool sendDatagram(const uint8_t *data, size_t length)
+    {
+        calls++;
+        bySequence[udpDatagramSequence(data)] = Datagram(data, data + length);
+        return true;
+    }
+};
+
+/// @brief Encode `packets` numbered wire packets, flushing a partial datagram every `flushEvery`
+static std::vector<Datagram> encode(uint8_t fecData, uint8_t fecParity, int packets, uint16_t mtu, int flushEvery)
+{
+    UdpBatcher *batcher = new UdpBatcher();
+    CaptureSink sink;
+    batcher->configure(mtu, true, 0, 1, fecData, fecParity);
+    uint8_t packet[UDP_BATCH_PACKET_SIZE];
+    for (int i = 0; i < packets; i++)
+    {
+        memset(packet, (uint8_t)(i * 7), sizeof(packet));
+        packet[0] = 0xA0;
+        packet[1] = (uint8_t)i;
+        packet[2] = (uint8_t)(i >> 8);
+        packet[UDP_BATCH_PACKET_SIZE - 1] = 0xC0;
+        batcher->addPacket(packet, sink);
+        if (flushEvery > 0 && i % flushEvery == flushEvery - 1)
+            batcher->flush(sink);
+    }
+    delete batcher;
+    return sink.sent;
+}
+
+static std::vector<Datagram> dataOnly(const std::vector<Datagram> &sent)
+{
+    std::vector<Datagram> out;
+    for (size_t i = 0; i < sent.size(); i++)
+    {
+        if (sent[i][0] == UDP_BATCH_TYPE_DATA)
+            out.push_back(sent[i]);
+    }
+    return out;
+}
+
+/// @brief Run the decoder over `sent`, skipping the indices in `lost`
+static void decode(const std::vector<Datagram> &sent, const std::set<size_t> &lost, ReceiveSink &out, UdpFecDecoder &decoder)
+{
+    for (size_t i = 0; i < sent.size(); i++)
+    {
+        if (lost.count(i) == 0)
+            decoder.receive(&sent[i][0], sent[i].size(), out);
+    }
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_block_layout(void)
+{
+    std::vector<Datagram> sent = encode(4, 2, 43 * 8, 1440, 0);
+    // Two blocks of four data datagrams, each followed by two parity datagrams
+    TEST_ASSERT_EQUAL(12, (int)sent.size());
+    const uint8_t types[] = {0xB0, 0xB0, 0xB0, 0xB0, 0xB1, 0xB1};
+    for (size_t i = 0; i < sent.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_HEX8(types[i % 6], sent[i][0]);
+        TEST_ASSERT_EQUAL(4, sent[i][6]);
+        TEST_ASSERT_EQUAL(2, sent[i][7]);
+        TEST_ASSERT_TRUE(sent[i].size() <= 1440);
+    }
+    TEST_ASSERT_EQUAL(0, sent[4][1]);
+    TEST_ASSERT_EQUAL(1, sent[5][1]);
+    TEST_ASSERT_EQUAL_UINT32(4, udpDatagramSequence(&sent[10][0])); // block start
+}
+
+void test_every_single_loss_is_recovered(void)
+{
+    std::vector<Datagram> sent = encode(8, 2, 43 * 8, 1440, 0);
+    std::vector<Datagram> data = dataOnly(sent);
+    for (size_t lose = 0; lose < sent.size(); lose++)
+    {
+        UdpFecDecoder decoder;
+        ReceiveSink out;
+        std::set<size_t> lost;
+        lost.insert(lose);
+        decode(sent, lost, out, decoder);
+
+        TEST_ASSERT_EQUAL(8, (int)out.bySequence.size());
+        for (uint32_t s = 0; s < data.size(); s++)
+        {
+            TEST_ASSERT_TRUE(out.bySequence[s] == data[s]);
+        }
+    }
+}
+
+void test_burst_up_to_parity_count_is_recovered(void)
+{
+    std::vector<Datagram> sent = encode(8, 3, 43 * 16, 1440, 0);
+    std::vector<Datagram> data = dataOnly(sent);
+    // Any three consecutive data datagrams, or all three parity datagrams
+    const size_t starts[] = {0, 1, 2, 3, 4, 5, 8, 11, 16};
+    for (size_t k = 0; k < sizeof(starts) / sizeof(starts[0]); k++)
+    {
+        size_t start = starts[k];
+        UdpFecDecoder decoder;
+        ReceiveSink out;
+        std::set<size_t> lost;
+        for (size_t i = start; i < start + 3; i++)
+            lost.insert(i);
+        decode(sent, lost, out, decoder);
+
+        TEST_ASSERT_EQUAL(16, (int)out.bySequence.size());
+        for (uint32_t s = 0; s < data.size(); s++)
+        {
+            TEST_ASSERT_TRUE(out.bySequence[s] == data[s]);
+        }
+    }
+}
+
+void test_partial_datagrams_are_recovered_to_their_length(void)
+{
+    // Latency flushes leave short datagrams in the block
+    std::vector<Datagram> sent = encode(4, 1, 40, 1440, 10);
+    std::vector<Datagram> data = dataOnly(sent);
+    TEST_ASSERT_EQUAL(4, (int)data.size());
+    TEST_ASSERT_EQUAL(UDP_BATCH_HEADER_SIZE + 10 * UDP_BATCH_PACKET_SIZE, (int)data[2].size());
+
+    UdpFecDecoder decoder;
+    ReceiveSink out;
+    std::set<size_t> lost;
+    lost.insert(2);
+    decode(sent, lost, out, decoder);
+
+    TEST_ASSERT_EQUAL_UINT32(1, decoder.getRecovered());
+    TEST_ASSERT_TRUE(out.bySequence[2] == data[2]);
+}
+
+void test_duplicates_are_delivered_once(void)
+{
+    std::vector<Datagram> sent = encode(4, 1, 43 * 4, 1440, 0);
+    std::vector<Datagram> twice(sent);
+    twice.insert(twice.end(), sent.begin(), sent.end());
+
+    UdpFecDecoder decoder;
+    ReceiveSink out;
+    decode(twice, std::set<size_t>(), out, decoder);
+
+    TEST_ASSERT_EQUAL(4, out.calls);
+    TEST_ASSERT_EQUAL_UINT32(5, decoder.getDuplicates());
+}
+
+void test_lossy_channel(void)
+{
+    // 5% independent loss. 8+2 parity costs 25% extra airtime against 200% for
+    // triplicates and should deliver better than 98% of the data datagrams
+    const int blocks = 500;
+    std::vector<Datagram> sent = encode(8, 2, 43 * 8 * blocks, 1440, 0);
+    std::minstd_rand rng(42);
+    std::set<size_t> lost;
+    size_t lostData = 0;
+    for (size_t i = 0; i < sent.size(); i++)
+    {
+        if (rng() % 100 < 5)
+        {
+            lost.insert(i);
+            if (sent[i][0] == UDP_BATCH_TYPE_DATA)
+                lostData++;
+        }
+    }
+
+    UdpFecDecoder decoder;
+    ReceiveSink out;
+    decode(sent, lost, out, decoder);
+
+    const size_t total = 8 * blocks;
+    const double withoutFec = (double)(total - lostData) / total;
+    const double withFec = (double)out.bySequence.size() / total;
+    TEST_ASSERT_TRUE(withoutFec < 0.97);
+    TEST_ASSERT_TRUE(withFec > 0.98);
+    TEST_ASSERT_EQUAL_UINT32(out.bySequence.size() - (total - lostData), decoder.getRecovered());
+}
+
+void test_without_fec_decoder_passes_through(void)
+{
+    std::vector<Datagram> sent = encode(0, 0, 43 * 3, 1440, 0);
+    TEST_ASSERT_EQUAL(3, (int)sent.size());
+    TEST_ASSERT_EQUAL(0, sent[0][6]);
+
+    UdpFecDecoder decoder;
+    ReceiveSink out;
+    decode(sent, std::set<size_t>(), out, decoder);
+    TEST_ASSERT_EQUAL(3, out.calls);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_block_layout);
+    RUN_TEST(test_every_single_loss_is_recovered);
+    RUN_TEST(test_burst_up_to_parity_count_is_recovered);
+    RUN_TEST(test_partial_datagrams_are_recovered_to_their_length);
+    RUN_TEST(test_duplicates_are_delivered_once);
+    RUN_TEST(test_lossy_channel);
+    RUN_TEST(test_without_fec_decoder_passes_through);
+    return UNITY_END();
+}
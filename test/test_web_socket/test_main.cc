@@ -0,0 +1,346 @@
+#include <unity.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "WebSocketServer.h"
+
+#define PACKET_SIZE 33
+#define PACKETS_PER_FRAME 10 // what one loop() pass sends at 16 kSPS with the default latency
+#define FRAME_PAYLOAD (PACKET_SIZE * PACKETS_PER_FRAME)
+
+static WebSocketServer *server;
+
+void setUp(void)
+{
+    server = new WebSocketServer();
+    TEST_ASSERT_TRUE(server->begin(0));
+}
+
+void tearDown(void)
+{
+    delete server;
+}
+
+static int64_t nowNanos(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// @brief Blocking browser stand-in
+class TestClient
+{
+public:
+    int fd;
+
+    explicit TestClient(int receiveBuffer = 0) : fd(socket(AF_INET, SOCK_STREAM, 0))
+    {
+        if (receiveBuffer > 0)
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+    }
+    ~TestClient() { ::close(fd); }
+
+    /// @brief Connect, send `text` and poll the server until a reply header is in
+    std::string request(const std::string &text)
+    {
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(server->getPort());
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+            return "";
+        send(fd, text.data(), text.size(), 0);
+        std::string reply;
+        for (int i = 0; i < 1000 && reply.find("\r\n\r\n") == std::string::npos; i++)
+        {
+            server->poll();
+            char buffer[512];
+            ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n == 0)
+                break;
+            if (n > 0)
+                reply.append(buffer, n);
+            else
+                usleep(1000);
+        }
+        return reply;
+    }
+
+    bool open(void)
+    {
+        std::string reply = request("GET /stream HTTP/1.1\r\nHost: test\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                                    "sec-websocket-key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+        return reply.find("101 Switching Protocols") != std::string::npos &&
+               reply.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") != std::string::npos;
+    }
+
+    void sendMasked(uint8_t opcode, const uint8_t *data, size_t length)
+    {
+        uint8_t frame[256] = {(uint8_t)(0x80 | opcode), (uint8_t)(0x80 | length), 0x12, 0x34, 0x56, 0x78};
+        for (size_t i = 0; i < length; i++)
+            frame[6 + i] = data[i] ^ frame[2 + (i & 3)];
+        send(fd, frame, 6 + length, 0);
+    }
+
+    bool readExactly(uint8_t *out, size_t length, int timeoutMs)
+    {
+        for (size_t got = 0; got < length;)
+        {
+            struct pollfd p = {fd, POLLIN, 0};
+            if (::poll(&p, 1, timeoutMs) <= 0)
+                return false;
+            ssize_t n = recv(fd, out + got, length - got, 0);
+            if (n <= 0)
+                return false;
+            got += n;
+        }
+        return true;
+    }
+
+    /// @brief Next server frame; `false` on timeout, close or a malformed header
+    bool readFrame(uint8_t &opcode, std::vector<uint8_t> &payload, int timeoutMs = 1000)
+    {
+        uint8_t header[10];
+        if (!readExactly(header, 2, timeoutMs) || (header[0] & 0xF0) != 0x80 || (header[1] & 0x80))
+            return false;
+        opcode = header[0] & 0x0F;
+        size_t length = header[1];
+        if (length == 126)
+        {
+            if (!readExactly(header + 2, 2, timeoutMs))
+                return false;
+            length = (header[2] << 8) | header[3];
+        }
+        else if (length == 127)
+            return false;
+        payload.resize(length);
+        return length == 0 || readExactly(payload.data(), length, timeoutMs);
+    }
+};
+
+/// @brief A frame of packets that carries its sequence number
+static void makeFrame(uint8_t *frame, uint32_t sequence)
+{
+    for (int p = 0; p < PACKETS_PER_FRAME; p++)
+    {
+        uint8_t *packet = frame + p * PACKET_SIZE;
+        memset(packet, (uint8_t)sequence, PACKET_SIZE);
+        packet[0] = 0xA0;
+        packet[PACKET_SIZE - 1] = 0xC0;
+    }
+    memcpy(frame + 2, &sequence, sizeof(sequence));
+}
+
+/// @brief Reads frames on its own thread and checks each one
+struct Reader
+{
+    TestClient &client;
+    std::atomic<bool> stop;
+    std::atomic<uint32_t> frames;
+    uint32_t gaps, malformed;
+    int64_t last;
+    std::thread thread;
+
+    explicit Reader(TestClient &c) : client(c), stop(false), frames(0), gaps(0), malformed(0), last(-1)
+    {
+        thread = std::thread(&Reader::run, this);
+    }
+
+    void run(void)
+    {
+        uint8_t opcode;
+        std::vector<uint8_t> payload;
+        while (client.readFrame(opcode, payload, stop ? 50 : 1000))
+        {
+            uint32_t sequence;
+            if (opcode != WEB_SOCKET_OPCODE_BINARY || payload.size() != FRAME_PAYLOAD || payload[0] != 0xA0 ||
+                payload[FRAME_PAYLOAD - 1] != 0xC0)
+            {
+                malformed++;
+                continue;
+            }
+            memcpy(&sequence, &payload[2], sizeof(sequence));
+            if ((int64_t)sequence <= last)
+                malformed++;
+            else if ((int64_t)sequence != last + 1)
+                gaps++;
+            last = sequence;
+            frames++;
+        }
+    }
+
+    void join(void)
+    {
+        stop = true;
+        thread.join();
+    }
+};
+
+void test_accept_key_and_headers(void)
+{
+    char accept[WEB_SOCKET_ACCEPT_LENGTH + 1];
+    const char *key = "dGhlIHNhbXBsZSBub25jZQ=="; // RFC 6455 section 1.3
+    WebSocketServer::acceptKey(key, strlen(key), accept);
+    TEST_ASSERT_EQUAL_STRING("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=", accept);
+
+    uint8_t header[WEB_SOCKET_HEADER_MAX];
+    TEST_ASSERT_EQUAL(2, WebSocketServer::frameHeader(WEB_SOCKET_OPCODE_BINARY, 125, header));
+    TEST_ASSERT_EQUAL_HEX8(0x82, header[0]);
+    TEST_ASSERT_EQUAL_HEX8(125, header[1]);
+    TEST_ASSERT_EQUAL(4, WebSocketServer::frameHeader(WEB_SOCKET_OPCODE_TEXT, 330, header));
+    TEST_ASSERT_EQUAL_HEX8(0x81, header[0]);
+    TEST_ASSERT_EQUAL_HEX8(126, header[1]);
+    TEST_ASSERT_EQUAL_UINT16(330, (header[2] << 8) | header[3]);
+    TEST_ASSERT_EQUAL(10, WebSocketServer::frameHeader(WEB_SOCKET_OPCODE_BINARY, 70000, header));
+    TEST_ASSERT_EQUAL_HEX8(127, header[1]);
+    TEST_ASSERT_EQUAL_HEX8(0x01, header[7]);
+    TEST_ASSERT_EQUAL_HEX8(0x11, header[8]);
+    TEST_ASSERT_EQUAL_HEX8(0x70, header[9]);
+}
+
+/// @brief Upgrade, ping/pong, close; a plain HTTP request gets a 400
+void test_handshake_ping_close(void)
+{
+    TestClient client;
+    TEST_ASSERT_TRUE(client.open());
+    TEST_ASSERT_EQUAL(1, server->getClients());
+
+    const uint8_t hello[5] = {'h', 'e', 'l', 'l', 'o'};
+    client.sendMasked(WEB_SOCKET_OPCODE_PING, hello, sizeof(hello));
+    uint8_t opcode = 0;
+    std::vector<uint8_t> payload;
+    for (int i = 0; i < 100; i++)
+    {
+        server->poll();
+        usleep(1000);
+    }
+    TEST_ASSERT_TRUE(client.readFrame(opcode, payload));
+    TEST_ASSERT_EQUAL_HEX8(WEB_SOCKET_OPCODE_PONG, opcode);
+    TEST_ASSERT_EQUAL(5, payload.size());
+    TEST_ASSERT_EQUAL_MEMORY(hello, payload.data(), 5);
+
+    const uint8_t normal[2] = {0x03, 0xE8}; // 1000
+    client.sendMasked(WEB_SOCKET_OPCODE_CLOSE, normal, 2);
+    for (int i = 0; i < 100; i++)
+    {
+        server->poll();
+        usleep(1000);
+    }
+    TEST_ASSERT_EQUAL(0, server->getClients());
+    TEST_ASSERT_TRUE(client.readFrame(opcode, payload));
+    TEST_ASSERT_EQUAL_HEX8(WEB_SOCKET_OPCODE_CLOSE, opcode);
+
+    TestClient plain;
+    std::string reply = plain.request("GET / HTTP/1.1\r\nHost: test\r\n\r\n");
+    TEST_ASSERT_TRUE(reply.find("400 Bad Request") != std::string::npos);
+    TEST_ASSERT_EQUAL(0, server->getClients());
+}
+
+/// @brief A client that keeps up gets every frame, whole and in order; one
+///        that does not loses whole frames, each one counted as dropped
+void test_frames_arrive_or_count_as_dropped(void)
+{
+    TestClient client;
+    TEST_ASSERT_TRUE(client.open());
+    uint8_t frame[FRAME_PAYLOAD];
+    uint32_t sequence = 0;
+
+    {
+        Reader reader(client);
+        for (int i = 0; i < 800; i++)
+        {
+            makeFrame(frame, sequence++);
+            server->broadcast(frame, sizeof(frame), WEB_SOCKET_OPCODE_BINARY);
+            // the reader takes each frame before the next, as at the stream rate
+            for (int wait = 0; wait < 100000 && reader.frames < sequence; wait++)
+                server->poll();
+        }
+        reader.join();
+        TEST_ASSERT_EQUAL(0, reader.malformed);
+        TEST_ASSERT_EQUAL(800, reader.frames);
+        TEST_ASSERT_EQUAL(0, reader.gaps);
+        TEST_ASSERT_EQUAL(0, server->getFramesDropped());
+    }
+
+    {
+        Reader reader(client);
+        const uint32_t first = sequence;
+        for (int i = 0; i < 5000; i++)
+        {
+            makeFrame(frame, sequence++);
+            server->broadcast(frame, sizeof(frame), WEB_SOCKET_OPCODE_BINARY);
+            server->poll();
+        }
+        // whatever is still queued drains to the reader
+        for (int wait = 0; wait < 1000000 && reader.frames + server->getFramesDropped() < sequence - first; wait++)
+            server->poll();
+        reader.join();
+        TEST_ASSERT_EQUAL(0, reader.malformed);
+        TEST_ASSERT_EQUAL(sequence - first, reader.frames + server->getFramesDropped());
+    }
+}
+
+/// @brief A client that stops reading loses frames, whole ones, while the
+///        other client gets every frame and broadcast() never waits
+void test_stalled_client_does_not_stall_others(void)
+{
+    TestClient fast, stalled(4096);
+    TEST_ASSERT_TRUE(fast.open());
+    TEST_ASSERT_TRUE(stalled.open());
+    TEST_ASSERT_EQUAL(2, server->getClients());
+
+    Reader reader(fast);
+    uint8_t frame[FRAME_PAYLOAD];
+    const int frames = 20000; // 6.6 MB, far more than the stalled socket and its queue hold
+    int64_t worst = 0;
+    for (int i = 0; i < frames; i++)
+    {
+        makeFrame(frame, i);
+        int64_t start = nowNanos();
+        server->broadcast(frame, sizeof(frame), WEB_SOCKET_OPCODE_BINARY);
+        worst = std::max(worst, nowNanos() - start);
+        server->poll();
+        usleep(20);
+    }
+    for (int i = 0; i < 100; i++)
+        server->poll();
+    reader.join();
+    TEST_ASSERT_EQUAL(frames, reader.frames);
+    TEST_ASSERT_EQUAL(0, reader.gaps);
+    TEST_ASSERT_TRUE(server->getFramesDropped() > 0);
+    TEST_ASSERT_TRUE(worst < 50000000); // a blocking send would never come back
+
+    // what the stalled client does get is still a clean, ordered stream, and
+    // every frame either arrives or is counted as dropped
+    Reader late(stalled);
+    for (int i = 0; i < 1000; i++)
+    {
+        server->poll();
+        usleep(100);
+    }
+    late.join();
+    TEST_ASSERT_EQUAL(0, late.malformed);
+    TEST_ASSERT_TRUE(late.frames > 0);
+    TEST_ASSERT_EQUAL(frames, late.frames + server->getFramesDropped());
+    TEST_ASSERT_EQUAL(2, server->getClients());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_accept_key_and_headers);
+    RUN_TEST(test_handshake_ping_close);
+    RUN_TEST(test_frames_arrive_or_count_as_dropped);
+    RUN_TEST(test_stalled_client_does_not_stall_others);
+    return UNITY_END();
+}